@@ -303,6 +303,18 @@ HEADERS += src/qt/bitcoingui.h \
     src/tesseractx.h \
     src/activeinode.h \
     src/hub.h \
+    src/rpcreader.h \
+    src/rpcstream.h \
+    src/chainquery.h \
+    src/txview.h \
+    src/chainstats.h \
+    src/walletjournal.h \
+    src/prevector.h \
+    src/blockimport.h \
+    src/blockstore.h \
+    src/indexsnapshot.h \
+    src/scheduler.h \
+    src/msgverify.h \
     src/crypto/common.h \
     src/crypto/hmac_sha256.h \
     src/crypto/hmac_sha512.h \
@@ -311,6 +323,8 @@ HEADERS += src/qt/bitcoingui.h \
     src/crypto/sha1.h \
     src/crypto/sha256.h \
     src/crypto/sha512.h \
+    src/xxhash/xxhash.h \
+    src/lz4/lz4.h \
     src/eccryptoverify.h \
     src/qt/inodemanager.h \
     src/qt/addeditrushnode.h \
@@ -422,6 +436,17 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/tesseractx.cpp \
     src/activeinode.cpp \
     src/hub.cpp \
+    src/rpcreader.cpp \
+    src/rpcstream.cpp \
+    src/chainquery.cpp \
+    src/txview.cpp \
+    src/chainstats.cpp \
+    src/walletjournal.cpp \
+    src/blockimport.cpp \
+    src/blockstore.cpp \
+    src/indexsnapshot.cpp \
+    src/scheduler.cpp \
+    src/msgverify.cpp \
     src/inodeconfig.cpp \
     src/crypto/hmac_sha256.cpp \
     src/crypto/hmac_sha512.cpp \
@@ -430,6 +455,8 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/crypto/sha1.cpp \
     src/crypto/sha256.cpp \
     src/crypto/sha512.cpp \
+    src/xxhash/xxhash.c \
+    src/lz4/lz4.c \
     src/eccryptoverify.cpp \
     src/qt/inodemanager.cpp \
     src/qt/addeditrushnode.cpp \
@@ -0,0 +1,96 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_H
+#define BITCOIN_BENCH_H
+
+//
+// Synthetic data for the harnesses in this directory. The values are random,
+// the layout is that of pay to pubkey hash transactions, so sizes and
+// serialization work match real blocks while compression is close to the
+// worst case.
+//
+
+#include "main.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <vector>
+
+// Resident set size in MB
+static inline double GetResidentMB()
+{
+    long nPages = 0, nResident = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    if (fscanf(file, "%ld %ld", &nPages, &nResident) != 2)
+        nResident = 0;
+    fclose(file);
+    return (double)nResident * sysconf(_SC_PAGESIZE) / 1000000;
+}
+
+static inline std::vector<unsigned char> RandomBytes(unsigned int nSize)
+{
+    std::vector<unsigned char> vch(nSize);
+    for (unsigned int i = 0; i < nSize; i++)
+        vch[i] = insecure_rand();
+    return vch;
+}
+
+static inline uint256 RandomHash()
+{
+    uint256 hash;
+    for (unsigned int i = 0; i < 8; i++)
+        ((uint32_t*)hash.begin())[i] = insecure_rand();
+    return hash;
+}
+
+/** nIn signed inputs and nOut pay to pubkey hash outputs, no inputs makes a coinbase */
+static inline CTransaction RandomTx(unsigned int nIn, unsigned int nOut)
+{
+    CTransaction tx;
+    tx.nTime = insecure_rand();
+    if (nIn == 0)
+    {
+        tx.vin.resize(1);
+        tx.vin[0].prevout.SetNull();
+        tx.vin[0].scriptSig << RandomBytes(4) << RandomBytes(8);
+    }
+    for (unsigned int i = 0; i < nIn; i++)
+    {
+        CTxIn txin(RandomHash(), insecure_rand() % 4);
+        txin.scriptSig << RandomBytes(72) << RandomBytes(33);
+        tx.vin.push_back(txin);
+    }
+    for (unsigned int i = 0; i < nOut; i++)
+    {
+        CTxOut txout;
+        txout.nValue = insecure_rand() % (100 * COIN);
+        txout.scriptPubKey << OP_DUP << OP_HASH160 << RandomBytes(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout.push_back(txout);
+    }
+    return tx;
+}
+
+/** A coinbase and nTx transactions with 2 inputs and 2 outputs each */
+static inline CBlock RandomBlock(unsigned int nTx)
+{
+    CBlock block;
+    block.nVersion = 7;
+    block.hashPrevBlock = RandomHash();
+    block.nTime = insecure_rand();
+    block.nBits = 0x1d00ffff;
+    block.nNonce = insecure_rand();
+    block.vtx.push_back(RandomTx(0, 1));
+    for (unsigned int i = 0; i < nTx; i++)
+        block.vtx.push_back(RandomTx(2, 2));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    block.vchBlockSig = RandomBytes(71);
+    return block;
+}
+
+#endif
@@ -0,0 +1,76 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Block index layouts: the old std::map with one heap allocation per entry
+// against BlockMap with its entries carved out of CBlockIndexArena. Run one
+// layout per process so the resident size is its own:
+//
+//   bench_blockindex map [entries]
+//   bench_blockindex hash [entries]
+//
+
+#include "bench.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+template<typename Map>
+static void Run(Map& mapIndex, const vector<uint256>& vHash, bool fArena)
+{
+    double dMemStart = GetResidentMB();
+
+    int64_t nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < vHash.size(); i++)
+    {
+        CBlockIndex* pindex = fArena ? new (blockIndexArena.Allocate()) CBlockIndex() : new CBlockIndex();
+        pindex->nHeight = i;
+        pindex->phashBlock = &mapIndex.insert(make_pair(vHash[i], pindex)).first->first;
+    }
+    int64_t nInsert = GetTimeMicros() - nStart;
+    double dMem = GetResidentMB() - dMemStart;
+
+    // look every entry up once, in an order unrelated to the insertion
+    vector<uint256> vLookup(vHash);
+    random_shuffle(vLookup.begin(), vLookup.end());
+    int64_t nSum = 0;
+    nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < vLookup.size(); i++)
+        nSum += mapIndex.find(vLookup[i])->second->nHeight;
+    int64_t nLookup = GetTimeMicros() - nStart;
+
+    printf("%s: %u entries, insert %.2fs, lookup %.2fs, %.0fMB resident (%ld)\n",
+        fArena ? "hash map with the arena" : "std::map with per-entry new",
+        (unsigned int)vHash.size(), nInsert / 1e6, nLookup / 1e6, dMem, (long)(nSum & 1));
+}
+
+int main(int argc, char* argv[])
+{
+    string strLayout = argc > 1 ? argv[1] : "";
+    if (strLayout != "map" && strLayout != "hash")
+    {
+        fprintf(stderr, "usage: %s map|hash [entries]\n", argv[0]);
+        return 1;
+    }
+    unsigned int nEntries = argc > 2 ? atoi(argv[2]) : 3000000;
+
+    seed_insecure_rand(true);
+    vector<uint256> vHash(nEntries);
+    for (unsigned int i = 0; i < nEntries; i++)
+        vHash[i] = RandomHash();
+
+    if (strLayout == "map")
+    {
+        map<uint256, CBlockIndex*> mapIndex;
+        Run(mapIndex, vHash, false);
+    }
+    else
+    {
+        BlockMap mapIndex;
+        Run(mapIndex, vHash, true);
+    }
+    return 0;
+}
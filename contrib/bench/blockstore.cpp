@@ -0,0 +1,137 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Raw against LZ4 compressed block files: size on disk, write time and the
+// time to read a block back and deserialize it. Blocks are written to an
+// empty directory and read back from the page cache:
+//
+//   bench_blockstore <empty directory> [blocks per size]
+//
+
+#include "bench.h"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+// Bytes in the directory's files with this extension
+static uint64_t GetFilesSize(const boost::filesystem::path& dir, const string& strExtension)
+{
+    uint64_t nSize = 0;
+    for (boost::filesystem::directory_iterator it(dir); it != boost::filesystem::directory_iterator(); ++it)
+        if (it->path().extension() == strExtension)
+            nSize += boost::filesystem::file_size(it->path());
+    return nSize;
+}
+
+struct CStoredBlock
+{
+    unsigned int nFile;
+    unsigned int nBlockPos;
+};
+
+// What CBlock::WriteToDisk does without -compressblocks
+static bool WriteRaw(const CBlock& block, CStoredBlock& stored)
+{
+    CAutoFile fileout = CAutoFile(AppendBlockFile(stored.nFile), SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return false;
+    unsigned int nSize = fileout.GetSerializeSize(block);
+    fileout << FLATDATA(Params().MessageStart()) << nSize;
+    stored.nBlockPos = ftell(fileout);
+    fileout << block;
+    fflush(fileout);
+    return true;
+}
+
+static bool WriteCompressed(const CBlock& block, CStoredBlock& stored)
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+    return WriteCompressedBlock(&ssBlock[0], ssBlock.size(), false, stored.nFile, stored.nBlockPos);
+}
+
+// The two branches of CBlock::ReadFromDisk, without the proof of work check
+static bool ReadRaw(const CStoredBlock& stored, CBlock& block)
+{
+    CAutoFile filein = CAutoFile(OpenBlockFile(stored.nFile, stored.nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return false;
+    filein >> block;
+    return true;
+}
+
+static bool ReadCompressed(const CStoredBlock& stored, CBlock& block)
+{
+    BlockDataPtr pBlock;
+    if (!ReadCompressedBlock(stored.nFile, stored.nBlockPos, pBlock))
+        return false;
+    CDataStream ssBlock(&(*pBlock)[0], &(*pBlock)[0] + pBlock->size(), SER_DISK, CLIENT_VERSION);
+    ssBlock >> block;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || !boost::filesystem::is_directory(argv[1]) || !boost::filesystem::is_empty(argv[1]))
+    {
+        fprintf(stderr, "usage: %s <empty directory> [blocks per size]\n", argv[0]);
+        return 1;
+    }
+    mapArgs["-datadir"] = argv[1];
+    unsigned int nBlocks = argc > 2 ? atoi(argv[2]) : 500;
+    seed_insecure_rand(true);
+
+    // compressed files are readable once InitBlockStore knows about them
+    fCompressBlocks = true;
+    InitBlockStore();
+
+    printf("txs/block  avg size  on disk  write raw  write lz4  read raw  read+decompress\n");
+    unsigned int vTx[] = { 2, 10, 100, 1000 };
+    for (unsigned int n = 0; n < sizeof(vTx) / sizeof(vTx[0]); n++)
+    {
+        vector<CBlock> vBlocks(nBlocks);
+        uint64_t nBlockBytes = 0;
+        for (unsigned int i = 0; i < nBlocks; i++)
+        {
+            vBlocks[i] = RandomBlock(vTx[n]);
+            nBlockBytes += ::GetSerializeSize(vBlocks[i], SER_DISK, CLIENT_VERSION);
+        }
+
+        vector<CStoredBlock> vRaw(nBlocks), vCompressed(nBlocks);
+        uint64_t nRawStart = GetFilesSize(GetDataDir(), ".dat");
+        uint64_t nCompressedStart = GetFilesSize(GetDataDir(), ".lz4") + GetFilesSize(GetDataDir(), ".idx");
+        int64_t nStart = GetTimeMicros();
+        for (unsigned int i = 0; i < nBlocks; i++)
+            if (!WriteRaw(vBlocks[i], vRaw[i]))
+                return 1;
+        int64_t nWriteRaw = GetTimeMicros() - nStart;
+        nStart = GetTimeMicros();
+        for (unsigned int i = 0; i < nBlocks; i++)
+            if (!WriteCompressed(vBlocks[i], vCompressed[i]))
+                return 1;
+        int64_t nWriteCompressed = GetTimeMicros() - nStart;
+        uint64_t nRaw = GetFilesSize(GetDataDir(), ".dat") - nRawStart;
+        uint64_t nCompressed = GetFilesSize(GetDataDir(), ".lz4") + GetFilesSize(GetDataDir(), ".idx") - nCompressedStart;
+
+        CBlock block;
+        nStart = GetTimeMicros();
+        for (unsigned int i = 0; i < nBlocks; i++)
+            if (!ReadRaw(vRaw[i], block) || block.vtx.size() != vBlocks[i].vtx.size())
+                return 1;
+        int64_t nReadRaw = GetTimeMicros() - nStart;
+        nStart = GetTimeMicros();
+        for (unsigned int i = 0; i < nBlocks; i++)
+            if (!ReadCompressed(vCompressed[i], block) || block.vtx.size() != vBlocks[i].vtx.size())
+                return 1;
+        int64_t nReadCompressed = GetTimeMicros() - nStart;
+
+        printf("%9u  %7.1fkB  %6.1f%%  %7.1fus  %7.1fus  %6.1fus  %13.1fus\n",
+            vTx[n], nBlockBytes / 1000.0 / nBlocks, 100.0 * nCompressed / nRaw,
+            (double)nWriteRaw / nBlocks, (double)nWriteCompressed / nBlocks,
+            (double)nReadRaw / nBlocks, (double)nReadCompressed / nBlocks);
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// The network paths of CDataStream, once with its own allocator and once with
+// the cleansing allocator of CSecureDataStream, which every stream used
+// before:
+//
+//   bench_streams [blocks] [transactions]
+//
+
+#include "bench.h"
+
+#include <algorithm>
+#include <deque>
+
+using namespace std;
+
+// What CNetMessage::readData and ProcessMessage do with a block: the message
+// buffer grows 256KB at a time as the bytes arrive, then the block is parsed
+template<typename Stream>
+static void ReceiveBlock(const vector<char>& vMsg, CBlock& block)
+{
+    Stream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    unsigned int nDataPos = 0;
+    while (nDataPos < vMsg.size())
+    {
+        unsigned int nCopy = min((unsigned int)vMsg.size() - nDataPos, 1460u);
+        if (vRecv.size() < nDataPos + nCopy)
+            vRecv.resize(min((unsigned int)vMsg.size(), nDataPos + nCopy + 256 * 1024));
+        memcpy(&vRecv[nDataPos], &vMsg[nDataPos], nCopy);
+        nDataPos += nCopy;
+    }
+    vRecv >> block;
+}
+
+// What RelayTransaction and PushMessage do with a transaction: serialize it
+// for mapRelay, then a second time behind a message header, checksum it and
+// move it to the send queue
+template<typename Stream>
+static void RelayTx(const CTransaction& tx, deque<vector<char, typename Stream::allocator_type> >& vSendMsg)
+{
+    Stream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(10000);
+    ss << tx;
+    Stream ssRelay(ss);
+
+    Stream ssSend(SER_NETWORK, PROTOCOL_VERSION);
+    ssSend << CMessageHeader("tx", 0) << tx;
+    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
+    memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
+    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &hash, 4);
+    vSendMsg.push_back(vector<char, typename Stream::allocator_type>());
+    vSendMsg.back().insert(vSendMsg.back().end(), ssSend.begin(), ssSend.end());
+    ssSend.clear();
+}
+
+// Fastest batch, in microseconds per item. The parsed blocks and sent
+// messages are freed between batches and not timed.
+template<typename Stream>
+static double TimeReceive(const vector<char>& vMsg, unsigned int nBlocks)
+{
+    double dBest = 1e9;
+    for (unsigned int i = 0; i < nBlocks; i += 20)
+    {
+        unsigned int nBatch = min(20u, nBlocks - i);
+        vector<CBlock> vBlock(nBatch);
+        int64_t nStart = GetTimeMicros();
+        for (unsigned int j = 0; j < nBatch; j++)
+            ReceiveBlock<Stream>(vMsg, vBlock[j]);
+        dBest = min(dBest, (double)(GetTimeMicros() - nStart) / nBatch);
+    }
+    return dBest;
+}
+
+template<typename Stream>
+static double TimeRelay(const vector<CTransaction>& vtx)
+{
+    double dBest = 1e9;
+    for (unsigned int i = 0; i < vtx.size(); i += 1000)
+    {
+        unsigned int nBatch = min(1000u, (unsigned int)vtx.size() - i);
+        deque<vector<char, typename Stream::allocator_type> > vSendMsg;
+        int64_t nStart = GetTimeMicros();
+        for (unsigned int j = 0; j < nBatch; j++)
+            RelayTx<Stream>(vtx[i + j], vSendMsg);
+        dBest = min(dBest, (double)(GetTimeMicros() - nStart) / nBatch);
+    }
+    return dBest;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int nBlocks = argc > 1 ? atoi(argv[1]) : 500;
+    unsigned int nTx = argc > 2 ? atoi(argv[2]) : 100000;
+    seed_insecure_rand(true);
+
+    CBlock block = RandomBlock(2000);
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    vector<char> vMsg(ssBlock.begin(), ssBlock.end());
+    vector<CTransaction> vtx(block.vtx.begin() + 1, block.vtx.end());
+    while (vtx.size() < nTx)
+        vtx.push_back(RandomTx(2, 2));
+
+    printf("receive a %uKB block: %.0fus CDataStream, %.0fus CSecureDataStream\n", (unsigned int)(vMsg.size() / 1000),
+        TimeReceive<CDataStream>(vMsg, nBlocks), TimeReceive<CSecureDataStream>(vMsg, nBlocks));
+    printf("relay a transaction: %.2fus CDataStream, %.2fus CSecureDataStream\n",
+        TimeRelay<CDataStream>(vtx), TimeRelay<CSecureDataStream>(vtx));
+    return 0;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Block deserialization time and the resident size of transactions held in a
+// map the way the memory pool and the wallet hold them. Both depend on how
+// CScript stores its bytes:
+//
+//   bench_transactions [blocks] [transactions in the map]
+//
+
+#include "bench.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    unsigned int nBlocks = argc > 1 ? atoi(argv[1]) : 500;
+    unsigned int nMapTx = argc > 2 ? atoi(argv[2]) : 200000;
+    seed_insecure_rand(true);
+
+    CBlock block = RandomBlock(2000);
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    vector<char> vBlock(ssBlock.begin(), ssBlock.end());
+
+    // Only the parse is timed. The streams are filled before and the blocks
+    // freed after, in batches, otherwise the page faults of a heap that malloc
+    // trims and grows again on every block dominate the numbers. The fastest
+    // batch is reported, the others carry noise from the rest of the system.
+    double dDeserialize = 1e9;
+    for (unsigned int i = 0; i < nBlocks; i += 50)
+    {
+        unsigned int nBatch = min(50u, nBlocks - i);
+        vector<CDataStream*> vStream;
+        for (unsigned int j = 0; j < nBatch; j++)
+            vStream.push_back(new CDataStream(&vBlock[0], &vBlock[0] + vBlock.size(), SER_NETWORK, PROTOCOL_VERSION));
+        vector<CBlock> vBlockRead(nBatch);
+        int64_t nStart = GetTimeMicros();
+        for (unsigned int j = 0; j < nBatch; j++)
+            *vStream[j] >> vBlockRead[j];
+        dDeserialize = min(dDeserialize, (double)(GetTimeMicros() - nStart) / nBatch);
+        for (unsigned int j = 0; j < nBatch; j++)
+        {
+            if (vBlockRead[j].vtx.size() != block.vtx.size())
+                return 1;
+            delete vStream[j];
+        }
+    }
+    printf("deserialize a %u transaction block (%uKB): %.2fms\n", (unsigned int)block.vtx.size(),
+        (unsigned int)(vBlock.size() / 1000), dDeserialize / 1e3);
+
+    double dMemStart = GetResidentMB();
+    map<uint256, CTransaction> mapTx;
+    for (unsigned int i = 0; i < nMapTx; i++)
+    {
+        CTransaction tx = RandomTx(2, 2);
+        mapTx[tx.GetHash()] = tx;
+    }
+    printf("%u transactions in a std::map: %.0fMB resident\n", (unsigned int)mapTx.size(), GetResidentMB() - dMemStart);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Wallet journal load time and write amplification. A staking wallet writes
+// each transaction record once and rewrites it later when its outputs are
+// spent; this does the same with records of wallet transaction size, then
+// compacts the journal:
+//
+//   bench_walletjournal <empty directory> [records]
+//
+
+#include "bench.h"
+#include "walletjournal.h"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+static CWalletJournal::Data TxKey(unsigned int n)
+{
+    CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << string("tx") << uint256(n);
+    return CWalletJournal::Data(ssKey.begin(), ssKey.end());
+}
+
+static CWalletJournal::Data TxValue()
+{
+    vector<unsigned char> vch = RandomBytes(300 + insecure_rand() % 200);
+    return CWalletJournal::Data(vch.begin(), vch.end());
+}
+
+static bool Put(CWalletJournal& journal, unsigned int n, uint64_t& nLogical)
+{
+    CWalletJournal::Batch batch(1);
+    batch[0].fErase = false;
+    batch[0].key = TxKey(n);
+    batch[0].value = TxValue();
+    nLogical += batch[0].key.size() + batch[0].value.size();
+    return journal.Write(batch);
+}
+
+static bool Erase(CWalletJournal& journal, unsigned int n, uint64_t& nLogical)
+{
+    CWalletJournal::Batch batch(1);
+    batch[0].fErase = true;
+    batch[0].key = TxKey(n);
+    nLogical += batch[0].key.size();
+    return journal.Write(batch);
+}
+
+// Time to load the journal from the page cache, in seconds
+static double Load(const boost::filesystem::path& path, size_t nExpected)
+{
+    CWalletJournal journal(path, false);
+    int64_t nStart = GetTimeMicros();
+    if (!journal.Open() || journal.size() != nExpected)
+    {
+        fprintf(stderr, "loading %s failed\n", path.string().c_str());
+        exit(1);
+    }
+    return (GetTimeMicros() - nStart) / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || !boost::filesystem::is_directory(argv[1]) || !boost::filesystem::is_empty(argv[1]))
+    {
+        fprintf(stderr, "usage: %s <empty directory> [records]\n", argv[0]);
+        return 1;
+    }
+    // the journal logs its stats to debug.log there
+    mapArgs["-datadir"] = argv[1];
+    boost::filesystem::path path = boost::filesystem::path(argv[1]) / "wallet.journal";
+    unsigned int nRecords = argc > 2 ? atoi(argv[2]) : 200000;
+    seed_insecure_rand(true);
+
+    CWalletJournal journal(path, false);
+    if (!journal.Open())
+        return 1;
+    uint64_t nLogical = 0;
+
+    // every record written, then rewritten, and a tenth of them erased
+    int64_t nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < nRecords; i++)
+        if (!Put(journal, i, nLogical))
+            return 1;
+    for (unsigned int i = 0; i < nRecords; i++)
+        if (!Put(journal, i, nLogical))
+            return 1;
+    for (unsigned int i = 0; i < nRecords; i += 10)
+        if (!Erase(journal, i, nLogical))
+            return 1;
+    if (!journal.Flush())
+        return 1;
+    int64_t nWrite = GetTimeMicros() - nStart;
+    size_t nLive = journal.size();
+    uint64_t nFileSize = boost::filesystem::file_size(path);
+    printf("%u records, %u writes in %.2fs, %uKB written for %uKB of records (write amplification %.2f)\n",
+        (unsigned int)nLive, nRecords * 2 + (nRecords + 9) / 10, nWrite / 1e6,
+        (unsigned int)(nFileSize / 1024), (unsigned int)(nLogical / 1024), (double)nFileSize / nLogical);
+    journal.Close();
+    printf("load before compaction: %.3fs\n", Load(path, nLive));
+
+    CWalletJournal journalCompact(path, false);
+    if (!journalCompact.Open())
+        return 1;
+    nStart = GetTimeMicros();
+    if (!journalCompact.Compact())
+        return 1;
+    int64_t nCompact = GetTimeMicros() - nStart;
+    journalCompact.Close();
+    uint64_t nCompacted = boost::filesystem::file_size(path);
+    printf("compaction: %.3fs, %uKB left, write amplification with it %.2f\n",
+        nCompact / 1e6, (unsigned int)(nCompacted / 1024), (double)(nFileSize + nCompacted) / nLogical);
+    printf("load after compaction: %.3fs\n", Load(path, nLive));
+    return 0;
+}
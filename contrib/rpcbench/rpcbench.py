@@ -0,0 +1,185 @@
+#!/usr/bin/python
+#
+# rpcbench.py:  Load generator for the JSON-RPC server.
+#
+# Copyright (c) 2014 The Bitcoin developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+
+from __future__ import print_function
+
+import base64
+import json
+import multiprocessing
+import optparse
+import socket
+import sys
+import time
+
+class RPCConnection:
+	"""One keep-alive HTTP/1.1 connection that can pipeline requests"""
+
+	def __init__(self, host, port, username, password):
+		authpair = ("%s:%s" % (username, password)).encode('utf-8')
+		self.authhdr = "Basic %s" % base64.b64encode(authpair).decode('ascii')
+		self.sock = socket.create_connection((host, port), 30)
+		self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+		self.buf = b''
+		self.objid = 0
+
+	def request(self, method, params):
+		self.objid += 1
+		body = json.dumps({ 'version' : '1.1', 'method' : method,
+				    'params' : params, 'id' : self.objid })
+		return ("POST / HTTP/1.1\r\n"
+			"Host: 127.0.0.1\r\n"
+			"Authorization: %s\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: %d\r\n"
+			"\r\n%s" % (self.authhdr, len(body), body)).encode('utf-8')
+
+	def send(self, data):
+		self.sock.sendall(data)
+
+	def fill(self):
+		data = self.sock.recv(65536)
+		if not data:
+			raise IOError("connection closed by server")
+		self.buf += data
+
+	def readline(self):
+		while True:
+			pos = self.buf.find(b'\r\n')
+			if pos >= 0:
+				line = self.buf[:pos]
+				self.buf = self.buf[pos + 2:]
+				return line.decode('latin-1')
+			self.fill()
+
+	def readbytes(self, n):
+		while len(self.buf) < n:
+			self.fill()
+		data = self.buf[:n]
+		self.buf = self.buf[n:]
+		return data
+
+	def response(self):
+		"""Read one reply, plain or chunked, and return its decoded JSON"""
+		status = self.readline()
+		if not status.startswith("HTTP/1.1 200") and not status.startswith("HTTP/1.1 500"):
+			raise IOError("unexpected reply: %s" % status)
+		headers = {}
+		while True:
+			line = self.readline()
+			if not line:
+				break
+			name, _, value = line.partition(':')
+			headers[name.strip().lower()] = value.strip()
+
+		if headers.get('transfer-encoding') == 'chunked':
+			parts = []
+			while True:
+				size = int(self.readline().split(';')[0], 16)
+				if size == 0:
+					break
+				parts.append(self.readbytes(size))
+				self.readline()
+			while self.readline():
+				pass
+			body = b''.join(parts)
+		else:
+			body = self.readbytes(int(headers['content-length']))
+
+		reply = json.loads(body.decode('utf-8'))
+		if reply.get('error') is not None:
+			raise IOError("RPC error: %s" % reply['error'])
+		return reply['result']
+
+	def call(self, method, params=[]):
+		self.send(self.request(method, params))
+		return self.response()
+
+def method_params(settings, conn):
+	if settings.method == 'getblockcount':
+		return []
+	if settings.method == 'getrawtransaction':
+		txid = settings.txid
+		if txid is None:
+			# the coinbase of the best block, which getrawtransaction
+			# finds with -txindex
+			height = conn.call('getblockcount')
+			block = conn.call('getblock', [conn.call('getblockhash', [height])])
+			txid = block['tx'][0]
+		return [txid, 0]
+	raise ValueError("unknown method %s" % settings.method)
+
+def worker(settings, params, start, results):
+	conn = RPCConnection(settings.host, settings.port, settings.user, settings.password)
+	batch = b''.join([conn.request(settings.method, params) for i in range(settings.pipeline)])
+	start.wait()
+
+	count = 0
+	latency = 0.0
+	end = time.time() + settings.duration
+	while time.time() < end:
+		sent = time.time()
+		conn.send(batch)
+		for i in range(settings.pipeline):
+			conn.response()
+		latency += time.time() - sent
+		count += settings.pipeline
+	results.put((count, latency))
+
+if __name__ == '__main__':
+	parser = optparse.OptionParser(usage="%prog [options] -u USER -p PASSWORD")
+	parser.add_option('--host', default='127.0.0.1')
+	parser.add_option('--port', type='int', default=44444,
+			  help="RPC port (default: 44444, testnet: 33444)")
+	parser.add_option('-u', '--user', help="rpcuser")
+	parser.add_option('-p', '--password', help="rpcpassword")
+	parser.add_option('-m', '--method', default='getblockcount',
+			  help="getblockcount or getrawtransaction (default: %default)")
+	parser.add_option('--txid', help="transaction for getrawtransaction (default: coinbase of the best block)")
+	parser.add_option('-c', '--connections', type='int', default=4,
+			  help="concurrent connections, one process each (default: %default)")
+	parser.add_option('-d', '--pipeline', type='int', default=1,
+			  help="requests sent per connection before reading the replies (default: %default)")
+	parser.add_option('-t', '--duration', type='float', default=10,
+			  help="seconds to run (default: %default)")
+	(settings, args) = parser.parse_args()
+	if settings.user is None or settings.password is None:
+		parser.error("rpcuser and rpcpassword are required")
+
+	conn = RPCConnection(settings.host, settings.port, settings.user, settings.password)
+	params = method_params(settings, conn)
+	conn.call(settings.method, params)
+	# each open connection holds one of the server's -rpcthreads
+	conn.sock.close()
+
+	start = multiprocessing.Event()
+	results = multiprocessing.Queue()
+	workers = [multiprocessing.Process(target=worker, args=(settings, params, start, results))
+		   for i in range(settings.connections)]
+	for p in workers:
+		p.start()
+	time.sleep(0.5)
+	start.set()
+	t0 = time.time()
+	totals = [results.get() for p in workers]
+	elapsed = time.time() - t0
+	for p in workers:
+		p.join()
+
+	count = sum([c for c, l in totals])
+	latency = sum([l for c, l in totals])
+	batches = count / settings.pipeline
+	print("%s: %d requests in %.1fs over %d connections, pipeline depth %d" %
+	      (settings.method, count, elapsed, settings.connections, settings.pipeline))
+	print("  %.0f requests/sec, %.2f ms per round trip" %
+	      (count / elapsed, 1000 * latency / max(batches, 1)))
+
+	conn = RPCConnection(settings.host, settings.port, settings.user, settings.password)
+	stats = conn.call('getrpcstats')
+	print("  server: %d requests, %.0f/sec over the last minute" %
+	      (stats['requests'], stats['lastminutepersec']))
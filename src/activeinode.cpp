@@ -193,11 +193,12 @@ bool CActiveInode::Dseep(CTxIn vin, CService service, CKey keyInode, CPubKey pub
 
     // Update Last Seen timestamp in inode list
     bool found = false;
-    BOOST_FOREACH(CINode& mn, vecInodes) {
-        //LogPrintf(" -- %s\n", mn.vin.ToString().c_str());
-        if(mn.vin == vin) {
+    {
+        LOCK(cs_inodes);
+        int nHandle = inodeRegistry.Find(vin);
+        if(nHandle != -1) {
             found = true;
-            mn.UpdateLastSeen();
+            inodeRegistry[nHandle].UpdateLastSeen();
         }
     }
 
@@ -282,17 +283,12 @@ bool CActiveInode::Register(CTxIn vin, CService service, CKey keyCollateralAddre
 		return false;
 	}
 
-    bool found = false;
     LOCK(cs_inodes);
-    BOOST_FOREACH(CINode& mn, vecInodes)
-        if(mn.vin == vin)
-            found = true;
-
-    if(!found) {
+    if(inodeRegistry.Find(vin) == -1) {
         LogPrintf("CActiveInode::Register() - Adding to inode list service: %s - vin: %s\n", service.ToString().c_str(), vin.ToString().c_str());
         CINode mn(service, vin, pubKeyCollateralAddress, vchINodeSignature, iNodeSignatureTime, pubKeyInode, PROTOCOL_VERSION);
         mn.UpdateLastSeen(iNodeSignatureTime);
-        vecInodes.push_back(mn);
+        inodeRegistry.Add(mn);
     }
 
     //send to all peers
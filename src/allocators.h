@@ -9,6 +9,7 @@
 #include <string>
 #include <boost/thread/mutex.hpp>
 #include <map>
+#include <vector>
 #include <openssl/crypto.h> // for OPENSSL_cleanse()
 
 #ifdef WIN32
@@ -265,6 +266,119 @@ struct zero_after_free_allocator : public std::allocator<T>
     }
 };
 
+/**
+ * Pool of large buffers for stream_allocator.
+ *
+ * Message and block buffers of 64KB to 4MB are rounded up to a power of two
+ * and a few of each size are kept when freed, instead of going back to malloc,
+ * which maps and unmaps blocks that large on every allocation. Smaller
+ * buffers go straight to operator new.
+ */
+class CStreamBufferPool
+{
+public:
+    static const size_t MIN_POOLED = 1 << 16;
+    static const int NUM_CLASSES = 7;          // 64KB .. 4MB
+    static const size_t MAX_FREE_PER_CLASS = 2;
+
+    static CStreamBufferPool& Instance()
+    {
+        // never destroyed, streams in static objects may free into it at exit
+        static CStreamBufferPool* pool = new CStreamBufferPool();
+        return *pool;
+    }
+
+    void* Allocate(size_t nSize)
+    {
+        int nClass = SizeClass(nSize);
+        if (nClass < 0)
+            return ::operator new(nSize);
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            std::vector<void*>& vFree = vFreeByClass[nClass];
+            if (!vFree.empty())
+            {
+                void* p = vFree.back();
+                vFree.pop_back();
+                return p;
+            }
+        }
+        return ::operator new(MIN_POOLED << nClass);
+    }
+
+    void Free(void* p, size_t nSize)
+    {
+        int nClass = SizeClass(nSize);
+        if (nClass >= 0)
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            std::vector<void*>& vFree = vFreeByClass[nClass];
+            if (vFree.size() < MAX_FREE_PER_CLASS)
+            {
+                vFree.push_back(p);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+private:
+    boost::mutex mutex;
+    std::vector<void*> vFreeByClass[NUM_CLASSES];
+
+    CStreamBufferPool()
+    {
+        for (int i = 0; i < NUM_CLASSES; i++)
+            vFreeByClass[i].reserve(MAX_FREE_PER_CLASS);
+    }
+
+    // -1 for sizes that aren't pooled
+    static int SizeClass(size_t nSize)
+    {
+        if (nSize < MIN_POOLED)
+            return -1;
+        for (int nClass = 0; nClass < NUM_CLASSES; nClass++)
+            if (nSize <= (MIN_POOLED << nClass))
+                return nClass;
+        return -1;
+    }
+};
+
+//
+// Allocator for buffers of public data: network messages and blocks and
+// transactions serialized for hashing or disk. Nothing is cleansed on free.
+//
+template<typename T>
+struct stream_allocator : public std::allocator<T>
+{
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type  difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    stream_allocator() throw() {}
+    stream_allocator(const stream_allocator& a) throw() : base(a) {}
+    template <typename U>
+    stream_allocator(const stream_allocator<U>& a) throw() : base(a) {}
+    ~stream_allocator() throw() {}
+    template<typename _Other> struct rebind
+    { typedef stream_allocator<_Other> other; };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        return static_cast<T*>(CStreamBufferPool::Instance().Allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (p != NULL)
+            CStreamBufferPool::Instance().Free(p, sizeof(T) * n);
+    }
+};
+
 // This is exactly like std::string, but with a custom allocator.
 typedef std::basic_string<char, std::char_traits<char>, secure_allocator<char> > SecureString;
 
@@ -11,6 +11,7 @@
 #include "util.h"
 #include "inode.h"
 #include "tesseractx.h"
+#include "msgverify.h"
 #include "ui_interface.h"
 //#include "random.h"
 
@@ -37,6 +38,10 @@ CAnonSendSigner anonSendSigner;
 std::vector<CAnonsendQueue> vecAnonsendQueue;
 /** Keep track of the used inodes */
 std::vector<CTxIn> vecInodesUsed;
+// memoized anonsend rounds of wallet outputs
+CAnonsendRoundsCache anonsendRoundsCache;
+/** Runs the anonsend and inode housekeeping tasks */
+CScheduler anonSendScheduler;
 // keep track of the scanning errors I've seen
 map<uint256, CAnonsendBroadcastTx> mapAnonsendBroadcastTxes;
 //
@@ -118,17 +123,20 @@ void ProcessMessageAnonsend(CNode* pfrom, std::string& strCommand, CDataStream&
         vRecv >> nDenom >> txCollateral;
 
         std::string error = "";
-        int mn = GetInodeByVin(activeInode.vin);
-        if(mn == -1){
-            std::string strError = _("Not in the inode list.");
-            pfrom->PushMessage("dssu", anonSendPool.sessionID, anonSendPool.GetState(), anonSendPool.GetEntriesCount(), INODE_REJECTED, strError);
-            return;
-        }
+        {
+            // handles change when inactive inodes are removed, use it under the same lock
+            LOCK(cs_inodes);
+            int mn = inodeRegistry.Find(activeInode.vin);
+            if(mn == -1){
+                std::string strError = _("Not in the inode list.");
+                pfrom->PushMessage("dssu", anonSendPool.sessionID, anonSendPool.GetState(), anonSendPool.GetEntriesCount(), INODE_REJECTED, strError);
+                return;
+            }
 
-        if(anonSendPool.sessionUsers == 0) {
-            if(vecInodes[mn].nLastDsq != 0 &&
-                vecInodes[mn].nLastDsq + CountInodesAboveProtocol(anonSendPool.MIN_PEER_PROTO_VERSION)/5 > anonSendPool.nDsqCount){
-                //LogPrintf("dsa -- last dsq too recent, must wait. %s \n", vecInodes[mn].addr.ToString().c_str());
+            if(anonSendPool.sessionUsers == 0 &&
+                inodeRegistry[mn].nLastDsq != 0 &&
+                inodeRegistry[mn].nLastDsq + inodeRegistry.CountAboveProtocol(anonSendPool.MIN_PEER_PROTO_VERSION)/5 > anonSendPool.nDsqCount){
+                //LogPrintf("dsa -- last dsq too recent, must wait. %s \n", inodeRegistry[mn].addr.ToString().c_str());
                 std::string strError = _("Last Anonsend was too recent.");
                 pfrom->PushMessage("dssu", anonSendPool.sessionID, anonSendPool.GetState(), anonSendPool.GetEntriesCount(), INODE_REJECTED, strError);
                 return;
@@ -161,8 +169,7 @@ void ProcessMessageAnonsend(CNode* pfrom, std::string& strCommand, CDataStream&
 
         if(dsq.IsExpired()) return;
 
-        int mn = GetInodeByVin(dsq.vin);
-        if(mn == -1) return;
+        if(GetInodeByVin(dsq.vin) == -1) return;
 
         // if the queue is ready, submit if we can
         if(dsq.ready) {
@@ -178,16 +185,20 @@ void ProcessMessageAnonsend(CNode* pfrom, std::string& strCommand, CDataStream&
                 if(q.vin == dsq.vin) return;
             }
 
-            if(fDebug) LogPrintf("dsq last %d last2 %d count %d\n", vecInodes[mn].nLastDsq, vecInodes[mn].nLastDsq + (int)vecInodes.size()/5, anonSendPool.nDsqCount);
+            LOCK(cs_inodes);
+            // looked up again, the registry may have been compacted since
+            int mn = inodeRegistry.Find(dsq.vin);
+            if(mn == -1) return;
+            if(fDebug) LogPrintf("dsq last %d last2 %d count %d\n", inodeRegistry[mn].nLastDsq, inodeRegistry[mn].nLastDsq + (int)inodeRegistry.size()/5, anonSendPool.nDsqCount);
             //don't allow a few nodes to dominate the queuing process
-            if(vecInodes[mn].nLastDsq != 0 &&
-                vecInodes[mn].nLastDsq + CountInodesAboveProtocol(anonSendPool.MIN_PEER_PROTO_VERSION)/5 > anonSendPool.nDsqCount){
-                if(fDebug) LogPrintf("dsq -- inode sending too many dsq messages. %s \n", vecInodes[mn].addr.ToString().c_str());
+            if(inodeRegistry[mn].nLastDsq != 0 &&
+                inodeRegistry[mn].nLastDsq + inodeRegistry.CountAboveProtocol(anonSendPool.MIN_PEER_PROTO_VERSION)/5 > anonSendPool.nDsqCount){
+                if(fDebug) LogPrintf("dsq -- inode sending too many dsq messages. %s \n", inodeRegistry[mn].addr.ToString().c_str());
                 return;
             }
             anonSendPool.nDsqCount++;
-            vecInodes[mn].nLastDsq = anonSendPool.nDsqCount;
-            vecInodes[mn].allowFreeTx = true;
+            inodeRegistry[mn].nLastDsq = anonSendPool.nDsqCount;
+            inodeRegistry[mn].allowFreeTx = true;
 
             if(fDebug) LogPrintf("dsq - new anonsend queue object - %s\n", addr.ToString().c_str());
             vecAnonsendQueue.push_back(dsq);
@@ -392,48 +403,111 @@ void ProcessMessageAnonsend(CNode* pfrom, std::string& strCommand, CDataStream&
 
 int randomizeList (int i) { return std::rand()%i;}
 
-// Recursively determine the rounds of a given input (How deep is the anonsend chain for a given input)
-int GetInputAnonsendRounds(CTxIn in, int rounds)
+bool CAnonsendRoundsCache::Get(const COutPoint& outpoint, int rounds, int& nRoundsOut)
 {
-    if(rounds >= 17) return rounds;
+    LOCK(cs);
+    std::map<COutPoint, CEntry>::const_iterator it = mapRounds.find(outpoint);
+    if(it == mapRounds.end() || it->second.vRounds[rounds] == ROUNDS_UNKNOWN) return false;
 
-    std::string padding = "";
-    padding.insert(0, ((rounds+1)*5)+3, ' ');
+    nRoundsOut = it->second.vRounds[rounds];
+    return true;
+}
 
-    CWalletTx tx;
-    if(pwalletMain->GetTransaction(in.prevout.hash,tx))
-    {
-        // bounds check
-        if(in.prevout.n >= tx.vout.size()) return -4;
+void CAnonsendRoundsCache::Set(const COutPoint& outpoint, int rounds, int nRounds)
+{
+    LOCK(cs);
+    std::map<COutPoint, CEntry>::iterator it = mapRounds.find(outpoint);
+    if(it == mapRounds.end()) {
+        it = mapRounds.insert(make_pair(outpoint, CEntry())).first;
+        for(int i = 0; i < ANONSEND_MAX_CHAIN_DEPTH; i++)
+            it->second.vRounds[i] = ROUNDS_UNKNOWN;
+    }
+    it->second.vRounds[rounds] = nRounds;
+}
+
+void CAnonsendRoundsCache::NoteMissing(const uint256& hash)
+{
+    LOCK(cs);
+    setMissing.insert(hash);
+}
 
-        if(tx.vout[in.prevout.n].nValue == ANONSEND_FEE) return -3;
+void CAnonsendRoundsCache::TransactionAdded(const uint256& hash)
+{
+    LOCK(cs);
+    // outputs of a new transaction are computed on demand from their cached parents,
+    // only chains that stopped at this transaction because it was missing have to go
+    if(setMissing.count(hash)) {
+        mapRounds.clear();
+        setMissing.clear();
+    }
+}
 
-        //make sure the final output is non-denominate
-        if(rounds == 0 && !pwalletMain->IsDenominatedAmount(tx.vout[in.prevout.n].nValue)) return -2; //NOT DENOM
+void CAnonsendRoundsCache::Clear()
+{
+    LOCK(cs);
+    mapRounds.clear();
+    setMissing.clear();
+}
 
-        bool found = false;
-        BOOST_FOREACH(CTxOut out, tx.vout)
-        {
-            found = pwalletMain->IsDenominatedAmount(out.nValue);
-            if(found) break; // no need to loop more
+// Determine the rounds of a given input one step down the chain, the next steps come from the cache
+static int CalculateInputAnonsendRounds(const CTxIn& in, int rounds)
+{
+    LOCK(pwalletMain->cs_wallet);
+
+    map<uint256, CWalletTx>::const_iterator mi = pwalletMain->mapWallet.find(in.prevout.hash);
+    if(mi == pwalletMain->mapWallet.end()) {
+        anonsendRoundsCache.NoteMissing(in.prevout.hash);
+        return rounds-1;
+    }
+    const CWalletTx& tx = (*mi).second;
+
+    // bounds check
+    if(in.prevout.n >= tx.vout.size()) return -4;
+
+    if(tx.vout[in.prevout.n].nValue == ANONSEND_FEE) return -3;
+
+    //make sure the final output is non-denominate
+    if(rounds == 0 && !pwalletMain->IsDenominatedAmount(tx.vout[in.prevout.n].nValue)) return -2; //NOT DENOM
+
+    bool found = false;
+    BOOST_FOREACH(const CTxOut& out, tx.vout)
+    {
+        found = pwalletMain->IsDenominatedAmount(out.nValue);
+        if(found) break; // no need to loop more
+    }
+    if(!found) return rounds - 1; //NOT FOUND, "-1" because of the pre-mixing creation of denominated amounts
+
+    // find my vin and look that up
+    BOOST_FOREACH(const CTxIn& in2, tx.vin)
+    {
+        if(!pwalletMain->mapWallet.count(in2.prevout.hash)) {
+            anonsendRoundsCache.NoteMissing(in2.prevout.hash);
+            continue;
         }
-        if(!found) return rounds - 1; //NOT FOUND, "-1" because of the pre-mixing creation of denominated amounts
 
-        // find my vin and look that up
-        BOOST_FOREACH(CTxIn in2, tx.vin)
+        if(pwalletMain->IsMine(in2))
         {
-            if(pwalletMain->IsMine(in2))
-            {
-                //LogPrintf("rounds :: %s %s %d NEXT\n", padding.c_str(), in.ToString().c_str(), rounds);
-                int n = GetInputAnonsendRounds(in2, rounds+1);
-                if(n != -3) return n;
-            }
+            int n = GetInputAnonsendRounds(in2, rounds+1);
+            if(n != -3) return n;
         }
     }
 
     return rounds-1;
 }
 
+// Recursively determine the rounds of a given input (How deep is the anonsend chain for a given input)
+int GetInputAnonsendRounds(CTxIn in, int rounds)
+{
+    if(rounds >= ANONSEND_MAX_CHAIN_DEPTH) return rounds;
+
+    int nRounds;
+    if(anonsendRoundsCache.Get(in.prevout, rounds, nRounds)) return nRounds;
+
+    nRounds = CalculateInputAnonsendRounds(in, rounds);
+    anonsendRoundsCache.Set(in.prevout, rounds, nRounds);
+    return nRounds;
+}
+
 void CAnonSendPool::Reset(){
     cachedLastSuccess = 0;
     vecInodesUsed.clear();
@@ -1381,7 +1455,7 @@ bool CAnonSendPool::DoAutomaticDenominating(bool fDryRun, bool ready)
         }
     }
 
-    if(vecInodes.size() == 0){
+    if(inodeRegistry.empty()){
         if(fDebug) LogPrintf("CAnonSendPool::DoAutomaticDenominating - No inodes detected\n");
         strAutoDenomResult = _("No inodes detected.");
         return false;
@@ -1534,40 +1608,59 @@ bool CAnonSendPool::DoAutomaticDenominating(bool fDryRun, bool ready)
             }
         }
 
-        //shuffle inodes around before we try to connect
-        std::random_shuffle ( vecInodes.begin(), vecInodes.end() );
+        //try inodes in random order instead of shuffling the list itself
+        std::vector<int> vHandles;
+        {
+            LOCK(cs_inodes);
+            inodeRegistry.GetShuffledHandles(vHandles);
+        }
         int i = 0;
 
         // otherwise, try one randomly
-        while(i < 10)
+        while(i < 10 && i < (int)vHandles.size())
         {
-            //don't reuse inodes
-            BOOST_FOREACH(CTxIn usedVin, vecInodesUsed) {
-                if(vecInodes[i].vin == usedVin){
+            CService addrInode;
+            CTxIn vinInode;
+            {
+                LOCK(cs_inodes);
+                if(vHandles[i] >= (int)inodeRegistry.size()) {
                     i++;
                     continue;
                 }
-            }
-            if(vecInodes[i].protocolVersion < MIN_PEER_PROTO_VERSION) {
-                i++;
-                continue;
-            }
+                CINode& mn = inodeRegistry[vHandles[i]];
 
-            if(vecInodes[i].nLastDsq != 0 &&
-                vecInodes[i].nLastDsq + CountInodesAboveProtocol(anonSendPool.MIN_PEER_PROTO_VERSION)/5 > anonSendPool.nDsqCount){
-                i++;
-                continue;
+                //don't reuse inodes
+                bool fUsed = false;
+                BOOST_FOREACH(CTxIn usedVin, vecInodesUsed) {
+                    if(mn.vin == usedVin){
+                        fUsed = true;
+                        break;
+                    }
+                }
+                if(fUsed || mn.protocolVersion < MIN_PEER_PROTO_VERSION) {
+                    i++;
+                    continue;
+                }
+
+                if(mn.nLastDsq != 0 &&
+                    mn.nLastDsq + inodeRegistry.CountAboveProtocol(anonSendPool.MIN_PEER_PROTO_VERSION)/5 > anonSendPool.nDsqCount){
+                    i++;
+                    continue;
+                }
+
+                addrInode = mn.addr;
+                vinInode = mn.vin;
             }
 
             lastTimeChanged = GetTimeMillis();
-            LogPrintf("DoAutomaticDenominating -- attempt %d connection to inode %s\n", i, vecInodes[i].addr.ToString().c_str());
-            if(ConnectNode((CAddress)vecInodes[i].addr, NULL, true)){
-                submittedToInode = vecInodes[i].addr;
+            LogPrintf("DoAutomaticDenominating -- attempt %d connection to inode %s\n", i, addrInode.ToString().c_str());
+            if(ConnectNode((CAddress)addrInode, NULL, true)){
+                submittedToInode = addrInode;
 
                 LOCK(cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
                 {
-                    if((CNetAddr)pnode->addr != (CNetAddr)vecInodes[i].addr) continue;
+                    if((CNetAddr)pnode->addr != (CNetAddr)addrInode) continue;
 
                     std::string strReason;
                     if(txCollateral == CTransaction()){
@@ -1577,7 +1670,7 @@ bool CAnonSendPool::DoAutomaticDenominating(bool fDryRun, bool ready)
                         }
                     }
 
-                    vecInodesUsed.push_back(vecInodes[i].vin);
+                    vecInodesUsed.push_back(vinInode);
 
                     std::vector<int64_t> vecAmounts;
                     pwalletMain->ConvertList(vCoins, vecAmounts);
@@ -2021,20 +2114,20 @@ bool CAnonSendSigner::SignMessage(std::string strMessage, std::string& errorMess
 
 bool CAnonSendSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
 {
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << strMessageMagic;
-    ss << strMessage;
+    bool fRecovered;
+    CKeyID keyIDRecovered;
+    if (messageVerifyQueue.Verify(pubkey, vchSig, strMessage, fRecovered, keyIDRecovered))
+        return true;
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    if (!fRecovered) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CAnonSendSigner::VerifyMessage -- keys don't match: %s %s", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug)
+        LogPrintf("CAnonSendSigner::VerifyMessage -- keys don't match: %s %s", keyIDRecovered.ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    return false;
 }
 
 bool CAnonsendQueue::Sign()
@@ -2080,127 +2173,126 @@ bool CAnonsendQueue::Relay()
 
 bool CAnonsendQueue::CheckSignature()
 {
-    BOOST_FOREACH(CINode& mn, vecInodes) {
-
-        if(mn.vin == vin) {
-            std::string strMessage = vin.ToString() + boost::lexical_cast<std::string>(nDenom) + boost::lexical_cast<std::string>(time) + boost::lexical_cast<std::string>(ready);
+    CPubKey pubkey2;
+    {
+        LOCK(cs_inodes);
+        int nHandle = inodeRegistry.Find(vin);
+        if(nHandle == -1) return false;
+        pubkey2 = inodeRegistry[nHandle].pubkey2;
+    }
 
-            std::string errorMessage = "";
-            if(!anonSendSigner.VerifyMessage(mn.pubkey2, vchSig, strMessage, errorMessage)){
-                return error("CAnonsendQueue::CheckSignature() - Got bad inode address signature %s \n", vin.ToString().c_str());
-            }
+    std::string strMessage = vin.ToString() + boost::lexical_cast<std::string>(nDenom) + boost::lexical_cast<std::string>(time) + boost::lexical_cast<std::string>(ready);
 
-            return true;
-        }
+    std::string errorMessage = "";
+    if(!anonSendSigner.VerifyMessage(pubkey2, vchSig, strMessage, errorMessage)){
+        return error("CAnonsendQueue::CheckSignature() - Got bad inode address signature %s \n", vin.ToString().c_str());
     }
 
-    return false;
+    return true;
 }
 
 
-//TODO: Rename/move to core
-void ThreadCheckAnonSendPool()
+static void CheckInodes()
 {
-    if(fLiteMode) return; //disable all anonsend/inode related functionality
-
-    // Make this thread recognisable as the wallet flushing thread
-    RenameThread("navcoin-anonsend");
-
-    unsigned int c = 0;
-    std::string errorMessage;
-
-    while (true)
+    /*
+        cs_main is required for the collateral lookups because something
+        is modifying the coins view without a mempool lock. Hold it for one
+        lookup at a time instead of across the whole list, and never
+        together with cs_inodes.
+    */
+    std::vector<CTxIn> vCollateral;
     {
-        c++;
+        LOCK(cs_inodes);
+        BOOST_FOREACH(CINode& mn, inodeRegistry)
+            if(mn.NeedsCollateralCheck()) vCollateral.push_back(mn.vin);
+    }
 
-        MilliSleep(2500);
-        //LogPrintf("ThreadCheckAnonSendPool::check timeout\n");
-        anonSendPool.CheckTimeout();
+    std::set<COutPoint> setSpent;
+    BOOST_FOREACH(const CTxIn& vin, vCollateral) {
+        LOCK(cs_main);
+        if(!CINode::IsCollateralUnspent(vin)) setSpent.insert(vin.prevout);
+    }
 
-        if(c % 60 == 0){
-            LOCK(cs_main);
-            /*
-                cs_main is required for doing inode.Check because something
-                is modifying the coins view without a mempool lock. It causes
-                segfaults from this code without the cs_main lock.
-            */
-	    {
-
-	    LOCK(cs_inodes);
-            vector<CINode>::iterator it = vecInodes.begin();
-            //check them separately
-            while(it != vecInodes.end()){
-                (*it).Check();
-                ++it;
-            }
+    //check them all and remove the inactive ones in one pass
+    LOCK(cs_inodes);
+    inodeRegistry.RemoveInactive(setSpent);
 
-            //remove inactive
-            it = vecInodes.begin();
-            while(it != vecInodes.end()){
-                if((*it).enabled == 4 || (*it).enabled == 3){
-                    LogPrintf("Removing inactive inode %s\n", (*it).addr.ToString().c_str());
-                    it = vecInodes.erase(it);
-                } else {
-                    ++it;
-                }
-            }
+    //if we've used 1/5 of the inode list, then clear the list.
+    if((int)vecInodesUsed.size() > (int)inodeRegistry.size() / 5)
+        vecInodesUsed.clear();
+}
 
-	    }
+static void CleanLocks()
+{
+    LOCK(cs_main);
+    CleanTransactionLocksList();
+}
 
-            inodePayments.CleanPaymentList();
-            CleanTransactionLocksList();
-        }
+static void SyncInodeList()
+{
+    //try to sync the inode list and payment list from at least 3 nodes
+    if(RequestedINodeList >= 3 || IsInitialBlockDownload()) return;
 
-        //try to sync the inode list and payment list every 5 seconds from at least 3 nodes
-        if(c % 5 == 0 && RequestedINodeList < 3){
-            bool fIsInitialDownload = IsInitialBlockDownload();
-            if(!fIsInitialDownload) {
-                LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                {
-                    if (pnode->nVersion >= anonSendPool.MIN_PEER_PROTO_VERSION) {
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        if (pnode->nVersion >= anonSendPool.MIN_PEER_PROTO_VERSION) {
 
-                        //keep track of who we've asked for the list
-                        if(pnode->HasFulfilledRequest("mnsync")) continue;
-                        pnode->FulfilledRequest("mnsync");
+            //keep track of who we've asked for the list
+            if(pnode->HasFulfilledRequest("mnsync")) continue;
+            pnode->FulfilledRequest("mnsync");
 
-                        LogPrintf("Successfully synced, asking for Inode list and payment list\n");
+            LogPrintf("Successfully synced, asking for Inode list and payment list\n");
 
-                        pnode->PushMessage("dseg", CTxIn()); //request full mn list
-                        pnode->PushMessage("mnget"); //sync payees
-                        pnode->PushMessage("gethubs"); //get current network sporks
-                        RequestedINodeList++;
-                    }
-                }
-            }
+            pnode->PushMessage("dseg", CTxIn()); //request full mn list
+            pnode->PushMessage("mnget"); //sync payees
+            pnode->PushMessage("gethubs"); //get current network sporks
+            RequestedINodeList++;
         }
+    }
+}
 
-        if(c % INODE_PING_SECONDS == 0){
-            activeInode.ManageStatus();
+static void AutoDenominate()
+{
+    if(nLiquidityProvider!=0){
+        int nRand = rand() % (101+nLiquidityProvider);
+        //about 1/100 chance of starting over after 4 rounds.
+        if(nRand == 50+nLiquidityProvider && pwalletMain->GetAverageAnonymizedRounds() > 8){
+            anonSendPool.SendRandomPaymentToSelf();
+            int nLeftToAnon = ((pwalletMain->GetBalance() - pwalletMain->GetAnonymizedBalance())/COIN)-3;
+            if(nLeftToAnon > 999) nLeftToAnon = 999;
+            nAnonymizeNavCoinAmount = (rand() % nLeftToAnon)+3;
+        } else {
+            anonSendPool.DoAutomaticDenominating();
         }
+    } else {
+        anonSendPool.DoAutomaticDenominating();
+    }
+}
 
-        if(c % 60 == 0){
-            //if we've used 1/5 of the inode list, then clear the list.
-            if((int)vecInodesUsed.size() > (int)vecInodes.size() / 5)
-                vecInodesUsed.clear();
-        }
+static void ManageInodeStatus()
+{
+    activeInode.ManageStatus();
+}
 
-        //auto denom every 1 minutes (liquidity provides try less often)
-        if(c % 60*(nLiquidityProvider+1) == 0){
-            if(nLiquidityProvider!=0){
-                int nRand = rand() % (101+nLiquidityProvider);
-                //about 1/100 chance of starting over after 4 rounds.
-                if(nRand == 50+nLiquidityProvider && pwalletMain->GetAverageAnonymizedRounds() > 8){
-                    anonSendPool.SendRandomPaymentToSelf();
-                    int nLeftToAnon = ((pwalletMain->GetBalance() - pwalletMain->GetAnonymizedBalance())/COIN)-3;
-                    if(nLeftToAnon > 999) nLeftToAnon = 999;
-                    nAnonymizeNavCoinAmount = (rand() % nLeftToAnon)+3;
-                } else {
-                    anonSendPool.DoAutomaticDenominating();
-                }
-            } else {
-                anonSendPool.DoAutomaticDenominating();
-            }
-        }
-    }
+//TODO: Rename/move to core
+void ThreadCheckAnonSendPool()
+{
+    if(fLiteMode) return; //disable all anonsend/inode related functionality
+
+    // Make this thread recognisable as the wallet flushing thread
+    RenameThread("navcoin-anonsend");
+
+    // interval and minimum interval between triggered runs, in milliseconds.
+    // "inode-check", "payment-clean" and "lock-clean" also run on new blocks once the initial download is
+    // done, "denominate" on new inodes.
+    anonSendScheduler.AddTask("pool-timeout", boost::bind(&CAnonSendPool::CheckTimeout, &anonSendPool), 2500);
+    anonSendScheduler.AddTask("inode-check", &CheckInodes, 150 * 1000, 60 * 1000);
+    anonSendScheduler.AddTask("payment-clean", boost::bind(&CInodePayments::CleanPaymentList, &inodePayments), 150 * 1000, 1000);
+    anonSendScheduler.AddTask("lock-clean", &CleanLocks, 150 * 1000, 1000);
+    anonSendScheduler.AddTask("inode-sync", &SyncInodeList, 12500);
+    anonSendScheduler.AddTask("inode-status", &ManageInodeStatus, INODE_PING_SECONDS * 2500);
+    anonSendScheduler.AddTask("denominate", &AutoDenominate, 150 * 1000, 60 * 1000);
+
+    anonSendScheduler.ServiceQueue();
 }
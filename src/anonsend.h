@@ -10,6 +10,7 @@
 #include "main.h"
 #include "inode.h"
 #include "activeinode.h"
+#include "scheduler.h"
 
 class CTxIn;
 class CAnonSendPool;
@@ -19,6 +20,7 @@ class CBitcoinAddress;
 class CAnonsendQueue;
 class CAnonsendBroadcastTx;
 class CActiveInode;
+class CAnonsendRoundsCache;
 
 #define POOL_MAX_TRANSACTIONS                  3 // wait for X transactions to merge and publish
 #define POOL_STATUS_UNKNOWN                    0 // waiting for update
@@ -39,12 +41,17 @@ class CActiveInode;
 #define ANONSEND_QUEUE_TIMEOUT                 120
 #define ANONSEND_SIGNING_TIMEOUT               30
 
+// how far back GetInputAnonsendRounds follows a chain
+#define ANONSEND_MAX_CHAIN_DEPTH               17
+
 extern CAnonSendPool anonSendPool;
 extern CAnonSendSigner anonSendSigner;
 extern std::vector<CAnonsendQueue> vecAnonsendQueue;
 extern std::string strINodePrivKey;
 extern map<uint256, CAnonsendBroadcastTx> mapAnonsendBroadcastTxes;
 extern CActiveInode activeInode;
+extern CAnonsendRoundsCache anonsendRoundsCache;
+extern CScheduler anonSendScheduler;
 
 //specific messages for the Anonsend protocol
 void ProcessMessageAnonsend(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -52,6 +59,35 @@ void ProcessMessageAnonsend(CNode* pfrom, std::string& strCommand, CDataStream&
 // get the anonsend chain depth for a given input
 int GetInputAnonsendRounds(CTxIn in, int rounds=0);
 
+//
+// Results of GetInputAnonsendRounds per wallet outpoint and chain depth. Every entry only
+// depends on the entries one step further down the chain, so after a transaction is added
+// its outputs are computed in one step from their parents. The wallet clears the cache when
+// transactions are removed, on reorganizations and on rescans.
+//
+class CAnonsendRoundsCache
+{
+private:
+    static const int ROUNDS_UNKNOWN = -128;
+
+    struct CEntry
+    {
+        signed char vRounds[ANONSEND_MAX_CHAIN_DEPTH];
+    };
+
+    CCriticalSection cs;
+    std::map<COutPoint, CEntry> mapRounds;
+    // transactions a lookup didn't find in the wallet
+    std::set<uint256> setMissing;
+
+public:
+    bool Get(const COutPoint& outpoint, int rounds, int& nRoundsOut);
+    void Set(const COutPoint& outpoint, int rounds, int nRounds);
+    void NoteMissing(const uint256& hash);
+    void TransactionAdded(const uint256& hash);
+    void Clear();
+};
+
 
 // An input in the anonsend pool
 class CAnonSendEntryVin
@@ -161,24 +197,20 @@ public:
 
     bool GetAddress(CService &addr)
     {
-        BOOST_FOREACH(CINode mn, vecInodes) {
-            if(mn.vin == vin){
-                addr = mn.addr;
-                return true;
-            }
-        }
-        return false;
+        LOCK(cs_inodes);
+        int nHandle = inodeRegistry.Find(vin);
+        if(nHandle == -1) return false;
+        addr = inodeRegistry[nHandle].addr;
+        return true;
     }
 
     bool GetProtocolVersion(int &protocolVersion)
     {
-        BOOST_FOREACH(CINode mn, vecInodes) {
-            if(mn.vin == vin){
-                protocolVersion = mn.protocolVersion;
-                return true;
-            }
-        }
-        return false;
+        LOCK(cs_inodes);
+        int nHandle = inodeRegistry.Find(vin);
+        if(nHandle == -1) return false;
+        protocolVersion = inodeRegistry[nHandle].protocolVersion;
+        return true;
     }
 
     bool Sign();
@@ -0,0 +1,239 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+using namespace std;
+
+static const size_t READ_CHUNK_SIZE = 16 << 20;
+static const size_t MAX_IN_FLIGHT_BLOCKS = 1024;
+static const size_t MAX_IN_FLIGHT_BYTES = 256 << 20;
+static const int64_t STATS_INTERVAL = 30 * 1000000;
+
+CBlockImporter::CBlockImporter(FILE* fileIn)
+{
+    file = fileIn;
+    nQueued = 0;
+    nInFlight = 0;
+    nInFlightBytes = 0;
+    fReadDone = false;
+    nBytesRead = 0;
+    nReadMicros = 0;
+    nDecodeMicros = 0;
+    nConnectMicros = 0;
+}
+
+CBlockImporter::~CBlockImporter()
+{
+    for (map<uint64_t, CDecoded>::iterator it = mapDecoded.begin(); it != mapDecoded.end(); ++it)
+        delete it->second.pblock;
+    if (file)
+        fclose(file);
+}
+
+void CBlockImporter::ThreadRead()
+{
+    RenameThread("navcoin-importread");
+
+    // vBuf[nBegin, nEnd) is the part of the file not cut into blocks yet
+    vector<char> vBuf(READ_CHUNK_SIZE);
+    size_t nBegin = 0, nEnd = 0;
+    bool fEof = false;
+    const unsigned char* pchMessageStart = Params().MessageStart();
+
+    while (true)
+    {
+        boost::this_thread::interruption_point();
+
+        // Refill when fewer bytes are left than the next step needs. A block
+        // that doesn't fit the buffer makes it grow.
+        size_t nNeed = 8;
+        if (nEnd - nBegin >= 8 && memcmp(&vBuf[nBegin], pchMessageStart, MESSAGE_START_SIZE) == 0)
+        {
+            unsigned int nSize = (unsigned char)vBuf[nBegin + 4] | ((unsigned char)vBuf[nBegin + 5] << 8) |
+                                 ((unsigned char)vBuf[nBegin + 6] << 16) | ((unsigned int)(unsigned char)vBuf[nBegin + 7] << 24);
+            if (nSize == 0 || nSize > MAX_BLOCK_SIZE)
+            {
+                nBegin += MESSAGE_START_SIZE;
+                continue;
+            }
+            nNeed = 8 + nSize;
+        }
+        if (nEnd - nBegin < nNeed)
+        {
+            if (fEof)
+                break;
+            memmove(&vBuf[0], &vBuf[nBegin], nEnd - nBegin);
+            nEnd -= nBegin;
+            nBegin = 0;
+            if (vBuf.size() < nNeed)
+                vBuf.resize(nNeed);
+            int64_t nStart = GetTimeMicros();
+            size_t nRead = fread(&vBuf[nEnd], 1, vBuf.size() - nEnd, file);
+            nEnd += nRead;
+            fEof = nRead == 0;
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nBytesRead += nRead;
+            nReadMicros += GetTimeMicros() - nStart;
+            continue;
+        }
+
+        if (nNeed == 8)
+        {
+            // not at a marker, skip to the next possible one
+            const char* pFind = (const char*)memchr(&vBuf[nBegin + 1], pchMessageStart[0], nEnd - nBegin - 1);
+            nBegin = pFind ? pFind - &vBuf[0] : nEnd;
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nInFlight >= MAX_IN_FLIGHT_BLOCKS || nInFlightBytes >= MAX_IN_FLIGHT_BYTES)
+            condSpace.wait(lock);
+        queueJobs.push_back(CJob());
+        CJob& job = queueJobs.back();
+        job.nSeq = nQueued++;
+        job.vData.assign(vBuf.begin() + nBegin + 8, vBuf.begin() + nBegin + nNeed);
+        nBegin += nNeed;
+        nInFlight++;
+        nInFlightBytes += job.vData.size();
+        condJobs.notify_one();
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fReadDone = true;
+    condJobs.notify_all();
+    condDecoded.notify_all();
+}
+
+void CBlockImporter::ThreadDecode()
+{
+    RenameThread("navcoin-importdec");
+
+    while (true)
+    {
+        CJob job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queueJobs.empty() && !fReadDone)
+                condJobs.wait(lock);
+            if (queueJobs.empty())
+                return;
+            job.nSeq = queueJobs.front().nSeq;
+            job.vData.swap(queueJobs.front().vData);
+            queueJobs.pop_front();
+        }
+
+        int64_t nStart = GetTimeMicros();
+        CDecoded decoded;
+        decoded.nBytes = job.vData.size();
+        decoded.pblock = new CBlock();
+        try {
+            CDataStream ssBlock(&job.vData[0], &job.vData[0] + job.vData.size(), SER_DISK, CLIENT_VERSION);
+            ssBlock >> *decoded.pblock;
+            // a block that fails is still connected, ProcessBlock reports why
+            decoded.pblock->PrecheckBlock();
+        }
+        catch (std::exception& e) {
+            delete decoded.pblock;
+            decoded.pblock = NULL;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nDecodeMicros += GetTimeMicros() - nStart;
+        mapDecoded[job.nSeq] = decoded;
+        condDecoded.notify_all();
+    }
+}
+
+void CBlockImporter::LogStats(const char* pszWhen, int64_t nStart, int nLoaded, int nSkipped, int nThreads)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    double dElapsed = std::max((int64_t)1, GetTimeMicros() - nStart) / 1000000.0;
+    LogPrintf("Import %s: %d blocks loaded, %d already known, %.1fMB in %.1fs; "
+              "read %.1fs (%.1fMB/s), decode and precheck %.1fs on %d threads, connect %.1fs (%.1f blocks/s)\n",
+              pszWhen, nLoaded, nSkipped, nBytesRead / 1000000.0, dElapsed,
+              nReadMicros / 1000000.0, nBytesRead / dElapsed / 1000000.0,
+              nDecodeMicros / 1000000.0, nThreads,
+              nConnectMicros / 1000000.0, nLoaded / dElapsed);
+}
+
+int CBlockImporter::Run()
+{
+    int64_t nStart = GetTimeMicros();
+    int64_t nLastStats = nStart;
+    int nLoaded = 0, nSkipped = 0;
+    int nThreads = std::max(1, std::min(8, (int)boost::thread::hardware_concurrency() - 1));
+
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&CBlockImporter::ThreadRead, this));
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CBlockImporter::ThreadDecode, this));
+
+    try {
+        for (uint64_t nNext = 0; ; nNext++)
+        {
+            CDecoded decoded;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!mapDecoded.count(nNext) && !(fReadDone && nNext == nQueued))
+                    condDecoded.wait(lock);
+                if (!mapDecoded.count(nNext))
+                    break;
+                decoded = mapDecoded[nNext];
+                mapDecoded.erase(nNext);
+                nInFlight--;
+                nInFlightBytes -= decoded.nBytes;
+                condSpace.notify_one();
+            }
+            if (decoded.pblock == NULL)
+                continue;
+
+            // Re-importing a file the node already has is mostly this check
+            boost::scoped_ptr<CBlock> pblock(decoded.pblock);
+            if (LookupBlockIndex(pblock->GetHash()))
+            {
+                nSkipped++;
+                continue;
+            }
+
+            int64_t nConnectStart = GetTimeMicros();
+            {
+                LOCK(cs_main);
+                if (ProcessBlock(NULL, pblock.get()))
+                    nLoaded++;
+            }
+            int64_t nNow = GetTimeMicros();
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                nConnectMicros += nNow - nConnectStart;
+            }
+
+            if (nNow - nLastStats > STATS_INTERVAL)
+            {
+                LogStats("progress", nStart, nLoaded, nSkipped, nThreads);
+                nLastStats = nNow;
+            }
+        }
+    }
+    catch (boost::thread_interrupted) {
+        threads.interrupt_all();
+        threads.join_all();
+        throw;
+    }
+    catch (std::exception& e) {
+        LogPrintf("%s() : error caught during import: %s\n", __PRETTY_FUNCTION__, e.what());
+        threads.interrupt_all();
+    }
+    threads.join_all();
+
+    LogStats("done", nStart, nLoaded, nSkipped, nThreads);
+    return nLoaded;
+}
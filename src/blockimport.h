@@ -0,0 +1,78 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+class CBlock;
+
+/**
+ * Imports a block file (-loadblock, bootstrap.dat) in three stages:
+ *
+ * - a reader thread reads the file in large chunks and cuts it into blocks
+ *   at the message start markers,
+ * - decoder threads deserialize the blocks and run CBlock::PrecheckBlock,
+ *   which hashes the header and checks proof of work, the block signature
+ *   and the merkle root,
+ * - the thread calling Run() connects the blocks in file order with
+ *   ProcessBlock, which then skips the checks that were already done.
+ *
+ * The number of blocks between the reader and the connect stage is bounded,
+ * so a fast disk doesn't fill memory while validation catches up.
+ */
+class CBlockImporter
+{
+private:
+    struct CJob
+    {
+        uint64_t nSeq;
+        std::vector<char> vData;
+    };
+
+    struct CDecoded
+    {
+        CBlock* pblock; // NULL if it didn't deserialize
+        size_t nBytes;
+    };
+
+    FILE* file;
+
+    boost::mutex mutex;
+    boost::condition_variable condJobs;    // reader -> decoders
+    boost::condition_variable condDecoded; // decoders -> connect stage
+    boost::condition_variable condSpace;   // connect stage -> reader
+    std::deque<CJob> queueJobs;
+    std::map<uint64_t, CDecoded> mapDecoded;
+    uint64_t nQueued;        // blocks handed out by the reader
+    size_t nInFlight;        // blocks read but not connected yet
+    size_t nInFlightBytes;
+    bool fReadDone;
+
+    // statistics
+    uint64_t nBytesRead;
+    int64_t nReadMicros;
+    int64_t nDecodeMicros;   // summed over all decoders
+    int64_t nConnectMicros;
+
+    void ThreadRead();
+    void ThreadDecode();
+    void LogStats(const char* pszWhen, int64_t nStart, int nLoaded, int nSkipped, int nThreads);
+
+public:
+    explicit CBlockImporter(FILE* fileIn);
+    ~CBlockImporter();
+
+    /** Import the whole file, returns the number of blocks that were accepted */
+    int Run();
+};
+
+#endif
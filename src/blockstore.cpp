@@ -0,0 +1,468 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "lz4/lz4.h"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+bool fCompressBlocks = false;
+
+namespace {
+
+// Set once by InitBlockStore, without compressed files no read takes cs_blockstore
+bool fHaveCompressedFiles = false;
+
+struct CCompressedBlock
+{
+    unsigned int nBlockPos; // where the block would start in a raw file
+    unsigned int nSize;     // serialized size
+    unsigned int nFramePos; // offset of its frame in the .lz4 file
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nBlockPos);
+        READWRITE(nSize);
+        READWRITE(nFramePos);
+    )
+};
+static const unsigned int INDEX_RECORD_SIZE = 12;
+
+struct CompareBlockPos
+{
+    bool operator()(unsigned int nPos, const CCompressedBlock& entry) const { return nPos < entry.nBlockPos; }
+    bool operator()(const CCompressedBlock& entry, unsigned int nPos) const { return entry.nBlockPos < nPos; }
+};
+
+CCriticalSection cs_blockstore;
+map<unsigned int, vector<CCompressedBlock> > mapFiles; // index of every compressed file seen so far
+set<unsigned int> setRawFiles;                         // file numbers known not to be compressed
+unsigned int nCurrentFile = 1;
+
+// The last block decompressed, inputs are often read from the same block one after another
+unsigned int nCachedFile = 0;
+unsigned int nCachedBlockPos = 0;
+BlockDataPtr pCachedData;
+
+boost::filesystem::path RawPath(unsigned int nFile)
+{
+    return GetDataDir() / strprintf("blk%04u.dat", nFile);
+}
+
+boost::filesystem::path DataPath(unsigned int nFile)
+{
+    return GetDataDir() / strprintf("blk%04u.lz4", nFile);
+}
+
+boost::filesystem::path IndexPath(unsigned int nFile)
+{
+    return GetDataDir() / strprintf("blk%04u.idx", nFile);
+}
+
+bool LoadIndex(unsigned int nFile, vector<CCompressedBlock>& vEntries)
+{
+    boost::filesystem::path path = IndexPath(nFile);
+    boost::system::error_code ec;
+    uintmax_t nFileSize = boost::filesystem::file_size(path, ec);
+    if (ec)
+        return error("LoadIndex() : can't read %s", path.string());
+
+    // A record cut short by a crash is dropped, nothing refers to its block yet
+    // and the next record has to start at a multiple of the record size.
+    size_t nRecords = nFileSize / INDEX_RECORD_SIZE;
+    if (nFileSize % INDEX_RECORD_SIZE != 0)
+        boost::filesystem::resize_file(path, nRecords * INDEX_RECORD_SIZE, ec);
+
+    CAutoFile filein = CAutoFile(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("LoadIndex() : can't open %s", path.string());
+    vEntries.resize(nRecords);
+    try {
+        for (size_t i = 0; i < nRecords; i++)
+            filein >> vEntries[i];
+    }
+    catch (std::exception& e) {
+        vEntries.clear();
+        return error("LoadIndex() : deserialize or I/O error in %s", path.string());
+    }
+    return true;
+}
+
+// The index of nFile, NULL if it's a raw file. cs_blockstore must be held.
+vector<CCompressedBlock>* GetIndex(unsigned int nFile)
+{
+    map<unsigned int, vector<CCompressedBlock> >::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end())
+        return &it->second;
+    if (setRawFiles.count(nFile))
+        return NULL;
+    if (!boost::filesystem::exists(DataPath(nFile)))
+    {
+        setRawFiles.insert(nFile);
+        return NULL;
+    }
+
+    // without an index (a crash right after the first frame) the file reads as empty
+    vector<CCompressedBlock>& vEntries = mapFiles[nFile];
+    LoadIndex(nFile, vEntries);
+    return &vEntries;
+}
+
+bool AppendFrame(FILE* file, const char* pData, unsigned int nSize, unsigned int& nFramePosRet)
+{
+    vector<char> vCompressed(LZ4_compressBound(nSize));
+    int nCompressedSize = LZ4_compress(pData, &vCompressed[0], nSize);
+    if (nCompressedSize <= 0)
+        return error("AppendFrame() : LZ4_compress failed");
+
+    long nPos = ftell(file);
+    if (nPos < 0)
+        return error("AppendFrame() : ftell failed");
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << nSize << (unsigned int)nCompressedSize;
+    if (fwrite(&ssHeader[0], 1, ssHeader.size(), file) != ssHeader.size() ||
+        fwrite(&vCompressed[0], 1, nCompressedSize, file) != (size_t)nCompressedSize)
+        return error("AppendFrame() : fwrite failed");
+
+    nFramePosRet = nPos;
+    return true;
+}
+
+bool AppendIndexRecord(FILE* file, const CCompressedBlock& entry)
+{
+    CDataStream ssEntry(SER_DISK, CLIENT_VERSION);
+    ssEntry << entry;
+    if (fwrite(&ssEntry[0], 1, ssEntry.size(), file) != ssEntry.size())
+        return error("AppendIndexRecord() : fwrite failed");
+    return true;
+}
+
+bool ReadFrame(unsigned int nFile, const CCompressedBlock& entry, vector<char>& vDataRet)
+{
+    CAutoFile filein = CAutoFile(fopen(DataPath(nFile).string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("ReadFrame() : can't open blk%04u.lz4", nFile);
+    if (fseek(filein, entry.nFramePos, SEEK_SET) != 0)
+        return error("ReadFrame() : fseek failed");
+
+    vector<char> vCompressed;
+    try {
+        unsigned int nSize, nCompressedSize;
+        filein >> nSize >> nCompressedSize;
+        if (nSize != entry.nSize || nCompressedSize == 0 || nCompressedSize > (unsigned int)LZ4_compressBound(nSize))
+            return error("ReadFrame() : bad frame at %u in blk%04u.lz4", entry.nFramePos, nFile);
+        vCompressed.resize(nCompressedSize);
+        filein.read(&vCompressed[0], nCompressedSize);
+    }
+    catch (std::exception& e) {
+        return error("ReadFrame() : deserialize or I/O error");
+    }
+
+    vDataRet.resize(entry.nSize);
+    if (LZ4_decompress_safe(&vCompressed[0], &vDataRet[0], vCompressed.size(), entry.nSize) != (int)entry.nSize)
+        return error("ReadFrame() : corrupt frame at %u in blk%04u.lz4", entry.nFramePos, nFile);
+    return true;
+}
+
+// The block starting at nPos, or if fExact is false the one containing it
+bool ReadBlockAt(unsigned int nFile, unsigned int nPos, bool fExact, BlockDataPtr& pDataRet, unsigned int& nBlockPosRet)
+{
+    CCompressedBlock entry;
+    {
+        LOCK(cs_blockstore);
+        vector<CCompressedBlock>* pvEntries = GetIndex(nFile);
+        if (pvEntries == NULL)
+            return error("ReadBlockAt() : blk%04u is not compressed", nFile);
+        vector<CCompressedBlock>::const_iterator it = upper_bound(pvEntries->begin(), pvEntries->end(), nPos, CompareBlockPos());
+        if (it == pvEntries->begin())
+            return error("ReadBlockAt() : no block at %u in blk%04u.lz4", nPos, nFile);
+        --it;
+        if (fExact ? it->nBlockPos != nPos : nPos >= it->nBlockPos + it->nSize)
+            return error("ReadBlockAt() : no block at %u in blk%04u.lz4", nPos, nFile);
+        entry = *it;
+        nBlockPosRet = entry.nBlockPos;
+
+        if (pCachedData && nCachedFile == nFile && nCachedBlockPos == entry.nBlockPos)
+        {
+            pDataRet = pCachedData;
+            return true;
+        }
+    }
+
+    // the disk read and decompression don't need the lock
+    boost::shared_ptr<vector<char> > pData(new vector<char>());
+    if (!ReadFrame(nFile, entry, *pData))
+        return false;
+    pDataRet = pData;
+
+    LOCK(cs_blockstore);
+    nCachedFile = nFile;
+    nCachedBlockPos = entry.nBlockPos;
+    pCachedData = pDataRet;
+    return true;
+}
+
+// True if every position in vBlockPos has its block in the compressed index of nFile
+bool HasBlocks(unsigned int nFile, const vector<unsigned int>& vBlockPos)
+{
+    LOCK(cs_blockstore);
+    vector<CCompressedBlock>* pvEntries = GetIndex(nFile);
+    if (pvEntries == NULL)
+        return false;
+    BOOST_FOREACH(unsigned int nBlockPos, vBlockPos)
+    {
+        vector<CCompressedBlock>::const_iterator it = lower_bound(pvEntries->begin(), pvEntries->end(), nBlockPos, CompareBlockPos());
+        if (it == pvEntries->end() || it->nBlockPos != nBlockPos)
+            return false;
+    }
+    return true;
+}
+
+// Copy the blocks at vBlockPos (sorted) into a compressed file. Bytes of the
+// raw file that no block index entry points at are dropped with it.
+bool ConvertBlockFile(unsigned int nFile, const vector<unsigned int>& vBlockPos, uint64_t& nRawSizeRet, uint64_t& nCompressedSizeRet)
+{
+    boost::filesystem::path pathRaw = RawPath(nFile);
+    boost::filesystem::path pathDataTmp = GetDataDir() / strprintf("blk%04u.lz4.new", nFile);
+    boost::filesystem::path pathIndexTmp = GetDataDir() / strprintf("blk%04u.idx.new", nFile);
+
+    FILE* filein = fopen(pathRaw.string().c_str(), "rb");
+    if (!filein)
+        return error("ConvertBlockFile() : can't open %s", pathRaw.string());
+    FILE* fileData = fopen(pathDataTmp.string().c_str(), "wb");
+    FILE* fileIndex = fopen(pathIndexTmp.string().c_str(), "wb");
+    bool fOk = fileData && fileIndex;
+
+    // Every block written by WriteToDisk is preceded by the message start and
+    // its size. A block the index knows about that can't be read fails the
+    // whole file, the raw file is then kept as it is.
+    unsigned char header[8];
+    vector<char> vBlock;
+    BOOST_FOREACH(unsigned int nBlockPos, vBlockPos)
+    {
+        if (!fOk)
+            break;
+        if (nBlockPos < sizeof(header) || fseek(filein, nBlockPos - sizeof(header), SEEK_SET) != 0 ||
+            fread(header, 1, sizeof(header), filein) != sizeof(header))
+        {
+            fOk = error("ConvertBlockFile() : can't read the block at %u in %s", nBlockPos, pathRaw.string());
+            break;
+        }
+        unsigned int nSize = header[4] | (header[5] << 8) | (header[6] << 16) | ((unsigned int)header[7] << 24);
+        if (memcmp(header, Params().MessageStart(), MESSAGE_START_SIZE) != 0 || nSize == 0 || nSize > MAX_BLOCK_SIZE)
+        {
+            fOk = error("ConvertBlockFile() : no block header at %u in %s", nBlockPos, pathRaw.string());
+            break;
+        }
+        vBlock.resize(nSize);
+        if (fread(&vBlock[0], 1, nSize, filein) != nSize)
+        {
+            fOk = error("ConvertBlockFile() : block at %u in %s is cut short", nBlockPos, pathRaw.string());
+            break;
+        }
+
+        CCompressedBlock entry;
+        entry.nBlockPos = nBlockPos;
+        entry.nSize = nSize;
+        fOk = AppendFrame(fileData, &vBlock[0], nSize, entry.nFramePos) && AppendIndexRecord(fileIndex, entry);
+    }
+    boost::system::error_code ec;
+    nRawSizeRet = boost::filesystem::file_size(pathRaw, ec);
+
+    if (fOk)
+    {
+        fflush(fileData);
+        fflush(fileIndex);
+        FileCommit(fileData);
+        FileCommit(fileIndex);
+        nCompressedSizeRet = ftell(fileData) + ftell(fileIndex);
+    }
+    fclose(filein);
+    if (fileData)
+        fclose(fileData);
+    if (fileIndex)
+        fclose(fileIndex);
+
+    // The .lz4 file marks a file number as compressed, so it is renamed last
+    if (!fOk || !RenameOver(pathIndexTmp, IndexPath(nFile)) || !RenameOver(pathDataTmp, DataPath(nFile)))
+    {
+        boost::filesystem::remove(pathDataTmp, ec);
+        boost::filesystem::remove(pathIndexTmp, ec);
+        return error("ConvertBlockFile() : failed to compress %s", pathRaw.string());
+    }
+
+    {
+        LOCK(cs_blockstore);
+        setRawFiles.erase(nFile);
+        mapFiles.erase(nFile);
+    }
+
+    // the raw file goes only once the compressed one is known to hold every block
+    if (!HasBlocks(nFile, vBlockPos))
+        return error("ConvertBlockFile() : blk%04u.lz4 is missing blocks, keeping %s", nFile, pathRaw.string());
+    boost::filesystem::remove(pathRaw);
+    return true;
+}
+
+}
+
+void InitBlockStore()
+{
+    // with -compressblocks new blocks go to compressed files, so reads always check
+    fHaveCompressedFiles = fCompressBlocks;
+    for (unsigned int nFile = 1; !fHaveCompressedFiles; nFile++)
+    {
+        if (boost::filesystem::exists(DataPath(nFile)))
+            fHaveCompressedFiles = true;
+        else if (!boost::filesystem::exists(RawPath(nFile)))
+            break;
+    }
+}
+
+bool IsCompressedBlockFile(unsigned int nFile)
+{
+    if (!fHaveCompressedFiles)
+        return false;
+
+    LOCK(cs_blockstore);
+    return GetIndex(nFile) != NULL;
+}
+
+bool WriteCompressedBlock(const char* pData, size_t nSize, bool fCommit, unsigned int& nFileRet, unsigned int& nBlockPosRet)
+{
+    LOCK(cs_blockstore);
+
+    // Find a file with room, skipping the numbers taken by raw files
+    vector<CCompressedBlock>* pvEntries;
+    unsigned int nEnd;
+    while (true)
+    {
+        pvEntries = GetIndex(nCurrentFile);
+        if (pvEntries == NULL)
+        {
+            if (boost::filesystem::exists(RawPath(nCurrentFile)))
+            {
+                nCurrentFile++;
+                continue;
+            }
+            setRawFiles.erase(nCurrentFile);
+            pvEntries = &mapFiles[nCurrentFile];
+        }
+        nEnd = pvEntries->empty() ? 0 : pvEntries->back().nBlockPos + pvEntries->back().nSize;
+        // positions have to fit a raw file, same limit as AppendBlockFile
+        if (nEnd < (unsigned int)(0x7F000000 - MAX_SIZE))
+            break;
+        nCurrentFile++;
+    }
+
+    CCompressedBlock entry;
+    entry.nBlockPos = nEnd + MESSAGE_START_SIZE + sizeof(unsigned int); // where a raw file would put it
+    entry.nSize = nSize;
+
+    FILE* fileData = fopen(DataPath(nCurrentFile).string().c_str(), "ab");
+    if (!fileData)
+        return error("WriteCompressedBlock() : can't open blk%04u.lz4", nCurrentFile);
+    bool fOk = fseek(fileData, 0, SEEK_END) == 0 && AppendFrame(fileData, pData, nSize, entry.nFramePos);
+    fflush(fileData);
+    if (fOk && fCommit)
+        FileCommit(fileData);
+    fclose(fileData);
+    if (!fOk)
+        return error("WriteCompressedBlock() : writing blk%04u.lz4 failed", nCurrentFile);
+
+    // the frame goes first, an index record never points past the end of the data
+    FILE* fileIndex = fopen(IndexPath(nCurrentFile).string().c_str(), "ab");
+    if (!fileIndex)
+        return error("WriteCompressedBlock() : can't open blk%04u.idx", nCurrentFile);
+    fOk = AppendIndexRecord(fileIndex, entry);
+    fflush(fileIndex);
+    if (fOk && fCommit)
+        FileCommit(fileIndex);
+    fclose(fileIndex);
+    if (!fOk)
+        return error("WriteCompressedBlock() : writing blk%04u.idx failed", nCurrentFile);
+
+    pvEntries->push_back(entry);
+    nFileRet = nCurrentFile;
+    nBlockPosRet = entry.nBlockPos;
+    return true;
+}
+
+bool ReadCompressedBlock(unsigned int nFile, unsigned int nBlockPos, BlockDataPtr& pDataRet)
+{
+    unsigned int nFound;
+    return ReadBlockAt(nFile, nBlockPos, true, pDataRet, nFound);
+}
+
+bool ReadCompressedTx(unsigned int nFile, unsigned int nTxPos, BlockDataPtr& pDataRet, unsigned int& nOffsetRet)
+{
+    unsigned int nBlockPos;
+    if (!ReadBlockAt(nFile, nTxPos, false, pDataRet, nBlockPos))
+        return false;
+    nOffsetRet = nTxPos - nBlockPos;
+    return true;
+}
+
+bool CompressBlockFiles()
+{
+    int64_t nStart = GetTimeMillis();
+    uint64_t nRawTotal = 0, nCompressedTotal = 0;
+    int nConverted = 0;
+
+    // the block index is the list of blocks that have to survive the conversion
+    map<unsigned int, vector<unsigned int> > mapBlockPos;
+    {
+        LOCK_SHARED(cs_blockindex);
+        for (BlockMap::const_iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+            mapBlockPos[mi->second->nFile].push_back(mi->second->nBlockPos);
+    }
+    for (map<unsigned int, vector<unsigned int> >::iterator it = mapBlockPos.begin(); it != mapBlockPos.end(); ++it)
+    {
+        sort(it->second.begin(), it->second.end());
+        it->second.erase(unique(it->second.begin(), it->second.end()), it->second.end());
+    }
+
+    for (unsigned int nFile = 1; ; nFile++)
+    {
+        const vector<unsigned int>& vBlockPos = mapBlockPos[nFile];
+        bool fRaw = boost::filesystem::exists(RawPath(nFile));
+        if (IsCompressedBlockFile(nFile))
+        {
+            if (!fRaw)
+                continue;
+            // A conversion that stopped after the rename leaves the raw file
+            // behind. It goes once the compressed file is known to hold every
+            // block, otherwise the file is converted again from the raw one.
+            if (HasBlocks(nFile, vBlockPos))
+            {
+                boost::filesystem::remove(RawPath(nFile));
+                continue;
+            }
+        }
+        else if (!fRaw)
+            break;
+
+        uiInterface.InitMessage(strprintf(_("Compressing block file %u..."), nFile));
+        uint64_t nRawSize = 0, nCompressedSize = 0;
+        if (!ConvertBlockFile(nFile, vBlockPos, nRawSize, nCompressedSize))
+            return false;
+        LogPrintf("CompressBlockFiles() : blk%04u.dat %uKiB -> %uKiB\n", nFile, nRawSize / 1024, nCompressedSize / 1024);
+        nRawTotal += nRawSize;
+        nCompressedTotal += nCompressedSize;
+        nConverted++;
+    }
+
+    if (nConverted > 0)
+        LogPrintf("CompressBlockFiles() : compressed %d files, %uMiB -> %uMiB in %dms\n",
+          nConverted, nRawTotal >> 20, nCompressedTotal >> 20, GetTimeMillis() - nStart);
+    return true;
+}
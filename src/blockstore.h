@@ -0,0 +1,55 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTORE_H
+#define BITCOIN_BLOCKSTORE_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+/**
+ * LZ4 compressed block files (-compressblocks).
+ *
+ * A compressed block file is a pair blkNNNN.lz4 / blkNNNN.idx. The .lz4 file
+ * holds one LZ4 frame per block, the .idx file one fixed-size record per block
+ * with its position and size in the uncompressed file and the offset of its
+ * frame. Positions stay those of a raw blkNNNN.dat, so CDiskTxPos and the
+ * block index don't change when a file is compressed; a transaction is read
+ * by decompressing its block and skipping to nTxPos.
+ *
+ * A file number is either raw or compressed. Compressed files are always
+ * readable, -compressblocks only decides how new blocks are written and makes
+ * CompressBlockFiles convert the raw files once the block index is loaded.
+ */
+
+extern bool fCompressBlocks;
+
+/** A decompressed block, shared with the read cache so a hit doesn't copy it */
+typedef boost::shared_ptr<const std::vector<char> > BlockDataPtr;
+
+/** Look for compressed block files, call before the first block is read */
+void InitBlockStore();
+
+/** True if block file nFile is stored compressed */
+bool IsCompressedBlockFile(unsigned int nFile);
+
+/** Append a serialized block to the current compressed file and return where it went */
+bool WriteCompressedBlock(const char* pData, size_t nSize, bool fCommit, unsigned int& nFileRet, unsigned int& nBlockPosRet);
+
+/** The serialized block at nBlockPos */
+bool ReadCompressedBlock(unsigned int nFile, unsigned int nBlockPos, BlockDataPtr& pDataRet);
+
+/** The serialized block containing nTxPos, nOffsetRet is where the transaction starts in it */
+bool ReadCompressedTx(unsigned int nFile, unsigned int nTxPos, BlockDataPtr& pDataRet, unsigned int& nOffsetRet);
+
+/**
+ * Convert every raw block file, positions are kept so the block index stays
+ * valid. Only the blocks in mapBlockIndex are copied, so it has to run after
+ * the block index is loaded and before anything else reads blocks.
+ */
+bool CompressBlockFiles();
+
+#endif
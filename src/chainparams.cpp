@@ -55,7 +55,7 @@ public:
         vAlertPubKey = ParseHex("0486bce1bac0d543f104cbff2bd23680056a3b9ea05e1137d2ff90eeb5e08472eb500322593a2cb06fbf8297d7beb6cd30cb90f98153b5b7cce1493749e41e0284");
         nDefaultPort = 44440;
         nRPCPort = 44444;
-        bnProofOfWorkLimit = CBigNum(~uint256(0) >> 16);
+        bnProofOfWorkLimit = ~uint256(0) >> 16;
 
         // Build the genesis block. Note that the output of the genesis coinbase cannot
         // be spent as it did not originally exist in the database.
@@ -84,7 +84,7 @@ public:
 
 		hashGenesisBlock = genesis.GetHash();
 		//// debug print
-/*        while (hashGenesisBlock > bnProofOfWorkLimit.getuint256()){
+/*        while (hashGenesisBlock > bnProofOfWorkLimit){
         if (++genesis.nNonce==0) break;
         hashGenesisBlock = genesis.GetHash();
         }
@@ -138,7 +138,7 @@ public:
         pchMessageStart[1] = 0x50;
         pchMessageStart[2] = 0x34;
         pchMessageStart[3] = 0x20;
-        bnProofOfWorkLimit = CBigNum(~uint256(0) >> 16);
+        bnProofOfWorkLimit = ~uint256(0) >> 16;
         vAlertPubKey = ParseHex("0471dc165db490094d35cde15b1f5d755fa6ad6f2b5ed0f340e3f17f57389c3c2af113a8cbcc885bde73305a553b5640c83021128008ddf882e856336269080496");
         nDefaultPort = 33440;
         nRPCPort = 33444;
@@ -149,7 +149,7 @@ public:
         genesis.nNonce = 6945;
 
 /*
-        while (hashGenesisBlock > bnProofOfWorkLimit.getuint256()){
+        while (hashGenesisBlock > bnProofOfWorkLimit){
             if (++genesis.nNonce==0) break;
             hashGenesisBlock = genesis.GetHash();
         }
@@ -0,0 +1,238 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainquery.h"
+
+#include "txview.h"
+#include "util.h"
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+CChainQuery chainQuery;
+
+int64_t CTxSummary::GetValueIn() const
+{
+    int64_t nValueIn = 0;
+    BOOST_FOREACH(const CTxOut& txout, vSpent)
+        nValueIn += txout.nValue;
+    return nValueIn;
+}
+
+CChainQuery::CChainQuery() : fStarted(false), nMaxSummaries(10000), nInvalidations(0)
+{
+}
+
+// height of pindex if it is in the best chain, -1 if not
+static int GetBestChainHeight(const CBlockIndex* pindex)
+{
+    LOCK_SHARED(cs_blockindex);
+    return chainActive.Contains(pindex) ? pindex->nHeight : -1;
+}
+
+bool CChainQuery::GetBlockHash(int nHeight, uint256& hashRet)
+{
+    CBlockIndex* pindex = FindBlockByHeight(nHeight);
+    if (!pindex)
+        return false;
+    hashRet = pindex->GetBlockHash();
+    return true;
+}
+
+bool CChainQuery::GetBlockSummary(const CBlockIndex* pindex, CBlockSummary& summaryRet)
+{
+    uint64_t nInvalidationsStart;
+    {
+        LOCK(cs_cache);
+        map<const CBlockIndex*, CBlockSummary>::const_iterator it = mapSummaries.find(pindex);
+        if (it != mapSummaries.end())
+        {
+            summaryRet = it->second;
+            return true;
+        }
+        nInvalidationsStart = nInvalidations;
+    }
+
+    // The position of a stored block doesn't change, so it can be read
+    // without cs_main
+    CBlock block;
+    if (!block.ReadFromDisk(pindex, true))
+        return false;
+
+    CBlockSummary summary;
+    summary.hash = pindex->GetBlockHash();
+    summary.nHeight = pindex->nHeight;
+    summary.nVersion = pindex->nVersion;
+    summary.hashMerkleRoot = pindex->hashMerkleRoot;
+    summary.nTime = pindex->GetBlockTime();
+    summary.nBits = pindex->nBits;
+    summary.nNonce = pindex->nNonce;
+    summary.fProofOfStake = pindex->IsProofOfStake();
+    summary.nMint = pindex->nMint;
+    summary.nMoneySupply = pindex->nMoneySupply;
+    summary.nTx = block.vtx.size();
+    summary.nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+
+    {
+        LOCK(cs_cache);
+        if (nInvalidations == nInvalidationsStart && mapSummaries.insert(make_pair(pindex, summary)).second)
+        {
+            vSummaryOrder.push_back(pindex);
+            while (vSummaryOrder.size() > nMaxSummaries)
+            {
+                mapSummaries.erase(vSummaryOrder.front());
+                vSummaryOrder.pop_front();
+            }
+        }
+    }
+
+    summaryRet = summary;
+    return true;
+}
+
+void CChainQuery::Invalidate(const CBlockIndex* pindex)
+{
+    LOCK(cs_cache);
+    nInvalidations++;
+    if (mapSummaries.erase(pindex))
+        vSummaryOrder.erase(find(vSummaryOrder.begin(), vSummaryOrder.end(), pindex));
+}
+
+bool CChainQuery::GetBlockSummary(int nHeight, CBlockSummary& summaryRet)
+{
+    CBlockIndex* pindex = FindBlockByHeight(nHeight);
+    if (!pindex)
+        return false;
+    return GetBlockSummary(pindex, summaryRet);
+}
+
+bool CChainQuery::GetTransactionBlock(const uint256& hashTx, uint256& hashBlockRet, int& nHeightRet)
+{
+    // only the header of the block is needed, the transaction isn't deserialized
+    CDiskTxBytes txbytes;
+    if (!GetTransactionBytes(hashTx, txbytes))
+        return false;
+    hashBlockRet = txbytes.GetHeader().GetHash();
+
+    CBlockIndex* pindex = LookupBlockIndex(hashBlockRet);
+    nHeightRet = pindex ? GetBestChainHeight(pindex) : -1;
+    return true;
+}
+
+bool CChainQuery::GetTxSummary(const uint256& hash, CTxSummary& summaryRet)
+{
+    CTxSummary summary;
+    if (!GetTransaction(hash, summary.tx, summary.hashBlock))
+        return false;
+
+    if (summary.hashBlock != 0)
+    {
+        CBlockIndex* pindex = LookupBlockIndex(summary.hashBlock);
+        if (pindex)
+            summary.nHeight = GetBestChainHeight(pindex);
+    }
+
+    summary.fSpentKnown = true;
+    if (!summary.tx.IsCoinBase())
+    {
+        // inputs often spend several outputs of the same transaction
+        map<uint256, CTransaction> mapPrev;
+        BOOST_FOREACH(const CTxIn& txin, summary.tx.vin)
+        {
+            map<uint256, CTransaction>::iterator mi = mapPrev.find(txin.prevout.hash);
+            if (mi == mapPrev.end())
+            {
+                CTransaction txPrev;
+                uint256 hashBlockPrev = 0;
+                if (!GetTransaction(txin.prevout.hash, txPrev, hashBlockPrev))
+                {
+                    summary.fSpentKnown = false;
+                    break;
+                }
+                mi = mapPrev.insert(make_pair(txin.prevout.hash, txPrev)).first;
+            }
+            if (txin.prevout.n >= mi->second.vout.size())
+            {
+                summary.fSpentKnown = false;
+                break;
+            }
+            summary.vSpent.push_back(mi->second.vout[txin.prevout.n]);
+        }
+        if (!summary.fSpentKnown)
+            summary.vSpent.clear();
+    }
+
+    summaryRet = summary;
+    return true;
+}
+
+void CChainQuery::RunBlockQuery(int nHeight, const block_callback_type& callback)
+{
+    CBlockSummary summary;
+    bool fFound = GetBlockSummary(nHeight, summary);
+    callback(fFound, summary);
+}
+
+void CChainQuery::RunTxQuery(const uint256& hash, const tx_callback_type& callback)
+{
+    CTxSummary summary;
+    bool fFound = GetTxSummary(hash, summary);
+    callback(fFound, summary);
+}
+
+void CChainQuery::Post(const boost::function<void ()>& job)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fStarted)
+        {
+            queue.push_back(job);
+            condWork.notify_one();
+            return;
+        }
+    }
+
+    // no worker thread
+    job();
+}
+
+void CChainQuery::QueryBlock(int nHeight, const block_callback_type& callback)
+{
+    Post(boost::bind(&CChainQuery::RunBlockQuery, this, nHeight, callback));
+}
+
+void CChainQuery::QueryTransaction(const uint256& hash, const tx_callback_type& callback)
+{
+    Post(boost::bind(&CChainQuery::RunTxQuery, this, hash, callback));
+}
+
+void CChainQuery::ThreadQuery()
+{
+    RenameThread("navcoin-chainquery");
+
+    while (true)
+    {
+        boost::function<void ()> job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                condWork.wait(lock);
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        job();
+    }
+}
+
+void CChainQuery::Start(boost::thread_group& threadGroup)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStarted = true;
+    }
+
+    threadGroup.create_thread(boost::bind(&CChainQuery::ThreadQuery, this));
+}
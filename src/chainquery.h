@@ -0,0 +1,116 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAINQUERY_H
+#define BITCOIN_CHAINQUERY_H
+
+#include "main.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/** What the block browser and getblocksummary show of a block of the best chain */
+struct CBlockSummary
+{
+    uint256 hash;
+    int nHeight;
+    int nVersion;
+    uint256 hashMerkleRoot;
+    int64_t nTime;
+    unsigned int nBits;
+    unsigned int nNonce;
+    bool fProofOfStake;
+    int64_t nMint;
+    int64_t nMoneySupply;
+
+    // from the block on disk
+    unsigned int nTx;
+    unsigned int nSize;
+
+    CBlockSummary() : nHeight(-1), nVersion(0), nTime(0), nBits(0), nNonce(0), fProofOfStake(false), nMint(0), nMoneySupply(0), nTx(0), nSize(0) {}
+};
+
+/** A transaction with the outputs its inputs spend */
+struct CTxSummary
+{
+    CTransaction tx;
+    uint256 hashBlock;          // 0 for a memory pool transaction
+    int nHeight;                // -1 if not in the best chain
+    std::vector<CTxOut> vSpent; // the output each input spends, empty for a coinbase
+    bool fSpentKnown;           // false if a spent output couldn't be found
+
+    CTxSummary() : hashBlock(0), nHeight(-1), fSpentKnown(false) {}
+
+    int64_t GetValueIn() const;
+};
+
+/**
+ * Read-only queries on the best chain for the block browser and RPC.
+ *
+ * Height lookups use chainActive under cs_blockindex. The parts of a block
+ * summary that need the block from disk are read once and cached per block
+ * index entry. Connecting or disconnecting the block changes nMint and
+ * nMoneySupply of its entry, so both drop it from the cache with
+ * Invalidate(). Transactions are found through the tx index.
+ *
+ * The GUI posts its queries with QueryBlock()/QueryTransaction(). They run on
+ * a worker thread and call back from it, so the GUI never waits on the disk
+ * or cs_main. RPC calls the synchronous functions directly.
+ */
+class CChainQuery
+{
+public:
+    typedef boost::function<void (bool, const CBlockSummary&)> block_callback_type;
+    typedef boost::function<void (bool, const CTxSummary&)> tx_callback_type;
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    std::deque<boost::function<void ()> > queue;
+    bool fStarted;
+
+    CCriticalSection cs_cache;
+    std::map<const CBlockIndex*, CBlockSummary> mapSummaries;
+    std::deque<const CBlockIndex*> vSummaryOrder; // oldest first, for eviction
+    unsigned int nMaxSummaries;
+    uint64_t nInvalidations;    // a summary read across an Invalidate() isn't cached
+
+    void RunBlockQuery(int nHeight, const block_callback_type& callback);
+    void RunTxQuery(const uint256& hash, const tx_callback_type& callback);
+    void Post(const boost::function<void ()>& job);
+    void ThreadQuery();
+
+public:
+    CChainQuery();
+
+    /** Hash of the best chain block at nHeight */
+    bool GetBlockHash(int nHeight, uint256& hashRet);
+
+    bool GetBlockSummary(const CBlockIndex* pindex, CBlockSummary& summaryRet);
+    bool GetBlockSummary(int nHeight, CBlockSummary& summaryRet);
+
+    /** Forget the cached summary of a block that was connected or disconnected */
+    void Invalidate(const CBlockIndex* pindex);
+
+    /** Block containing a transaction of the tx index, from its position on disk */
+    bool GetTransactionBlock(const uint256& hashTx, uint256& hashBlockRet, int& nHeightRet);
+
+    bool GetTxSummary(const uint256& hash, CTxSummary& summaryRet);
+
+    /** Look up in the background, the callback runs on the worker thread */
+    void QueryBlock(int nHeight, const block_callback_type& callback);
+    void QueryTransaction(const uint256& hash, const tx_callback_type& callback);
+
+    void Start(boost::thread_group& threadGroup);
+};
+
+extern CChainQuery chainQuery;
+
+#endif
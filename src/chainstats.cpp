@@ -0,0 +1,226 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainstats.h"
+
+#include "chainparams.h"
+#include "kernel.h"
+#include "main.h"
+#include "rpcserver.h"
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+CChainStats chainStats;
+
+static const int64_t POW_INTERVAL = 72;
+static const int64_t POW_SPACING_MIN = 30;
+static const int POS_INTERVAL = 72;
+
+// Stake weight needs the 72 stakes before a block, which may reach past the
+// window while few blocks are staked; keep them unless the window gets this big.
+static const unsigned int CHAIN_STATS_WINDOW_MAX = 4 * CHAIN_STATS_WINDOW;
+
+static void UpdatePoWSpacing(CChainStatsEntry& entry, const CBlockIndex* pindex)
+{
+    int64_t nActualSpacingWork = pindex->GetBlockTime() - entry.nLastPoWTime;
+    entry.nPoWSpacing = ((POW_INTERVAL - 1) * entry.nPoWSpacing + nActualSpacingWork + nActualSpacingWork) / (POW_INTERVAL + 1);
+    entry.nPoWSpacing = max(entry.nPoWSpacing, POW_SPACING_MIN);
+    entry.nLastPoWTime = pindex->GetBlockTime();
+}
+
+bool CChainStats::Contains(const CBlockIndex* pindex) const
+{
+    if (window.empty())
+        return false;
+    int nOffset = pindex->nHeight - window.front().nHeight;
+    return nOffset >= 0 && nOffset < (int)window.size() && window[nOffset].pindex == pindex;
+}
+
+double CChainStats::GetNetStakeWeight(size_t nIndex) const
+{
+    double dStakeKernelsTriedAvg = 0;
+    int nStakesHandled = 0;
+    int64_t nStakesTime = 0;
+    const CChainStatsEntry* pentryPrevStake = NULL;
+
+    for (size_t i = nIndex + 1; i-- > 0 && nStakesHandled < POS_INTERVAL; )
+    {
+        const CChainStatsEntry& entry = window[i];
+        if (!entry.fProofOfStake)
+            continue;
+        if (pentryPrevStake)
+        {
+            dStakeKernelsTriedAvg += pentryPrevStake->dPoSDifficulty * 4294967296.0;
+            nStakesTime += pentryPrevStake->nTime - entry.nTime;
+            nStakesHandled++;
+        }
+        pentryPrevStake = &entry;
+    }
+
+    double result = 0;
+    if (nStakesTime)
+        result = dStakeKernelsTriedAvg / nStakesTime;
+    if (IsProtocolV2(window[nIndex].nHeight))
+        result *= STAKE_TIMESTAMP_MASK + 1;
+    return result;
+}
+
+void CChainStats::Append(const CBlockIndex* pindex)
+{
+    CChainStatsEntry entry;
+    entry.pindex = pindex;
+    entry.nHeight = pindex->nHeight;
+    entry.nTime = pindex->GetBlockTime();
+    entry.fProofOfStake = pindex->IsProofOfStake();
+    entry.nMoneySupply = pindex->nMoneySupply;
+    entry.nMint = pindex->nMint;
+
+    if (!window.empty())
+    {
+        const CChainStatsEntry& prev = window.back();
+        entry.nPoWSpacing = prev.nPoWSpacing;
+        entry.nLastPoWTime = prev.nLastPoWTime;
+        entry.dPoWDifficulty = prev.dPoWDifficulty;
+        entry.dPoSDifficulty = prev.dPoSDifficulty;
+    }
+    else if (pindex->pprev)
+    {
+        // First block of a new window, start from the block index
+        const CBlockIndex* pindexLastPoW = GetLastBlockIndex(pindex->pprev, false);
+        entry.nPoWSpacing = POW_SPACING_MIN;
+        entry.nLastPoWTime = pindexLastPoW->GetBlockTime();
+        entry.dPoWDifficulty = GetDifficulty(pindexLastPoW);
+        entry.dPoSDifficulty = GetDifficulty(GetLastBlockIndex(pindex->pprev, true));
+        if (pindex->nHeight < Params().LastPOWBlock() && pindexGenesisBlock)
+        {
+            // the spacing average runs from the genesis block
+            entry.nLastPoWTime = pindexGenesisBlock->GetBlockTime();
+            for (const CBlockIndex* pindexWalk = pindexGenesisBlock; pindexWalk && pindexWalk != pindex; pindexWalk = pindexWalk->pnext)
+                if (pindexWalk->IsProofOfWork())
+                    UpdatePoWSpacing(entry, pindexWalk);
+        }
+    }
+    else
+    {
+        entry.nPoWSpacing = POW_SPACING_MIN;
+        entry.nLastPoWTime = entry.nTime;
+        entry.dPoWDifficulty = entry.dPoSDifficulty = GetDifficulty(pindex);
+    }
+
+    if (entry.fProofOfStake)
+        entry.dPoSDifficulty = GetDifficulty(pindex);
+    else
+    {
+        UpdatePoWSpacing(entry, pindex);
+        entry.dPoWDifficulty = GetDifficulty(pindex);
+    }
+
+    if (entry.nHeight >= Params().LastPOWBlock())
+        entry.dNetMHashPS = 0;
+    else
+        entry.dNetMHashPS = entry.dPoWDifficulty * 4294.967296 / entry.nPoWSpacing;
+
+    window.push_back(entry);
+    if (entry.fProofOfStake)
+        nStakesInWindow++;
+    window.back().dNetStakeWeight = GetNetStakeWeight(window.size() - 1);
+}
+
+void CChainStats::PopBack()
+{
+    if (window.back().fProofOfStake)
+        nStakesInWindow--;
+    window.pop_back();
+}
+
+void CChainStats::SetTip(const CBlockIndex* pindexTip)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_stats);
+
+    // Walk back to the fork with the window
+    vector<const CBlockIndex*> vConnect;
+    const CBlockIndex* pindex = pindexTip;
+    while (pindex && !Contains(pindex) && vConnect.size() < CHAIN_STATS_WINDOW)
+    {
+        vConnect.push_back(pindex);
+        pindex = pindex->pprev;
+    }
+
+    if (pindex && Contains(pindex))
+    {
+        while (window.back().pindex != pindex)
+            PopBack();
+    }
+    else
+    {
+        window.clear();
+        nStakesInWindow = 0;
+    }
+
+    BOOST_REVERSE_FOREACH(const CBlockIndex* pindexConnect, vConnect)
+        Append(pindexConnect);
+
+    while (window.size() > CHAIN_STATS_WINDOW)
+    {
+        const CChainStatsEntry& front = window.front();
+        if (front.fProofOfStake && nStakesInWindow <= POS_INTERVAL + 1 && window.size() <= CHAIN_STATS_WINDOW_MAX)
+            break;
+        if (front.fProofOfStake)
+            nStakesInWindow--;
+        window.pop_front();
+    }
+}
+
+bool CChainStats::GetTip(CChainStatsEntry& entryRet) const
+{
+    LOCK(cs_stats);
+    if (window.empty())
+        return false;
+    entryRet = window.back();
+    return true;
+}
+
+void CChainStats::GetSeries(int nBlocks, int nInterval, vector<CChainStatsInterval>& vRet) const
+{
+    LOCK(cs_stats);
+    vRet.clear();
+    if (window.empty() || nBlocks <= 0 || nInterval <= 0)
+        return;
+
+    // Intervals end at the tip, so the oldest one may be short
+    size_t nCount = min((size_t)nBlocks, min(window.size(), (size_t)CHAIN_STATS_WINDOW));
+    size_t nBegin = window.size() - nCount;
+    size_t nFirst = (nCount - 1) % nInterval + 1;
+    for (size_t a = nBegin, b = nBegin + nFirst - 1; b < window.size(); a = b + 1, b += nInterval)
+    {
+        const CChainStatsEntry& last = window[b];
+        CChainStatsInterval interval;
+        interval.nHeight = last.nHeight;
+        interval.nTime = last.nTime;
+        interval.nBlocks = b - a + 1;
+        interval.nProofOfStake = 0;
+        interval.nMint = 0;
+        for (size_t i = a; i <= b; i++)
+        {
+            if (window[i].fProofOfStake)
+                interval.nProofOfStake++;
+            interval.nMint += window[i].nMint;
+        }
+
+        // spacing from the block before the interval if the window has it
+        int nSpacings = a > 0 ? interval.nBlocks : interval.nBlocks - 1;
+        int64_t nTimeBefore = a > 0 ? window[a - 1].nTime : window[a].nTime;
+        interval.dSpacing = nSpacings > 0 ? (double)(last.nTime - nTimeBefore) / nSpacings : 0;
+
+        interval.dPoWDifficulty = last.dPoWDifficulty;
+        interval.dPoSDifficulty = last.dPoSDifficulty;
+        interval.dNetMHashPS = last.dNetMHashPS;
+        interval.dNetStakeWeight = last.dNetStakeWeight;
+        interval.nMoneySupply = last.nMoneySupply;
+        vRet.push_back(interval);
+    }
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAINSTATS_H
+#define BITCOIN_CHAINSTATS_H
+
+#include "sync.h"
+
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+
+/** Blocks of the best chain kept by CChainStats, about a week */
+static const unsigned int CHAIN_STATS_WINDOW = 20160;
+
+/** Network statistics as of one block of the best chain */
+struct CChainStatsEntry
+{
+    const CBlockIndex* pindex;
+    int nHeight;
+    int64_t nTime;
+    bool fProofOfStake;
+    int64_t nMoneySupply;
+    int64_t nMint;
+
+    // carried forward from the last block of each kind
+    int64_t nPoWSpacing;        // exponential moving average of the PoW block spacing
+    int64_t nLastPoWTime;
+    double dPoWDifficulty;
+    double dPoSDifficulty;
+
+    double dNetMHashPS;
+    double dNetStakeWeight;     // from the last 72 stakes
+};
+
+/** Statistics over nBlocks consecutive blocks, see CChainStats::GetSeries */
+struct CChainStatsInterval
+{
+    int nHeight;                // of the last block
+    int64_t nTime;
+    int nBlocks;
+    int nProofOfStake;
+    double dSpacing;            // average seconds between blocks
+    double dPoWDifficulty;
+    double dPoSDifficulty;
+    double dNetMHashPS;
+    double dNetStakeWeight;
+    int64_t nMoneySupply;
+    int64_t nMint;              // created in the interval
+};
+
+/**
+ * Rolling statistics over the recent best chain, kept up to date by
+ * SetBestChain so getmininginfo, getstakinginfo and the staking status in
+ * the GUI don't walk the block index on every call.
+ *
+ * Every block of the window gets its values when it is connected, from the
+ * entry before it. A reorganisation pops the disconnected entries; one deeper
+ * than the window rebuilds it from the block index.
+ */
+class CChainStats
+{
+private:
+    mutable CCriticalSection cs_stats;
+    std::deque<CChainStatsEntry> window;
+    unsigned int nStakesInWindow;
+
+    bool Contains(const CBlockIndex* pindex) const;
+    void Append(const CBlockIndex* pindex);
+    void PopBack();
+    double GetNetStakeWeight(size_t nIndex) const;
+
+public:
+    CChainStats() : nStakesInWindow(0) {}
+
+    /** Follow the best chain to pindexTip, cs_main must be held */
+    void SetTip(const CBlockIndex* pindexTip);
+
+    /** Values as of the best block, false before the first block */
+    bool GetTip(CChainStatsEntry& entryRet) const;
+
+    /** The last nBlocks blocks in intervals of nInterval blocks, oldest first */
+    void GetSeries(int nBlocks, int nInterval, std::vector<CChainStatsInterval>& vRet) const;
+};
+
+extern CChainStats chainStats;
+
+#endif
@@ -127,6 +127,75 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/** Extend a message schedule from word nFirst (at least 16) up to word 63. */
+void inline Expand(uint32_t* w, int nFirst)
+{
+    for (int i = nFirst; i < 64; i++)
+        w[i] = sigma1(w[i - 2]) + w[i - 7] + sigma0(w[i - 15]) + w[i - 16];
+}
+
+/** Run rounds nFirst up to (not including) nEnd on the working variables v, using the schedule w. */
+void inline Rounds(uint32_t* v, const uint32_t* w, int nFirst, int nEnd)
+{
+    uint32_t a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+    int i = nFirst;
+    for (; (nEnd - i) % 8 != 0; i++) {
+        Round(a, b, c, d, e, f, g, h, K[i], w[i]);
+        uint32_t t = h;
+        h = g;
+        g = f;
+        f = e;
+        e = d;
+        d = c;
+        c = b;
+        b = a;
+        a = t;
+    }
+    for (; i < nEnd; i += 8) {
+        Round(a, b, c, d, e, f, g, h, K[i], w[i]);
+        Round(h, a, b, c, d, e, f, g, K[i + 1], w[i + 1]);
+        Round(g, h, a, b, c, d, e, f, K[i + 2], w[i + 2]);
+        Round(f, g, h, a, b, c, d, e, K[i + 3], w[i + 3]);
+        Round(e, f, g, h, a, b, c, d, K[i + 4], w[i + 4]);
+        Round(d, e, f, g, h, a, b, c, K[i + 5], w[i + 5]);
+        Round(c, d, e, f, g, h, a, b, K[i + 6], w[i + 6]);
+        Round(b, c, d, e, f, g, h, a, K[i + 7], w[i + 7]);
+    }
+    v[0] = a;
+    v[1] = b;
+    v[2] = c;
+    v[3] = d;
+    v[4] = e;
+    v[5] = f;
+    v[6] = g;
+    v[7] = h;
+}
+
+/** Expanded schedule of the block that only holds the padding of a 56-byte message. */
+struct CPadding56
+{
+    uint32_t w[64];
+
+    CPadding56()
+    {
+        for (int i = 0; i < 16; i++)
+            w[i] = 0;
+        w[15] = 56 * 8;
+        Expand(w, 16);
+    }
+};
+static const CPadding56 padding56;
+
 } // namespace sha256
 } // namespace
 
@@ -187,3 +256,59 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+
+
+////// Double SHA-256 of 56-byte messages with a shared prefix
+
+CSHA256D56::CSHA256D56(const unsigned char prefix[PREFIX_SIZE])
+{
+    for (int i = 0; i < 13; i++)
+        w[i] = ReadBE32(prefix + 4 * i);
+    // word 13 is the suffix, followed by the 0x80 padding byte. The first
+    // expanded words that depend on word 13 are 20 and 28, so 16..19 are fixed.
+    w[13] = 0;
+    w[14] = 0x80000000ul;
+    w[15] = 0;
+    for (int i = 16; i < 20; i++)
+        w[i] = sha256::sigma1(w[i - 2]) + w[i - 7] + sha256::sigma0(w[i - 15]) + w[i - 16];
+
+    sha256::Initialize(mid);
+    sha256::Rounds(mid, w, 0, 13);
+}
+
+void CSHA256D56::Finalize(const unsigned char* suffixes, size_t count, unsigned char* hashes) const
+{
+    uint32_t init[8];
+    sha256::Initialize(init);
+
+    for (size_t n = 0; n < count; n++, suffixes += SUFFIX_SIZE, hashes += OUTPUT_SIZE) {
+        uint32_t s[8], v[8], x[64];
+
+        // first hash, block 1: finish the rounds from the precomputed state
+        memcpy(x, w, sizeof(w));
+        x[13] = ReadBE32(suffixes);
+        sha256::Expand(x, 20);
+        memcpy(v, mid, sizeof(v));
+        sha256::Rounds(v, x, 13, 64);
+        for (int i = 0; i < 8; i++)
+            s[i] = init[i] + v[i];
+
+        // first hash, block 2: padding only, its schedule is a constant
+        memcpy(v, s, sizeof(v));
+        sha256::Rounds(v, sha256::padding56.w, 0, 64);
+        for (int i = 0; i < 8; i++)
+            x[i] = s[i] + v[i];
+
+        // second hash over the 32-byte digest
+        x[8] = 0x80000000ul;
+        for (int i = 9; i < 15; i++)
+            x[i] = 0;
+        x[15] = 32 * 8;
+        sha256::Expand(x, 16);
+        memcpy(v, init, sizeof(v));
+        sha256::Rounds(v, x, 0, 64);
+        for (int i = 0; i < 8; i++)
+            WriteBE32(hashes + 4 * i, init[i] + v[i]);
+    }
+}
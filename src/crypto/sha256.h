@@ -25,4 +25,28 @@ public:
     CSHA256& Reset();
 };
 
+/**
+ * Double SHA-256 of 56-byte messages that share their first 52 bytes.
+ *
+ * Used for the stake kernel, which is hashed for many timestamps that only
+ * change its last four bytes. The rounds over the shared words, the schedule
+ * words that don't depend on the suffix and the schedule of the padding block
+ * are computed once.
+ */
+class CSHA256D56
+{
+private:
+    uint32_t mid[8];
+    uint32_t w[20];
+
+public:
+    static const size_t PREFIX_SIZE = 52;
+    static const size_t SUFFIX_SIZE = 4;
+    static const size_t OUTPUT_SIZE = 32;
+
+    explicit CSHA256D56(const unsigned char prefix[PREFIX_SIZE]);
+    /** Hash prefix + suffix for count consecutive 4-byte suffixes, writing count 32-byte hashes */
+    void Finalize(const unsigned char* suffixes, size_t count, unsigned char* hashes) const;
+};
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #endif
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/version.hpp>
 #include <openssl/rand.h>
@@ -231,7 +232,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 
 
 CDB::CDB(const std::string& strFilename, const char* pszMode) :
-    pdb(NULL), activeTxn(NULL)
+    pdb(NULL), activeTxn(NULL), pjournal(NULL), fJournalTxn(false)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -245,6 +246,20 @@ CDB::CDB(const std::string& strFilename, const char* pszMode) :
 
     {
         LOCK(bitdb.cs_db);
+        pjournal = bitdb.GetJournal(strFilename);
+        if (pjournal)
+        {
+            strFile = strFilename;
+            if (fCreate && !Exists(string("version")))
+            {
+                bool fTmp = fReadOnly;
+                fReadOnly = false;
+                WriteVersion(CLIENT_VERSION);
+                fReadOnly = fTmp;
+            }
+            return;
+        }
+
         if (!bitdb.Open(GetDataDir()))
             throw runtime_error("env open failed");
 
@@ -295,6 +310,14 @@ CDB::CDB(const std::string& strFilename, const char* pszMode) :
 
 void CDB::Close()
 {
+    if (pjournal)
+    {
+        // like an open Berkeley DB transaction, unfinished writes are dropped
+        batchTxn.clear();
+        fJournalTxn = false;
+        pjournal = NULL;
+        return;
+    }
     if (!pdb)
         return;
     if (activeTxn)
@@ -315,6 +338,88 @@ void CDB::Close()
     }
 }
 
+bool CDB::JournalRead(const CSecureDataStream& ssKey, CSecureDataStream& ssValue)
+{
+    CWalletJournal::Data vchKey(ssKey.begin(), ssKey.end());
+
+    // an open transaction sees its own writes
+    for (CWalletJournal::Batch::reverse_iterator it = batchTxn.rbegin(); it != batchTxn.rend(); ++it)
+    {
+        if (it->key == vchKey)
+        {
+            if (it->fErase)
+                return false;
+            if (!it->value.empty())
+                ssValue.write((const char*)&it->value[0], it->value.size());
+            return true;
+        }
+    }
+
+    CWalletJournal::Data vchValue;
+    if (!pjournal->Read(vchKey, vchValue))
+        return false;
+    if (!vchValue.empty())
+        ssValue.write((const char*)&vchValue[0], vchValue.size());
+    return true;
+}
+
+bool CDB::JournalExists(const CSecureDataStream& ssKey)
+{
+    CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    return JournalRead(ssKey, ssValue);
+}
+
+bool CDB::JournalWrite(const CSecureDataStream& ssKey, const CSecureDataStream* pssValue, bool fOverwrite)
+{
+    if (fReadOnly)
+        assert(!"Write called on database in read-only mode");
+    if (!fOverwrite && JournalExists(ssKey))
+        return false;
+
+    CWalletJournal::Batch batch;
+    CWalletJournal::Batch& batchWrite = fJournalTxn ? batchTxn : batch;
+    batchWrite.push_back(CWalletJournal::COp());
+    CWalletJournal::COp& op = batchWrite.back();
+    op.fErase = (pssValue == NULL);
+    op.key.assign(ssKey.begin(), ssKey.end());
+    if (pssValue)
+        op.value.assign(pssValue->begin(), pssValue->end());
+
+    if (fJournalTxn)
+        return true;
+    return pjournal->Write(batch);
+}
+
+int CDB::ReadAtJournalCursor(CDBCursor* pcursor, CSecureDataStream& ssKey, CSecureDataStream& ssValue, unsigned int fFlags)
+{
+    bool fInclusive;
+    if (fFlags == DB_SET_RANGE)
+    {
+        pcursor->vchKey.assign(ssKey.begin(), ssKey.end());
+        fInclusive = true;
+    }
+    else if (fFlags == DB_NEXT)
+        fInclusive = !pcursor->fStarted;
+    else
+        return EINVAL;
+
+    CWalletJournal::Data vchKey, vchValue;
+    if (!pjournal->Next(pcursor->vchKey, fInclusive, vchKey, vchValue))
+        return DB_NOTFOUND;
+    pcursor->vchKey = vchKey;
+    pcursor->fStarted = true;
+
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    if (!vchKey.empty())
+        ssKey.write((const char*)&vchKey[0], vchKey.size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    if (!vchValue.empty())
+        ssValue.write((const char*)&vchValue[0], vchValue.size());
+    return 0;
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
@@ -341,6 +446,19 @@ bool CDBEnv::RemoveDb(const string& strFile)
 
 bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 {
+    CWalletJournal* pjournal = bitdb.GetJournal(strFile);
+    if (pjournal)
+    {
+        // A journal is rewritten by compacting it, which doesn't have to wait
+        // for the file to be unused.
+        LogPrintf("Rewriting %s...\n", strFile);
+        {
+            CDB db(strFile.c_str());
+            db.WriteVersion(CLIENT_VERSION);
+        }
+        return pjournal->Compact(pszSkip);
+    }
+
     while (true)
     {
         {
@@ -371,21 +489,21 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess)
                         {
-                            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-                            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                            CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+                            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
                             int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
                             if (ret == DB_NOTFOUND)
                             {
-                                pcursor->close();
+                                db.CloseCursor(pcursor);
                                 break;
                             }
                             else if (ret != 0)
                             {
-                                pcursor->close();
+                                db.CloseCursor(pcursor);
                                 fSuccess = false;
                                 break;
                             }
@@ -436,6 +554,20 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 void CDBEnv::Flush(bool fShutdown)
 {
     int64_t nStart = GetTimeMillis();
+    {
+        LOCK(cs_db);
+        for (map<string, CWalletJournal*>::iterator mi = mapJournal.begin(); mi != mapJournal.end(); ++mi)
+        {
+            mi->second->Flush();
+            if (fShutdown)
+            {
+                mi->second->LogStats("closed");
+                delete mi->second;
+            }
+        }
+        if (fShutdown)
+            mapJournal.clear();
+    }
     // Flush log data to the actual data file
     //  on all files that are not in use
     LogPrint("db", "Flush(%s)%s\n", fShutdown ? "true" : "false", fDbEnvInit ? "" : " db not started");
@@ -476,3 +608,200 @@ void CDBEnv::Flush(bool fShutdown)
         }
     }
 }
+
+CWalletJournal* CDBEnv::GetJournal(const string& strFile)
+{
+    LOCK(cs_db);
+    map<string, CWalletJournal*>::iterator mi = mapJournal.find(strFile);
+    return mi == mapJournal.end() ? NULL : mi->second;
+}
+
+void CDBEnv::CloseJournal(const string& strFile)
+{
+    LOCK(cs_db);
+    map<string, CWalletJournal*>::iterator mi = mapJournal.find(strFile);
+    if (mi == mapJournal.end())
+        return;
+    mi->second->LogStats("closed");
+    delete mi->second;
+    mapJournal.erase(mi);
+}
+
+bool CDBEnv::OpenJournal(const string& strFile, bool fSyncWrites)
+{
+    LOCK(cs_db);
+    if (mapJournal.count(strFile))
+        return true;
+
+    filesystem::path pathFile = GetDataDir() / strFile;
+    filesystem::path pathJournal = GetDataDir() / (strFile + ".journal");
+    if (!filesystem::exists(pathJournal) && filesystem::exists(pathFile))
+    {
+        // Import into a temporary journal that is only renamed once complete
+        int64_t nStart = GetTimeMillis();
+        LogPrintf("Importing %s into %s...\n", strFile, pathJournal.filename().string());
+        filesystem::path pathImport = pathJournal.string() + ".import";
+        filesystem::remove(pathImport);
+
+        CloseDb(strFile);
+        CheckpointLSN(strFile);
+        Db db(&dbenv, 0);
+        if (db.open(NULL, strFile.c_str(), "main", DB_BTREE, DB_RDONLY, 0) != 0)
+            return error("OpenJournal() : cannot open %s", strFile);
+
+        bool fSuccess = false;
+        unsigned int nRecords = 0;
+        {
+            CWalletJournal journal(pathImport, false);
+            Dbc* pcursor = NULL;
+            if (journal.Open() && db.cursor(NULL, &pcursor, 0) == 0)
+            {
+                fSuccess = true;
+                CWalletJournal::Batch batch;
+                size_t nBatchBytes = 0;
+                while (fSuccess)
+                {
+                    Dbt datKey, datValue;
+                    int ret = pcursor->get(&datKey, &datValue, DB_NEXT);
+                    if (ret == DB_NOTFOUND)
+                        break;
+                    if (ret != 0)
+                    {
+                        fSuccess = false;
+                        break;
+                    }
+                    batch.push_back(CWalletJournal::COp());
+                    CWalletJournal::COp& op = batch.back();
+                    op.fErase = false;
+                    op.key.assign((unsigned char*)datKey.get_data(), (unsigned char*)datKey.get_data() + datKey.get_size());
+                    op.value.assign((unsigned char*)datValue.get_data(), (unsigned char*)datValue.get_data() + datValue.get_size());
+                    nBatchBytes += datKey.get_size() + datValue.get_size();
+                    nRecords++;
+                    if (nBatchBytes >= (1 << 20))
+                    {
+                        fSuccess = journal.Write(batch);
+                        batch.clear();
+                        nBatchBytes = 0;
+                    }
+                }
+                pcursor->close();
+                if (fSuccess)
+                    fSuccess = journal.Write(batch);
+            }
+            journal.Close();
+        }
+        db.close(0);
+        if (!fSuccess || !RenameOver(pathImport, pathJournal))
+            return error("OpenJournal() : importing %s failed", strFile);
+
+        // Only the journal is current from now on. If wallet.dat can't be
+        // moved away the import is undone, the next start would see both.
+        filesystem::path pathOld = pathFile.string() + ".imported";
+        if (!RenameOver(pathFile, pathOld))
+        {
+            filesystem::remove(pathJournal);
+            return error("OpenJournal() : cannot move %s to %s", strFile, pathOld.filename().string());
+        }
+        LogPrintf("Imported %u records in %dms, %s moved to %s\n", nRecords, GetTimeMillis() - nStart,
+                  strFile, pathOld.filename().string());
+    }
+
+    CWalletJournal* pjournal = new CWalletJournal(pathJournal, fSyncWrites);
+    if (!pjournal->Open())
+    {
+        delete pjournal;
+        return false;
+    }
+    if (pjournal->NeedsCompaction())
+        pjournal->Compact();
+    mapJournal[strFile] = pjournal;
+    return true;
+}
+
+// Overwrite a file with zeros before removing it, so its old contents don't
+// stay readable in the data directory
+static bool WipeFile(const filesystem::path& path)
+{
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    if (!file)
+        return false;
+    uint64_t nSize = filesystem::file_size(path);
+    std::vector<char> vZero(std::min(nSize, (uint64_t)(1 << 20)), 0);
+    bool fSuccess = true;
+    for (uint64_t nDone = 0; fSuccess && nDone < nSize; nDone += vZero.size())
+        fSuccess = fwrite(&vZero[0], 1, std::min(nSize - nDone, (uint64_t)vZero.size()), file) > 0;
+    fflush(file);
+    FileCommit(file);
+    fclose(file);
+    filesystem::remove(path);
+    return fSuccess;
+}
+
+void CDBEnv::WipeWalletCopies(const string& strFile)
+{
+    // the wallet.dat moved away by an import, the journal left behind by an
+    // export, an unfinished import and the copies saved when a torn write was cut off
+    string strJournal = strFile + ".journal";
+    std::vector<filesystem::path> vWipe;
+    vWipe.push_back(GetDataDir() / (strFile + ".imported"));
+    vWipe.push_back(GetDataDir() / (strJournal + ".exported"));
+    vWipe.push_back(GetDataDir() / (strJournal + ".import"));
+    try {
+        for (filesystem::directory_iterator it(GetDataDir()); it != filesystem::directory_iterator(); ++it)
+        {
+            string strName = it->path().filename().string();
+            if (boost::algorithm::starts_with(strName, strJournal + ".") && boost::algorithm::ends_with(strName, ".bak"))
+                vWipe.push_back(it->path());
+        }
+        for (std::vector<filesystem::path>::const_iterator it = vWipe.begin(); it != vWipe.end(); ++it)
+        {
+            if (!filesystem::exists(*it))
+                continue;
+            if (WipeFile(*it))
+                LogPrintf("WipeWalletCopies() : wiped %s\n", it->filename().string());
+            else
+                LogPrintf("WipeWalletCopies() : failed to wipe %s\n", it->string());
+        }
+    } catch (const filesystem::filesystem_error& e) {
+        LogPrintf("WipeWalletCopies() : %s\n", e.what());
+    }
+}
+
+bool CDBEnv::ExportJournal(const string& strFile, const string& strDest)
+{
+    LOCK(cs_db);
+    CWalletJournal* pjournal = GetJournal(strFile);
+    if (!pjournal)
+        return false;
+    if (!Open(GetDataDir()))
+        return false;
+
+    Db* pdbCopy = new Db(&dbenv, 0);
+    int ret = pdbCopy->open(NULL, strDest.c_str(), "main", DB_BTREE, DB_CREATE | DB_EXCL, 0);
+    if (ret != 0)
+    {
+        delete pdbCopy;
+        return error("ExportJournal() : cannot create database file %s", strDest);
+    }
+
+    bool fSuccess = true;
+    CWalletJournal::Data vchKey, vchValue;
+    bool fStarted = false;
+    while (fSuccess && pjournal->Next(vchKey, !fStarted, vchKey, vchValue))
+    {
+        fStarted = true;
+        Dbt datKey(vchKey.empty() ? NULL : &vchKey[0], vchKey.size());
+        Dbt datValue(vchValue.empty() ? NULL : &vchValue[0], vchValue.size());
+        fSuccess = pdbCopy->put(NULL, &datKey, &datValue, DB_NOOVERWRITE) == 0;
+    }
+    if (pdbCopy->close(0))
+        fSuccess = false;
+    delete pdbCopy;
+
+    // Make the new file self contained
+    if (fSuccess)
+        CheckpointLSN(strDest);
+    else
+        LogPrintf("Exporting %s to %s FAILED!\n", strFile, strDest);
+    return fSuccess;
+}
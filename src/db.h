@@ -9,6 +9,7 @@
 #include "serialize.h"
 #include "sync.h"
 #include "version.h"
+#include "walletjournal.h"
 
 #include <map>
 #include <string>
@@ -44,6 +45,7 @@ public:
     DbEnv dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    std::map<std::string, CWalletJournal*> mapJournal;
 
     CDBEnv();
     ~CDBEnv();
@@ -76,6 +78,20 @@ public:
     void CloseDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
 
+    /*
+     * Keep strFile in an append-only journal (strFile.journal) instead of
+     * Berkeley DB. The first time, the records of strFile are imported and
+     * strFile is moved out of the way. Must be called before strFile is opened.
+     */
+    bool OpenJournal(const std::string& strFile, bool fSyncWrites);
+    /* The journal strFile is kept in, NULL if it is a Berkeley database */
+    CWalletJournal* GetJournal(const std::string& strFile);
+    void CloseJournal(const std::string& strFile);
+    /* Write the records of journal strFile to a new Berkeley database strDest */
+    bool ExportJournal(const std::string& strFile, const std::string& strDest);
+    /* Wipe the unencrypted copies of strFile that an import, an export or a torn journal write left behind */
+    void WipeWalletCopies(const std::string& strFile);
+
     DbTxn *TxnBegin(int flags=DB_TXN_WRITE_NOSYNC)
     {
         DbTxn* ptxn = NULL;
@@ -89,7 +105,20 @@ public:
 extern CDBEnv bitdb;
 
 
-/** RAII class that provides access to a Berkeley database */
+/** Cursor over a CDB, see CDB::GetCursor */
+class CDBCursor
+{
+public:
+    Dbc* pdbc;
+    // journal cursors remember the last key they returned
+    CWalletJournal::Data vchKey;
+    bool fStarted;
+
+    CDBCursor() : pdbc(NULL), fStarted(false) {}
+};
+
+
+/** RAII class that provides access to a Berkeley database or a wallet journal */
 class CDB
 {
 protected:
@@ -97,6 +126,10 @@ protected:
     std::string strFile;
     DbTxn *activeTxn;
     bool fReadOnly;
+    CWalletJournal* pjournal;
+    // writes of an open transaction on a journal
+    CWalletJournal::Batch batchTxn;
+    bool fJournalTxn;
 
     explicit CDB(const std::string& strFilename, const char* pszMode="r+");
     ~CDB() { Close(); }
@@ -108,17 +141,36 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    bool JournalRead(const CSecureDataStream& ssKey, CSecureDataStream& ssValue);
+    bool JournalWrite(const CSecureDataStream& ssKey, const CSecureDataStream* pssValue, bool fOverwrite=true);
+    bool JournalExists(const CSecureDataStream& ssKey);
+    int ReadAtJournalCursor(CDBCursor* pcursor, CSecureDataStream& ssKey, CSecureDataStream& ssValue, unsigned int fFlags);
+
 protected:
     template<typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !pjournal)
             return false;
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (pjournal)
+        {
+            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (!JournalRead(ssKey, ssValue))
+                return false;
+            try {
+                ssValue >> value;
+            }
+            catch (std::exception &e) {
+                return false;
+            }
+            return true;
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
@@ -131,7 +183,7 @@ protected:
 
         // Unserialize value
         try {
-            CDataStream ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         }
         catch (std::exception &e) {
@@ -147,21 +199,23 @@ protected:
     template<typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite=true)
     {
-        if (!pdb)
+        if (!pdb && !pjournal)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Value
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+        if (pjournal)
+            return JournalWrite(ssKey, &ssValue, fOverwrite);
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
@@ -176,15 +230,17 @@ protected:
     template<typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !pjournal)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (pjournal)
+            return JournalWrite(ssKey, NULL);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
@@ -198,13 +254,15 @@ protected:
     template<typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !pjournal)
             return false;
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (pjournal)
+            return JournalExists(ssKey);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
@@ -215,19 +273,34 @@ protected:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
+    /** Only DB_NEXT and DB_SET_RANGE are supported on a journal. Free with CloseCursor. */
+    CDBCursor* GetCursor()
     {
+        if (pjournal)
+            return new CDBCursor();
         if (!pdb)
             return NULL;
-        Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
+        Dbc* pdbc = NULL;
+        int ret = pdb->cursor(NULL, &pdbc, 0);
         if (ret != 0)
             return NULL;
+        CDBCursor* pcursor = new CDBCursor();
+        pcursor->pdbc = pdbc;
         return pcursor;
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags=DB_NEXT)
+    void CloseCursor(CDBCursor* pcursor)
     {
+        if (pcursor->pdbc)
+            pcursor->pdbc->close();
+        delete pcursor;
+    }
+
+    int ReadAtCursor(CDBCursor* pcursor, CSecureDataStream& ssKey, CSecureDataStream& ssValue, unsigned int fFlags=DB_NEXT)
+    {
+        if (!pcursor->pdbc)
+            return ReadAtJournalCursor(pcursor, ssKey, ssValue, fFlags);
+
         // Read at cursor
         Dbt datKey;
         if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE)
@@ -243,7 +316,7 @@ protected:
         }
         datKey.set_flags(DB_DBT_MALLOC);
         datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
+        int ret = pcursor->pdbc->get(&datKey, &datValue, fFlags);
         if (ret != 0)
             return ret;
         else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
@@ -268,6 +341,13 @@ protected:
 public:
     bool TxnBegin()
     {
+        if (pjournal)
+        {
+            if (fJournalTxn)
+                return false;
+            fJournalTxn = true;
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -279,6 +359,15 @@ public:
 
     bool TxnCommit()
     {
+        if (pjournal)
+        {
+            if (!fJournalTxn)
+                return false;
+            fJournalTxn = false;
+            bool fSuccess = pjournal->Write(batchTxn);
+            batchTxn.clear();
+            return fSuccess;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -288,6 +377,14 @@ public:
 
     bool TxnAbort()
     {
+        if (pjournal)
+        {
+            if (!fJournalTxn)
+                return false;
+            fJournalTxn = false;
+            batchTxn.clear();
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
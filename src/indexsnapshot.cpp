@@ -0,0 +1,322 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexsnapshot.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+#include "xxhash/xxhash.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+using namespace std;
+
+namespace {
+
+static const char SNAPSHOT_MAGIC[8] = { 'N', 'A', 'V', 'B', 'I', 'D', 'X', '1' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+// written in native byte order, a snapshot from another architecture fails this check
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct CSnapshotHeader
+{
+    char pchMagic[8];
+    uint32_t nVersion;
+    uint32_t nRecordSize;
+    uint32_t nByteOrder;
+    uint32_t nChecksum; // of the header with nChecksum = 0, followed by the records
+    uint64_t nRecords;
+    unsigned char hashBestChain[32];
+};
+
+// Fields are ordered by size so neither struct has any padding
+struct CSnapshotRecord
+{
+    int64_t nMint;
+    int64_t nMoneySupply;
+    uint64_t nStakeModifier;
+    uint32_t nFile;
+    uint32_t nBlockPos;
+    int32_t nHeight;
+    uint32_t nFlags;
+    uint32_t nStakeTime;
+    uint32_t nPrevoutStakeN;
+    int32_t nVersion;
+    uint32_t nTime;
+    uint32_t nBits;
+    uint32_t nNonce;
+    unsigned char hash[32];
+    unsigned char hashPrev[32];
+    unsigned char hashMerkleRoot[32];
+    unsigned char hashProof[32];
+    unsigned char hashPrevoutStake[32];
+    unsigned char nChainTrust[32];
+};
+
+typedef char snapshot_header_size_check[sizeof(CSnapshotHeader) == 64 ? 1 : -1];
+typedef char snapshot_record_size_check[sizeof(CSnapshotRecord) == 256 ? 1 : -1];
+
+class CSnapshotChecksum
+{
+private:
+    XXH32_stateSpace_t state;
+
+public:
+    CSnapshotChecksum() { XXH32_resetState(&state, 0); }
+
+    void Write(const void* pv, size_t nSize)
+    {
+        // XXH32_update takes an int length
+        const char* p = static_cast<const char*>(pv);
+        while (nSize > 0)
+        {
+            size_t nChunk = std::min(nSize, (size_t)1 << 30);
+            XXH32_update(&state, p, (int)nChunk);
+            p += nChunk;
+            nSize -= nChunk;
+        }
+    }
+
+    uint32_t Get() { return XXH32_intermediateDigest(&state); }
+};
+
+boost::filesystem::path GetSnapshotPath()
+{
+    return GetDataDir() / "blkindex.snapshot";
+}
+
+void ToBytes(const uint256& n, unsigned char* p)
+{
+    memcpy(p, n.begin(), 32);
+}
+
+uint256 FromBytes(const unsigned char* p)
+{
+    uint256 n;
+    memcpy(n.begin(), p, 32);
+    return n;
+}
+
+void ToRecord(const CBlockIndex* pindex, CSnapshotRecord& rec)
+{
+    rec.nMint = pindex->nMint;
+    rec.nMoneySupply = pindex->nMoneySupply;
+    rec.nStakeModifier = pindex->nStakeModifier;
+    rec.nFile = pindex->nFile;
+    rec.nBlockPos = pindex->nBlockPos;
+    rec.nHeight = pindex->nHeight;
+    rec.nFlags = pindex->nFlags;
+    rec.nStakeTime = pindex->nStakeTime;
+    rec.nPrevoutStakeN = pindex->prevoutStake.n;
+    rec.nVersion = pindex->nVersion;
+    rec.nTime = pindex->nTime;
+    rec.nBits = pindex->nBits;
+    rec.nNonce = pindex->nNonce;
+    ToBytes(pindex->GetBlockHash(), rec.hash);
+    ToBytes(pindex->pprev ? pindex->pprev->GetBlockHash() : 0, rec.hashPrev);
+    ToBytes(pindex->hashMerkleRoot, rec.hashMerkleRoot);
+    ToBytes(pindex->hashProof, rec.hashProof);
+    ToBytes(pindex->prevoutStake.hash, rec.hashPrevoutStake);
+    ToBytes(pindex->nChainTrust, rec.nChainTrust);
+}
+
+void FromRecord(const CSnapshotRecord& rec, CBlockIndex* pindex)
+{
+    pindex->nMint = rec.nMint;
+    pindex->nMoneySupply = rec.nMoneySupply;
+    pindex->nStakeModifier = rec.nStakeModifier;
+    pindex->nFile = rec.nFile;
+    pindex->nBlockPos = rec.nBlockPos;
+    pindex->nHeight = rec.nHeight;
+    pindex->nFlags = rec.nFlags;
+    pindex->nStakeTime = rec.nStakeTime;
+    pindex->prevoutStake = COutPoint(FromBytes(rec.hashPrevoutStake), rec.nPrevoutStakeN);
+    pindex->nVersion = rec.nVersion;
+    pindex->nTime = rec.nTime;
+    pindex->nBits = rec.nBits;
+    pindex->nNonce = rec.nNonce;
+    pindex->hashMerkleRoot = FromBytes(rec.hashMerkleRoot);
+    pindex->hashProof = FromBytes(rec.hashProof);
+    pindex->nChainTrust = FromBytes(rec.nChainTrust);
+}
+
+// Entries already taken from the arena stay allocated when this fails, there
+// is no way to hand them back and the checksum makes it very unlikely anyway.
+bool LoadRecords(const char* pData, size_t nSize, const uint256& hashBestChainIn)
+{
+    CSnapshotHeader header;
+    if (nSize < sizeof(header))
+        return error("LoadBlockIndexSnapshot() : snapshot is truncated");
+    memcpy(&header, pData, sizeof(header));
+    if (memcmp(header.pchMagic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.nVersion != SNAPSHOT_VERSION ||
+        header.nRecordSize != sizeof(CSnapshotRecord) || header.nByteOrder != SNAPSHOT_BYTE_ORDER)
+        return error("LoadBlockIndexSnapshot() : unknown snapshot format");
+    if (header.nRecords == 0 || header.nRecords > (nSize - sizeof(header)) / sizeof(CSnapshotRecord) ||
+        nSize != sizeof(header) + header.nRecords * sizeof(CSnapshotRecord))
+        return error("LoadBlockIndexSnapshot() : snapshot is truncated");
+    if (FromBytes(header.hashBestChain) != hashBestChainIn)
+        return error("LoadBlockIndexSnapshot() : snapshot is stale, written at %s", FromBytes(header.hashBestChain).ToString());
+
+    const CSnapshotRecord* pRecords = reinterpret_cast<const CSnapshotRecord*>(pData + sizeof(header));
+    size_t nRecords = header.nRecords;
+
+    CSnapshotChecksum checksum;
+    uint32_t nChecksum = header.nChecksum;
+    header.nChecksum = 0;
+    checksum.Write(&header, sizeof(header));
+    checksum.Write(pRecords, nRecords * sizeof(CSnapshotRecord));
+    if (checksum.Get() != nChecksum)
+        return error("LoadBlockIndexSnapshot() : checksum mismatch");
+
+    LOCK_EXCLUSIVE(cs_blockindex);
+    mapBlockIndex.rehash(nRecords);
+    size_t nLinked = 0;
+    for (; nLinked < nRecords; nLinked++)
+    {
+        const CSnapshotRecord& rec = pRecords[nLinked];
+        uint256 hash = FromBytes(rec.hash);
+        uint256 hashPrev = FromBytes(rec.hashPrev);
+
+        CBlockIndex* pindexNew = new (blockIndexArena.Allocate()) CBlockIndex();
+        pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(make_pair(hash, pindexNew));
+        if (!ret.second)
+            break;
+        pindexNew->phashBlock = &ret.first->first;
+        FromRecord(rec, pindexNew);
+
+        // records are sorted by height, so the parent was inserted before
+        if (hashPrev != 0)
+        {
+            BlockMap::iterator mi = mapBlockIndex.find(hashPrev);
+            if (mi == mapBlockIndex.end())
+                break;
+            pindexNew->pprev = mi->second;
+        }
+
+        if (pindexGenesisBlock == NULL && hash == Params().HashGenesisBlock())
+            pindexGenesisBlock = pindexNew;
+
+        // NavCoin: build setStakeSeen
+        if (pindexNew->IsProofOfStake())
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashBestChainIn);
+    if (nLinked != nRecords || mi == mapBlockIndex.end())
+    {
+        mapBlockIndex.clear();
+        setStakeSeen.clear();
+        pindexGenesisBlock = NULL;
+        return error("LoadBlockIndexSnapshot() : snapshot entries don't link up");
+    }
+
+    // pnext is only set along the best chain
+    for (CBlockIndex* pindex = mi->second; pindex->pprev; pindex = pindex->pprev)
+        pindex->pprev->pnext = pindex;
+
+    return true;
+}
+
+}
+
+bool WriteBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
+
+    int64_t nStart = GetTimeMillis();
+    vector<pair<int, CBlockIndex*> > vSortedByHeight;
+    uint256 hashBest;
+    {
+        LOCK_SHARED(cs_blockindex);
+        if (pindexBest == NULL)
+            return false;
+        hashBest = hashBestChain;
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+            vSortedByHeight.push_back(make_pair(item.second->nHeight, item.second));
+    }
+    sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    CSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.pchMagic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.nVersion = SNAPSHOT_VERSION;
+    header.nRecordSize = sizeof(CSnapshotRecord);
+    header.nByteOrder = SNAPSHOT_BYTE_ORDER;
+    header.nRecords = vSortedByHeight.size();
+    ToBytes(hashBest, header.hashBestChain);
+
+    boost::filesystem::path pathTmp = GetDataDir() / "blkindex.snapshot.new";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("WriteBlockIndexSnapshot() : can't open %s", pathTmp.string());
+
+    // The header goes in twice, first as a placeholder and then with the
+    // checksum once all records have been hashed
+    CSnapshotChecksum checksum;
+    checksum.Write(&header, sizeof(header));
+    bool fOk = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    vector<CSnapshotRecord> vRecords;
+    vRecords.reserve(4096);
+    for (size_t i = 0; fOk && i < vSortedByHeight.size(); i++)
+    {
+        vRecords.push_back(CSnapshotRecord());
+        ToRecord(vSortedByHeight[i].second, vRecords.back());
+        if (vRecords.size() == 4096 || i + 1 == vSortedByHeight.size())
+        {
+            checksum.Write(&vRecords[0], vRecords.size() * sizeof(CSnapshotRecord));
+            fOk = fwrite(&vRecords[0], sizeof(CSnapshotRecord), vRecords.size(), file) == vRecords.size();
+            vRecords.clear();
+        }
+    }
+
+    header.nChecksum = checksum.Get();
+    fOk = fOk && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    if (fOk)
+        FileCommit(file);
+    fclose(file);
+    if (!fOk || !RenameOver(pathTmp, GetSnapshotPath()))
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathTmp, ec);
+        return error("WriteBlockIndexSnapshot() : failed to write %s", pathTmp.string());
+    }
+
+    LogPrintf("WriteBlockIndexSnapshot() : %u entries in %dms\n", vSortedByHeight.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool LoadBlockIndexSnapshot(const uint256& hashBestChainIn)
+{
+    boost::filesystem::path path = GetSnapshotPath();
+    if (!boost::filesystem::exists(path))
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    bool fLoaded = false;
+    try {
+        boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+        fLoaded = LoadRecords(static_cast<const char*>(region.get_address()), region.get_size(), hashBestChainIn);
+    }
+    catch (std::exception& e) {
+        LogPrintf("LoadBlockIndexSnapshot() : %s\n", e.what());
+    }
+    RemoveBlockIndexSnapshot();
+
+    if (fLoaded)
+        LogPrintf("LoadBlockIndexSnapshot() : %u entries in %dms\n", mapBlockIndex.size(), GetTimeMillis() - nStart);
+    return fLoaded;
+}
+
+void RemoveBlockIndexSnapshot()
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove(GetSnapshotPath(), ec);
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEXSNAPSHOT_H
+#define BITCOIN_INDEXSNAPSHOT_H
+
+#include "uint256.h"
+
+/**
+ * Snapshot of the in-memory block index (-indexsnapshot).
+ *
+ * blkindex.snapshot is a header followed by one fixed-size record per block,
+ * sorted by height, with an xxhash checksum over all of it. It is written at
+ * clean shutdown and mapped into memory at the next start, which is much
+ * faster than rebuilding every entry from LevelDB and recomputing chain trust.
+ *
+ * The file only describes the database as it was when it was written, so it
+ * is removed as soon as it has been read and LoadBlockIndex falls back to the
+ * LevelDB scan after a crash or whenever the snapshot doesn't match.
+ */
+
+/** Write the snapshot, cs_main must be held and nothing may change the index */
+bool WriteBlockIndexSnapshot();
+
+/** Fill mapBlockIndex from the snapshot if it was written at hashBestChain. On false the index is left empty */
+bool LoadBlockIndexSnapshot(const uint256& hashBestChain);
+
+/** Drop a snapshot that won't be used, it would be stale by the next start */
+void RemoveBlockIndexSnapshot();
+
+#endif
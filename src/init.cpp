@@ -14,6 +14,10 @@
 #include "checkpoints.h"
 #include "activeinode.h"
 #include "hub.h"
+#include "msgverify.h"
+#include "indexsnapshot.h"
+#include "chainstats.h"
+#include "chainquery.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet.h"
@@ -113,6 +117,8 @@ void Shutdown()
         if (pwalletMain)
             pwalletMain->SetBestChain(CBlockLocator(pindexBest));
 #endif
+        if (GetBoolArg("-indexsnapshot", false))
+            WriteBlockIndexSnapshot();
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -238,6 +244,8 @@ std::string HelpMessage()
     strUsage += "  -logtimestamps         " + _("Prepend debug output with timestamp") + "\n";
     strUsage += "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n";
     strUsage += "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n";
+    strUsage += "  -lockprofile           " + _("Record wait and hold times of every lock site, see getlockstats (default: 0)") + "\n";
+    strUsage += "  -lockprofileinterval=<n> " + _("Write the lock profile to debug.log every <n> seconds (default: 600)") + "\n";
     strUsage += "  -rpcuser=<user>        " + _("Username for JSON-RPC connections") + "\n";
     strUsage += "  -rpcpassword=<pw>      " + _("Password for JSON-RPC connections") + "\n";
     strUsage += "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 44444 or testnet: 33444)") + "\n";
@@ -257,8 +265,12 @@ std::string HelpMessage()
     strUsage += "  -keypool=<n>           " + _("Set key pool size to <n> (default: 100)") + "\n";
     strUsage += "  -rescan                " + _("Rescan the block chain for missing wallet transactions") + "\n";
     strUsage += "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n";
+    strUsage += "  -walletjournal         " + _("Keep the wallet in an append-only journal instead of wallet.dat, which is imported on first use and restored when the option is turned off (default: 0)") + "\n";
+    strUsage += "  -walletjournalsync     " + _("Sync the wallet journal to disk after every write instead of when the wallet is idle (default: 0)") + "\n";
     strUsage += "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 500, 0 = all)") + "\n";
     strUsage += "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n";
+    strUsage += "  -compressblocks        " + _("Store blocks LZ4 compressed, existing block files are converted at startup (default: 0)") + "\n";
+    strUsage += "  -indexsnapshot         " + _("Save the block index at shutdown and load it from that file at the next start (default: 0)") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n";
     strUsage += "  -maxorphanblocks=<n>   " + strprintf(_("Keep at most <n> unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
 
@@ -279,6 +291,7 @@ strUsage += "\n" + _("Inode options:") + "\n";
     strUsage += "  -inodeprivkey=<n>     " + _("Set the inode private key") + "\n";
     strUsage += "  -inodeaddr=<n>        " + _("Set external address:port to get to this inode (example: address:port)") + "\n";
     strUsage += "  -inodeminprotocol=<n> " + _("Ignore inodes less than version (example: 70007; default : 0)") + "\n";
+    strUsage += "  -msgverifythreads=<n>  " + _("Set the number of threads verifying inode and lock vote signatures (0 = verify on the message thread, default: number of cores, at most 4)") + "\n";
 
     strUsage += "\n" + _("Anonsend options:") + "\n";
     strUsage += "  -enableanonsend=<n>          " + _("Enable use of automated anonsend for funds stored in this wallet (0-1, default: 0)") + "\n";
@@ -320,6 +333,8 @@ bool InitSanityCheck(void)
  */
 bool AppInit2(boost::thread_group& threadGroup)
 {
+    int64_t nInitStart = GetTimeMillis();
+
     // ********************************************************* Step 1: setup
 #ifdef _MSC_VER
     // Turn off Microsoft heap dump noise
@@ -380,6 +395,7 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     nNodeLifespan = GetArg("-addrlifespan", 7);
     fUseFastIndex = GetBoolArg("-fastindex", true);
+    fCompressBlocks = GetBoolArg("-compressblocks", false);
     nMinerSleep = GetArg("-minersleep", 500);
 
     nDerivationMethodIndex = 0;
@@ -457,6 +473,7 @@ bool AppInit2(boost::thread_group& threadGroup)
         fServer = true;
     fPrintToConsole = GetBoolArg("-printtoconsole", false);
     fLogTimestamps = GetBoolArg("-logtimestamps", false);
+    fLockProfile = GetBoolArg("-lockprofile", false);
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
 #endif
@@ -585,6 +602,26 @@ bool AppInit2(boost::thread_group& threadGroup)
                 return InitError(_("wallet.dat corrupt, salvage failed"));
         }
 
+        filesystem::path pathJournal = GetDataDir() / (strWalletFileName + ".journal");
+        bool fJournal = GetBoolArg("-walletjournal", false);
+        if (filesystem::exists(pathJournal) && filesystem::exists(GetDataDir() / strWalletFileName))
+            return InitError(strprintf(_("Both %s and %s exist in %s, move the one that isn't current away."),
+                                       strWalletFileName, pathJournal.filename().string(), strDataDir));
+        if (fJournal || filesystem::exists(pathJournal))
+        {
+            if (!bitdb.OpenJournal(strWalletFileName, GetBoolArg("-walletjournalsync", false)))
+                return InitError(strprintf(_("Error loading wallet journal %s"), pathJournal.string()));
+        }
+        if (!fJournal && filesystem::exists(pathJournal))
+        {
+            // -walletjournal was turned off, go back to a regular wallet.dat
+            uiInterface.InitMessage(_("Restoring wallet.dat from the wallet journal..."));
+            bool fExported = bitdb.ExportJournal(strWalletFileName, strWalletFileName);
+            bitdb.CloseJournal(strWalletFileName);
+            if (!fExported || !RenameOver(pathJournal, pathJournal.string() + ".exported"))
+                return InitError(strprintf(_("Error restoring %s from the wallet journal"), strWalletFileName));
+        }
+
     } // (!fDisableWallet)
 #endif // ENABLE_WALLET
     // ********************************************************* Step 6: network initialization
@@ -709,6 +746,8 @@ bool AppInit2(boost::thread_group& threadGroup)
         return false;
     }
 
+    InitBlockStore();
+
     uiInterface.InitMessage(_("Loading block index..."));
 
     nStart = GetTimeMillis();
@@ -726,6 +765,20 @@ bool AppInit2(boost::thread_group& threadGroup)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // the block index says which blocks a raw file holds, so it is converted afterwards
+    if (fCompressBlocks)
+    {
+        nStart = GetTimeMillis();
+        if (!CompressBlockFiles())
+            return InitError(_("Error compressing block files"));
+        LogPrintf(" compress    %15dms\n", GetTimeMillis() - nStart);
+    }
+
+    {
+        LOCK(cs_main);
+        chainStats.SetTip(pindexBest);
+    }
+
     if (GetBoolArg("-printblockindex", false) || GetBoolArg("-printblocktree", false))
     {
         PrintBlockTree();
@@ -736,7 +789,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     {
         string strMatch = mapArgs["-printblock"];
         int nFound = 0;
-        for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+        for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
         {
             uint256 hash = (*mi).first;
             if (strncmp(hash.ToString().c_str(), strMatch.c_str(), strMatch.size()) == 0)
@@ -976,6 +1029,12 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     threadGroup.create_thread(boost::bind(&ThreadCheckAnonSendPool));
 
+    int nMsgVerifyThreads = GetArg("-msgverifythreads", std::min(4, (int)boost::thread::hardware_concurrency()));
+    if (nMsgVerifyThreads > 0)
+        messageVerifyQueue.Start(threadGroup, nMsgVerifyThreads);
+
+    chainQuery.Start(threadGroup);
+
 
 
     RandAddSeedPerfmon();
@@ -1007,6 +1066,8 @@ bool AppInit2(boost::thread_group& threadGroup)
 #endif
 
     StartNode(threadGroup);
+    if (fLockProfile)
+        threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "lockstats", &LogLockStats, GetArg("-lockprofileinterval", 600) * 1000));
 #ifdef ENABLE_WALLET
     // InitRPCMining is needed here so getwork/getblocktemplate in the GUI debug console works properly.
     InitRPCMining();
@@ -1014,6 +1075,8 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (fServer)
         StartRPCThreads();
 
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "verifyblk", &ThreadVerifyBlocks));
+
 #ifdef ENABLE_WALLET
     // Mine proof-of-stake blocks in the background
     if (!GetBoolArg("-staking", true))
@@ -1025,6 +1088,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     // ********************************************************* Step 12: finished
 
     uiInterface.InitMessage(_("Done loading"));
+    LogPrintf(" startup     %15dms\n", GetTimeMillis() - nInitStart);
 
 #ifdef ENABLE_WALLET
     if (pwalletMain) {
@@ -5,6 +5,7 @@
 #include "main.h"
 #include "util.h"
 #include "addrman.h"
+#include "msgverify.h"
 #include <boost/lexical_cast.hpp>
 
 
@@ -13,7 +14,7 @@ int CINode::minProtoVersion = MIN_MN_PROTO_VERSION;
 CCriticalSection cs_inodes;
 
 /** The list of active inodes */
-std::vector<CINode> vecInodes;
+CInodeRegistry inodeRegistry;
 /** Object for who's going to get paid on which blocks */
 CInodePayments inodePayments;
 // keep track of inode votes I've seen
@@ -25,7 +26,6 @@ std::map<CNetAddr, int64_t> askedForInodeList;
 // which inodes we've asked for
 std::map<COutPoint, int64_t> askedForInodeListEntry;
 // cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
 
 // manage the inode connections
 void ProcessInodeConnections(){
@@ -43,6 +43,128 @@ void ProcessInodeConnections(){
     }
 }
 
+void CInodeAnnounce::Process(bool fValid)
+{
+    if(!fValid){
+        LogPrintf("dsee - Got bad inode address signature\n");
+        Misbehaving(nodeFrom, 100);
+        return;
+    }
+
+    //search existing inode list, this is where we update existing inodes with new dsee broadcasts
+    LOCK(cs_inodes);
+    int nHandle = inodeRegistry.Find(vin.prevout);
+    if(nHandle != -1) {
+        CINode& mn = inodeRegistry[nHandle];
+        // count == -1 when it's a new entry
+        //   e.g. We don't want the entry relayed/time updated when we're syncing the list
+        // mn.pubkey = pubkey, IsVinAssociatedWithPubkey is validated once below,
+        //   after that they just need to match
+        if(count == -1 && mn.pubkey == pubkey && !mn.UpdatedWithin(INODE_MIN_DSEE_SECONDS)){
+            mn.UpdateLastSeen();
+
+            if(mn.now < sigTime){ //take the newest entry
+                LogPrintf("dsee - Got updated entry for %s\n", addr.ToString().c_str());
+                mn.pubkey2 = pubkey2;
+                mn.now = sigTime;
+                mn.sig = vchSig;
+                inodeRegistry.Update(nHandle, addr, protocolVersion);
+
+                RelayAnonSendElectionEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion);
+            }
+        }
+
+        return;
+    }
+
+    // make sure the vout that was signed is related to the transaction that spawned the inode
+    //  - this is expensive, so it's only done once per inode
+    if(!anonSendSigner.IsVinAssociatedWithPubkey(vin, pubkey)) {
+        LogPrintf("dsee - Got mismatched pubkey and vin\n");
+        Misbehaving(nodeFrom, 100);
+        return;
+    }
+
+    if(fDebug) LogPrintf("dsee - Got NEW inode entry %s\n", addr.ToString().c_str());
+
+    // make sure it's still unspent
+    //  - this is checked later by .check() in many places and by ThreadCheckAnonSendPool()
+
+    CValidationState state;
+    CTransaction tx = CTransaction();
+    CTxOut vout = CTxOut(99999*COIN, anonSendPool.collateralPubKey);
+    tx.vin.push_back(vin);
+    tx.vout.push_back(vout);
+    //if(AcceptableInputs(mempool, state, tx)){
+    bool* pfMissingInputs = NULL;
+    if(AcceptableInputs(mempool, tx, false, pfMissingInputs)){
+        if(fDebug) LogPrintf("dsee - Accepted inode entry %i %i\n", count, current);
+
+        if(GetInputAge(vin) < INODE_MIN_CONFIRMATIONS){
+            LogPrintf("dsee - Input must have least %d confirmations\n", INODE_MIN_CONFIRMATIONS);
+            Misbehaving(nodeFrom, 20);
+            return;
+        }
+
+        // use this as a peer
+        addrman.Add(CAddress(addr), addrFrom, 2*60*60);
+
+        // add our inode
+        CINode mn(addr, vin, pubkey, vchSig, sigTime, pubkey2, protocolVersion);
+        mn.UpdateLastSeen(lastUpdated);
+        inodeRegistry.Add(mn);
+        anonSendScheduler.Trigger("denominate");
+
+        // if it matches our inodeprivkey, then we've been remotely activated
+        if(pubkey2 == activeInode.pubKeyInode && protocolVersion == PROTOCOL_VERSION){
+            activeInode.EnableHotColdINode(vin, addr);
+        }
+
+        if(count == -1 && !isLocal)
+            RelayAnonSendElectionEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion);
+
+    } else {
+        LogPrintf("dsee - Rejected inode entry %s\n", addr.ToString().c_str());
+
+        int nDoS = 0;
+        if (state.IsInvalid(nDoS))
+        {
+            LogPrintf("dsee - %s from %s %s was not accepted into the memory pool\n", tx.GetHash().ToString().c_str(),
+                addrFrom.ToString().c_str(), strSubVerFrom.c_str());
+            if (nDoS > 0)
+                Misbehaving(nodeFrom, nDoS);
+        }
+    }
+}
+
+void CInodePing::Process(bool fValid)
+{
+    if(!fValid){
+        LogPrintf("dseep - Got bad inode address signature %s \n", vin.ToString().c_str());
+        //Misbehaving(pfrom->GetId(), 100);
+        return;
+    }
+
+    LOCK(cs_inodes);
+    int nHandle = inodeRegistry.Find(vin.prevout);
+    if(nHandle == -1) return;
+
+    CINode& mn = inodeRegistry[nHandle];
+    // another ping may have been processed while this one was verified
+    if(mn.lastDseep >= sigTime) return;
+
+    mn.lastDseep = sigTime;
+
+    if(!mn.UpdatedWithin(INODE_MIN_DSEEP_SECONDS)){
+        mn.UpdateLastSeen();
+        if(stop) {
+            mn.Disable();
+            mn.Check();
+        }
+        RelayAnonSendElectionEntryPing(vin, vchSig, sigTime, stop);
+    }
+}
+
 void ProcessMessageInode(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
 
@@ -104,99 +226,34 @@ void ProcessMessageInode(CNode* pfrom, std::string& strCommand, CDataStream& vRe
             return;
         }
 
-        std::string errorMessage = "";
-        if(!anonSendSigner.VerifyMessage(pubkey, vchSig, strMessage, errorMessage)){
-            LogPrintf("dsee - Got bad inode address signature\n");
-            Misbehaving(pfrom->GetId(), 100);
-            return;
-        }
-
-        
-
-        //search existing inode list, this is where we update existing inodes with new dsee broadcasts
-	LOCK(cs_inodes);
-        BOOST_FOREACH(CINode& mn, vecInodes) {
-            if(mn.vin.prevout == vin.prevout) {
-                // count == -1 when it's a new entry
-                //   e.g. We don't want the entry relayed/time updated when we're syncing the list
-                // mn.pubkey = pubkey, IsVinAssociatedWithPubkey is validated once below,
-                //   after that they just need to match
-                if(count == -1 && mn.pubkey == pubkey && !mn.UpdatedWithin(INODE_MIN_DSEE_SECONDS)){
-                    mn.UpdateLastSeen();
-
-                    if(mn.now < sigTime){ //take the newest entry
-                        LogPrintf("dsee - Got updated entry for %s\n", addr.ToString().c_str());
-                        mn.pubkey2 = pubkey2;
-                        mn.now = sigTime;
-                        mn.sig = vchSig;
-                        mn.protocolVersion = protocolVersion;
-                        mn.addr = addr;
-
-                        RelayAnonSendElectionEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion);
-                    }
-                }
-
-                return;
+        // known inodes only take a fresh broadcast, everything else is dropped without paying for the signature
+        {
+            LOCK(cs_inodes);
+            int nHandle = inodeRegistry.Find(vin.prevout);
+            if(nHandle != -1) {
+                CINode& mn = inodeRegistry[nHandle];
+                if(count != -1 || mn.pubkey != pubkey || mn.UpdatedWithin(INODE_MIN_DSEE_SECONDS))
+                    return;
             }
         }
 
-        // make sure the vout that was signed is related to the transaction that spawned the inode
-        //  - this is expensive, so it's only done once per inode
-        if(!anonSendSigner.IsVinAssociatedWithPubkey(vin, pubkey)) {
-            LogPrintf("dsee - Got mismatched pubkey and vin\n");
-            Misbehaving(pfrom->GetId(), 100);
-            return;
-        }
-
-        if(fDebug) LogPrintf("dsee - Got NEW inode entry %s\n", addr.ToString().c_str());
-
-        // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckAnonSendPool()
-
-        CValidationState state;
-        CTransaction tx = CTransaction();
-        CTxOut vout = CTxOut(99999*COIN, anonSendPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-        //if(AcceptableInputs(mempool, state, tx)){
-	bool* pfMissingInputs = NULL;
-	if(AcceptableInputs(mempool, tx, false, pfMissingInputs)){
-            if(fDebug) LogPrintf("dsee - Accepted inode entry %i %i\n", count, current);
-
-            if(GetInputAge(vin) < INODE_MIN_CONFIRMATIONS){
-                LogPrintf("dsee - Input must have least %d confirmations\n", INODE_MIN_CONFIRMATIONS);
-                Misbehaving(pfrom->GetId(), 20);
-                return;
-            }
-
-            // use this as a peer
-            addrman.Add(CAddress(addr), pfrom->addr, 2*60*60);
-
-            // add our inode
-            CINode mn(addr, vin, pubkey, vchSig, sigTime, pubkey2, protocolVersion);
-            mn.UpdateLastSeen(lastUpdated);
-            vecInodes.push_back(mn);
-
-            // if it matches our inodeprivkey, then we've been remotely activated
-            if(pubkey2 == activeInode.pubKeyInode && protocolVersion == PROTOCOL_VERSION){
-                activeInode.EnableHotColdINode(vin, addr);
-            }
-
-            if(count == -1 && !isLocal)
-                RelayAnonSendElectionEntry(vin, addr, vchSig, sigTime, pubkey, pubkey2, count, current, lastUpdated, protocolVersion);
+        CInodeAnnounce announce;
+        announce.nodeFrom = pfrom->GetId();
+        announce.addrFrom = pfrom->addr;
+        announce.strSubVerFrom = pfrom->cleanSubVer;
+        announce.vin = vin;
+        announce.addr = addr;
+        announce.vchSig = vchSig;
+        announce.sigTime = sigTime;
+        announce.pubkey = pubkey;
+        announce.pubkey2 = pubkey2;
+        announce.count = count;
+        announce.current = current;
+        announce.lastUpdated = lastUpdated;
+        announce.protocolVersion = protocolVersion;
+        announce.isLocal = isLocal;
 
-        } else {
-            LogPrintf("dsee - Rejected inode entry %s\n", addr.ToString().c_str());
-
-            int nDoS = 0;
-            if (state.IsInvalid(nDoS))
-            {
-                LogPrintf("dsee - %s from %s %s was not accepted into the memory pool\n", tx.GetHash().ToString().c_str(),
-                    pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str());
-                if (nDoS > 0)
-                    Misbehaving(pfrom->GetId(), nDoS);
-            }
-        }
+        messageVerifyQueue.Push(pubkey, vchSig, strMessage, boost::bind(&CInodeAnnounce::Process, announce, _1));
     }
 
     else if (strCommand == "dseep") { //AnonSend Election Entry Ping
@@ -223,31 +280,22 @@ void ProcessMessageInode(CNode* pfrom, std::string& strCommand, CDataStream& vRe
         }
 
         // see if we have this inode
-	LOCK(cs_inodes);
-        BOOST_FOREACH(CINode& mn, vecInodes) {
-            if(mn.vin.prevout == vin.prevout) {
-            	// LogPrintf("dseep - Found corresponding mn for vin: %s\n", vin.ToString().c_str());
-            	// take this only if it's newer
+        {
+            LOCK(cs_inodes);
+            int nHandle = inodeRegistry.Find(vin.prevout);
+            if(nHandle != -1) {
+                CINode& mn = inodeRegistry[nHandle];
+                // LogPrintf("dseep - Found corresponding mn for vin: %s\n", vin.ToString().c_str());
+                // take this only if it's newer
                 if(mn.lastDseep < sigTime){
                     std::string strMessage = mn.addr.ToString() + boost::lexical_cast<std::string>(sigTime) + boost::lexical_cast<std::string>(stop);
 
-                    std::string errorMessage = "";
-                    if(!anonSendSigner.VerifyMessage(mn.pubkey2, vchSig, strMessage, errorMessage)){
-                        LogPrintf("dseep - Got bad inode address signature %s \n", vin.ToString().c_str());
-                        //Misbehaving(pfrom->GetId(), 100);
-                        return;
-                    }
-
-                    mn.lastDseep = sigTime;
-
-                    if(!mn.UpdatedWithin(INODE_MIN_DSEEP_SECONDS)){
-                        mn.UpdateLastSeen();
-                        if(stop) {
-                            mn.Disable();
-                            mn.Check();
-                        }
-                        RelayAnonSendElectionEntryPing(vin, vchSig, sigTime, stop);
-                    }
+                    CInodePing ping;
+                    ping.vin = vin;
+                    ping.vchSig = vchSig;
+                    ping.sigTime = sigTime;
+                    ping.stop = stop;
+                    messageVerifyQueue.Push(mn.pubkey2, vchSig, strMessage, boost::bind(&CInodePing::Process, ping, _1));
                 }
                 return;
             }
@@ -297,24 +345,30 @@ void ProcessMessageInode(CNode* pfrom, std::string& strCommand, CDataStream& vRe
         } //else, asking for a specific node which is ok
 
 	LOCK(cs_inodes);
-        int count = vecInodes.size();
+        int count = inodeRegistry.size();
         int i = 0;
 
-        BOOST_FOREACH(CINode mn, vecInodes) {
+        if(vin != CTxIn()) {
+            int nHandle = inodeRegistry.Find(vin.prevout);
+            if(nHandle == -1) return;
+
+            CINode& mn = inodeRegistry[nHandle];
+            if(mn.addr.IsRFC1918()) return; //local network
+
+            if(fDebug) LogPrintf("dseg - Sending inode entry - %s \n", mn.addr.ToString().c_str());
+            pfrom->PushMessage("dsee", mn.vin, mn.addr, mn.sig, mn.now, mn.pubkey, mn.pubkey2, count, nHandle, mn.lastTimeSeen, mn.protocolVersion);
+            LogPrintf("dseg - Sent 1 inode entries to %s\n", pfrom->addr.ToString().c_str());
+            return;
+        }
+
+        BOOST_FOREACH(CINode& mn, inodeRegistry) {
 
             if(mn.addr.IsRFC1918()) continue; //local network
 
-            if(vin == CTxIn()){
-                mn.Check();
-                if(mn.IsEnabled()) {
-                    if(fDebug) LogPrintf("dseg - Sending inode entry - %s \n", mn.addr.ToString().c_str());
-                    pfrom->PushMessage("dsee", mn.vin, mn.addr, mn.sig, mn.now, mn.pubkey, mn.pubkey2, count, i, mn.lastTimeSeen, mn.protocolVersion);
-                }
-            } else if (vin == mn.vin) {
+            mn.Check();
+            if(mn.IsEnabled()) {
                 if(fDebug) LogPrintf("dseg - Sending inode entry - %s \n", mn.addr.ToString().c_str());
                 pfrom->PushMessage("dsee", mn.vin, mn.addr, mn.sig, mn.now, mn.pubkey, mn.pubkey2, count, i, mn.lastTimeSeen, mn.protocolVersion);
-                LogPrintf("dseg - Sent 1 inode entries to %s\n", pfrom->addr.ToString().c_str());
-                return;
             }
             i++;
         }
@@ -396,44 +450,28 @@ struct CompareValueOnly2
 
 int CountInodesAboveProtocol(int protocolVersion)
 {
-    int i = 0;
     LOCK(cs_inodes);
-    BOOST_FOREACH(CINode& mn, vecInodes) {
-        if(mn.protocolVersion < protocolVersion) continue;
-        i++;
-    }
-
-    return i;
-
+    return inodeRegistry.CountAboveProtocol(protocolVersion);
 }
 
 
 int GetInodeByVin(CTxIn& vin)
 {
-    int i = 0;
     LOCK(cs_inodes);
-    BOOST_FOREACH(CINode& mn, vecInodes) {
-        if (mn.vin == vin) return i;
-        i++;
-    }
-
-    return -1;
+    return inodeRegistry.Find(vin.prevout);
 }
 
 int GetCurrentINode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int i = 0;
     unsigned int score = 0;
     int winner = -1;
     LOCK(cs_inodes);
     // scan for winner
-    BOOST_FOREACH(CINode mn, vecInodes) {
+    for(int i = 0; i < (int)inodeRegistry.size(); i++) {
+        CINode& mn = inodeRegistry[i];
         mn.Check();
         if(mn.protocolVersion < minProtocol) continue;
-        if(!mn.IsEnabled()) {
-            i++;
-            continue;
-        }
+        if(!mn.IsEnabled()) continue;
 
         // calculate the score for each inode
         uint256 n = mn.CalculateScore(mod, nBlockHeight);
@@ -445,7 +483,6 @@ int GetCurrentINode(int mod, int64_t nBlockHeight, int minProtocol)
             score = n2;
             winner = i;
         }
-        i++;
     }
 
     return winner;
@@ -454,25 +491,19 @@ int GetCurrentINode(int mod, int64_t nBlockHeight, int minProtocol)
 int GetInodeByRank(int findRank, int64_t nBlockHeight, int minProtocol)
 {
     LOCK(cs_inodes);
-    int i = 0;
-
     std::vector<pair<unsigned int, int> > vecInodeScores;
 
-    i = 0;
-    BOOST_FOREACH(CINode mn, vecInodes) {
+    for(int i = 0; i < (int)inodeRegistry.size(); i++) {
+        CINode& mn = inodeRegistry[i];
         mn.Check();
         if(mn.protocolVersion < minProtocol) continue;
-        if(!mn.IsEnabled()) {
-            i++;
-            continue;
-        }
+        if(!mn.IsEnabled()) continue;
 
         uint256 n = mn.CalculateScore(1, nBlockHeight);
         unsigned int n2 = 0;
         memcpy(&n2, &n, sizeof(n2));
 
         vecInodeScores.push_back(make_pair(n2, i));
-        i++;
     }
 
     sort(vecInodeScores.rbegin(), vecInodeScores.rend(), CompareValueOnly2());
@@ -491,7 +522,7 @@ int GetInodeRank(CTxIn& vin, int64_t nBlockHeight, int minProtocol)
     LOCK(cs_inodes);
     std::vector<pair<unsigned int, CTxIn> > vecInodeScores;
 
-    BOOST_FOREACH(CINode& mn, vecInodes) {
+    BOOST_FOREACH(CINode& mn, inodeRegistry) {
         mn.Check();
 
         if(mn.protocolVersion < minProtocol) continue;
@@ -519,42 +550,21 @@ int GetInodeRank(CTxIn& vin, int64_t nBlockHeight, int minProtocol)
     return -1;
 }
 
-//Get the last hash that matches the modulus given. Processed in reverse order
+// Hash of the block before nBlockHeight on the best chain, or of the block
+// before the tip when nBlockHeight is 0. The genesis block is never returned.
 bool GetBlockHash(uint256& hash, int nBlockHeight)
 {
-    if (pindexBest == NULL) return false;
+    LOCK_SHARED(cs_blockindex);
+    if (pindexBest == NULL || pindexBest->nHeight == 0)
+        return false;
 
-    if(nBlockHeight == 0)
+    if (nBlockHeight == 0)
         nBlockHeight = pindexBest->nHeight;
+    if (nBlockHeight < 2 || nBlockHeight > pindexBest->nHeight + 1)
+        return false;
 
-    if(mapCacheBlockHashes.count(nBlockHeight)){
-        hash = mapCacheBlockHashes[nBlockHeight];
-        return true;
-    }
-
-    const CBlockIndex *BlockLastSolved = pindexBest;
-    const CBlockIndex *BlockReading = pindexBest;
-
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || pindexBest->nHeight+1 < nBlockHeight) return false;
-
-    int nBlocksAgo = 0;
-    if(nBlockHeight > 0) nBlocksAgo = (pindexBest->nHeight+1)-nBlockHeight;
-    assert(nBlocksAgo >= 0);
-
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nBlocksAgo){
-            hash = BlockReading->GetBlockHash();
-            mapCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
-
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
-    }
-
-    return false;
+    hash = chainActive[nBlockHeight - 1]->GetBlockHash();
+    return true;
 }
 
 //
@@ -580,6 +590,11 @@ uint256 CINode::CalculateScore(int mod, int64_t nBlockHeight)
 }
 
 void CINode::Check()
+{
+    Check(!NeedsCollateralCheck() || IsCollateralUnspent(vin));
+}
+
+void CINode::Check(bool fCollateralUnspent)
 {
     //once spent, stop doing the checks
     if(enabled==3) return;
@@ -595,22 +610,132 @@ void CINode::Check()
         return;
     }
 
-    if(!unitTest){
-        CValidationState state;
-        CTransaction tx = CTransaction();
-        CTxOut vout = CTxOut(99999*COIN, anonSendPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
+    if(!fCollateralUnspent){
+        enabled = 3;
+        return;
+    }
 
-        //if(!AcceptableInputs(mempool, state, tx)){
-        bool* pfMissingInputs = NULL;
-	if(!AcceptableInputs(mempool, tx, false, pfMissingInputs)){
-            enabled = 3;
-            return;
+    enabled = 1; // OK
+}
+
+bool CINode::IsCollateralUnspent(const CTxIn& vin)
+{
+    CTransaction tx = CTransaction();
+    CTxOut vout = CTxOut(99999*COIN, anonSendPool.collateralPubKey);
+    tx.vin.push_back(vin);
+    tx.vout.push_back(vout);
+
+    bool* pfMissingInputs = NULL;
+    return AcceptableInputs(mempool, tx, false, pfMissingInputs);
+}
+
+COutPointHasher::COutPointHasher()
+{
+    nSalt = (size_t)GetRand(std::numeric_limits<uint64_t>::max());
+}
+
+void CInodeRegistry::IndexEntry(int nHandle)
+{
+    const CINode& mn = vInodes[nHandle];
+    mapByOutpoint[mn.vin.prevout] = nHandle;
+    mapCountByProtocol[mn.protocolVersion]++;
+}
+
+void CInodeRegistry::Reindex()
+{
+    mapByOutpoint.clear();
+    mapCountByProtocol.clear();
+    for(int i = 0; i < (int)vInodes.size(); i++)
+        IndexEntry(i);
+}
+
+int CInodeRegistry::Find(const COutPoint& outpoint) const
+{
+    boost::unordered_map<COutPoint, int, COutPointHasher>::const_iterator it = mapByOutpoint.find(outpoint);
+    if(it == mapByOutpoint.end()) return -1;
+    return it->second;
+}
+
+int CInodeRegistry::Add(const CINode& mn)
+{
+    int nHandle = Find(mn.vin.prevout);
+    if(nHandle != -1) return nHandle;
+
+    vInodes.push_back(mn);
+    nHandle = vInodes.size() - 1;
+    IndexEntry(nHandle);
+    return nHandle;
+}
+
+void CInodeRegistry::Update(int nHandle, const CService& addr, int protocolVersion)
+{
+    CINode& mn = vInodes[nHandle];
+
+    mn.addr = addr;
+
+    if(mn.protocolVersion != protocolVersion) {
+        if(--mapCountByProtocol[mn.protocolVersion] == 0)
+            mapCountByProtocol.erase(mn.protocolVersion);
+        mn.protocolVersion = protocolVersion;
+        mapCountByProtocol[protocolVersion]++;
+    }
+}
+
+int CInodeRegistry::CountAboveProtocol(int protocolVersion) const
+{
+    int nCount = 0;
+    for(std::map<int, int>::const_iterator it = mapCountByProtocol.lower_bound(protocolVersion); it != mapCountByProtocol.end(); ++it)
+        nCount += it->second;
+    return nCount;
+}
+
+void CInodeRegistry::GetShuffledHandles(std::vector<int>& vHandles) const
+{
+    vHandles.resize(vInodes.size());
+    for(int i = 0; i < (int)vHandles.size(); i++)
+        vHandles[i] = i;
+    std::random_shuffle(vHandles.begin(), vHandles.end());
+}
+
+int CInodeRegistry::RemoveInactive()
+{
+    for(std::vector<CINode>::iterator it = vInodes.begin(); it != vInodes.end(); ++it)
+        (*it).Check();
+    return Compact();
+}
+
+int CInodeRegistry::RemoveInactive(const std::set<COutPoint>& setSpent)
+{
+    for(std::vector<CINode>::iterator it = vInodes.begin(); it != vInodes.end(); ++it)
+        (*it).Check(setSpent.count((*it).vin.prevout) == 0);
+    return Compact();
+}
+
+int CInodeRegistry::Compact()
+{
+    std::vector<CINode>::iterator itOut = vInodes.begin();
+    for(std::vector<CINode>::iterator it = vInodes.begin(); it != vInodes.end(); ++it) {
+        if((*it).enabled == 4 || (*it).enabled == 3) {
+            LogPrintf("Removing inactive inode %s\n", (*it).addr.ToString().c_str());
+            continue;
         }
+        if(itOut != it) *itOut = *it;
+        ++itOut;
     }
 
-    enabled = 1; // OK
+    int nRemoved = vInodes.end() - itOut;
+    if(nRemoved > 0) {
+        vInodes.erase(itOut, vInodes.end());
+        Reindex();
+    }
+    return nRemoved;
+}
+
+void CInodeRegistry::Clear()
+{
+    vInodes.clear();
+    mapByOutpoint.clear();
+    mapCountByProtocol.clear();
 }
 
 bool CInodePayments::CheckSignature(CInodePaymentWinner& winner)
@@ -733,7 +858,7 @@ void CInodePayments::CleanPaymentList()
     LOCK(cs_inodes);
     if(pindexBest == NULL) return;
 
-    int nLimit = std::max(((int)vecInodes.size())*2, 1000);
+    int nLimit = std::max(((int)inodeRegistry.size())*2, 1000);
 
     vector<CInodePaymentWinner>::iterator it;
     for(it=vWinning.begin();it<vWinning.end();it++){
@@ -756,11 +881,13 @@ bool CInodePayments::ProcessBlock(int nBlockHeight)
     BOOST_REVERSE_FOREACH(CInodePaymentWinner& winner, vWinning){
         vecLastPayments.push_back(winner.vin);
         //if we have one full payment cycle, break
-        if(++c > (int)vecInodes.size()) break;
+        if(++c > (int)inodeRegistry.size()) break;
     }
 
-    std::random_shuffle ( vecInodes.begin(), vecInodes.end() );
-    BOOST_FOREACH(CINode& mn, vecInodes) {
+    std::vector<int> vHandles;
+    inodeRegistry.GetShuffledHandles(vHandles);
+    BOOST_FOREACH(int nHandle, vHandles) {
+        CINode& mn = inodeRegistry[nHandle];
         bool found = false;
         BOOST_FOREACH(CTxIn& vin, vecLastPayments)
             if(mn.vin == vin) found = true;
@@ -781,11 +908,11 @@ bool CInodePayments::ProcessBlock(int nBlockHeight)
     }
 
     //if we can't find someone to get paid, pick randomly
-    if(winner.nBlockHeight == 0 && vecInodes.size() > 0) {
+    if(winner.nBlockHeight == 0 && !vHandles.empty()) {
         winner.score = 0;
         winner.nBlockHeight = nBlockHeight;
-        winner.vin = vecInodes[0].vin;
-        winner.payee =GetScriptForDestination(vecInodes[0].pubkey.GetID());
+        winner.vin = inodeRegistry[vHandles[0]].vin;
+        winner.payee =GetScriptForDestination(inodeRegistry[vHandles[0]].pubkey.GetID());
     }
 
     if(Sign(winner)){
@@ -16,6 +16,8 @@
 #include "timedata.h"
 #include "script.h"
 
+#include <boost/unordered_map.hpp>
+
 class CINode;
 class CInodePayments;
 class uint256;
@@ -40,13 +42,13 @@ class uint256;
 using namespace std;
 
 class CInodePaymentWinner;
+class CInodeRegistry;
 
 extern CCriticalSection cs_inodes;
-extern std::vector<CINode> vecInodes;
+extern CInodeRegistry inodeRegistry;
 extern CInodePayments inodePayments;
 extern std::vector<CTxIn> vecInodeAskedFor;
 extern map<uint256, CInodePaymentWinner> mapSeenInodeVotes;
-extern map<int64_t, uint256> mapCacheBlockHashes;
 
 
 // manage the inode connections
@@ -120,6 +122,15 @@ public:
     }
 
     void Check();
+    // same as Check() with the collateral lookup done by the caller
+    void Check(bool fCollateralUnspent);
+    // whether the collateral can still be spent, requires cs_main
+    static bool IsCollateralUnspent(const CTxIn& vin);
+    // whether Check() would look the collateral up at all
+    bool NeedsCollateralCheck()
+    {
+        return enabled != 3 && !unitTest && UpdatedWithin(INODE_EXPIRATION_SECONDS);
+    }
 
     bool UpdatedWithin(int seconds)
     {
@@ -152,6 +163,111 @@ public:
 };
 
 
+/** Hasher for collateral outpoints, salted per process so peers can't aim at one bucket */
+struct COutPointHasher
+{
+    size_t nSalt;
+
+    COutPointHasher();
+
+    size_t operator()(const COutPoint& outpoint) const
+    {
+        size_t nSeed = nSalt;
+        boost::hash_combine(nSeed, outpoint.hash.Get64(0));
+        boost::hash_combine(nSeed, outpoint.hash.Get64(1));
+        boost::hash_combine(nSeed, outpoint.n);
+        return nSeed;
+    }
+};
+
+//
+// The inode list. Entries live in one contiguous vector and are addressed by an
+// integer handle (their position), with a hash index on the collateral outpoint
+// and a count of entries per protocol version. Every lookup goes by collateral,
+// so there is no index by address. Handles stay valid
+// across Add() and Update(); only the bulk expiry in RemoveInactive() compacts
+// the storage and renumbers them. All members must be called with cs_inodes held.
+//
+class CInodeRegistry
+{
+private:
+    std::vector<CINode> vInodes;
+    boost::unordered_map<COutPoint, int, COutPointHasher> mapByOutpoint;
+    std::map<int, int> mapCountByProtocol;
+
+    void IndexEntry(int nHandle);
+    void Reindex();
+    int Compact();
+
+public:
+    typedef std::vector<CINode>::iterator iterator;
+    typedef std::vector<CINode>::const_iterator const_iterator;
+
+    iterator begin() { return vInodes.begin(); }
+    iterator end() { return vInodes.end(); }
+    const_iterator begin() const { return vInodes.begin(); }
+    const_iterator end() const { return vInodes.end(); }
+    size_t size() const { return vInodes.size(); }
+    bool empty() const { return vInodes.empty(); }
+    CINode& operator[](int nHandle) { return vInodes[nHandle]; }
+    const CINode& operator[](int nHandle) const { return vInodes[nHandle]; }
+
+    // handle of the inode with this collateral, or -1
+    int Find(const COutPoint& outpoint) const;
+    int Find(const CTxIn& vin) const { return Find(vin.prevout); }
+
+    // insert a new inode, or return the handle of the existing one with the same collateral
+    int Add(const CINode& mn);
+    // change the address and protocol version of an entry, keeping the protocol counts
+    void Update(int nHandle, const CService& addr, int protocolVersion);
+
+    int CountAboveProtocol(int protocolVersion) const;
+    // all handles in random order, replaces shuffling the list itself
+    void GetShuffledHandles(std::vector<int>& vHandles) const;
+
+    // run Check() on every entry and drop the spent and expired ones in a single pass
+    int RemoveInactive();
+    // same, with the collateral lookups already done: setSpent holds the spent collaterals
+    int RemoveInactive(const std::set<COutPoint>& setSpent);
+    void Clear();
+};
+
+
+/** A "dsee" announcement waiting for its signature to be verified */
+class CInodeAnnounce
+{
+public:
+    NodeId nodeFrom;
+    CAddress addrFrom;
+    std::string strSubVerFrom;
+    CTxIn vin;
+    CService addr;
+    std::vector<unsigned char> vchSig;
+    int64_t sigTime;
+    CPubKey pubkey;
+    CPubKey pubkey2;
+    int count;
+    int current;
+    int64_t lastUpdated;
+    int protocolVersion;
+    bool isLocal;
+
+    void Process(bool fValid);
+};
+
+/** A "dseep" ping waiting for its signature to be verified */
+class CInodePing
+{
+public:
+    CTxIn vin;
+    std::vector<unsigned char> vchSig;
+    int64_t sigTime;
+    bool stop;
+
+    void Process(bool fValid);
+};
+
+
 // Get the current winner for this block
 int GetCurrentINode(int mod=1, int64_t nBlockHeight=0, int minProtocol=CINode::minProtoVersion);
 
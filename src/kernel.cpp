@@ -7,6 +7,7 @@
 
 #include "kernel.h"
 #include "txdb.h"
+#include "crypto/common.h"
 
 using namespace std;
 
@@ -221,6 +222,37 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
     return true;
 }
 
+// Same result as CBigNum().SetCompact(nBits) * bnWeight, where the weight has
+// magnitude bnWeight and is negative if fNegativeWeight. Returns the low 256 bits
+// of the magnitude, fNegative and fOverflow flag the results that don't fit.
+static uint256 GetWeightedTarget(unsigned int nBits, const uint256& bnWeight, bool fNegativeWeight, bool& fNegative, bool& fOverflow)
+{
+    uint256 bnTarget;
+    bool fNegativeTarget, fOverflowTarget;
+    bnTarget.SetCompact(nBits, &fNegativeTarget, &fOverflowTarget);
+
+    fNegative = false;
+    fOverflow = false;
+    if ((bnTarget == 0 && !fOverflowTarget) || bnWeight == 0)
+        return 0;
+    fNegative = fNegativeTarget != fNegativeWeight;
+
+    // bnTarget holds the low 256 bits of an overflowing target, so the low
+    // half of the 512 bit product is still exact
+    uint512 bnProduct = uint512(bnTarget) * uint512(bnWeight);
+    fOverflow = fOverflowTarget || (bnProduct >> 256) != 0;
+    return bnProduct.trim256();
+}
+
+static bool HashMeetsTarget(const uint256& hash, const uint256& target, bool fNegative, bool fOverflow)
+{
+    if (fNegative)
+        return false;
+    if (fOverflow)
+        return true;
+    return hash <= target;
+}
+
 // ppcoin kernel protocol
 // coinstake must meet hash target according to the protocol:
 // kernel (input 0) must meet the formula
@@ -242,21 +274,23 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlockHeaderView& blockFrom, unsigned int nTxPrevOffset, unsigned int nTimeTxPrev, int64_t nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
     unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
 
-    CBigNum bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
+    int64_t nTimeWeight = GetWeight((int64_t)nTimeTxPrev, (int64_t)nTimeTx);
 
     uint256 hashBlockFrom = blockFrom.GetHash();
 
-    CBigNum bnCoinDayWeight = CBigNum(nValueIn) * GetWeight((int64_t)txPrev.nTime, (int64_t)nTimeTx) / COIN / (24 * 60 * 60);
-    targetProofOfStake = (bnCoinDayWeight * bnTargetPerCoinDay).getuint256();
+    // coin day weight, divided with truncation towards zero the way CBigNum does
+    uint256 bnCoinDayWeight = uint256(nValueIn < 0 ? -(uint64_t)nValueIn : (uint64_t)nValueIn) *
+                              uint256(nTimeWeight < 0 ? -(uint64_t)nTimeWeight : (uint64_t)nTimeWeight);
+    bnCoinDayWeight = bnCoinDayWeight / COIN / (24 * 60 * 60);
+    bool fNegativeTarget, fOverflowTarget;
+    targetProofOfStake = GetWeightedTarget(nBits, bnCoinDayWeight, (nValueIn < 0) != (nTimeWeight < 0), fNegativeTarget, fOverflowTarget);
 
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
@@ -268,7 +302,7 @@ static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom,
         return false;
     ss << nStakeModifier;
 
-    ss << nTimeBlockFrom << nTxPrevOffset << txPrev.nTime << prevout.n << nTimeTx;
+    ss << nTimeBlockFrom << nTxPrevOffset << nTimeTxPrev << prevout.n << nTimeTx;
     hashProofOfStake = Hash(ss.begin(), ss.end());
     if (fPrintProofOfStake)
     {
@@ -279,12 +313,12 @@ static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom,
             DateTimeStrFormat(blockFrom.GetBlockTime()));
         LogPrintf("CheckStakeKernelHash() : check modifier=0x%016x nTimeBlockFrom=%u nTxPrevOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, nTxPrevOffset, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTxPrevOffset, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
     // Now check if proof-of-stake hash meets target protocol
-    if (CBigNum(hashProofOfStake) > bnCoinDayWeight * bnTargetPerCoinDay)
+    if (!HashMeetsTarget(hashProofOfStake, targetProofOfStake, fNegativeTarget, fOverflowTarget))
         return false;
     if (fDebug && !fPrintProofOfStake)
     {
@@ -295,7 +329,7 @@ static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom,
             DateTimeStrFormat(blockFrom.GetBlockTime()));
         LogPrintf("CheckStakeKernelHash() : pass modifier=0x%016x nTimeBlockFrom=%u nTxPrevOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, nTxPrevOffset, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTxPrevOffset, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
     return true;
@@ -322,33 +356,22 @@ static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom,
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, int64_t nValueIn, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
     if (nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation");
 
-    // Base target
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
-
-    // Weighted target
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    CBigNum bnWeight = CBigNum(nValueIn);
-    bnTarget *= bnWeight;
-
-    targetProofOfStake = bnTarget.getuint256();
-
     uint64_t nStakeModifier = pindexPrev->nStakeModifier;
     int nStakeModifierHeight = pindexPrev->nHeight;
     int64_t nStakeModifierTime = pindexPrev->nTime;
 
-    // Calculate hash
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier << nTimeBlockFrom << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
-    hashProofOfStake = Hash(ss.begin(), ss.end());
+    // Weighted target and hash
+    CStakeKernel kernel(nStakeModifier, nTimeBlockFrom, nTimeTxPrev, prevout, nBits, nValueIn);
+    targetProofOfStake = kernel.GetTarget();
+    hashProofOfStake = kernel.GetHash(nTimeTx);
 
     if (fPrintProofOfStake)
     {
@@ -358,12 +381,12 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
             DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : check modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
     // Now check if proof-of-stake hash meets target protocol
-    if (CBigNum(hashProofOfStake) > bnTarget)
+    if (!kernel.MeetsTarget(hashProofOfStake))
         return false;
 
     if (fDebug && !fPrintProofOfStake)
@@ -374,19 +397,35 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
             DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : pass modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
     return true;
 }
 
-bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlockHeaderView& blockFrom, unsigned int nTxPrevOffset, const CTransactionView& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
+    CTxOutView txoutPrev;
+    if (!txPrev.GetOutput(prevout.n, txoutPrev))
+        return error("CheckStakeKernelHash() : prevout %u out of range", prevout.n);
+
     if (IsProtocolV2(pindexPrev->nHeight+1))
-        return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+        return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev.GetTime(), txoutPrev.GetValue(), prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
     else
-        return CheckStakeKernelHashV1(nBits, blockFrom, nTxPrevOffset, txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+        return CheckStakeKernelHashV1(nBits, blockFrom, nTxPrevOffset, txPrev.GetTime(), txoutPrev.GetValue(), prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+}
+
+// Read the transaction prevout spends and the header of its block, as views
+// over the serialized bytes so only the fields the kernel uses are decoded
+static bool ReadKernelCoin(CTxDB& txdb, const COutPoint& prevout, CDiskTxBytes& coinRet)
+{
+    CTxIndex txindex;
+    if (!txdb.ReadTxIndex(prevout.hash, txindex))
+        return false;
+    if (!coinRet.ReadFromDisk(txindex.pos))
+        return false;
+    return prevout.n < coinRet.GetTransaction().GetOutputCount();
 }
 
 // Check kernel hash target and coinstake signature
@@ -398,23 +437,26 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    // First try finding the previous transaction in database
+    // First try finding the previous transaction in database, with the header of its block
     CTxDB txdb("r");
-    CTransaction txPrev;
     CTxIndex txindex;
-    if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
+    if (!txdb.ReadTxIndex(txin.prevout.hash, txindex))
         return tx.DoS(1, error("CheckProofOfStake() : INFO: read txPrev failed"));  // previous transaction not in main chain, may occur during initial download
-
-    // Verify signature
-    if (!VerifySignature(txPrev, tx, 0, SCRIPT_VERIFY_NONE, 0))
-        return tx.DoS(100, error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString()));
-
-    // Read block header
-    CBlock block;
-    if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+    CDiskTxBytes coin;
+    if (!coin.ReadFromDisk(txindex.pos))
         return fDebug? error("CheckProofOfStake() : read block failed") : false; // unable to read block of previous transaction
+    CTransactionView txPrev = coin.GetTransaction();
+    if (txin.prevout.n >= txPrev.GetOutputCount())
+        return tx.DoS(1, error("CheckProofOfStake() : INFO: read txPrev failed"));
+
+    // Verify signature, as VerifySignature does with the whole txPrev
+    CTxOutView txoutPrev;
+    txPrev.GetOutput(txin.prevout.n, txoutPrev);
+    if (txPrev.GetHash() != txin.prevout.hash ||
+        !VerifyScript(txin.scriptSig, txoutPrev.GetScriptPubKey(), tx, 0, SCRIPT_VERIFY_NONE, 0))
+        return tx.DoS(100, error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString()));
 
-    if (!CheckStakeKernelHash(pindexPrev, nBits, block, txindex.pos.nTxPos - txindex.pos.nBlockPos, txPrev, txin.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, fDebug))
+    if (!CheckStakeKernelHash(pindexPrev, nBits, coin.GetHeader(), coin.GetTxOffset(), txPrev, txin.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, fDebug))
         return tx.DoS(1, error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", tx.GetHash().ToString(), hashProofOfStake.ToString())); // may occur during initial download or if behind on block chain sync
 
     return true;
@@ -434,15 +476,10 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, con
     uint256 hashProofOfStake, targetProofOfStake;
 
     CTxDB txdb("r");
-    CTransaction txPrev;
-    CTxIndex txindex;
-    if (!txPrev.ReadFromDisk(txdb, prevout, txindex))
-        return false;
-
-    // Read block header
-    CBlock block;
-    if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+    CDiskTxBytes coin;
+    if (!ReadKernelCoin(txdb, prevout, coin))
         return false;
+    CBlockHeaderView block = coin.GetHeader();
 
     if (block.GetBlockTime() + nStakeMinAge > nTime)
         return false; // only count coins meeting min age requirement
@@ -450,5 +487,117 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, con
     if (pBlockTime)
         *pBlockTime = block.GetBlockTime();
 
-    return CheckStakeKernelHash(pindexPrev, nBits, block, txindex.pos.nTxPos - txindex.pos.nBlockPos, txPrev, prevout, nTime, hashProofOfStake, targetProofOfStake);
+    return CheckStakeKernelHash(pindexPrev, nBits, block, coin.GetTxOffset(), coin.GetTransaction(), prevout, nTime, hashProofOfStake, targetProofOfStake);
+}
+
+CStakeKernel::CStakeKernel(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, const COutPoint& prevout, unsigned int nBits, int64_t nValueIn)
+    : hasher(&BuildPrefix(nStakeModifier, nTimeBlockFrom, nTimeTxPrev, prevout)[0])
+{
+    uint256 bnValueIn = nValueIn < 0 ? -(uint64_t)nValueIn : (uint64_t)nValueIn;
+    target = GetWeightedTarget(nBits, bnValueIn, nValueIn < 0, fNegative, fOverflow);
+}
+
+// nStakeModifier + nTimeBlockFrom + txPrev.nTime + prevout.hash + prevout.n, serialized the way CDataStream does
+std::vector<unsigned char> CStakeKernel::BuildPrefix(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, const COutPoint& prevout)
+{
+    std::vector<unsigned char> vPrefix(CSHA256D56::PREFIX_SIZE);
+    WriteLE64(&vPrefix[0], nStakeModifier);
+    WriteLE32(&vPrefix[8], nTimeBlockFrom);
+    WriteLE32(&vPrefix[12], nTimeTxPrev);
+    memcpy(&vPrefix[16], prevout.hash.begin(), 32);
+    WriteLE32(&vPrefix[48], prevout.n);
+    return vPrefix;
+}
+
+uint256 CStakeKernel::GetHash(unsigned int nTimeTx) const
+{
+    unsigned char vTime[4];
+    WriteLE32(vTime, nTimeTx);
+    uint256 hash;
+    hasher.Finalize(vTime, 1, hash.begin());
+    return hash;
+}
+
+bool CStakeKernel::MeetsTarget(const uint256& hash) const
+{
+    return HashMeetsTarget(hash, target, fNegative, fOverflow);
+}
+
+int CStakeKernel::Search(const std::vector<unsigned int>& vTimes, uint256& hashProofOfStake) const
+{
+    static const unsigned int nBatch = 64;
+    unsigned char vSuffixes[nBatch * 4];
+    unsigned char vHashes[nBatch * 32];
+
+    for (unsigned int nStart = 0; nStart < vTimes.size(); nStart += nBatch)
+    {
+        unsigned int nCount = std::min(nBatch, (unsigned int)vTimes.size() - nStart);
+        for (unsigned int i = 0; i < nCount; i++)
+            WriteLE32(vSuffixes + 4 * i, vTimes[nStart + i]);
+        hasher.Finalize(vSuffixes, nCount, vHashes);
+
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            uint256 hash;
+            memcpy(hash.begin(), vHashes + 32 * i, 32);
+            if (MeetsTarget(hash))
+            {
+                hashProofOfStake = hash;
+                return nStart + i;
+            }
+        }
+    }
+    return -1;
+}
+
+bool FindKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, unsigned int nCount, const COutPoint& prevout, int64_t& nTimeKernel, int64_t* pBlockTime)
+{
+    uint256 hashProofOfStake, targetProofOfStake;
+
+    CTxDB txdb("r");
+    CDiskTxBytes coin;
+    if (!ReadKernelCoin(txdb, prevout, coin))
+        return false;
+    CBlockHeaderView block = coin.GetHeader();
+    CTransactionView txPrev = coin.GetTransaction();
+
+    if (pBlockTime)
+        *pBlockTime = block.GetBlockTime();
+
+    // candidates that pass the time checks, newest first
+    std::vector<unsigned int> vTimes;
+    for (unsigned int n = 0; n < nCount; n++)
+    {
+        int64_t nTimeTx = nTime - n;
+        if (block.GetBlockTime() + nStakeMinAge > nTimeTx || nTimeTx < txPrev.GetTime())
+            break; // only count coins meeting min age requirement
+        vTimes.push_back(nTimeTx);
+    }
+
+    if (!IsProtocolV2(pindexPrev->nHeight+1))
+    {
+        BOOST_FOREACH(unsigned int nTimeTx, vTimes)
+        {
+            if (CheckStakeKernelHash(pindexPrev, nBits, block, coin.GetTxOffset(), txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake))
+            {
+                nTimeKernel = nTimeTx;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    CTxOutView txoutPrev;
+    txPrev.GetOutput(prevout.n, txoutPrev);
+    CStakeKernel kernel(pindexPrev->nStakeModifier, block.GetBlockTime(), txPrev.GetTime(), prevout, nBits, txoutPrev.GetValue());
+    int nFound = kernel.Search(vTimes, hashProofOfStake);
+    if (nFound < 0)
+        return false;
+
+    nTimeKernel = vTimes[nFound];
+    if (fDebug)
+        LogPrintf("FindKernel() : pass modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
+            pindexPrev->nStakeModifier, (unsigned int)block.GetBlockTime(), txPrev.GetTime(), prevout.n, (unsigned int)nTimeKernel,
+            hashProofOfStake.ToString());
+    return true;
 }
@@ -5,6 +5,8 @@
 #define PPCOIN_KERNEL_H
 
 #include "main.h"
+#include "txview.h"
+#include "crypto/sha256.h"
 
 // To decrease granularity of timestamp
 // Supposed to be 2^n-1
@@ -22,7 +24,7 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
-bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake=false);
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlockHeaderView& blockFrom, unsigned int nTxPrevOffset, const CTransactionView& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake=false);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
@@ -34,6 +36,36 @@ bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock, int64_t nTimeTx);
 // Get time weight using supplied timestamps
 int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd);
 
+// Protocol v2 stake kernel of one coin, hashed for many timestamps at once.
+// Only the timestamp changes between candidates, so the kernel prefix is
+// serialized and pre-hashed once, and the weighted target is compared as a
+// plain 256 bit integer.
+class CStakeKernel
+{
+private:
+    CSHA256D56 hasher;
+    uint256 target;
+    bool fNegative; // target below zero, no hash meets it
+    bool fOverflow; // target of 2^256 or more, every hash meets it
+
+    static std::vector<unsigned char> BuildPrefix(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, const COutPoint& prevout);
+
+public:
+    CStakeKernel(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, const COutPoint& prevout, unsigned int nBits, int64_t nValueIn);
+
+    uint256 GetHash(unsigned int nTimeTx) const;
+    bool MeetsTarget(const uint256& hash) const;
+    // weighted target, truncated to 256 bits
+    const uint256& GetTarget() const { return target; }
+
+    // Index of the first timestamp in vTimes whose hash meets the target, or -1
+    int Search(const std::vector<unsigned int>& vTimes, uint256& hashProofOfStake) const;
+};
+
+// Search nTime, nTime - 1, ... nTime - nCount + 1 for a kernel of prevout.
+// The coin is read from disk once for the whole range.
+bool FindKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, unsigned int nCount, const COutPoint& prevout, int64_t& nTimeKernel, int64_t* pBlockTime = NULL);
+
 // Wrapper around CheckStakeKernelHash()
 // Also checks existence of kernel input and min age
 // Convenient for searching a kernel
@@ -7,7 +7,12 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 
+#include <limits>
+
 #include "alert.h"
+#include "blockimport.h"
+#include "chainquery.h"
+#include "chainstats.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "db.h"
@@ -16,6 +21,7 @@
 #include "net.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txview.h"
 #include "ui_interface.h"
 #include "tesseractx.h"
 #include "anonsend.h"
@@ -33,14 +39,17 @@ CCriticalSection cs_setpwalletRegistered;
 set<CWallet*> setpwalletRegistered;
 
 CCriticalSection cs_main;
+CSharedCriticalSection cs_blockindex;
 
 CTxMemPool mempool;
 
-map<uint256, CBlockIndex*> mapBlockIndex;
+BlockMap mapBlockIndex;
+CBlockIndexArena blockIndexArena;
+CChain chainActive;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 
-CBigNum bnProofOfStakeLimit(~uint256(0) >> 20);
-CBigNum bnProofOfStakeLimitV2(~uint256(0) >> 20);
+uint256 bnProofOfStakeLimit(~uint256(0) >> 20);
+uint256 bnProofOfStakeLimitV2(~uint256(0) >> 20);
 
 unsigned int nStakeMinAge = 60 * 60 * 2;	// minimum age for coin age: 2 hours
 unsigned int nModifierInterval = 10 * 60; // time to elapse before new modifier is computed
@@ -70,6 +79,7 @@ map<uint256, COrphanBlock*> mapOrphanBlocks;
 multimap<uint256, COrphanBlock*> mapOrphanBlocksByPrev;
 set<pair<COutPoint, unsigned int> > setStakeSeenOrphan;
 
+CCriticalSection cs_orphans;
 map<uint256, CTransaction> mapOrphanTransactions;
 map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
 
@@ -176,6 +186,7 @@ bool AbortNode(const std::string &strMessage, const std::string &userMessage) {
 
 bool AddOrphanTx(const CTransaction& tx)
 {
+    LOCK(cs_orphans);
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
@@ -207,6 +218,7 @@ bool AddOrphanTx(const CTransaction& tx)
 
 void static EraseOrphanTx(uint256 hash)
 {
+    LOCK(cs_orphans);
     map<uint256, CTransaction>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
@@ -222,8 +234,21 @@ void static EraseOrphanTx(uint256 hash)
     mapOrphanTransactions.erase(it);
 }
 
+// copies of the orphans that spend an output of hashPrev
+static void GetOrphansByPrev(const uint256& hashPrev, vector<pair<uint256, CTransaction> >& vOrphans)
+{
+    LOCK(cs_orphans);
+    vOrphans.clear();
+    map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(hashPrev);
+    if (itByPrev == mapOrphanTransactionsByPrev.end())
+        return;
+    BOOST_FOREACH(const uint256& hash, itByPrev->second)
+        vOrphans.push_back(make_pair(hash, mapOrphanTransactions[hash]));
+}
+
 unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
 {
+    LOCK(cs_orphans);
     unsigned int nEvicted = 0;
     while (mapOrphanTransactions.size() > nMaxOrphans)
     {
@@ -373,6 +398,16 @@ bool IsStandardTx(const CTransaction& tx, string& reason)
     return true;
 }
 
+static bool IsFinalTxAt(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
+{
+    if ((int64_t)tx.nLockTime < ((int64_t)tx.nLockTime < LOCKTIME_THRESHOLD ? (int64_t)nBlockHeight : nBlockTime))
+        return true;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        if (!txin.IsFinal())
+            return false;
+    return true;
+}
+
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
 {
     AssertLockHeld(cs_main);
@@ -383,12 +418,19 @@ bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
         nBlockHeight = nBestHeight;
     if (nBlockTime == 0)
         nBlockTime = GetAdjustedTime();
-    if ((int64_t)tx.nLockTime < ((int64_t)tx.nLockTime < LOCKTIME_THRESHOLD ? (int64_t)nBlockHeight : nBlockTime))
+    return IsFinalTxAt(tx, nBlockHeight, nBlockTime);
+}
+
+bool IsFinalTxAtBest(const CTransaction &tx)
+{
+    if (tx.nLockTime == 0)
         return true;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-        if (!txin.IsFinal())
-            return false;
-    return true;
+    int nBlockHeight;
+    {
+        LOCK_SHARED(cs_blockindex);
+        nBlockHeight = nBestHeight;
+    }
+    return IsFinalTxAt(tx, nBlockHeight, GetAdjustedTime());
 }
 
 //
@@ -523,7 +565,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
     vMerkleBranch = pblock->GetMerkleBranch(nIndex);
 
     // Is the tx in a block that's in the main chain
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -881,14 +923,23 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(CBlockIndex* &pindexRet) const
 {
     if (hashBlock == 0 || nIndex == -1)
         return 0;
-    AssertLockHeld(cs_main);
 
     // Find the block it claims to be in
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi == mapBlockIndex.end())
-        return 0;
-    CBlockIndex* pindex = (*mi).second;
-    if (!pindex || !pindex->IsInMainChain())
+    CBlockIndex* pindex;
+    int nDepth;
+    {
+        LOCK_SHARED(cs_blockindex);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            return 0;
+        pindex = (*mi).second;
+        if (!pindex || !pindex->IsInMainChain())
+            return 0;
+        nDepth = pindexBest->nHeight - pindex->nHeight + 1;
+    }
+    // a reorganization that is still being applied can show a block on
+    // both branches for a moment
+    if (nDepth <= 0)
         return 0;
 
     // Make sure the merkle branch connects to this block
@@ -900,12 +951,11 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(CBlockIndex* &pindexRet) const
     }
 
     pindexRet = pindex;
-    return pindexBest->nHeight - pindex->nHeight + 1;
+    return nDepth;
 }
 
 int CMerkleTx::GetDepthInMainChain(CBlockIndex* &pindexRet) const
 {
-    AssertLockHeld(cs_main);
     int nResult = GetDepthInMainChainINTERNAL(pindexRet);
     if (nResult == 0 && !mempool.exists(GetHash()))
         return -1; // Not in chain, not in mempool
@@ -979,13 +1029,58 @@ int CTxIndex::GetDepthInMainChain() const
     if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, false))
         return 0;
     // Find the block in the index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+    LOCK_SHARED(cs_blockindex);
+    BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
     if (!pindex || !pindex->IsInMainChain())
         return 0;
-    return 1 + nBestHeight - pindex->nHeight;
+    return max(0, 1 + nBestHeight - pindex->nHeight);
+}
+
+BlockHasher::BlockHasher()
+{
+    nSalt = (size_t)GetRand(std::numeric_limits<uint64_t>::max());
+}
+
+void* CBlockIndexArena::Allocate()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (nUsed == CHUNK_ENTRIES)
+    {
+        vChunks.push_back(static_cast<char*>(::operator new(CHUNK_ENTRIES * sizeof(CBlockIndex))));
+        nUsed = 0;
+    }
+    return vChunks.back() + sizeof(CBlockIndex) * nUsed++;
+}
+
+size_t CBlockIndexArena::GetMemoryUsage()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return vChunks.size() * CHUNK_ENTRIES * sizeof(CBlockIndex);
+}
+
+void CChain::SetTip(CBlockIndex* pindex)
+{
+    if (pindex == NULL)
+    {
+        vChain.clear();
+        return;
+    }
+    vChain.resize(pindex->nHeight + 1);
+    while (pindex && vChain[pindex->nHeight] != pindex)
+    {
+        vChain[pindex->nHeight] = pindex;
+        pindex = pindex->pprev;
+    }
+}
+
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    LOCK_SHARED(cs_blockindex);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    return mi == mapBlockIndex.end() ? NULL : mi->second;
 }
 
 // Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock
@@ -999,19 +1094,37 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock)
                 return true;
             }
         }
-        CTxDB txdb("r");
-        CTxIndex txindex;
-        if (tx.ReadFromDisk(txdb, COutPoint(hash, 0), txindex))
+        CDiskTxBytes txbytes;
+        if (GetTransactionBytes(hash, txbytes))
         {
-            CBlock block;
-            if (block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
-                hashBlock = block.GetHash();
+            // one read for the transaction and the header of its block
+            CTransactionView txview = txbytes.GetTransaction();
+            try {
+                CDataStream ssTx((const char*)txview.begin(), (const char*)txview.end(), SER_DISK, CLIENT_VERSION);
+                ssTx >> tx;
+            }
+            catch (std::exception &e) {
+                return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+            }
+            if (tx.vout.empty())
+                return false;
+            hashBlock = txbytes.GetHeader().GetHash();
             return true;
         }
     }
     return false;
 }
 
+bool GetTransactionBytes(const uint256 &hash, CDiskTxBytes &txbytes)
+{
+    LOCK(cs_main);
+    CTxDB txdb("r");
+    CTxIndex txindex;
+    if (!txdb.ReadTxIndex(hash, txindex))
+        return false;
+    return txbytes.ReadFromDisk(txindex.pos);
+}
+
 
 
 
@@ -1024,22 +1137,10 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock)
 // CBlock and CBlockIndex
 //
 
-static CBlockIndex* pblockindexFBBHLast;
 CBlockIndex* FindBlockByHeight(int nHeight)
 {
-    CBlockIndex *pblockindex;
-    if (nHeight < nBestHeight / 2)
-        pblockindex = pindexGenesisBlock;
-    else
-        pblockindex = pindexBest;
-    if (pblockindexFBBHLast && abs(nHeight - pblockindex->nHeight) > abs(nHeight - pblockindexFBBHLast->nHeight))
-        pblockindex = pblockindexFBBHLast;
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-    while (pblockindex->nHeight < nHeight)
-        pblockindex = pblockindex->pnext;
-    pblockindexFBBHLast = pblockindex;
-    return pblockindex;
+    LOCK_SHARED(cs_blockindex);
+    return chainActive[nHeight];
 }
 
 bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
@@ -1106,7 +1207,7 @@ void static PruneOrphanBlocks()
     mapOrphanBlocks.erase(hash);
 }
 
-static CBigNum GetProofOfStakeLimit(int nHeight)
+static const uint256& GetProofOfStakeLimit(int nHeight)
 {
     if (IsProtocolV2(nHeight))
         return bnProofOfStakeLimitV2;
@@ -1154,15 +1255,32 @@ static int64_t nTargetTimespan = 25 * 30;  // 12.5 mins
 //
 // maximum nBits value could possible be required nTime after
 //
-unsigned int ComputeMaxBits(CBigNum bnTargetLimit, unsigned int nBase, int64_t nTime)
+unsigned int ComputeMaxBits(const uint256& bnTargetLimit, unsigned int nBase, int64_t nTime)
 {
-    CBigNum bnResult;
-    bnResult.SetCompact(nBase);
-    bnResult *= 2;
+    uint256 bnResult;
+    bool fNegative, fOverflow;
+    bnResult.SetCompact(nBase, &fNegative, &fOverflow);
+    if (fNegative)
+    {
+        // a negative target stays below the limit and keeps doubling
+        CBigNum bnNegative;
+        bnNegative.SetCompact(nBase);
+        bnNegative *= 2;
+        for (; nTime > 0; nTime -= 24 * 60 * 60)
+            bnNegative *= 2;
+        return bnNegative.GetCompact();
+    }
+    if (fOverflow)
+        return bnTargetLimit.GetCompact();
+
+    // the limit is far below 2^255, so doubling stops long before it could wrap
+    if (bnResult.bits() >= 256)
+        return bnTargetLimit.GetCompact();
+    bnResult <<= 1;
     while (nTime > 0 && bnResult < bnTargetLimit)
     {
         // Maximum 200% adjustment per day...
-        bnResult *= 2;
+        bnResult <<= 1;
         nTime -= 24 * 60 * 60;
     }
     if (bnResult > bnTargetLimit)
@@ -1202,7 +1320,7 @@ int nTargetSpacing = 30;
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake)
 {
 
-    CBigNum bnTargetLimit = fProofOfStake ? GetProofOfStakeLimit(pindexLast->nHeight) : Params().ProofOfWorkLimit();
+    const uint256& bnTargetLimit = fProofOfStake ? GetProofOfStakeLimit(pindexLast->nHeight) : Params().ProofOfWorkLimit();
 
     if (pindexLast == NULL)
         return bnTargetLimit.GetCompact(); // genesis block
@@ -1220,13 +1338,23 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfS
 
     // ppcoin: target change every block
     // ppcoin: retarget with exponential moving toward target spacing
-    CBigNum bnNew;
-    bnNew.SetCompact(pindexPrev->nBits);
+    uint256 bnNew;
+    bool fNegative, fOverflow;
+    bnNew.SetCompact(pindexPrev->nBits, &fNegative, &fOverflow);
+    if (fNegative || fOverflow || bnNew == 0)
+        return bnTargetLimit.GetCompact();
+
     int64_t nInterval = nTargetTimespan / nTargetSpacing;
-    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing);
-    bnNew /= ((nInterval + 1) * nTargetSpacing);
+    uint256 bnMul = (nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing;
+    uint256 bnDiv = (nInterval + 1) * nTargetSpacing;
+
+    // a product that doesn't fit is far above every limit
+    if (bnNew.bits() + bnMul.bits() > 256)
+        return bnTargetLimit.GetCompact();
+    bnNew *= bnMul;
+    bnNew /= bnDiv;
 
-    if (bnNew <= 0 || bnNew > bnTargetLimit)
+    if (bnNew == 0 || bnNew > bnTargetLimit)
         bnNew = bnTargetLimit;
 
     return bnNew.GetCompact();
@@ -1234,15 +1362,16 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfS
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits)
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    uint256 bnTarget;
+    bool fNegative, fOverflow;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
     // Check range
-    if (bnTarget <= 0 || bnTarget > Params().ProofOfWorkLimit())
+    if (fNegative || fOverflow || bnTarget == 0 || bnTarget > Params().ProofOfWorkLimit())
         return error("CheckProofOfWork() : nBits below minimum work");
 
     // Check proof of work matches claimed amount
-    if (hash > bnTarget.getuint256())
+    if (hash > bnTarget)
         return error("CheckProofOfWork() : hash doesn't match nBits");
 
     return true;
@@ -1605,6 +1734,9 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
             return error("DisconnectBlock() : WriteBlockIndex failed");
     }
 
+    // the block summary of a disconnected block is stale
+    chainQuery.Invalidate(pindex);
+
     // ppcoin: clean up wallet after disconnecting coinstake
     BOOST_FOREACH(CTransaction& tx, vtx)
         SyncWithWallets(tx, this, false);
@@ -1851,6 +1983,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     // ppcoin: track money supply and mint amount info
     pindex->nMint = nValueOut - nValueIn + nFees;
     pindex->nMoneySupply = (pindex->pprev? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
+    chainQuery.Invalidate(pindex);
     if (!txdb.WriteBlockIndex(CDiskBlockIndex(pindex)))
         return error("Connect() : WriteBlockIndex for pindex failed");
 
@@ -2006,15 +2139,19 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     if (!txdb.TxnCommit())
         return error("Reorganize() : TxnCommit failed");
 
-    // Disconnect shorter branch
-    BOOST_FOREACH(CBlockIndex* pindex, vDisconnect)
-        if (pindex->pprev)
-            pindex->pprev->pnext = NULL;
+    {
+        LOCK_EXCLUSIVE(cs_blockindex);
 
-    // Connect longer branch
-    BOOST_FOREACH(CBlockIndex* pindex, vConnect)
-        if (pindex->pprev)
-            pindex->pprev->pnext = pindex;
+        // Disconnect shorter branch
+        BOOST_FOREACH(CBlockIndex* pindex, vDisconnect)
+            if (pindex->pprev)
+                pindex->pprev->pnext = NULL;
+
+        // Connect longer branch
+        BOOST_FOREACH(CBlockIndex* pindex, vConnect)
+            if (pindex->pprev)
+                pindex->pprev->pnext = pindex;
+    }
 
     // Resurrect memory transactions that were in the disconnected branch
     BOOST_FOREACH(CTransaction& tx, vResurrect)
@@ -2048,7 +2185,10 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
         return error("SetBestChain() : TxnCommit failed");
 
     // Add to current best branch
-    pindexNew->pprev->pnext = pindexNew;
+    {
+        LOCK_EXCLUSIVE(cs_blockindex);
+        pindexNew->pprev->pnext = pindexNew;
+    }
 
     // Delete redundant memory transactions
     BOOST_FOREACH(CTransaction& tx, vtx)
@@ -2131,11 +2271,15 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     }
 
     // New best block
-    hashBestChain = hash;
-    pindexBest = pindexNew;
-    pblockindexFBBHLast = NULL;
-    nBestHeight = pindexBest->nHeight;
-    nBestChainTrust = pindexNew->nChainTrust;
+    {
+        LOCK_EXCLUSIVE(cs_blockindex);
+        hashBestChain = hash;
+        pindexBest = pindexNew;
+        chainActive.SetTip(pindexNew);
+        nBestHeight = pindexBest->nHeight;
+        nBestChainTrust = pindexNew->nChainTrust;
+    }
+    chainStats.SetTip(pindexNew);
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
@@ -2167,12 +2311,22 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
 
     std::string strCmd = GetArg("-blocknotify", "");
 
+    if (!fIsInitialDownload)
+    {
+        // spent collaterals, old payment votes and expired locks are checked once per new block
+        anonSendScheduler.Trigger("inode-check");
+        anonSendScheduler.Trigger("payment-clean");
+        anonSendScheduler.Trigger("lock-clean");
+    }
+
     if (!fIsInitialDownload && !strCmd.empty())
     {
         boost::replace_all(strCmd, "%s", hashBestChain.GetHex());
         boost::thread t(runCommand, strCmd); // thread runs free
     }
 
+    uiInterface.NotifyBlocksChanged();
+
     return true;
 }
 
@@ -2230,11 +2384,11 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
         return error("AddToBlockIndex() : %s already exists", hash.ToString());
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(nFile, nBlockPos, *this);
+    CBlockIndex* pindexNew = new (blockIndexArena.Allocate()) CBlockIndex(nFile, nBlockPos, *this);
     if (!pindexNew)
         return error("AddToBlockIndex() : new CBlockIndex failed");
     pindexNew->phashBlock = &hash;
-    map<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
@@ -2259,7 +2413,11 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
     pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
 
     // Add to mapBlockIndex
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    BlockMap::iterator mi;
+    {
+        LOCK_EXCLUSIVE(cs_blockindex);
+        mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    }
     if (pindexNew->IsProofOfStake())
         setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
@@ -2291,7 +2449,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
 
 
 
-bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) const
+bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig, bool fCheckLocks) const
 {
     // These are checks that are independent of context
     // that can be verified before saving an orphan block.
@@ -2301,7 +2459,7 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
         return DoS(100, error("CheckBlock() : size limits failed"));
 
     // Check proof of work matches claimed amount
-    if (fCheckPOW && IsProofOfWork() && !CheckProofOfWork(GetPoWHash(), nBits))
+    if (fCheckPOW && !IsPrechecked() && IsProofOfWork() && !CheckProofOfWork(GetPoWHash(), nBits))
         return DoS(50, error("CheckBlock() : proof of work failed"));
 
     // Check timestamp
@@ -2330,7 +2488,7 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
     }
 
     // Check proof-of-stake block signature
-    if (fCheckSig && !CheckBlockSignature())
+    if (fCheckSig && !IsPrechecked() && !CheckBlockSignature())
         return DoS(100, error("CheckBlock() : bad proof-of-stake block signature"));
 
 
@@ -2338,15 +2496,12 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
 
    
         BOOST_FOREACH(const CTransaction& tx, vtx){
-            if (!tx.IsCoinBase()){
+            if (fCheckLocks && !tx.IsCoinBase()){
                 //only reject blocks when it's based on complete consensus
-                BOOST_FOREACH(const CTxIn& in, tx.vin){
-                    if(mapLockedInputs.count(in.prevout)){
-                        if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                            if(fDebug) { LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString().c_str(), tx.GetHash().ToString().c_str()); }
-                            return DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"));
-                        }
-                    }
+                uint256 hashLocked;
+                if(txLockTracker.GetConflictingLock(tx, hashLocked)){
+                    if(fDebug) { LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", hashLocked.ToString().c_str(), tx.GetHash().ToString().c_str()); }
+                    return DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"));
                 }
             }
         }
@@ -2448,13 +2603,30 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
         return DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"));
 
     // Check merkle root
-    if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleTree())
+    if (fCheckMerkleRoot && !IsPrechecked() && hashMerkleRoot != BuildMerkleTree())
         return DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"));
 
 
     return true;
 }
 
+bool CBlock::PrecheckBlock() const
+{
+    fPrechecked = false;
+    if (vtx.empty())
+        return false;
+    if (IsProofOfWork() && !CheckProofOfWork(GetPoWHash(), nBits))
+        return false;
+    if (!CheckBlockSignature() || hashMerkleRoot != BuildMerkleTree())
+        return false;
+
+    hashPrechecked = GetHash();
+    memcpy(pchPrecheckedHeader, BEGIN(nVersion), sizeof(pchPrecheckedHeader));
+    vchPrecheckedSig = vchBlockSig;
+    fPrechecked = true;
+    return true;
+}
+
 bool CBlock::AcceptBlock()
 {
     AssertLockHeld(cs_main);
@@ -2468,7 +2640,7 @@ bool CBlock::AcceptBlock()
         return error("AcceptBlock() : block already in mapBlockIndex");
 
     // Get prev block index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashPrevBlock);
     if (mi == mapBlockIndex.end())
         return DoS(10, error("AcceptBlock() : prev block not found"));
     CBlockIndex* pindexPrev = (*mi).second;
@@ -2561,13 +2733,16 @@ bool CBlock::AcceptBlock()
 
 uint256 CBlockIndex::GetBlockTrust() const
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    uint256 bnTarget;
+    bool fNegative, fOverflow;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
-    if (bnTarget <= 0)
+    if (fNegative || fOverflow || bnTarget == 0)
         return 0;
 
-    return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
+    // 2^256 / (bnTarget+1) without a 257 bit numerator: 2^256 is
+    // (~bnTarget + bnTarget + 1), so the quotient is ~bnTarget / (bnTarget+1) + 1
+    return (~bnTarget / (bnTarget + 1)) + 1;
 }
 
 bool CBlockIndex::IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned int nRequired, unsigned int nToCheck)
@@ -2595,6 +2770,9 @@ void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd)
 
 bool static ReserealizeBlockSignature(CBlock* pblock)
 {
+    // the signature was checked in its old encoding
+    pblock->fPrechecked = false;
+
     if (pblock->IsProofOfWork()) {
         pblock->vchBlockSig.clear();
         return true;
@@ -2861,6 +3039,12 @@ FILE* AppendBlockFile(unsigned int& nFileRet)
     nFileRet = 0;
     while (true)
     {
+        // numbers taken by compressed files are skipped, see blockstore.h
+        if (IsCompressedBlockFile(nCurrentBlockFile))
+        {
+            nCurrentBlockFile++;
+            continue;
+        }
         FILE* file = OpenBlockFile(nCurrentBlockFile, 0, "ab");
         if (!file)
             return NULL;
@@ -2941,7 +3125,7 @@ void PrintBlockTree()
     AssertLockHeld(cs_main);
     // pre-compute tree structure
     map<CBlockIndex*, vector<CBlockIndex*> > mapNext;
-    for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+    for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
     {
         CBlockIndex* pindex = (*mi).second;
         mapNext[pindex->pprev].push_back(pindex);
@@ -3011,64 +3195,8 @@ void PrintBlockTree()
 
 bool LoadExternalBlockFile(FILE* fileIn)
 {
-    int64_t nStart = GetTimeMillis();
-
-    int nLoaded = 0;
-    {
-        try {
-            CAutoFile blkdat(fileIn, SER_DISK, CLIENT_VERSION);
-            unsigned int nPos = 0;
-            while (nPos != (unsigned int)-1 && blkdat.good())
-            {
-                boost::this_thread::interruption_point();
-                unsigned char pchData[65536];
-                do {
-                    fseek(blkdat, nPos, SEEK_SET);
-                    int nRead = fread(pchData, 1, sizeof(pchData), blkdat);
-                    if (nRead <= 8)
-                    {
-                        nPos = (unsigned int)-1;
-                        break;
-                    }
-                    void* nFind = memchr(pchData, Params().MessageStart()[0], nRead+1-MESSAGE_START_SIZE);
-                    if (nFind)
-                    {
-                        if (memcmp(nFind, Params().MessageStart(), MESSAGE_START_SIZE)==0)
-                        {
-                            nPos += ((unsigned char*)nFind - pchData) + MESSAGE_START_SIZE;
-                            break;
-                        }
-                        nPos += ((unsigned char*)nFind - pchData) + 1;
-                    }
-                    else
-                        nPos += sizeof(pchData) - MESSAGE_START_SIZE + 1;
-                    boost::this_thread::interruption_point();
-                } while(true);
-                if (nPos == (unsigned int)-1)
-                    break;
-                fseek(blkdat, nPos, SEEK_SET);
-                unsigned int nSize;
-                blkdat >> nSize;
-                if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
-                {
-                    CBlock block;
-                    blkdat >> block;
-                    LOCK(cs_main);
-                    if (ProcessBlock(NULL,&block))
-                    {
-                        nLoaded++;
-                        nPos += 4 + nSize;
-                    }
-                }
-            }
-        }
-        catch (std::exception &e) {
-            LogPrintf("%s() : Deserialize or I/O error caught during load\n",
-                   __PRETTY_FUNCTION__);
-        }
-    }
-    LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
-    return nLoaded > 0;
+    CBlockImporter importer(fileIn);
+    return importer.Run() > 0;
 }
 
 struct CImportingNow
@@ -3109,6 +3237,18 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     }
 }
 
+void ThreadVerifyBlocks()
+{
+    int nCheckLevel = GetArg("-checklevel", 1);
+    if (nCheckLevel > MAX_BACKGROUND_CHECK_LEVEL)
+        return; // already done by LoadBlockIndex
+
+    int64_t nStart = GetTimeMillis();
+    CTxDB txdb("r");
+    if (txdb.VerifyBlockIndex(nCheckLevel, GetArg("-checkblocks", 500), true))
+        LogPrintf("ThreadVerifyBlocks() : verified in %dms\n", GetTimeMillis() - nStart);
+}
+
 
 
 
@@ -3197,13 +3337,18 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
         {
         bool txInMap = false;
         txInMap = mempool.exists(inv.hash);
-        return txInMap ||
-               mapOrphanTransactions.count(inv.hash) ||
-               txdb.ContainsTx(inv.hash);
+        if (txInMap)
+            return true;
+        {
+            LOCK(cs_orphans);
+            if (mapOrphanTransactions.count(inv.hash))
+                return true;
+        }
+        return txdb.ContainsTx(inv.hash);
         }
 
     case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash) ||
+        return LookupBlockIndex(inv.hash) ||
                mapOrphanBlocks.count(inv.hash);
     case MSG_TXLOCK_REQUEST:
         return mapTxLockReq.count(inv.hash) ||
@@ -3228,42 +3373,61 @@ void static ProcessGetData(CNode* pfrom)
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
+    // Blocks are served without cs_main: the index lookup takes cs_blockindex
+    // and the block itself comes from disk
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
             break;
 
-        const CInv &inv = *it;
+        if (it->type == MSG_BLOCK)
         {
+            const CInv &inv = *it;
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK)
+            // Send block from disk
+            CBlockIndex* pindex = LookupBlockIndex(inv.hash);
+            if (pindex)
             {
-                // Send block from disk
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
-                {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
+                CBlock block;
+                block.ReadFromDisk(pindex);
+                pfrom->PushMessage("block", block);
 
-                    // Trigger them to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue)
+                // Trigger them to send a getblocks request for the next batch of inventory
+                if (inv.hash == pfrom->hashContinue)
+                {
+                    // Bypass PushInventory, this must send even if redundant,
+                    // and we want it right after the last block so they don't
+                    // wait for other stuff first.
+                    vector<CInv> vInv;
                     {
-                        // Bypass PushInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        vector<CInv> vInv;
+                        LOCK_SHARED(cs_blockindex);
                         vInv.push_back(CInv(MSG_BLOCK, hashBestChain));
-                        pfrom->PushMessage("inv", vInv);
-                        pfrom->hashContinue = 0;
                     }
+                    pfrom->PushMessage("inv", vInv);
+                    pfrom->hashContinue = 0;
                 }
             }
-            else if (inv.IsKnownType())
+
+            // Track requests for our stuff.
+            g_signals.Inventory(inv.hash);
+            break;
+        }
+
+        // The anonsend, lock and hub maps are still guarded by cs_main, it is
+        // taken once for everything up to the next block
+        LOCK(cs_main);
+        while (it != pfrom->vRecvGetData.end() && it->type != MSG_BLOCK)
+        {
+            if (pfrom->nSendSize >= SendBufferSize())
+                break;
+
+            const CInv &inv = *it;
+            boost::this_thread::interruption_point();
+            it++;
+
+            if (inv.IsKnownType())
             {
                 // Send stream from relay memory
                 bool pushed = false;
@@ -3342,9 +3506,6 @@ void static ProcessGetData(CNode* pfrom)
 
             // Track requests for our stuff.
             g_signals.Inventory(inv.hash);
-
-            if (inv.type == MSG_BLOCK /* || inv.type == MSG_FILTERED_BLOCK */)
-                break;
         }
     }
 
@@ -3696,7 +3857,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (locator.IsNull())
         {
             // If locator is null, return the hashStop block
-            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
+            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
             if (mi == mapBlockIndex.end())
                 return true;
             pindex = (*mi).second;
@@ -3747,15 +3908,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             // Recursively process any orphan transactions that depended on this one
             for (unsigned int i = 0; i < vWorkQueue.size(); i++)
             {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
+                vector<pair<uint256, CTransaction> > vOrphans;
+                GetOrphansByPrev(vWorkQueue[i], vOrphans);
+                for (unsigned int j = 0; j < vOrphans.size(); j++)
                 {
-                    const uint256& orphanTxHash = *mi;
-                    CTransaction& orphanTx = mapOrphanTransactions[orphanTxHash];
+                    const uint256& orphanTxHash = vOrphans[j].first;
+                    CTransaction& orphanTx = vOrphans[j].second;
                     bool fMissingInputs2 = false;
 
                     if (AcceptToMemoryPool(mempool, orphanTx, true, &fMissingInputs2))
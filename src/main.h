@@ -6,6 +6,7 @@
 #define BITCOIN_MAIN_H
 
 #include "core.h"
+#include "blockstore.h"
 #include "bignum.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -16,6 +17,8 @@
 
 #include <list>
 
+#include <boost/unordered_map.hpp>
+
 class CValidationState;
 
 #define START_INODE_PAYMENTS_TESTNET 1429456427 
@@ -79,6 +82,8 @@ static const unsigned int DZEEL_HEIGHT = 2;
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 10000;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
+/** -checklevel values up to this only read block files, their startup check runs in ThreadVerifyBlocks */
+static const int MAX_BACKGROUND_CHECK_LEVEL = 1;
 /** Fees smaller than this (in satoshi) are considered zero fee (for transaction creation) */
 static const int64_t MIN_TX_FEE = 10000;
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying) */
@@ -102,8 +107,32 @@ inline unsigned int GetTargetSpacing(int nHeight) { return IsProtocolV2(nHeight)
 
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
+/**
+ * Guards inserts into mapBlockIndex, the pnext links of the main chain and the
+ * best chain variables (pindexBest, nBestHeight, hashBestChain, nBestChainTrust).
+ * Writers hold cs_main as well, so code under cs_main can read these without it;
+ * lookups and depth queries from other threads take it shared instead of cs_main.
+ */
+extern CSharedCriticalSection cs_blockindex;
 extern CTxMemPool mempool;
-extern std::map<uint256, CBlockIndex*> mapBlockIndex;
+/** Hasher for block hashes, salted per process like COutPointHasher */
+struct BlockHasher
+{
+    size_t nSalt;
+
+    BlockHasher();
+
+    size_t operator()(const uint256& hash) const
+    {
+        size_t nSeed = nSalt;
+        boost::hash_combine(nSeed, hash.Get64(0));
+        boost::hash_combine(nSeed, hash.Get64(1));
+        return nSeed;
+    }
+};
+typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+
+extern BlockMap mapBlockIndex;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 extern CBlockIndex* pindexGenesisBlock;
 extern unsigned int nStakeMinAge;
@@ -134,6 +163,7 @@ extern bool fMinimizeCoinAge;
 // Minimum disk space required - used in CheckDiskSpace()
 static const uint64_t nMinDiskSpace = 52428800;
 
+class CDiskTxBytes;
 class CReserveKey;
 class CTxDB;
 class CTxIndex;
@@ -164,9 +194,13 @@ FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
 CBlockIndex* FindBlockByHeight(int nHeight);
+/** Find a block in mapBlockIndex without holding cs_main, NULL if it's unknown */
+CBlockIndex* LookupBlockIndex(const uint256& hash);
 bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 void ThreadImport(std::vector<boost::filesystem::path> vImportFiles);
+/** Verify the last -checkblocks blocks after startup, see MAX_BACKGROUND_CHECK_LEVEL */
+void ThreadVerifyBlocks();
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits);
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake);
@@ -178,6 +212,8 @@ bool IsInitialBlockDownload();
 bool IsConfirmedInNPrevBlocks(const CTxIndex& txindex, const CBlockIndex* pindexFrom, int nMaxDepth, int& nActualDepth);
 std::string GetWarnings(std::string strFor);
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock);
+/** The serialized transaction and the header of its block, for a transaction in the block files */
+bool GetTransactionBytes(const uint256 &hash, CDiskTxBytes &txbytes);
 uint256 WantedByOrphan(const COrphanBlock* pblockOrphan);
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 void ThreadStakeMiner(CWallet *pwallet);
@@ -364,6 +400,25 @@ public:
 
     bool ReadFromDisk(CDiskTxPos pos, FILE** pfileRet=NULL)
     {
+        if (IsCompressedBlockFile(pos.nFile))
+        {
+            if (pfileRet)
+                return error("CTransaction::ReadFromDisk() : no file handle into a compressed block file");
+            BlockDataPtr pBlock;
+            unsigned int nOffset;
+            if (!ReadCompressedTx(pos.nFile, pos.nTxPos, pBlock, nOffset))
+                return error("CTransaction::ReadFromDisk() : ReadCompressedTx failed");
+            try {
+                const std::vector<char>& vBlock = *pBlock;
+                CDataStream ssTx(&vBlock[0] + nOffset, &vBlock[0] + vBlock.size(), SER_DISK, CLIENT_VERSION);
+                ssTx >> *this;
+            }
+            catch (std::exception &e) {
+                return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+            }
+            return true;
+        }
+
         CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK, CLIENT_VERSION);
         if (!filein)
             return error("CTransaction::ReadFromDisk() : OpenBlockFile failed");
@@ -515,6 +570,9 @@ bool IsStandardTx(const CTransaction& tx, std::string& reason);
 
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight = 0, int64_t nBlockTime = 0);
 
+/** IsFinalTx at the best height for callers without cs_main, reads the height under cs_blockindex */
+bool IsFinalTxAtBest(const CTransaction &tx);
+
 
 
 /** A transaction with a merkle branch linking it to the block chain. */
@@ -665,6 +723,10 @@ public:
 
     // memory only
     mutable std::vector<uint256> vMerkleTree;
+    mutable bool fPrechecked;      // passed PrecheckBlock, see IsPrechecked
+    mutable uint256 hashPrechecked;
+    mutable unsigned char pchPrecheckedHeader[80]; // the nVersion..nNonce bytes GetHash hashes
+    mutable std::vector<unsigned char> vchPrecheckedSig;
 
     // Denial-of-service detection:
     mutable int nDoS;
@@ -709,6 +771,9 @@ public:
         vtx.clear();
         vchBlockSig.clear();
         vMerkleTree.clear();
+        fPrechecked = false;
+        hashPrechecked = 0;
+        vchPrecheckedSig.clear();
         nDoS = 0;
     }
 
@@ -717,8 +782,17 @@ public:
         return (nBits == 0);
     }
 
+    /** True if PrecheckBlock passed and the header and signature are still the ones it checked */
+    bool IsPrechecked() const
+    {
+        return fPrechecked && memcmp(pchPrecheckedHeader, BEGIN(nVersion), sizeof(pchPrecheckedHeader)) == 0 &&
+               vchBlockSig == vchPrecheckedSig;
+    }
+
     uint256 GetHash() const
     {
+        if (IsPrechecked())
+            return hashPrechecked;
         if (nVersion > 6)
             return Hash(BEGIN(nVersion), END(nNonce));
         else
@@ -824,6 +898,13 @@ public:
 
     bool WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet)
     {
+        if (fCompressBlocks)
+        {
+            CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+            ssBlock << *this;
+            return WriteCompressedBlock(&ssBlock[0], ssBlock.size(), !IsInitialBlockDownload() || (nBestHeight+1) % 500 == 0, nFileRet, nBlockPosRet);
+        }
+
         // Open history file to append
         CAutoFile fileout = CAutoFile(AppendBlockFile(nFileRet), SER_DISK, CLIENT_VERSION);
         if (!fileout)
@@ -852,16 +933,29 @@ public:
     {
         SetNull();
 
-        // Open history file to read
-        CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
-        if (!filein)
-            return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
-        if (!fReadTransactions)
-            filein.nType |= SER_BLOCKHEADERONLY;
-
         // Read block
         try {
-            filein >> *this;
+            if (IsCompressedBlockFile(nFile))
+            {
+                BlockDataPtr pBlock;
+                if (!ReadCompressedBlock(nFile, nBlockPos, pBlock))
+                    return error("CBlock::ReadFromDisk() : ReadCompressedBlock failed");
+                const std::vector<char>& vBlock = *pBlock;
+                CDataStream ssBlock(&vBlock[0], &vBlock[0] + vBlock.size(), SER_DISK, CLIENT_VERSION);
+                if (!fReadTransactions)
+                    ssBlock.nType |= SER_BLOCKHEADERONLY;
+                ssBlock >> *this;
+            }
+            else
+            {
+                // Open history file to read
+                CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
+                if (!filein)
+                    return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
+                if (!fReadTransactions)
+                    filein.nType |= SER_BLOCKHEADERONLY;
+                filein >> *this;
+            }
         }
         catch (std::exception &e) {
             return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
@@ -904,7 +998,13 @@ public:
     bool ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions=true);
     bool SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew);
     bool AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const uint256& hashProof);
-    bool CheckBlock(bool fCheckPOW=true, bool fCheckMerkleRoot=true, bool fCheckSig=true) const;
+    /** fCheckLocks rejects transactions that conflict with a TesseractX lock, which only means
+     *  something for blocks arriving now, not for ones already in the chain */
+    bool CheckBlock(bool fCheckPOW=true, bool fCheckMerkleRoot=true, bool fCheckSig=true, bool fCheckLocks=true) const;
+    /** The context free and expensive part of CheckBlock (block hash, proof of work, block signature
+     *  and merkle root) so it can run on another thread. CheckBlock skips these checks and GetHash
+     *  returns the cached hash once it passed, for as long as the header and signature don't change. */
+    bool PrecheckBlock() const;
     bool AcceptBlock();
     bool SignBlock(CWallet& keystore, int64_t nFees);
     bool CheckBlockSignature() const;
@@ -1143,6 +1243,63 @@ public:
 
 
 
+/**
+ * Storage for block index entries. Entries are never freed, so they are
+ * carved out of large chunks instead of being allocated one by one.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_ENTRIES = 4096;
+
+    boost::mutex mutex;
+    std::vector<char*> vChunks;
+    size_t nUsed; // entries handed out from the last chunk
+
+public:
+    CBlockIndexArena() : nUsed(CHUNK_ENTRIES) {}
+
+    /** Uninitialized space for one entry, construct it with placement new */
+    void* Allocate();
+
+    size_t GetMemoryUsage();
+};
+
+extern CBlockIndexArena blockIndexArena;
+
+/**
+ * The best chain as an array indexed by height, for constant time lookups by
+ * height. It follows pindexBest and is guarded by cs_blockindex.
+ */
+class CChain
+{
+private:
+    std::vector<CBlockIndex*> vChain;
+
+public:
+    /** Block at nHeight, NULL if the chain isn't that long */
+    CBlockIndex* operator[](int nHeight) const
+    {
+        if (nHeight < 0 || nHeight >= (int)vChain.size())
+            return NULL;
+        return vChain[nHeight];
+    }
+
+    int Height() const { return (int)vChain.size() - 1; }
+
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Make pindex the tip, only the entries that differ are rewritten */
+    void SetTip(CBlockIndex* pindex);
+};
+
+extern CChain chainActive;
+
+
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
@@ -1259,7 +1416,7 @@ public:
 
     explicit CBlockLocator(uint256 hashBlock)
     {
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end())
             Set((*mi).second);
     }
@@ -1310,7 +1467,7 @@ public:
         int nStep = 1;
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1329,7 +1486,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1345,7 +1502,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -0,0 +1,287 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "msgverify.h"
+
+#include "hash.h"
+#include "main.h"
+#include "util.h"
+
+#include <secp256k1.h>
+#include <secp256k1_recovery.h>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+CMessageVerifyQueue messageVerifyQueue;
+
+namespace {
+
+/** Verification context shared by all workers, libsecp256k1 contexts are safe for concurrent use once created */
+class CSecp256k1VerifyInit
+{
+public:
+    secp256k1_context* ctx;
+
+    CSecp256k1VerifyInit()
+    {
+        ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+    }
+
+    ~CSecp256k1VerifyInit()
+    {
+        secp256k1_context_destroy(ctx);
+    }
+};
+static CSecp256k1VerifyInit secp256k1_verify;
+
+}
+
+uint256 GetSignedMessageHash(const std::string& strMessage)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << strMessageMagic;
+    ss << strMessage;
+    return ss.GetHash();
+}
+
+CMessageVerifyQueue::CMessageVerifyQueue(unsigned int nMaxPendingIn)
+{
+    nWorkers = 0;
+    nMaxPending = nMaxPendingIn;
+    nCallbacks = 0;
+    nMaxCacheSize = 50000;
+    nVerified = 0;
+    nCacheHits = 0;
+    nMerged = 0;
+    nDropped = 0;
+}
+
+int CMessageVerifyQueue::Recover(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID, CKeyID* pkeyIDRecovered)
+{
+    if (vchSig.size() != 65)
+        return -1;
+    int recid = (vchSig[0] - 27) & 3;
+    bool fComp = ((vchSig[0] - 27) & 4) != 0;
+
+    secp256k1_ecdsa_recoverable_signature sig;
+    if (!secp256k1_ecdsa_recoverable_signature_parse_compact(secp256k1_verify.ctx, &sig, &vchSig[1], recid))
+        return -1;
+
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ecdsa_recover(secp256k1_verify.ctx, &pubkey, &sig, hashMessage.begin()))
+        return -1;
+
+    unsigned char pub[65];
+    size_t publen = 65;
+    secp256k1_ec_pubkey_serialize(secp256k1_verify.ctx, pub, &publen, &pubkey, fComp ? SECP256K1_EC_COMPRESSED : SECP256K1_EC_UNCOMPRESSED);
+
+    CPubKey pubkeyRec(pub, pub + publen);
+    if (pkeyIDRecovered)
+        *pkeyIDRecovered = pubkeyRec.GetID();
+    return pubkeyRec.GetID() == keyID ? 1 : 0;
+}
+
+uint256 CMessageVerifyQueue::GetEntryHash(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << hashMessage << vchSig << keyID;
+    return ss.GetHash();
+}
+
+bool CMessageVerifyQueue::IsCached(const uint256& hashEntry)
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs_cache);
+    return setValid.count(hashEntry) > 0;
+}
+
+void CMessageVerifyQueue::AddToCache(const uint256& hashEntry)
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_cache);
+
+    while (setValid.size() > nMaxCacheSize)
+    {
+        // Evict a random entry, same as the script signature cache
+        std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+        if (it == setValid.end())
+            it = setValid.begin();
+        setValid.erase(it);
+    }
+
+    setValid.insert(hashEntry);
+}
+
+bool CMessageVerifyQueue::VerifyJob(const CJob& job)
+{
+    bool fValid = Recover(job.hashMessage, job.vchSig, job.keyID) == 1;
+    if (fValid)
+        AddToCache(job.hashEntry);
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nVerified++;
+    return fValid;
+}
+
+bool CMessageVerifyQueue::Verify(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage, bool& fRecovered, CKeyID& keyIDRecovered)
+{
+    fRecovered = true;
+
+    CJob job;
+    job.hashMessage = GetSignedMessageHash(strMessage);
+    job.keyID = pubkey.GetID();
+    job.hashEntry = GetEntryHash(job.hashMessage, vchSig, job.keyID);
+
+    if (IsCached(job.hashEntry))
+    {
+        keyIDRecovered = job.keyID;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nCacheHits++;
+        return true;
+    }
+
+    job.vchSig = vchSig;
+    int nResult = Recover(job.hashMessage, job.vchSig, job.keyID, &keyIDRecovered);
+    fRecovered = nResult != -1;
+    if (nResult == 1)
+        AddToCache(job.hashEntry);
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nVerified++;
+    return nResult == 1;
+}
+
+bool CMessageVerifyQueue::Push(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage, const callback_type& callback)
+{
+    CJob job;
+    job.hashMessage = GetSignedMessageHash(strMessage);
+    job.keyID = pubkey.GetID();
+    job.hashEntry = GetEntryHash(job.hashMessage, vchSig, job.keyID);
+
+    if (IsCached(job.hashEntry))
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nCacheHits++;
+        }
+        callback(true);
+        return true;
+    }
+
+    job.vchSig = vchSig;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers > 0)
+        {
+            if (nCallbacks >= nMaxPending)
+            {
+                if (nDropped++ % 1000 == 0)
+                    LogPrintf("CMessageVerifyQueue::Push() : %u requests pending, dropping new ones\n", nCallbacks);
+                return false;
+            }
+            nCallbacks++;
+
+            std::map<uint256, std::vector<callback_type> >::iterator it = mapPending.find(job.hashEntry);
+            if (it != mapPending.end())
+            {
+                // same message from another peer, one verification answers both
+                it->second.push_back(callback);
+                nMerged++;
+                return true;
+            }
+
+            mapPending[job.hashEntry].push_back(callback);
+            queue.push_back(job);
+            condWork.notify_one();
+            return true;
+        }
+    }
+
+    callback(VerifyJob(job));
+    return true;
+}
+
+void CMessageVerifyQueue::ProcessCompleted()
+{
+    std::vector<std::pair<callback_type, bool> > vRun;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        vRun.swap(vCompleted);
+        nCallbacks -= vRun.size();
+    }
+
+    // a callback that throws must not take the message handler thread or the
+    // callbacks after it down with it
+    for (unsigned int i = 0; i < vRun.size(); i++)
+    {
+        try {
+            vRun[i].first(vRun[i].second);
+        }
+        catch (boost::thread_interrupted) {
+            throw;
+        }
+        catch (std::exception& e) {
+            PrintExceptionContinue(&e, "CMessageVerifyQueue::ProcessCompleted()");
+        } catch (...) {
+            PrintExceptionContinue(NULL, "CMessageVerifyQueue::ProcessCompleted()");
+        }
+    }
+}
+
+void CMessageVerifyQueue::ThreadVerify()
+{
+    RenameThread("navcoin-msgverify");
+
+    while (true)
+    {
+        CJob job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                condWork.wait(lock);
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        bool fValid = VerifyJob(job);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::map<uint256, std::vector<callback_type> >::iterator it = mapPending.find(job.hashEntry);
+        if (it != mapPending.end())
+        {
+            BOOST_FOREACH(const callback_type& callback, it->second)
+                vCompleted.push_back(std::make_pair(callback, fValid));
+            mapPending.erase(it);
+        }
+    }
+}
+
+void CMessageVerifyQueue::Start(boost::thread_group& threadGroup, int nThreads)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWorkers = nThreads;
+    }
+
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&CMessageVerifyQueue::ThreadVerify, this));
+
+    LogPrintf("Using %d threads for message signature verification\n", nThreads);
+}
+
+size_t CMessageVerifyQueue::GetPendingCount()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+void CMessageVerifyQueue::GetStats(uint64_t& nVerifiedOut, uint64_t& nCacheHitsOut, uint64_t& nMergedOut, uint64_t& nDroppedOut)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nVerifiedOut = nVerified;
+    nCacheHitsOut = nCacheHits;
+    nMergedOut = nMerged;
+    nDroppedOut = nDropped;
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MSGVERIFY_H
+#define BITCOIN_MSGVERIFY_H
+
+#include "key.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/** Hash of a signed message the way CAnonSendSigner and "signmessage" build it */
+uint256 GetSignedMessageHash(const std::string& strMessage);
+
+/**
+ * Verification of compact message signatures (inode announcements and pings,
+ * anonsend queues, payment votes and TesseractX lock votes).
+ *
+ * Verification recovers the public key with libsecp256k1 and compares key ids.
+ * Valid results are cached, so a message relayed by several peers or checked
+ * again later (e.g. lock votes) only pays for one recovery.
+ *
+ * Push() hands a signature to a pool of worker threads and returns at once.
+ * Identical requests that are still pending are merged. When a request has been
+ * verified its callbacks are queued, and they run on the message handler thread
+ * from ProcessCompleted(), so message handlers never wait on signature checks
+ * and keep running on the thread they always ran on.
+ *
+ * At most nMaxPending callbacks wait for a worker or for ProcessCompleted();
+ * beyond that Push() drops the request, so a peer flooding signed messages
+ * can't grow the queue without bound.
+ */
+class CMessageVerifyQueue
+{
+public:
+    typedef boost::function<void (bool)> callback_type;
+
+private:
+    struct CJob
+    {
+        uint256 hashEntry;
+        uint256 hashMessage;
+        std::vector<unsigned char> vchSig;
+        CKeyID keyID;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    std::deque<CJob> queue;
+    std::map<uint256, std::vector<callback_type> > mapPending;
+    std::vector<std::pair<callback_type, bool> > vCompleted;
+    int nWorkers;
+    unsigned int nMaxPending;
+    unsigned int nCallbacks;  // in mapPending and vCompleted
+
+    boost::shared_mutex cs_cache;
+    std::set<uint256> setValid;
+    unsigned int nMaxCacheSize;
+
+    // statistics
+    uint64_t nVerified;
+    uint64_t nCacheHits;
+    uint64_t nMerged;
+    uint64_t nDropped;
+
+    static uint256 GetEntryHash(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID);
+    bool IsCached(const uint256& hashEntry);
+    void AddToCache(const uint256& hashEntry);
+    bool VerifyJob(const CJob& job);
+    void ThreadVerify();
+
+public:
+    CMessageVerifyQueue(unsigned int nMaxPendingIn = 20000);
+
+    /** Recover the signer of hashMessage, returns -1 if the signature can't be recovered, 0 on a key mismatch and 1 if it matches */
+    static int Recover(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID, CKeyID* pkeyIDRecovered = NULL);
+
+    /** Verify now, through the cache. fRecovered is false if no key could be recovered at all, otherwise keyIDRecovered is the signer */
+    bool Verify(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage, bool& fRecovered, CKeyID& keyIDRecovered);
+
+    /**
+     * Verify in the background. Cached signatures call back immediately; without workers this verifies inline.
+     * Returns false, without calling back, if the request was dropped because too many are pending.
+     */
+    bool Push(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage, const callback_type& callback);
+
+    /** Run the callbacks of finished requests, called from the message handler thread */
+    void ProcessCompleted();
+
+    void Start(boost::thread_group& threadGroup, int nThreads);
+
+    size_t GetPendingCount();
+    void GetStats(uint64_t& nVerifiedOut, uint64_t& nCacheHitsOut, uint64_t& nMergedOut, uint64_t& nDroppedOut);
+};
+
+extern CMessageVerifyQueue messageVerifyQueue;
+
+#endif
@@ -11,6 +11,7 @@
 #include "addrman.h"
 #include "ui_interface.h"
 #include "anonsend.h"
+#include "msgverify.h"
 #include "wallet.h"
 
 #ifdef USE_NATIVE_I2P
@@ -1605,6 +1606,9 @@ void ThreadMessageHandler()
 
         bool fSleep = true;
 
+        // Finish inode and lock vote messages whose signatures were verified in the background
+        messageVerifyQueue.ProcessCompleted();
+
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             if (pnode->fDisconnect)
@@ -10,14 +10,14 @@
 
 #include <sstream>
 #include <string>
-double getBlockHardness(int height)
-{
-    const CBlockIndex* blockindex = getBlockIndex(height);
 
-    int nShift = (blockindex->nBits >> 24) & 0xff;
+// Difficulty of a block, as GetDifficulty computes it
+static double getBlockHardness(unsigned int nBits)
+{
+    int nShift = (nBits >> 24) & 0xff;
 
     double dDiff =
-        (double)0x0000ffff / (double)(blockindex->nBits & 0x00ffffff);
+        (double)0x0000ffff / (double)(nBits & 0x00ffffff);
 
     while (nShift < 29)
     {
@@ -33,301 +33,35 @@ double getBlockHardness(int height)
     return dDiff;
 }
 
-int getBlockHashrate(int height)
-{
-    int lookup = height;
-
-    double timeDiff = getBlockTime(height) - getBlockTime(1);
-    double timePerBlock = timeDiff / lookup;
-
-    return (boost::int64_t)(((double)getBlockHardness(height) * pow(2.0, 32)) / timePerBlock);
-}
-
-const CBlockIndex* getBlockIndex(int height)
-{
-    std::string hex = getBlockHash(height);
-    uint256 hash(hex);
-    return mapBlockIndex[hash];
-}
-
-std::string getBlockHash(int Height)
-{
-    if(Height > pindexBest->nHeight) { return "351c6703813172725c6d660aa539ee6a3d7a9fe784c87fae7f36582e3b797058"; }
-    if(Height < 0) { return "351c6703813172725c6d660aa539ee6a3d7a9fe784c87fae7f36582e3b797058"; }
-    int desiredheight;
-    desiredheight = Height;
-    if (desiredheight < 0 || desiredheight > nBestHeight)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > desiredheight)
-        pblockindex = pblockindex->pprev;
-    return pblockindex->phashBlock->GetHex();
-}
-
-int getBlockTime(int Height)
-{
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->nTime;
-}
-
-std::string getBlockMerkle(int Height)
-{
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->hashMerkleRoot.ToString().substr(0,10).c_str();
-}
-
-int getBlocknBits(int Height)
-{
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->nBits;
-}
-
-int getBlockNonce(int Height)
-{
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->nNonce;
-}
-
-std::string getBlockDebug(int Height)
-{
-    std::string strHash = getBlockHash(Height);
-    uint256 hash(strHash);
-
-    if (mapBlockIndex.count(hash) == 0)
-        return 0;
-
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->ToString();
-}
-
-int blocksInPastHours(int hours)
-{
-    int wayback = hours * 3600;
-    bool check = true;
-    int height = pindexBest->nHeight;
-    int heightHour = pindexBest->nHeight;
-    int utime = (int)time(NULL);
-    int target = utime - wayback;
-
-    while(check)
-    {
-        if(getBlockTime(heightHour) < target)
-        {
-            check = false;
-            return height - heightHour;
-        } else {
-            heightHour = heightHour - 1;
-        }
-    }
-
-    return 0;
-}
-
-double getTxTotalValue(std::string txid)
-{
-    uint256 hash;
-    hash.SetHex(txid);
-
-    CTransaction tx;
-    uint256 hashBlock = 0;
-    if (!GetTransaction(hash, tx, hashBlock))
-        return 1000;
-
-    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-    ssTx << tx;
-
-    double value = 0;
-    double buffer = 0;
-    for (unsigned int i = 0; i < tx.vout.size(); i++)
-    {
-        const CTxOut& txout = tx.vout[i];
-
-        buffer = value + convertCoins(txout.nValue);
-        value = buffer;
-    }
-
-    return value;
-}
-
-double convertCoins(int64_t amount)
+static double convertCoins(int64_t amount)
 {
     return (double)amount / (double)COIN;
 }
 
-std::string getOutputs(std::string txid)
+// One "address: amount NAV" line per output
+static std::string formatOutputs(const std::vector<CTxOut>& vout)
 {
-    uint256 hash;
-    hash.SetHex(txid);
-
-    CTransaction tx;
-    uint256 hashBlock = 0;
-    if (!GetTransaction(hash, tx, hashBlock))
-        return "fail";
-
-    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-    ssTx << tx;
-
     std::string str = "";
-    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    for (unsigned int i = 0; i < vout.size(); i++)
     {
-        const CTxOut& txout = tx.vout[i];
-        CTxDestination source;
-        ExtractDestination(txout.scriptPubKey, source);
-        CBitcoinAddress addressSource(source);
-        std::string lol7 = addressSource.ToString();
-        double buffer = convertCoins(txout.nValue);
-		std::ostringstream ss;
-		ss << std::fixed << std::setprecision(4) << buffer;
-        std::string amount = ss.str();
-        str.append(lol7);
+        CTxDestination dest;
+        ExtractDestination(vout[i].scriptPubKey, dest);
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(4) << convertCoins(vout[i].nValue);
+        str.append(CBitcoinAddress(dest).ToString());
         str.append(": ");
-        str.append(amount);
+        str.append(ss.str());
         str.append(" NAV");
         str.append("\n");
     }
-
     return str;
 }
 
-std::string getInputs(std::string txid)
-{
-    uint256 hash;
-    hash.SetHex(txid);
-
-    CTransaction tx;
-    uint256 hashBlock = 0;
-    if (!GetTransaction(hash, tx, hashBlock))
-        return "fail";
-
-    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-    ssTx << tx;
-
-    std::string str = "";
-    for (unsigned int i = 0; i < tx.vin.size(); i++)
-    {
-        uint256 hash;
-        const CTxIn& vin = tx.vin[i];
-        hash.SetHex(vin.prevout.hash.ToString());
-        CTransaction wtxPrev;
-        uint256 hashBlock = 0;
-        if (!GetTransaction(hash, wtxPrev, hashBlock))
-             return "fail";
-
-        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-        ssTx << wtxPrev;
-
-        CTxDestination source;
-        ExtractDestination(wtxPrev.vout[vin.prevout.n].scriptPubKey, source);
-        CBitcoinAddress addressSource(source);
-        std::string lol6 = addressSource.ToString();
-        const CScript target = wtxPrev.vout[vin.prevout.n].scriptPubKey;
-        double buffer = convertCoins(getInputValue(wtxPrev, target));
-		std::ostringstream ss;
-		ss << std::fixed << std::setprecision(4) << buffer;
-        std::string amount = ss.str();
-        str.append(lol6);
-        str.append(": ");
-        str.append(amount);
-        str.append(" NAV");
-        str.append("\n");
-    }
-
-    return str;
-}
-
-int64_t getInputValue(CTransaction tx, CScript target)
-{
-    for (unsigned int i = 0; i < tx.vin.size(); i++)
-    {
-        const CTxOut& txout = tx.vout[i];
-        if(txout.scriptPubKey == target)
-        {
-            return txout.nValue;
-        }
-    }
-    return 0;
-}
-
-double getTxFees(std::string txid)
-{
-    uint256 hash;
-    hash.SetHex(txid);
-
-
-    CTransaction tx;
-    uint256 hashBlock = 0;
-    if (!GetTransaction(hash, tx, hashBlock))
-        return 51;
-
-    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-    ssTx << tx;
-
-    double value = 0;
-    double buffer = 0;
-    for (unsigned int i = 0; i < tx.vout.size(); i++)
-    {
-        const CTxOut& txout = tx.vout[i];
-
-        buffer = value + convertCoins(txout.nValue);
-        value = buffer;
-    }
-
-    double value0 = 0;
-    double buffer0 = 0;
-    for (unsigned int i = 0; i < tx.vin.size(); i++)
-    {
-        uint256 hash0;
-        const CTxIn& vin = tx.vin[i];
-        hash0.SetHex(vin.prevout.hash.ToString());
-        CTransaction wtxPrev;
-        uint256 hashBlock0 = 0;
-        if (!GetTransaction(hash0, wtxPrev, hashBlock0))
-             return 0;
-        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-        ssTx << wtxPrev;
-        const CScript target = wtxPrev.vout[vin.prevout.n].scriptPubKey;
-        buffer0 = value0 + convertCoins(getInputValue(wtxPrev, target));
-        value0 = buffer0;
-    }
-
-    return value0 - value;
-}
-
 
 BlockBrowser::BlockBrowser(QWidget *parent) :
     QWidget(parent),
-    ui(new Ui::BlockBrowser)
+    ui(new Ui::BlockBrowser),
+    queries(new BlockBrowserQueries(this))
 {
     ui->setupUi(this);
 
@@ -356,31 +90,17 @@ void BlockBrowser::updateExplorer(bool block)
         ui->hardLabel->show();
         ui->hardBox->show();;
         int height = ui->heightBox->value();
-        if (height > pindexBest->nHeight)
+        if (height > nBestHeight)
+        {
+            ui->heightBox->setValue(nBestHeight);
+            height = nBestHeight;
+        }
+        int nQuery;
         {
-            ui->heightBox->setValue(pindexBest->nHeight);
-            height = pindexBest->nHeight;
+            LOCK(queries->cs);
+            nQuery = ++queries->nBlockQuery;
         }
-        std::string hash = getBlockHash(height);
-        std::string merkle = getBlockMerkle(height);
-        int nBits = getBlocknBits(height);
-        int nNonce = getBlockNonce(height);
-        int atime = getBlockTime(height);
-        double hardness = getBlockHardness(height);
-        QString QHeight = QString::number(height);
-        QString QHash = QString::fromUtf8(hash.c_str());
-        QString QMerkle = QString::fromUtf8(merkle.c_str());
-        QString QBits = QString::number(nBits);
-        QString QNonce = QString::number(nNonce);
-        QString QTime = QString::number(atime);
-        QString QHardness = QString::number(hardness, 'f', 6);
-        ui->heightLabel->setText(QHeight);
-        ui->hashBox->setText(QHash);
-        ui->merkleBox->setText(QMerkle);
-        ui->bitsBox->setText(QBits);
-        ui->nonceBox->setText(QNonce);
-        ui->timeBox->setText(QTime);     
-        ui->hardBox->setText(QHardness);
+        chainQuery.QueryBlock(height, boost::bind(&BlockBrowser::blockQueried, queries, nQuery, _1, _2));
     } 
     
     if(block == false) {
@@ -394,24 +114,100 @@ void BlockBrowser::updateExplorer(bool block)
         ui->outputBox->show();
         ui->feesLabel->show();
         ui->feesBox->show();
-        std::string txid = ui->txBox->text().toUtf8().constData();
-        double value = getTxTotalValue(txid);
-        double fees = getTxFees(txid);
-        std::string outputs = getOutputs(txid);
-        std::string inputs = getInputs(txid);
-        QString QValue = QString::number(value, 'f', 6);
-        QString QID = QString::fromUtf8(txid.c_str());
-        QString QOutputs = QString::fromUtf8(outputs.c_str());
-        QString QInputs = QString::fromUtf8(inputs.c_str());
-        QString QFees = QString::number(fees, 'f', 6);
-        ui->valueBox->setText(QValue + " NAV");
-        ui->txID->setText(QID);
-        ui->outputBox->setText(QOutputs);
-        ui->inputBox->setText(QInputs);
-        ui->feesBox->setText(QFees + " NAV");
+        uint256 hash;
+        hash.SetHex(ui->txBox->text().toUtf8().constData());
+        int nQuery;
+        {
+            LOCK(queries->cs);
+            nQuery = ++queries->nTxQuery;
+        }
+        chainQuery.QueryTransaction(hash, boost::bind(&BlockBrowser::txQueried, queries, nQuery, _1, _2));
+    }
+}
+
+
+void BlockBrowser::blockQueried(boost::shared_ptr<BlockBrowserQueries> queries, int nQuery, bool fFound, const CBlockSummary& summary)
+{
+    LOCK(queries->cs);
+    // an answer to a query the user has already replaced, or for a closed browser
+    if (nQuery != queries->nBlockQuery || !queries->browser)
+        return;
+    queries->fBlockFound = fFound;
+    queries->blockSummary = summary;
+    // posted under the lock, the destructor can't run in between and removes the event
+    QMetaObject::invokeMethod(queries->browser, "showBlock", Qt::QueuedConnection);
+}
+
+void BlockBrowser::txQueried(boost::shared_ptr<BlockBrowserQueries> queries, int nQuery, bool fFound, const CTxSummary& summary)
+{
+    LOCK(queries->cs);
+    if (nQuery != queries->nTxQuery || !queries->browser)
+        return;
+    queries->fTxFound = fFound;
+    queries->txSummary = summary;
+    QMetaObject::invokeMethod(queries->browser, "showTransaction", Qt::QueuedConnection);
+}
+
+void BlockBrowser::showBlock()
+{
+    bool fFound;
+    CBlockSummary summary;
+    {
+        LOCK(queries->cs);
+        fFound = queries->fBlockFound;
+        summary = queries->blockSummary;
+    }
+
+    if (!fFound)
+    {
+        ui->hashBox->setText(tr("Block not found"));
+        return;
     }
+
+    ui->heightLabel->setText(QString::number(summary.nHeight));
+    ui->heightLabel->setToolTip(tr("%1 transactions, %2 bytes, %3, minted %4 NAV")
+        .arg(summary.nTx)
+        .arg(summary.nSize)
+        .arg(summary.fProofOfStake ? tr("proof-of-stake") : tr("proof-of-work"))
+        .arg(convertCoins(summary.nMint), 0, 'f', 6));
+    ui->hashBox->setText(QString::fromStdString(summary.hash.GetHex()));
+    ui->merkleBox->setText(QString::fromStdString(summary.hashMerkleRoot.ToString().substr(0,10)));
+    ui->bitsBox->setText(QString::number(summary.nBits));
+    ui->nonceBox->setText(QString::number(summary.nNonce));
+    ui->timeBox->setText(QString::number(summary.nTime));
+    ui->hardBox->setText(QString::number(getBlockHardness(summary.nBits), 'f', 6));
 }
 
+void BlockBrowser::showTransaction()
+{
+    bool fFound;
+    CTxSummary summary;
+    {
+        LOCK(queries->cs);
+        fFound = queries->fTxFound;
+        summary = queries->txSummary;
+    }
+
+    if (!fFound)
+    {
+        ui->txID->setText(tr("Transaction not found"));
+        ui->valueBox->clear();
+        ui->outputBox->clear();
+        ui->inputBox->clear();
+        ui->feesBox->clear();
+        return;
+    }
+
+    int64_t nValueOut = summary.tx.GetValueOut();
+    ui->txID->setText(QString::fromStdString(summary.tx.GetHash().GetHex()));
+    ui->valueBox->setText(QString::number(convertCoins(nValueOut), 'f', 6) + " NAV");
+    ui->outputBox->setText(QString::fromStdString(formatOutputs(summary.tx.vout)));
+    ui->inputBox->setText(QString::fromStdString(formatOutputs(summary.vSpent)));
+    if (summary.fSpentKnown && !summary.tx.IsCoinBase())
+        ui->feesBox->setText(QString::number(convertCoins(summary.GetValueIn() - nValueOut), 'f', 6) + " NAV");
+    else
+        ui->feesBox->setText(tr("unknown"));
+}
 
 void BlockBrowser::txClicked()
 {
@@ -430,5 +226,12 @@ void BlockBrowser::setModel(WalletModel *model)
 
 BlockBrowser::~BlockBrowser()
 {
+    {
+        // queries still running answer into the void
+        LOCK(queries->cs);
+        queries->browser = NULL;
+        queries->nBlockQuery++;
+        queries->nTxQuery++;
+    }
     delete ui;
 }
@@ -4,6 +4,7 @@
 #include "clientmodel.h"
 #include "walletmodel.h"
 #include "main.h"
+#include "chainquery.h"
 #include "wallet.h"
 #include "base58.h"
 #include <QWidget>
@@ -18,28 +19,32 @@
 #include <QSettings>
 #include <QSlider>
 
-double getBlockHardness(int);
-double getTxTotalValue(std::string);
-double convertCoins(int64_t);
-double getTxFees(std::string);
-int getBlockTime(int);
-int getBlocknBits(int);
-int getBlockNonce(int);
-int blocksInPastHours(int);
-int getBlockHashrate(int);
-std::string getInputs(std::string);
-std::string getOutputs(std::string);
-std::string getBlockHash(int);
-std::string getBlockMerkle(int);
-bool addnode(std::string);
-const CBlockIndex* getBlockIndex(int);
-int64_t getInputValue(CTransaction, CScript);
-
+#include <boost/shared_ptr.hpp>
 
 namespace Ui {
 class BlockBrowser;
 }
 class WalletModel;
+class BlockBrowser;
+
+/**
+ * Queries run on the chain query thread, which hands the answer to the last
+ * one over here and queues showBlock()/showTransaction(). The running queries
+ * hold on to this, not to the browser, so they can finish after it is gone.
+ */
+struct BlockBrowserQueries
+{
+    CCriticalSection cs;
+    BlockBrowser* browser;      // NULL once the browser is destroyed
+    int nBlockQuery;
+    int nTxQuery;
+    bool fBlockFound;
+    CBlockSummary blockSummary;
+    bool fTxFound;
+    CTxSummary txSummary;
+
+    BlockBrowserQueries(BlockBrowser* browserIn) : browser(browserIn), nBlockQuery(0), nTxQuery(0), fBlockFound(false), fTxFound(false) {}
+};
 
 class BlockBrowser : public QWidget
 {
@@ -58,11 +63,18 @@ public slots:
     void updateExplorer(bool);
 
 private slots:
+    /** Show the answer to the last block or transaction query */
+    void showBlock();
+    void showTransaction();
 
 private:
     Ui::BlockBrowser *ui;
     WalletModel *model;
-    
+
+    boost::shared_ptr<BlockBrowserQueries> queries;
+
+    static void blockQueried(boost::shared_ptr<BlockBrowserQueries> queries, int nQuery, bool fFound, const CBlockSummary& summary);
+    static void txQueried(boost::shared_ptr<BlockBrowserQueries> queries, int nQuery, bool fFound, const CTxSummary& summary);
 };
 
 #endif // BLOCKBROWSER_H
\ No newline at end of file
@@ -152,7 +152,7 @@ void InodeManager::updateNodeList()
     ui->countLabel->setText("Updating...");
     ui->tableWidget->clearContents();
     ui->tableWidget->setRowCount(0);
-    BOOST_FOREACH(CINode mn, vecInodes) 
+    BOOST_FOREACH(CINode& mn, inodeRegistry)
     {
         int mnRow = 0;
         ui->tableWidget->insertRow(0);
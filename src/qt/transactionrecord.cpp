@@ -56,13 +56,13 @@ QList<TransactionRecord> TransactionRecord::decomposeTransaction(const CWallet *
                 {
                     // Received by Bitcoin Address
                     sub.type = TransactionRecord::RecvWithAddress;
-                    sub.address = CBitcoinAddress(address).ToString();
+                    sub.setAddress(address);
                 }
                 else
                 {
                     // Received by IP connection (deprecated features), or a multisignature or other non-simple transaction
                     sub.type = TransactionRecord::RecvFromOther;
-                    sub.address = mapValue["from"];
+                    sub.setAddress(mapValue["from"]);
                 }
                 if (wtx.IsCoinBase())
                 {
@@ -129,13 +129,13 @@ QList<TransactionRecord> TransactionRecord::decomposeTransaction(const CWallet *
                 {
                     // Sent to Bitcoin Address
                     sub.type = TransactionRecord::SendToAddress;
-                    sub.address = CBitcoinAddress(address).ToString();
+                    sub.setAddress(address);
                 }
                 else
                 {
                     // Sent to IP, or other non-address transaction like OP_EVAL
                     sub.type = TransactionRecord::SendToOther;
-                    sub.address = mapValue["to"];
+                    sub.setAddress(mapValue["to"]);
                 }
 
                 int64_t nValue = txout.nValue;
@@ -169,7 +169,7 @@ void TransactionRecord::updateStatus(const CWalletTx &wtx)
 
     // Find the block the tx is in
     CBlockIndex* pindex = NULL;
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(wtx.hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(wtx.hashBlock);
     if (mi != mapBlockIndex.end())
         pindex = (*mi).second;
 
@@ -253,6 +253,25 @@ bool TransactionRecord::statusUpdateNeeded()
     return status.cur_num_blocks != nBestHeight;
 }
 
+const std::string &TransactionRecord::getAddress() const
+{
+    if (address.empty() && !boost::get<CNoDestination>(&destination))
+        address = CBitcoinAddress(destination).ToString();
+    return address;
+}
+
+void TransactionRecord::setAddress(const std::string &address)
+{
+    this->address = address;
+    destination = CNoDestination();
+}
+
+void TransactionRecord::setAddress(const CTxDestination &destination)
+{
+    address.clear();
+    this->destination = destination;
+}
+
 QString TransactionRecord::getTxID() const
 {
     return formatSubTxId(hash, idx);
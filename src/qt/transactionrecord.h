@@ -1,6 +1,7 @@
 #ifndef TRANSACTIONRECORD_H
 #define TRANSACTIONRECORD_H
 
+#include "script.h"
 #include "uint256.h"
 
 #include <QList>
@@ -78,22 +79,22 @@ public:
     static const int RecommendedNumConfirmations = 3;
 
     TransactionRecord():
-            hash(), time(0), type(Other), address(""), debit(0), credit(0), dzeel(""), idx(0)
+            hash(), time(0), type(Other), debit(0), credit(0), dzeel(""), idx(0), address("")
     {
     }
 
     TransactionRecord(uint256 hash, int64_t time):
-            hash(hash), time(time), type(Other), address(""), debit(0),
-            credit(0), dzeel(""), idx(0)
+            hash(hash), time(time), type(Other), debit(0),
+            credit(0), dzeel(""), idx(0), address("")
     {
     }
 
     TransactionRecord(uint256 hash, int64_t time,
                 Type type, const std::string &address,
                 int64_t debit, int64_t credit, const std::string &dzeel):
-            hash(hash), time(time), type(type), address(address), debit(debit), credit(credit),
+            hash(hash), time(time), type(type), debit(debit), credit(credit),
 			dzeel(dzeel),
-            idx(0)
+            idx(0), address(address)
     {
     }
 
@@ -107,7 +108,6 @@ public:
     uint256 hash;
     qint64 time;
     Type type;
-    std::string address;
     qint64 debit;
     qint64 credit;
 	std::string dzeel;
@@ -132,6 +132,18 @@ public:
     /** Return whether a status update is needed.
      */
     bool statusUpdateNeeded();
+
+    /** Address of the transaction part. A destination is only base58
+        encoded when it is first asked for, which is mostly for the rows
+        on screen: encoding took most of the time decomposing a wallet.
+     */
+    const std::string &getAddress() const;
+    void setAddress(const std::string &address);
+    void setAddress(const CTxDestination &destination);
+
+private:
+    mutable std::string address;
+    CTxDestination destination;
 };
 
 #endif // TRANSACTIONRECORD_H
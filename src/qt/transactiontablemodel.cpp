@@ -18,6 +18,11 @@
 #include <QDateTime>
 #include <QDebug>
 
+#include <boost/thread.hpp>
+
+// Wallet transactions decomposed per lock of the wallet while loading
+static const unsigned int LOAD_BATCH_SIZE = 1000;
+
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
         Qt::AlignLeft|Qt::AlignVCenter,
@@ -51,8 +56,19 @@ class TransactionTablePriv
 public:
     TransactionTablePriv(CWallet *wallet, TransactionTableModel *parent) :
         wallet(wallet),
-        parent(parent)
+        parent(parent),
+        loader(0)
+    {
+    }
+
+    ~TransactionTablePriv()
     {
+        if(loader)
+        {
+            loader->interrupt();
+            loader->join();
+            delete loader;
+        }
     }
 
     CWallet *wallet;
@@ -64,20 +80,100 @@ public:
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* Records decomposed by the loader, not yet in cachedWallet */
+    boost::thread *loader;
+    CCriticalSection cs_pending;
+    QList<TransactionRecord> pendingRecords;
+
+    /* Query entire wallet anew from core, in the background. The rows
+       appear as the loader hands them over, see insertPending().
      */
     void refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
+        loader = new boost::thread(boost::bind(&TransactionTablePriv::loadWallet, this));
+    }
+
+    /* Loader thread: decompose the wallet a batch at a time, so the locks
+       are only held briefly and the GUI keeps running meanwhile.
+     */
+    void loadWallet()
+    {
+        std::vector<uint256> vHashes;
         {
             LOCK2(cs_main, wallet->cs_wallet);
+            vHashes.reserve(wallet->mapWallet.size());
             for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+                vHashes.push_back(it->first);
+        }
+
+        try
+        {
+            for(unsigned int nStart = 0; nStart < vHashes.size(); nStart += LOAD_BATCH_SIZE)
             {
-                if(TransactionRecord::showTransaction(it->second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                boost::this_thread::interruption_point();
+
+                QList<TransactionRecord> batch;
+                LOCK2(cs_main, wallet->cs_wallet);
+                unsigned int nEnd = std::min(nStart + LOAD_BATCH_SIZE, (unsigned int)vHashes.size());
+                for(unsigned int i = nStart; i < nEnd; i++)
+                {
+                    std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(vHashes[i]);
+                    if(mi != wallet->mapWallet.end() && TransactionRecord::showTransaction(mi->second))
+                        batch.append(TransactionRecord::decomposeTransaction(wallet, mi->second));
+                }
+
+                // Handed over with the wallet still locked, so the batch reaches
+                // the GUI before the notifications of any later change to it
+                {
+                    LOCK(cs_pending);
+                    pendingRecords.append(batch);
+                }
+                QMetaObject::invokeMethod(parent, "loadPending", Qt::QueuedConnection);
             }
         }
+        catch(boost::thread_interrupted)
+        {
+        }
+    }
+
+    /* Insert the records handed over by the loader. They come in hash
+       order; a transaction a notification already added is skipped.
+     */
+    void insertPending()
+    {
+        QList<TransactionRecord> records;
+        {
+            LOCK(cs_pending);
+            records = pendingRecords;
+            pendingRecords.clear();
+        }
+
+        int nRecord = 0;
+        while(nRecord < records.size())
+        {
+            // Insert the records that go before the next transaction of the model in one go
+            QList<TransactionRecord>::iterator lower = qLowerBound(
+                cachedWallet.begin(), cachedWallet.end(), records[nRecord].hash, TxLessThan());
+            int insertIndex = (lower - cachedWallet.begin());
+            bool fAtEnd = (lower == cachedWallet.end());
+            uint256 hashNext = fAtEnd ? uint256(0) : lower->hash;
+
+            int nFirst = nRecord;
+            while(nRecord < records.size() && (fAtEnd || records[nRecord].hash < hashNext))
+                nRecord++;
+            if(nRecord > nFirst)
+            {
+                parent->beginInsertRows(QModelIndex(), insertIndex, insertIndex + (nRecord - nFirst) - 1);
+                for(int i = nFirst; i < nRecord; i++)
+                    cachedWallet.insert(insertIndex + (i - nFirst), records[i]);
+                parent->endInsertRows();
+            }
+
+            while(nRecord < records.size() && !fAtEnd && records[nRecord].hash == hashNext)
+                nRecord++;
+        }
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -241,6 +337,11 @@ TransactionTableModel::~TransactionTableModel()
     delete priv;
 }
 
+void TransactionTableModel::loadPending()
+{
+    priv->insertPending();
+}
+
 void TransactionTableModel::updateTransaction(const QString &hash, int status)
 {
     uint256 updated;
@@ -385,13 +486,13 @@ QString TransactionTableModel::formatTxToAddress(const TransactionRecord *wtx, b
     switch(wtx->type)
     {
     case TransactionRecord::RecvFromOther:
-        return QString::fromStdString(wtx->address);
+        return QString::fromStdString(wtx->getAddress());
     case TransactionRecord::RecvWithAddress:
     case TransactionRecord::SendToAddress:
     case TransactionRecord::Generated:
-        return lookupAddress(wtx->address, tooltip);
+        return lookupAddress(wtx->getAddress(), tooltip);
     case TransactionRecord::SendToOther:
-        return QString::fromStdString(wtx->address);
+        return QString::fromStdString(wtx->getAddress());
     case TransactionRecord::SendToSelf:
     default:
         return tr("(n/a)");
@@ -425,7 +526,7 @@ QVariant TransactionTableModel::addressColor(const TransactionRecord *wtx) const
     case TransactionRecord::SendToAddress:
     case TransactionRecord::Generated:
         {
-        QString label = walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(wtx->address));
+        QString label = walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(wtx->getAddress()));
         if(label.isEmpty())
             return COLOR_BAREADDRESS;
         } break;
@@ -582,9 +683,9 @@ QVariant TransactionTableModel::data(const QModelIndex &index, int role) const
     case LongDescriptionRole:
         return priv->describe(rec, walletModel->getOptionsModel()->getDisplayUnit());
     case AddressRole:
-        return QString::fromStdString(rec->address);
+        return QString::fromStdString(rec->getAddress());
     case LabelRole:
-        return walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(rec->address));
+        return walletModel->getAddressTableModel()->labelForAddress(QString::fromStdString(rec->getAddress()));
     case AmountRole:
         return rec->credit + rec->debit;
     case TxIDRole:
@@ -83,6 +83,10 @@ public slots:
     void updateConfirmations();
     void updateDisplayUnit();
 
+private slots:
+    /** Take the rows the background loader has decomposed so far */
+    void loadPending();
+
     friend class TransactionTablePriv;
 };
 
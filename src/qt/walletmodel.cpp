@@ -24,10 +24,13 @@ WalletModel::WalletModel(CWallet *wallet, OptionsModel *optionsModel, QObject *p
     addressTableModel = new AddressTableModel(wallet, this);
     transactionTableModel = new TransactionTableModel(wallet, this);
 
-    // This timer will be fired repeatedly to update the balance
-    pollTimer = new QTimer(this);
-    connect(pollTimer, SIGNAL(timeout()), this, SLOT(pollBalanceChanged()));
-    pollTimer->start(MODEL_UPDATE_DELAY);
+    // Balance and confirmations are checked once the blocks coming in
+    // settle for MODEL_UPDATE_DELAY, and once at startup
+    blocksChangedTimer = new QTimer(this);
+    blocksChangedTimer->setSingleShot(true);
+    blocksChangedTimer->setInterval(MODEL_UPDATE_DELAY);
+    connect(blocksChangedTimer, SIGNAL(timeout()), this, SLOT(pollBalanceChanged()));
+    blocksChangedTimer->start();
 
     subscribeToCoreSignals();
 }
@@ -83,17 +86,29 @@ void WalletModel::updateStatus()
         emit encryptionStatusChanged(newEncryptionStatus);
 }
 
+void WalletModel::updateBlocks()
+{
+    if(!blocksChangedTimer->isActive())
+        blocksChangedTimer->start();
+}
+
 void WalletModel::pollBalanceChanged()
 {
-    // Get required locks upfront. This avoids the GUI from getting stuck on
-    // periodical polls if the core is holding the locks for a longer time -
-    // for example, during a wallet rescan.
+    // Get required locks upfront. This avoids the GUI from getting stuck
+    // if the core is holding the locks for a longer time - for example,
+    // during a wallet rescan. Try again later in that case.
     TRY_LOCK(cs_main, lockMain);
     if(!lockMain)
+    {
+        blocksChangedTimer->start();
         return;
+    }
     TRY_LOCK(wallet->cs_wallet, lockWallet);
     if(!lockWallet)
+    {
+        blocksChangedTimer->start();
         return;
+    }
 
     if(nBestHeight != cachedNumBlocks)
     {
@@ -586,12 +601,18 @@ static void NotifyTransactionChanged(WalletModel *walletmodel, CWallet *wallet,
                               Q_ARG(int, status));
 }
 
+static void NotifyBlocksChanged(WalletModel *walletmodel)
+{
+    QMetaObject::invokeMethod(walletmodel, "updateBlocks", Qt::QueuedConnection);
+}
+
 void WalletModel::subscribeToCoreSignals()
 {
     // Connect signals to wallet
     wallet->NotifyStatusChanged.connect(boost::bind(&NotifyKeyStoreStatusChanged, this, _1));
     wallet->NotifyAddressBookChanged.connect(boost::bind(NotifyAddressBookChanged, this, _1, _2, _3, _4, _5));
     wallet->NotifyTransactionChanged.connect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
+    uiInterface.NotifyBlocksChanged.connect(boost::bind(NotifyBlocksChanged, this));
 }
 
 void WalletModel::unsubscribeFromCoreSignals()
@@ -600,6 +621,7 @@ void WalletModel::unsubscribeFromCoreSignals()
     wallet->NotifyStatusChanged.disconnect(boost::bind(&NotifyKeyStoreStatusChanged, this, _1));
     wallet->NotifyAddressBookChanged.disconnect(boost::bind(NotifyAddressBookChanged, this, _1, _2, _3, _4, _5));
     wallet->NotifyTransactionChanged.disconnect(boost::bind(NotifyTransactionChanged, this, _1, _2, _3));
+    uiInterface.NotifyBlocksChanged.disconnect(boost::bind(NotifyBlocksChanged, this));
 }
 
 // WalletModel::UnlockContext implementation
@@ -165,7 +165,7 @@ private:
     EncryptionStatus cachedEncryptionStatus;
     int cachedNumBlocks;
 
-    QTimer *pollTimer;
+    QTimer *blocksChangedTimer;
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
@@ -183,6 +183,8 @@ public slots:
     void updateTransaction(const QString &hash, int status);
     /* New, updated or removed address book entry */
     void updateAddressBook(const QString &address, const QString &label, bool isMine, int status);
+    /* New best block, check the balance and confirmations shortly */
+    void updateBlocks();
     /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so */
     void pollBalanceChanged();
 
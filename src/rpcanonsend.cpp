@@ -119,6 +119,33 @@ Value getpoolinfo(const Array& params, bool fHelp)
 }
 
 
+Value getschedulerinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getschedulerinfo\n"
+            "Returns run counts and timings (in microseconds) of the anonsend and inode background tasks.");
+
+    std::map<std::string, CScheduler::CTaskStats> mapStats;
+    anonSendScheduler.GetStats(mapStats);
+
+    Object obj;
+    for (std::map<std::string, CScheduler::CTaskStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it)
+    {
+        const CScheduler::CTaskStats& stats = it->second;
+        Object task;
+        task.push_back(Pair("interval",  stats.nIntervalMillis));
+        task.push_back(Pair("runs",      (boost::int64_t)stats.nRuns));
+        task.push_back(Pair("triggered", (boost::int64_t)stats.nTriggered));
+        task.push_back(Pair("lastrun",   stats.nLastRun / 1000));
+        task.push_back(Pair("last",      stats.nLastMicros));
+        task.push_back(Pair("max",       stats.nMaxMicros));
+        task.push_back(Pair("average",   stats.nRuns ? stats.nTotalMicros / (int64_t)stats.nRuns : 0));
+        obj.push_back(Pair(it->first, task));
+    }
+    return obj;
+}
+
 Value inode(const Array& params, bool fHelp)
 {
     string strCommand;
@@ -285,7 +312,8 @@ Value inode(const Array& params, bool fHelp)
         }
 
         Object obj;
-        BOOST_FOREACH(CINode mn, vecInodes) {
+        LOCK(cs_inodes);
+        BOOST_FOREACH(CINode& mn, inodeRegistry) {
             mn.Check();
 
             if(strCommand == "active"){
@@ -312,7 +340,11 @@ Value inode(const Array& params, bool fHelp)
         }
         return obj;
     }
-    if (strCommand == "count") return (int)vecInodes.size();
+    if (strCommand == "count")
+    {
+        LOCK(cs_inodes);
+        return (int)inodeRegistry.size();
+    }
 
     if (strCommand == "start")
     {
@@ -471,7 +503,7 @@ Value inode(const Array& params, bool fHelp)
         if(activeInode.status == INODE_SYNC_IN_PROCESS) return "sync in process. Must wait until client is synced to start.";
 
         CTxIn vin = CTxIn();
-        CPubKey pubkey = CScript();
+        CPubKey pubkey;
         CKey key;
         bool found = activeInode.GetINodeVin(vin, pubkey, key);
         if(!found){
@@ -489,9 +521,10 @@ Value inode(const Array& params, bool fHelp)
 
     if (strCommand == "current")
     {
+        LOCK(cs_inodes);
         int winner = GetCurrentINode(1);
         if(winner >= 0) {
-            return vecInodes[winner].addr.ToString().c_str();
+            return inodeRegistry[winner].addr.ToString().c_str();
         }
 
         return "unknown";
@@ -4,6 +4,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "rpcserver.h"
+#include "chainquery.h"
+#include "chainstats.h"
 #include "main.h"
 #include "kernel.h"
 #include "checkpoints.h"
@@ -46,97 +48,56 @@ double GetDifficulty(const CBlockIndex* blockindex)
 
 double GetPoWMHashPS()
 {
-    if (pindexBest->nHeight >= Params().LastPOWBlock())
+    CChainStatsEntry tip;
+    if (!chainStats.GetTip(tip))
         return 0;
-
-    int nPoWInterval = 72;
-    int64_t nTargetSpacingWorkMin = 30, nTargetSpacingWork = 30;
-
-    CBlockIndex* pindex = pindexGenesisBlock;
-    CBlockIndex* pindexPrevWork = pindexGenesisBlock;
-
-    while (pindex)
-    {
-        if (pindex->IsProofOfWork())
-        {
-            int64_t nActualSpacingWork = pindex->GetBlockTime() - pindexPrevWork->GetBlockTime();
-            nTargetSpacingWork = ((nPoWInterval - 1) * nTargetSpacingWork + nActualSpacingWork + nActualSpacingWork) / (nPoWInterval + 1);
-            nTargetSpacingWork = max(nTargetSpacingWork, nTargetSpacingWorkMin);
-            pindexPrevWork = pindex;
-        }
-
-        pindex = pindex->pnext;
-    }
-
-    return GetDifficulty() * 4294.967296 / nTargetSpacingWork;
+    return tip.dNetMHashPS;
 }
 
 double GetPoSKernelPS()
 {
-    int nPoSInterval = 72;
-    double dStakeKernelsTriedAvg = 0;
-    int nStakesHandled = 0, nStakesTime = 0;
-
-    CBlockIndex* pindex = pindexBest;;
-    CBlockIndex* pindexPrevStake = NULL;
-
-    while (pindex && nStakesHandled < nPoSInterval)
-    {
-        if (pindex->IsProofOfStake())
-        {
-            if (pindexPrevStake)
-            {
-                dStakeKernelsTriedAvg += GetDifficulty(pindexPrevStake) * 4294967296.0;
-                nStakesTime += pindexPrevStake->nTime - pindex->nTime;
-                nStakesHandled++;
-            }
-            pindexPrevStake = pindex;
-        }
-
-        pindex = pindex->pprev;
-    }
-
-    double result = 0;
-
-    if (nStakesTime)
-        result = dStakeKernelsTriedAvg / nStakesTime;
-
-    if (IsProtocolV2(nBestHeight))
-        result *= STAKE_TIMESTAMP_MASK + 1;
-
-    return result;
+    CChainStatsEntry tip;
+    if (!chainStats.GetTip(tip))
+        return 0;
+    return tip.dNetStakeWeight;
 }
 
-Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail)
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail, CJSONStream& stream)
 {
-    Object result;
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
+    stream.BeginObject();
+    stream.Pair("hash", block.GetHash().GetHex());
     int confirmations = -1;
-    // Only report confirmations if the block is on the main chain
-    if (blockindex->IsInMainChain())
-        confirmations = nBestHeight - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    result.push_back(Pair("mint", ValueFromAmount(blockindex->nMint)));
-    result.push_back(Pair("time", (int64_t)block.GetBlockTime()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("blocktrust", leftTrim(blockindex->GetBlockTrust().GetHex(), '0')));
-    result.push_back(Pair("chaintrust", leftTrim(blockindex->nChainTrust.GetHex(), '0')));
+    const CBlockIndex* pnext;
+    {
+        LOCK_SHARED(cs_blockindex);
+        // Only report confirmations if the block is on the main chain
+        if (blockindex->IsInMainChain())
+            confirmations = nBestHeight - blockindex->nHeight + 1;
+        pnext = blockindex->pnext;
+    }
+    stream.Pair("confirmations", confirmations);
+    stream.Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    stream.Pair("height", blockindex->nHeight);
+    stream.Pair("version", block.nVersion);
+    stream.Pair("merkleroot", block.hashMerkleRoot.GetHex());
+    stream.Pair("mint", ValueFromAmount(blockindex->nMint));
+    stream.Pair("time", (int64_t)block.GetBlockTime());
+    stream.Pair("nonce", (uint64_t)block.nNonce);
+    stream.Pair("bits", strprintf("%08x", block.nBits));
+    stream.Pair("difficulty", GetDifficulty(blockindex));
+    stream.Pair("blocktrust", leftTrim(blockindex->GetBlockTrust().GetHex(), '0'));
+    stream.Pair("chaintrust", leftTrim(blockindex->nChainTrust.GetHex(), '0'));
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    if (blockindex->pnext)
-        result.push_back(Pair("nextblockhash", blockindex->pnext->GetBlockHash().GetHex()));
-
-    result.push_back(Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": "")));
-    result.push_back(Pair("proofhash", blockindex->hashProof.GetHex()));
-    result.push_back(Pair("entropybit", (int)blockindex->GetStakeEntropyBit()));
-    result.push_back(Pair("modifier", strprintf("%016x", blockindex->nStakeModifier)));
-    Array txinfo;
+        stream.Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+    if (pnext)
+        stream.Pair("nextblockhash", pnext->GetBlockHash().GetHex());
+
+    stream.Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": ""));
+    stream.Pair("proofhash", blockindex->hashProof.GetHex());
+    stream.Pair("entropybit", (int)blockindex->GetStakeEntropyBit());
+    stream.Pair("modifier", strprintf("%016x", blockindex->nStakeModifier));
+    stream.Key("tx");
+    stream.BeginArray();
     BOOST_FOREACH (const CTransaction& tx, block.vtx)
     {
         if (fPrintTransactionDetail)
@@ -146,18 +107,17 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPri
             entry.push_back(Pair("txid", tx.GetHash().GetHex()));
             TxToJSON(tx, 0, entry);
 
-            txinfo.push_back(entry);
+            stream.Write(entry);
         }
         else
-            txinfo.push_back(tx.GetHash().GetHex());
+            stream.Write(tx.GetHash().GetHex());
     }
-
-    result.push_back(Pair("tx", txinfo));
+    stream.EndArray();
 
     if (block.IsProofOfStake())
-        result.push_back(Pair("signature", HexStr(block.vchBlockSig.begin(), block.vchBlockSig.end())));
+        stream.Pair("signature", HexStr(block.vchBlockSig.begin(), block.vchBlockSig.end()));
 
-    return result;
+    stream.EndObject();
 }
 
 Value getbestblockhash(const Array& params, bool fHelp)
@@ -167,6 +127,7 @@ Value getbestblockhash(const Array& params, bool fHelp)
             "getbestblockhash\n"
             "Returns the hash of the best block in the longest block chain.");
 
+    LOCK_SHARED(cs_blockindex);
     return hashBestChain.GetHex();
 }
 
@@ -177,6 +138,7 @@ Value getblockcount(const Array& params, bool fHelp)
             "getblockcount\n"
             "Returns the number of blocks in the longest block chain.");
 
+    LOCK_SHARED(cs_blockindex);
     return nBestHeight;
 }
 
@@ -195,21 +157,59 @@ Value getdifficulty(const Array& params, bool fHelp)
 }
 
 
-Value getrawmempool(const Array& params, bool fHelp)
+Value getchainstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getchainstats [blocks] [interval]\n"
+            "Returns network statistics over the last [blocks] blocks (default: 2880, at most " + strprintf("%u", CHAIN_STATS_WINDOW) + "),\n"
+            "one entry per [interval] blocks (default: 120), oldest first.");
+
+    int nBlocks = params.size() > 0 ? params[0].get_int() : 2880;
+    int nInterval = params.size() > 1 ? params[1].get_int() : 120;
+    if (nBlocks <= 0 || nInterval <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "blocks and interval must be positive");
+
+    vector<CChainStatsInterval> vIntervals;
+    chainStats.GetSeries(nBlocks, nInterval, vIntervals);
+
+    Array ret;
+    BOOST_FOREACH(const CChainStatsInterval& interval, vIntervals)
+    {
+        Object obj;
+        obj.push_back(Pair("height", interval.nHeight));
+        obj.push_back(Pair("time", interval.nTime));
+        obj.push_back(Pair("blocks", interval.nBlocks));
+        obj.push_back(Pair("proofofstake", interval.nProofOfStake));
+        obj.push_back(Pair("spacing", interval.dSpacing));
+        obj.push_back(Pair("powdifficulty", interval.dPoWDifficulty));
+        obj.push_back(Pair("posdifficulty", interval.dPoSDifficulty));
+        obj.push_back(Pair("netmhashps", interval.dNetMHashPS));
+        obj.push_back(Pair("netstakeweight", interval.dNetStakeWeight));
+        obj.push_back(Pair("moneysupply", ValueFromAmount(interval.nMoneySupply)));
+        obj.push_back(Pair("mint", ValueFromAmount(interval.nMint)));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+
+void getrawmempool(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "getrawmempool\n"
             "Returns all transaction ids in memory pool.");
 
+    // queryHashes copies the ids under mempool.cs, so this is threadSafe and
+    // streams without cs_main
     vector<uint256> vtxid;
     mempool.queryHashes(vtxid);
 
-    Array a;
+    stream.BeginArray();
     BOOST_FOREACH(const uint256& hash, vtxid)
-        a.push_back(hash.ToString());
-
-    return a;
+        stream.Write(hash.ToString());
+    stream.EndArray();
 }
 
 Value getblockhash(const Array& params, bool fHelp)
@@ -223,11 +223,13 @@ Value getblockhash(const Array& params, bool fHelp)
     if (nHeight < 0 || nHeight > nBestHeight)
         throw runtime_error("Block number out of range.");
 
-    CBlockIndex* pblockindex = FindBlockByHeight(nHeight);
-    return pblockindex->phashBlock->GetHex();
+    uint256 hash;
+    if (!chainQuery.GetBlockHash(nHeight, hash))
+        throw runtime_error("Block number out of range.");
+    return hash.GetHex();
 }
 
-Value getblock(const Array& params, bool fHelp)
+void getblock(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
@@ -238,17 +240,17 @@ Value getblock(const Array& params, bool fHelp)
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
-    if (mapBlockIndex.count(hash) == 0)
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
     block.ReadFromDisk(pblockindex, true);
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false, stream);
 }
 
-Value getblockbynumber(const Array& params, bool fHelp)
+void getblockbynumber(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
@@ -257,20 +259,76 @@ Value getblockbynumber(const Array& params, bool fHelp)
             "Returns details of a block with given block-number.");
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > nBestHeight)
+
+    CBlockIndex* pblockindex = FindBlockByHeight(nHeight);
+    if (!pblockindex)
         throw runtime_error("Block number out of range.");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
+    block.ReadFromDisk(pblockindex, true);
 
-    uint256 hash = *pblockindex->phashBlock;
+    blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false, stream);
+}
 
-    pblockindex = mapBlockIndex[hash];
-    block.ReadFromDisk(pblockindex, true);
+Value getblocksummary(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getblocksummary <height|hash|txid>\n"
+            "Returns a summary of the best chain block at <height>, with hash <hash>\n"
+            "or containing transaction <txid>, without the transactions.");
+
+    CBlockSummary summary;
+    string strParam = params[0].type() == int_type ? strprintf("%d", params[0].get_int()) : params[0].get_str();
+    if (strParam.size() < 64)
+    {
+        int32_t nHeight;
+        if (strParam.empty() || strParam.find_first_not_of("0123456789") != string::npos)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height");
+        if (!ParseInt32(strParam, &nHeight) || nHeight > nBestHeight)
+            throw runtime_error("Block number out of range.");
+        if (!chainQuery.GetBlockSummary(nHeight, summary))
+            throw runtime_error("Block number out of range.");
+    }
+    else
+    {
+        uint256 hash(strParam);
+        CBlockIndex* pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex)
+        {
+            int nHeight;
+            uint256 hashBlock;
+            if (chainQuery.GetTransactionBlock(hash, hashBlock, nHeight))
+                pblockindex = LookupBlockIndex(hashBlock);
+        }
+        if (!pblockindex)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block or transaction not found");
+        if (!chainQuery.GetBlockSummary(pblockindex, summary))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    }
+
+    int confirmations = -1;
+    {
+        LOCK_SHARED(cs_blockindex);
+        if (chainActive[summary.nHeight] && chainActive[summary.nHeight]->GetBlockHash() == summary.hash)
+            confirmations = nBestHeight - summary.nHeight + 1;
+    }
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    Object result;
+    result.push_back(Pair("hash", summary.hash.GetHex()));
+    result.push_back(Pair("confirmations", confirmations));
+    result.push_back(Pair("size", (int)summary.nSize));
+    result.push_back(Pair("height", summary.nHeight));
+    result.push_back(Pair("version", summary.nVersion));
+    result.push_back(Pair("merkleroot", summary.hashMerkleRoot.GetHex()));
+    result.push_back(Pair("mint", ValueFromAmount(summary.nMint)));
+    result.push_back(Pair("moneysupply", ValueFromAmount(summary.nMoneySupply)));
+    result.push_back(Pair("time", summary.nTime));
+    result.push_back(Pair("nonce", (uint64_t)summary.nNonce));
+    result.push_back(Pair("bits", strprintf("%08x", summary.nBits)));
+    result.push_back(Pair("flags", summary.fProofOfStake ? "proof-of-stake" : "proof-of-work"));
+    result.push_back(Pair("tx", (int)summary.nTx));
+    return result;
 }
 
 // ppcoin: get information of sync-checkpoint
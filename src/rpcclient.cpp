@@ -7,6 +7,7 @@
 #include "rpcclient.h"
 
 #include "rpcprotocol.h"
+#include "rpcreader.h"
 #include "util.h"
 #include "ui_interface.h"
 #include "chainparams.h" // for Params().RPCPort()
@@ -85,7 +86,7 @@ Object CallRPC(const string& strMethod, const Array& params)
 
     // Parse reply
     Value valReply;
-    if (!read_string(strReply, valReply))
+    if (!ReadJSON(strReply, valReply))
         throw runtime_error("couldn't parse reply from server");
     const Object& reply = valReply.get_obj();
     if (reply.empty())
@@ -118,6 +119,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblockbynumber", 0 },
     { "getblockbynumber", 1 },
     { "getblockhash", 0 },
+    { "getchainstats", 0 },
+    { "getchainstats", 1 },
     { "move", 2 },
     { "move", 3 },
     { "sendfrom", 2 },
@@ -157,6 +160,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "searchrawtransactions", 1 },
     { "searchrawtransactions", 2 },
     { "searchrawtransactions", 3 },
+    { "getlockstats", 0 },
 };
 
 class CRPCConvertTable
@@ -201,7 +205,7 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
         // parse string as JSON, insert bool/number/object/etc. value
         else {
             Value jVal;
-            if (!read_string(strVal, jVal))
+            if (!ReadJSON(strVal, jVal))
                 throw runtime_error(string("Error parsing JSON:")+strVal);
             params.push_back(jVal);
         }
@@ -226,6 +226,39 @@ Value verifymessage(const Array& params, bool fHelp)
     return (pubkey.GetID() == keyID);
 }
 
+Value getlockstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getlockstats [reset=false]\n"
+            "Returns the lock profile collected with -lockprofile, per lock site and most waited on first.\n"
+            "Times are in microseconds. With reset=true the profile starts over afterwards.");
+
+    if (!fLockProfile)
+        throw JSONRPCError(RPC_MISC_ERROR, "Lock profiling is disabled, restart with -lockprofile");
+
+    vector<CLockStats> vStats;
+    GetLockStats(vStats);
+    if (params.size() > 0 && params[0].get_bool())
+        ResetLockStats();
+
+    Array ret;
+    BOOST_FOREACH(const CLockStats& stats, vStats)
+    {
+        Object obj;
+        obj.push_back(Pair("lock",      stats.strName));
+        obj.push_back(Pair("location",  stats.strLocation));
+        obj.push_back(Pair("acquired",  (boost::int64_t)stats.nAcquired));
+        obj.push_back(Pair("contended", (boost::int64_t)stats.nContended));
+        obj.push_back(Pair("wait",      stats.nWaitMicros));
+        obj.push_back(Pair("maxwait",   stats.nMaxWaitMicros));
+        obj.push_back(Pair("hold",      stats.nHoldMicros));
+        obj.push_back(Pair("maxhold",   stats.nMaxHoldMicros));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 /*
     Used for updating/reading hub settings on the network
 */
@@ -5,9 +5,11 @@
 
 #include "rpcprotocol.h"
 
+#include "sync.h"
 #include "util.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
@@ -50,9 +52,62 @@ string HTTPPost(const string& strMsg, const map<string,string>& mapRequestHeader
     return s.str();
 }
 
+static CCriticalSection cs_rfc1123Time;
+
+// Formatting the date goes through a stringstream, so it is done at most once
+// a second rather than for every reply
 static string rfc1123Time()
 {
-    return DateTimeStrFormat("%a, %d %b %Y %H:%M:%S +0000", GetTime());
+    static int64_t nTimeFormatted = 0;
+    static string strFormatted;
+
+    int64_t nTime = GetTime();
+    LOCK(cs_rfc1123Time);
+    if (nTime != nTimeFormatted)
+    {
+        strFormatted = DateTimeStrFormat("%a, %d %b %Y %H:%M:%S +0000", nTime);
+        nTimeFormatted = nTime;
+    }
+    return strFormatted;
+}
+
+static const string& ServerVersion()
+{
+    static const string strVersion = FormatFullVersion();
+    return strVersion;
+}
+
+// Reply headers are put together with appends, strprintf costs an
+// ostringstream per call
+static void AppendNumber(string& str, uint64_t n, int nBase = 10)
+{
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    do
+    {
+        *--p = "0123456789abcdef"[n % nBase];
+        n /= nBase;
+    } while (n > 0);
+    str.append(p, buf + sizeof(buf));
+}
+
+static void AppendReplyHeader(string& str, int nStatus, bool keepalive)
+{
+    const char *cStatus;
+         if (nStatus == HTTP_OK) cStatus = "OK";
+    else if (nStatus == HTTP_BAD_REQUEST) cStatus = "Bad Request";
+    else if (nStatus == HTTP_FORBIDDEN) cStatus = "Forbidden";
+    else if (nStatus == HTTP_NOT_FOUND) cStatus = "Not Found";
+    else if (nStatus == HTTP_INTERNAL_SERVER_ERROR) cStatus = "Internal Server Error";
+    else cStatus = "";
+
+    str += "HTTP/1.1 ";
+    AppendNumber(str, nStatus);
+    str += ' ';
+    str += cStatus;
+    str += "\r\nDate: ";
+    str += rfc1123Time();
+    str += keepalive ? "\r\nConnection: keep-alive" : "\r\nConnection: close";
 }
 
 string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
@@ -74,64 +129,40 @@ string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
             "</HEAD>\r\n"
             "<BODY><H1>401 Unauthorized.</H1></BODY>\r\n"
             "</HTML>\r\n", rfc1123Time(), FormatFullVersion());
-    const char *cStatus;
-         if (nStatus == HTTP_OK) cStatus = "OK";
-    else if (nStatus == HTTP_BAD_REQUEST) cStatus = "Bad Request";
-    else if (nStatus == HTTP_FORBIDDEN) cStatus = "Forbidden";
-    else if (nStatus == HTTP_NOT_FOUND) cStatus = "Not Found";
-    else if (nStatus == HTTP_INTERNAL_SERVER_ERROR) cStatus = "Internal Server Error";
-    else cStatus = "";
-    return strprintf(
-            "HTTP/1.1 %d %s\r\n"
-            "Date: %s\r\n"
-            "Connection: %s\r\n"
-            "Content-Length: %u\r\n"
-            "Content-Type: application/json\r\n"
-            "Server: navcoin-json-rpc/%s\r\n"
-            "\r\n"
-            "%s",
-        nStatus,
-        cStatus,
-        rfc1123Time(),
-        keepalive ? "keep-alive" : "close",
-        strMsg.size(),
-        FormatFullVersion(),
-        strMsg);
+
+    string strReply;
+    strReply.reserve(192 + strMsg.size());
+    AppendReplyHeader(strReply, nStatus, keepalive);
+    strReply += "\r\nContent-Length: ";
+    AppendNumber(strReply, strMsg.size());
+    strReply += "\r\nContent-Type: application/json\r\nServer: navcoin-json-rpc/";
+    strReply += ServerVersion();
+    strReply += "\r\n\r\n";
+    strReply += strMsg;
+    return strReply;
 }
 
-bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
-                         string& http_method, string& http_uri)
+string HTTPReplyChunkedHeader(int nStatus, bool keepalive)
 {
-    string str;
-    getline(stream, str);
-
-    // HTTP request line is space-delimited
-    vector<string> vWords;
-    boost::split(vWords, str, boost::is_any_of(" "));
-    if (vWords.size() < 2)
-        return false;
-
-    // HTTP methods permitted: GET, POST
-    http_method = vWords[0];
-    if (http_method != "GET" && http_method != "POST")
-        return false;
-
-    // HTTP URI must be an absolute path, relative to current host
-    http_uri = vWords[1];
-    if (http_uri.size() == 0 || http_uri[0] != '/')
-        return false;
-
-    // parse proto, if present
-    string strProto = "";
-    if (vWords.size() > 2)
-        strProto = vWords[2];
-
-    proto = 0;
-    const char *ver = strstr(strProto.c_str(), "HTTP/1.");
-    if (ver != NULL)
-        proto = atoi(ver+7);
+    string strReply;
+    AppendReplyHeader(strReply, nStatus, keepalive);
+    strReply += "\r\nTransfer-Encoding: chunked\r\nContent-Type: application/json\r\nServer: navcoin-json-rpc/";
+    strReply += ServerVersion();
+    strReply += "\r\n\r\n";
+    return strReply;
+}
 
-    return true;
+string HTTPChunk(const string& strData)
+{
+    if (strData.empty())
+        return "0\r\n\r\n";
+    string strChunk;
+    strChunk.reserve(strData.size() + 12);
+    AppendNumber(strChunk, strData.size(), 16);
+    strChunk += "\r\n";
+    strChunk += strData;
+    strChunk += "\r\n";
+    return strChunk;
 }
 
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto)
@@ -175,6 +206,34 @@ int ReadHTTPHeaders(std::basic_istream<char>& stream, map<string, string>& mapHe
 }
 
 
+// Body sent with chunked transfer encoding
+static bool ReadHTTPChunks(std::basic_istream<char>& stream, string& strMessageRet, size_t max_size)
+{
+    while (true)
+    {
+        string str;
+        if (!std::getline(stream, str))
+            return false;
+        // size in hex, possibly followed by extensions
+        unsigned long nChunk = strtoul(str.c_str(), NULL, 16);
+        if (nChunk == 0)
+            break;
+        if (nChunk > max_size - strMessageRet.size())
+            return false;
+        size_t nOffset = strMessageRet.size();
+        strMessageRet.resize(nOffset + nChunk);
+        if (!stream.read(&strMessageRet[nOffset], nChunk))
+            return false;
+        // the line break after the data
+        std::getline(stream, str);
+    }
+
+    // trailer up to the empty line
+    map<string, string> mapTrailer;
+    ReadHTTPHeaders(stream, mapTrailer);
+    return true;
+}
+
 int ReadHTTPMessage(std::basic_istream<char>& stream, map<string,
                     string>& mapHeadersRet, string& strMessageRet,
                     int nProto, size_t max_size)
@@ -188,7 +247,13 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string,
         return HTTP_INTERNAL_SERVER_ERROR;
 
     // Read message
-    if (nLen > 0)
+    map<string, string>::const_iterator it = mapHeadersRet.find("transfer-encoding");
+    if (it != mapHeadersRet.end() && boost::iequals(it->second, "chunked"))
+    {
+        if (!ReadHTTPChunks(stream, strMessageRet, max_size))
+            return HTTP_INTERNAL_SERVER_ERROR;
+    }
+    else if (nLen > 0)
     {
         vector<char> vch(nLen);
         stream.read(&vch[0], nLen);
@@ -208,6 +273,202 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, map<string,
     return HTTP_OK;
 }
 
+//
+// Server side requests, read straight off the connection's bytes
+//
+
+static const size_t MAX_HTTP_LINE = 65536;
+
+CHTTPRequestReader::CHTTPRequestReader(const read_type& readIn, size_t nMaxSizeIn) :
+    read(readIn), nMaxSize(nMaxSizeIn), nPos(0), nEnd(0), nBytesRead(0)
+{
+}
+
+// Make sure nWant bytes past nPos are buffered
+bool CHTTPRequestReader::Fill(size_t nWant)
+{
+    if (nEnd - nPos >= nWant)
+        return true;
+
+    // Move the unread data to the front and make room for all of it once,
+    // reads then go straight into the free space
+    if (nPos > 0)
+    {
+        memmove(&strBuffer[0], &strBuffer[nPos], nEnd - nPos);
+        nEnd -= nPos;
+        nPos = 0;
+    }
+    size_t nSize = std::max(nWant, nEnd + 16384);
+    if (strBuffer.size() < nSize)
+        strBuffer.resize(nSize);
+
+    while (nEnd < nWant)
+    {
+        size_t n = read(&strBuffer[nEnd], strBuffer.size() - nEnd);
+        if (n == 0)
+            return false;
+        nEnd += n;
+        nBytesRead += n;
+    }
+    return true;
+}
+
+bool CHTTPRequestReader::ReadLine(string& strLine)
+{
+    size_t nScanned = 0;
+    while (true)
+    {
+        const char* pbegin = strBuffer.data() + nPos;
+        size_t nHave = nEnd - nPos;
+        const char* pLF = (const char*)memchr(pbegin + nScanned, '\n', nHave - nScanned);
+        if (pLF)
+        {
+            const char* pend = pLF;
+            if (pend != pbegin && pend[-1] == '\r')
+                pend--;
+            strLine.assign(pbegin, pend);
+            nPos += pLF + 1 - pbegin;
+            return true;
+        }
+        if (nHave >= MAX_HTTP_LINE)
+            return false;
+        nScanned = nHave;
+        if (!Fill(nHave + 1))
+            return false;
+    }
+}
+
+bool CHTTPRequestReader::ReadChunks(string& strBody)
+{
+    strBody.clear();
+    string strLine;
+    while (true)
+    {
+        if (!ReadLine(strLine))
+            return false;
+        // size in hex, possibly followed by extensions
+        unsigned long nChunk = strtoul(strLine.c_str(), NULL, 16);
+        if (nChunk == 0)
+            break;
+        if (nChunk > nMaxSize - strBody.size())
+            return false;
+        if (!Fill(nChunk))
+            return false;
+        strBody.append(strBuffer, nPos, nChunk);
+        nPos += nChunk;
+        // the line break after the data
+        if (!ReadLine(strLine))
+            return false;
+    }
+
+    // trailer up to the empty line
+    do
+    {
+        if (!ReadLine(strLine))
+            return false;
+    } while (!strLine.empty());
+    return true;
+}
+
+// Case-insensitive match of the header name before the colon
+static bool IsHeader(const string& strLine, size_t nColon, const char* pszName)
+{
+    size_t nBegin = 0, nEnd = nColon;
+    while (nBegin < nEnd && isspace((unsigned char)strLine[nBegin]))
+        nBegin++;
+    while (nEnd > nBegin && isspace((unsigned char)strLine[nEnd - 1]))
+        nEnd--;
+    size_t nLen = strlen(pszName);
+    if (nEnd - nBegin != nLen)
+        return false;
+    for (size_t i = 0; i < nLen; i++)
+        if (tolower((unsigned char)strLine[nBegin + i]) != pszName[i])
+            return false;
+    return true;
+}
+
+bool CHTTPRequestReader::Read(CHTTPRequest& req)
+{
+    // Request line, blank lines a client sent after the previous body are skipped
+    string strLine;
+    do
+    {
+        if (!ReadLine(strLine))
+            return false;
+    } while (strLine.empty());
+
+    // HTTP request line is space-delimited
+    vector<string> vWords;
+    boost::split(vWords, strLine, boost::is_any_of(" "));
+    if (vWords.size() < 2)
+        return false;
+
+    // HTTP methods permitted: GET, POST
+    req.strMethod = vWords[0];
+    if (req.strMethod != "GET" && req.strMethod != "POST")
+        return false;
+
+    // HTTP URI must be an absolute path, relative to current host
+    req.strURI = vWords[1];
+    if (req.strURI.empty() || req.strURI[0] != '/')
+        return false;
+
+    req.nProto = 0;
+    if (vWords.size() > 2)
+    {
+        const char *ver = strstr(vWords[2].c_str(), "HTTP/1.");
+        if (ver != NULL)
+            req.nProto = atoi(ver+7);
+    }
+
+    // Headers, keeping only the ones the server acts on
+    req.strAuthorization.clear();
+    string strConnection, strTransferEncoding;
+    int64_t nContentLength = 0;
+    while (true)
+    {
+        if (!ReadLine(strLine))
+            return false;
+        if (strLine.empty())
+            break;
+        size_t nColon = strLine.find(':');
+        if (nColon == string::npos)
+            continue;
+        string* pstrValue = NULL;
+        string strContentLength;
+        if (IsHeader(strLine, nColon, "authorization"))
+            pstrValue = &req.strAuthorization;
+        else if (IsHeader(strLine, nColon, "connection"))
+            pstrValue = &strConnection;
+        else if (IsHeader(strLine, nColon, "transfer-encoding"))
+            pstrValue = &strTransferEncoding;
+        else if (IsHeader(strLine, nColon, "content-length"))
+            pstrValue = &strContentLength;
+        else
+            continue;
+        pstrValue->assign(strLine, nColon + 1, string::npos);
+        boost::trim(*pstrValue);
+        if (pstrValue == &strContentLength)
+            nContentLength = atoi64(strContentLength);
+    }
+
+    // HTTP/1.1 keeps the connection open unless told otherwise, 1.0 only when asked
+    boost::to_lower(strConnection);
+    boost::to_lower(strTransferEncoding);
+    req.fKeepAlive = (strConnection == "keep-alive" || (strConnection != "close" && req.nProto >= 1));
+
+    if (strTransferEncoding == "chunked")
+        return ReadChunks(req.strBody);
+
+    if (nContentLength < 0 || (uint64_t)nContentLength > nMaxSize)
+        return false;
+    if (!Fill(nContentLength))
+        return false;
+    req.strBody.assign(strBuffer, nPos, nContentLength);
+    nPos += nContentLength;
+    return true;
+}
+
 //
 // JSON-RPC protocol.  Bitcoin speaks version 1.0 for maximum compatibility,
 // but uses JSON-RPC 1.1/2.0 standards for parts of the 1.0 standard that were
@@ -12,6 +12,7 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <boost/function.hpp>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/asio.hpp>
@@ -124,10 +125,59 @@ private:
     boost::asio::ssl::stream<typename Protocol::socket>& stream;
 };
 
+/** The parts of an HTTP request the RPC server looks at */
+class CHTTPRequest
+{
+public:
+    int nProto;
+    std::string strMethod;
+    std::string strURI;
+    std::string strAuthorization;
+    bool fKeepAlive;
+    std::string strBody;
+
+    CHTTPRequest() : nProto(0), fKeepAlive(false) {}
+};
+
+/**
+ * Reads HTTP requests off a connection through one buffer. Requests a client
+ * pipelines arrive in the same read and are then taken one at a time, and the
+ * few headers that matter are picked out of the buffer in place rather than
+ * going through an iostream into a map.
+ */
+class CHTTPRequestReader
+{
+public:
+    /** Read up to n bytes into pch, blocking until some arrive; 0 once the connection is gone */
+    typedef boost::function<size_t (char* pch, size_t n)> read_type;
+
+private:
+    read_type read;
+    size_t nMaxSize;
+    std::string strBuffer;
+    size_t nPos;            // start of the unread data in strBuffer
+    size_t nEnd;            // end of the data read so far, the rest of strBuffer is room for more
+    uint64_t nBytesRead;
+
+    bool Fill(size_t nWant);
+    bool ReadLine(std::string& strLine);
+    bool ReadChunks(std::string& strBody);
+
+public:
+    CHTTPRequestReader(const read_type& readIn, size_t nMaxSizeIn);
+
+    /** The next request, false when the connection closed or didn't speak HTTP */
+    bool Read(CHTTPRequest& req);
+
+    uint64_t GetBytesRead() const { return nBytesRead; }
+};
+
 std::string HTTPPost(const std::string& strMsg, const std::map<std::string,std::string>& mapRequestHeaders);
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive);
-bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
-                         std::string& http_method, std::string& http_uri);
+/** Header of a reply whose body follows in HTTPChunk()s */
+std::string HTTPReplyChunkedHeader(int nStatus, bool keepalive);
+/** One chunk of a chunked body, an empty one ends the body */
+std::string HTTPChunk(const std::string& strData);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto);
 int ReadHTTPHeaders(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet);
 int ReadHTTPMessage(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet,
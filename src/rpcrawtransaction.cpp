@@ -8,6 +8,7 @@
 #include "base58.h"
 #include "rpcserver.h"
 #include "txdb.h"
+#include "txview.h"
 #include "init.h"
 #include "main.h"
 #include "net.h"
@@ -93,7 +94,8 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
     if (hashBlock != 0)
     {
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        LOCK_SHARED(cs_blockindex);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second)
         {
             CBlockIndex* pindex = (*mi).second;
@@ -145,7 +147,7 @@ Value getrawtransaction(const Array& params, bool fHelp)
 }
 
 #ifdef ENABLE_WALLET
-Value listunspent(const Array& params, bool fHelp)
+void listunspent(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() > 3)
         throw runtime_error(
@@ -181,10 +183,10 @@ Value listunspent(const Array& params, bool fHelp)
         }
     }
 
-    Array results;
     vector<COutput> vecOutputs;
     assert(pwalletMain != NULL);
     pwalletMain->AvailableCoins(vecOutputs, false);
+    stream.BeginArray();
     BOOST_FOREACH(const COutput& out, vecOutputs)
     {
         if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
@@ -202,17 +204,17 @@ Value listunspent(const Array& params, bool fHelp)
 
         int64_t nValue = out.tx->vout[out.i].nValue;
         const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-        Object entry;
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
+        stream.BeginObject();
+        stream.Pair("txid", out.tx->GetHash().GetHex());
+        stream.Pair("vout", out.i);
         CTxDestination address;
         if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
         {
-            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+            stream.Pair("address", CBitcoinAddress(address).ToString());
             if (pwalletMain->mapAddressBook.count(address))
-                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address]));
+                stream.Pair("account", pwalletMain->mapAddressBook[address]);
         }
-        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
+        stream.Pair("scriptPubKey", HexStr(pk.begin(), pk.end()));
         if (pk.IsPayToScriptHash())
         {
             CTxDestination address;
@@ -221,15 +223,14 @@ Value listunspent(const Array& params, bool fHelp)
                 const CScriptID& hash = boost::get<CScriptID>(address);
                 CScript redeemScript;
                 if (pwalletMain->GetCScript(hash, redeemScript))
-                    entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+                    stream.Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end()));
             }
         }
-        entry.push_back(Pair("amount",ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations",out.nDepth));
-        results.push_back(entry);
+        stream.Pair("amount",ValueFromAmount(nValue));
+        stream.Pair("confirmations",out.nDepth);
+        stream.EndObject();
     }
-
-    return results;
+    stream.EndArray();
 }
 #endif
 
@@ -615,7 +616,7 @@ Value sendrawtransaction(const Array& params, bool fHelp)
 }
 
 
-Value searchrawtransactions(const Array &params, bool fHelp)
+void searchrawtransactions(const Array &params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() < 1 || params.size() > 4)
         throw runtime_error(
@@ -650,25 +651,39 @@ Value searchrawtransactions(const Array &params, bool fHelp)
     std::vector<uint256>::const_iterator it = vtxhash.begin();
     while (it != vtxhash.end() && nSkip--) it++;
 
-    Array result;
+    stream.BeginArray();
     while (it != vtxhash.end() && nCount--) {
         CTransaction tx;
-        uint256 hashBlock;
-        if (!GetTransaction(*it, tx, hashBlock))
-            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Cannot read transaction from disk");
-        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-        ssTx << tx;
-        string strHex = HexStr(ssTx.begin(), ssTx.end());
+        uint256 hashBlock = 0;
+        string strHex;
+        CDiskTxBytes txbytes;
+        if (GetTransactionBytes(*it, txbytes)) {
+            // the hex is the bytes in the block file, the disk and network
+            // serializations of a transaction are the same
+            CTransactionView txview = txbytes.GetTransaction();
+            strHex = HexStr(txview.begin(), txview.end());
+            if (fVerbose) {
+                CDataStream ssTx((const char*)txview.begin(), (const char*)txview.end(), SER_DISK, CLIENT_VERSION);
+                ssTx >> tx;
+                hashBlock = txbytes.GetHeader().GetHash();
+            }
+        } else {
+            if (!GetTransaction(*it, tx, hashBlock))
+                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Cannot read transaction from disk");
+            CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+            ssTx << tx;
+            strHex = HexStr(ssTx.begin(), ssTx.end());
+        }
         if (fVerbose) {
             Object object;
             TxToJSON(tx, hashBlock, object);
             object.push_back(Pair("hex", strHex));
-            result.push_back(object);
+            stream.Write(object);
         } else {
-            result.push_back(strHex);
+            stream.Write(strHex);
         }
         it++;
     }
-    return result;
+    stream.EndArray();
 }
 
@@ -0,0 +1,435 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpcreader.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace std;
+using namespace json_spirit;
+
+namespace {
+
+inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// json_spirit's hex_to_num: anything that is not a hex digit counts as 0
+inline int HexValue(char c)
+{
+    int n = HexDigit(c);
+    return n < 0 ? 0 : n;
+}
+
+// Digits accumulate as a double, the way spirit's real parser does it, so
+// reals come out bit for bit the same
+bool ReadDigits(const char*& p, const char* pend, double& n, bool fNegative)
+{
+    static const double dMax = numeric_limits<double>::max();
+    for (; p != pend && IsDigit(*p); p++)
+    {
+        double d = *p - '0';
+        if (fNegative)
+        {
+            if (n < -dMax / 10) return false;
+            n *= 10;
+            if (n < -dMax + d) return false;
+            n -= d;
+        }
+        else
+        {
+            if (n > dMax / 10) return false;
+            n *= 10;
+            if (n > dMax - d) return false;
+            n += d;
+        }
+    }
+    return true;
+}
+
+// A real needs a dot or an exponent, otherwise the text is an integer
+bool ReadReal(const char*& pRet, const char* pend, double& dRet)
+{
+    const char* p = pRet;
+    bool fNegative = false;
+    if (p != pend && (*p == '+' || *p == '-'))
+        fNegative = (*p++ == '-');
+
+    double n = 0;
+    const char* pDigits = p;
+    if (!ReadDigits(p, pend, n, false))
+        return false;
+    bool fNumber = (p != pDigits);
+    if (fNegative)
+        n = -n;
+
+    bool fExponent;
+    if (p != pend && *p == '.')
+    {
+        p++;
+        double frac = 0;
+        const char* pFrac = p;
+        if (!ReadDigits(p, pend, frac, false))
+            return false;
+        if (p != pFrac)
+        {
+            frac *= pow(10.0, -(double)(p - pFrac));
+            if (fNegative)
+                n -= frac;
+            else
+                n += frac;
+        }
+        else if (!fNumber)
+            return false;
+        fExponent = (p != pend && (*p == 'e' || *p == 'E'));
+    }
+    else
+    {
+        if (!fNumber)
+            return false;
+        fExponent = (p != pend && (*p == 'e' || *p == 'E'));
+        if (!fExponent)
+            return false;
+    }
+
+    if (fExponent)
+    {
+        p++;
+        bool fNegativeExp = false;
+        if (p != pend && (*p == '+' || *p == '-'))
+            fNegativeExp = (*p++ == '-');
+        double e = 0;
+        const char* pExp = p;
+        if (!ReadDigits(p, pend, e, fNegativeExp) || p == pExp)
+            return false;
+        n *= pow(10.0, e);
+    }
+
+    dRet = n;
+    pRet = p;
+    return true;
+}
+
+bool ReadInt64(const char*& pRet, const char* pend, int64_t& nRet)
+{
+    const char* p = pRet;
+    bool fNegative = false;
+    if (p != pend && (*p == '+' || *p == '-'))
+        fNegative = (*p++ == '-');
+    if (p == pend || !IsDigit(*p))
+        return false;
+
+    static const int64_t nMax = numeric_limits<int64_t>::max();
+    static const int64_t nMin = numeric_limits<int64_t>::min();
+    int64_t n = 0;
+    for (; p != pend && IsDigit(*p); p++)
+    {
+        int d = *p - '0';
+        if (fNegative)
+        {
+            if (n < nMin / 10) return false;
+            n *= 10;
+            if (n < nMin + d) return false;
+            n -= d;
+        }
+        else
+        {
+            if (n > nMax / 10) return false;
+            n *= 10;
+            if (n > nMax - d) return false;
+            n += d;
+        }
+    }
+    nRet = n;
+    pRet = p;
+    return true;
+}
+
+bool ReadUint64(const char*& pRet, const char* pend, uint64_t& nRet)
+{
+    const char* p = pRet;
+    if (p == pend || !IsDigit(*p))
+        return false;
+
+    static const uint64_t nMax = numeric_limits<uint64_t>::max();
+    uint64_t n = 0;
+    for (; p != pend && IsDigit(*p); p++)
+    {
+        int d = *p - '0';
+        if (n > nMax / 10) return false;
+        n *= 10;
+        if (n > nMax - d) return false;
+        n += d;
+    }
+    nRet = n;
+    pRet = p;
+    return true;
+}
+
+// json_spirit's substitute_esc_chars: unknown escapes are dropped, \u keeps
+// only the low byte
+void Unescape(const char* pbegin, const char* pend, string& str)
+{
+    str.clear();
+    str.reserve(pend - pbegin);
+    const char* pStart = pbegin;
+    for (const char* p = pbegin; p < pend - 1; p++)
+    {
+        if (*p != '\\')
+            continue;
+        str.append(pStart, p);
+        p++;
+        switch (*p)
+        {
+        case 't':  str += '\t'; break;
+        case 'b':  str += '\b'; break;
+        case 'f':  str += '\f'; break;
+        case 'n':  str += '\n'; break;
+        case 'r':  str += '\r'; break;
+        case '\\': str += '\\'; break;
+        case '/':  str += '/';  break;
+        case '"':  str += '"';  break;
+        case 'x':
+            if (pend - p >= 3)
+            {
+                str += (char)((HexValue(p[1]) << 4) + HexValue(p[2]));
+                p += 2;
+            }
+            break;
+        case 'u':
+            if (pend - p >= 5)
+            {
+                str += (char)((HexValue(p[1]) << 12) + (HexValue(p[2]) << 8) +
+                              (HexValue(p[3]) << 4) + HexValue(p[4]));
+                p += 4;
+            }
+            break;
+        }
+        pStart = p + 1;
+    }
+    str.append(pStart, pend);
+}
+
+// p is at the opening quote. Where the string ends follows spirit's escape
+// rules: a backslash takes the next character along, except that \x needs
+// one or two hex digits that fit in a signed char.
+bool ReadString(const char*& pRet, const char* pend, string& str)
+{
+    const char* pbegin = pRet + 1;
+    const char* p = pbegin;
+    const char* pQuote = NULL;
+    bool fEscaped = false;
+    while (true)
+    {
+        // memchr runs through long hex strings many times faster than a
+        // loop over the characters. The quote found stays good until an
+        // escape has taken it.
+        if (!pQuote || pQuote < p)
+            pQuote = (const char*)memchr(p, '"', pend - p);
+        if (!pQuote)
+            return false;
+        const char* pEscape = (const char*)memchr(p, '\\', pQuote - p);
+        if (!pEscape)
+        {
+            p = pQuote;
+            break;
+        }
+        p = pEscape;
+
+        fEscaped = true;
+        if (++p == pend)
+            return false;
+        if (*p == 'x' || *p == 'X')
+        {
+            if (++p == pend)
+                return false;
+            int n = HexDigit(*p);
+            if (n < 0)
+                return false;
+            if (++p != pend && HexDigit(*p) >= 0)
+            {
+                if (n > 7)
+                    return false;
+                p++;
+            }
+        }
+        else
+            p++;
+    }
+
+    if (fEscaped)
+        Unescape(pbegin, p, str);
+    else
+        str.assign(pbegin, p);
+    pRet = p + 1;
+    return true;
+}
+
+bool ReadLiteral(const char*& p, const char* pend, const char* psz)
+{
+    const char* q = p;
+    for (; *psz; psz++, q++)
+        if (q == pend || *q != *psz)
+            return false;
+    p = q;
+    return true;
+}
+
+inline void SkipSpace(const char*& p, const char* pend)
+{
+    while (p != pend && IsSpace(*p))
+        p++;
+}
+
+class CJSONReader
+{
+private:
+    Value& valueRet;
+    vector<Value*> vStack;   // open objects and arrays, innermost last
+    string strName;          // key of the next value in an object
+
+public:
+    CJSONReader(Value& valueIn) : valueRet(valueIn) {}
+
+    Value* Add(const Value& value)
+    {
+        if (vStack.empty())
+        {
+            valueRet = value;
+            return &valueRet;
+        }
+        Value* pcurrent = vStack.back();
+        if (pcurrent->type() == array_type)
+        {
+            Array& array = pcurrent->get_array();
+            array.push_back(value);
+            return &array.back();
+        }
+        Object& obj = pcurrent->get_obj();
+        obj.push_back(Pair(strName, value));
+        return &obj.back().value_;
+    }
+
+    bool ReadKey(const char*& p, const char* pend)
+    {
+        SkipSpace(p, pend);
+        if (p == pend || *p != '"' || !ReadString(p, pend, strName))
+            return false;
+        SkipSpace(p, pend);
+        if (p == pend || *p != ':')
+            return false;
+        p++;
+        return true;
+    }
+
+    bool Read(const char* p, const char* pend)
+    {
+        while (true)
+        {
+            // A value
+            SkipSpace(p, pend);
+            if (p == pend)
+                return false;
+
+            char c = *p;
+            if (c == '{' || c == '[')
+            {
+                p++;
+                if (c == '{')
+                    vStack.push_back(Add(Object()));
+                else
+                    vStack.push_back(Add(Array()));
+                SkipSpace(p, pend);
+                if (p != pend && *p == (c == '{' ? '}' : ']'))
+                {
+                    p++;
+                    vStack.pop_back();
+                }
+                else
+                {
+                    if (c == '{' && !ReadKey(p, pend))
+                        return false;
+                    continue;
+                }
+            }
+            else if (c == '"')
+            {
+                // Value only hands out its string as const. Filling it in
+                // place saves copying a large hex string twice more.
+                Value* pvalue = Add(string());
+                if (!ReadString(p, pend, const_cast<string&>(pvalue->get_str())))
+                    return false;
+            }
+            else if (c == '-' || c == '+' || c == '.' || IsDigit(c))
+            {
+                double d;
+                int64_t n;
+                uint64_t u;
+                if (ReadReal(p, pend, d))
+                    Add(d);
+                else if (ReadInt64(p, pend, n))
+                    Add(n);
+                else if (ReadUint64(p, pend, u))
+                    Add(u);
+                else
+                    return false;
+            }
+            else if (ReadLiteral(p, pend, "true"))
+                Add(true);
+            else if (ReadLiteral(p, pend, "false"))
+                Add(false);
+            else if (ReadLiteral(p, pend, "null"))
+                Add(Value());
+            else
+                return false;
+
+            // What follows it: a comma, or the end of one or more containers
+            while (true)
+            {
+                if (vStack.empty())
+                    return true;  // anything after the value is ignored
+                SkipSpace(p, pend);
+                if (p == pend)
+                    return false;
+                bool fObject = (vStack.back()->type() == obj_type);
+                if (*p == ',')
+                {
+                    p++;
+                    if (fObject && !ReadKey(p, pend))
+                        return false;
+                    break;
+                }
+                if (*p != (fObject ? '}' : ']'))
+                    return false;
+                p++;
+                vStack.pop_back();
+            }
+        }
+    }
+};
+
+}
+
+bool ReadJSON(const string& strJSON, Value& valueRet)
+{
+    const char* pbegin = strJSON.data();
+    return CJSONReader(valueRet).Read(pbegin, pbegin + strJSON.size());
+}
@@ -0,0 +1,25 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPCREADER_H
+#define BITCOIN_RPCREADER_H
+
+#include "json/json_spirit_value.h"
+
+#include <string>
+
+/**
+ * Parse JSON text into a json_spirit value without going through
+ * Boost.Spirit.
+ *
+ * This accepts exactly what json_spirit::read_string accepts and gives the
+ * same value: trailing text after the first value is ignored, escapes are
+ * substituted the way json_spirit does it and numbers become int, uint64 or
+ * real by the same rules. Containers are tracked on an explicit stack rather
+ * than by recursion, and strings without escapes (hex blobs) are copied out
+ * in one piece. Hex is only decoded when the handler calls ParseHex.
+ */
+bool ReadJSON(const std::string& strJSON, json_spirit::Value& valueRet);
+
+#endif
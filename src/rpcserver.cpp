@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "rpcserver.h"
+#include "rpcreader.h"
 
 #include "base58.h"
 #include "init.h"
@@ -42,6 +43,31 @@ static map<string, boost::shared_ptr<deadline_timer> > deadlineTimers;
 static ssl::context* rpc_ssl_context = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
 
+/** Requests served on one open RPC connection */
+struct CRPCConnectionStats
+{
+    std::string strPeer;
+    int64_t nTimeConnected;
+    uint64_t nRequests;
+    uint64_t nBytesIn;
+    uint64_t nBytesOut;
+
+    CRPCConnectionStats() : nTimeConnected(0), nRequests(0), nBytesIn(0), nBytesOut(0) {}
+};
+
+// Request counts for getrpcstats
+static CCriticalSection cs_rpcStats;
+static int64_t nRPCTimeStarted = 0;
+static int64_t nRPCLastConnectionId = 0;
+static uint64_t nRPCConnections = 0;
+static uint64_t nRPCRequests = 0;
+static uint64_t nRPCBytesIn = 0;
+static uint64_t nRPCBytesOut = 0;
+static map<int64_t, CRPCConnectionStats> mapRPCConnections;
+// Requests per second over the last minute, slot nTime % 60 counts second nTime
+static int64_t vRPCRequestSecond[60];
+static uint64_t vRPCRequestsInSecond[60];
+
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
                   bool fAllowNull)
@@ -196,6 +222,94 @@ Value help(const Array& params, bool fHelp)
 }
 
 
+static int64_t RPCConnectionOpened(const string& strPeer)
+{
+    LOCK(cs_rpcStats);
+    int64_t nId = ++nRPCLastConnectionId;
+    CRPCConnectionStats& stats = mapRPCConnections[nId];
+    stats.strPeer = strPeer;
+    stats.nTimeConnected = GetTime();
+    nRPCConnections++;
+    return nId;
+}
+
+// Bring a connection's byte counts up to date, with one more request if fRequest
+static void RPCConnectionUpdate(int64_t nId, uint64_t nBytesIn, uint64_t nBytesOut, bool fRequest)
+{
+    LOCK(cs_rpcStats);
+    CRPCConnectionStats& stats = mapRPCConnections[nId];
+    nRPCBytesIn += nBytesIn - stats.nBytesIn;
+    nRPCBytesOut += nBytesOut - stats.nBytesOut;
+    stats.nBytesIn = nBytesIn;
+    stats.nBytesOut = nBytesOut;
+    if (!fRequest)
+        return;
+
+    stats.nRequests++;
+    nRPCRequests++;
+    int64_t nTime = GetTime();
+    int nSlot = nTime % 60;
+    if (vRPCRequestSecond[nSlot] != nTime)
+    {
+        vRPCRequestSecond[nSlot] = nTime;
+        vRPCRequestsInSecond[nSlot] = 0;
+    }
+    vRPCRequestsInSecond[nSlot]++;
+}
+
+static void RPCConnectionClosed(int64_t nId, uint64_t nBytesIn, uint64_t nBytesOut)
+{
+    RPCConnectionUpdate(nId, nBytesIn, nBytesOut, false);
+    LOCK(cs_rpcStats);
+    mapRPCConnections.erase(nId);
+}
+
+Value getrpcstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcstats\n"
+            "Returns request counts and rates of the RPC server, in total and per open connection.\n"
+            "Rates are requests per second, over the server's or connection's lifetime and over the last minute.");
+
+    LOCK(cs_rpcStats);
+    int64_t nTime = GetTime();
+    uint64_t nLastMinute = 0;
+    for (int i = 0; i < 60; i++)
+        if (vRPCRequestSecond[i] > nTime - 60)
+            nLastMinute += vRPCRequestsInSecond[i];
+
+    Object ret;
+    int64_t nUptime = nTime - nRPCTimeStarted;
+    ret.push_back(Pair("uptime",             nUptime));
+    ret.push_back(Pair("connections",        (int64_t)mapRPCConnections.size()));
+    ret.push_back(Pair("totalconnections",   (int64_t)nRPCConnections));
+    ret.push_back(Pair("requests",           (int64_t)nRPCRequests));
+    ret.push_back(Pair("requestspersec",     (double)nRPCRequests / max(nUptime, (int64_t)1)));
+    ret.push_back(Pair("lastminutepersec",   (double)nLastMinute / 60));
+    ret.push_back(Pair("bytesin",            (int64_t)nRPCBytesIn));
+    ret.push_back(Pair("bytesout",           (int64_t)nRPCBytesOut));
+
+    Array peers;
+    for (map<int64_t, CRPCConnectionStats>::const_iterator it = mapRPCConnections.begin(); it != mapRPCConnections.end(); ++it)
+    {
+        const CRPCConnectionStats& stats = it->second;
+        Object obj;
+        int64_t nConnected = nTime - stats.nTimeConnected;
+        obj.push_back(Pair("id",             it->first));
+        obj.push_back(Pair("addr",           stats.strPeer));
+        obj.push_back(Pair("conntime",       nConnected));
+        obj.push_back(Pair("requests",       (int64_t)stats.nRequests));
+        obj.push_back(Pair("requestspersec", (double)stats.nRequests / max(nConnected, (int64_t)1)));
+        obj.push_back(Pair("bytesin",        (int64_t)stats.nBytesIn));
+        obj.push_back(Pair("bytesout",       (int64_t)stats.nBytesOut));
+        peers.push_back(obj);
+    }
+    ret.push_back(Pair("peers", peers));
+    return ret;
+}
+
+
 Value stop(const Array& params, bool fHelp)
 {
     // Accept the deprecated and ignored 'detach' boolean argument
@@ -216,101 +330,106 @@ Value stop(const Array& params, bool fHelp)
 
 
 static const CRPCCommand vRPCCommands[] =
-{ //  name                      actor (function)         okSafeMode threadSafe reqWallet
-  //  ------------------------  -----------------------  ---------- ---------- ---------
-    { "help",                   &help,                   true,      true,      false },
-    { "stop",                   &stop,                   true,      true,      false },
-    { "getbestblockhash",       &getbestblockhash,       true,      false,     false },
-    { "getblockcount",          &getblockcount,          true,      false,     false },
-    { "getconnectioncount",     &getconnectioncount,     true,      false,     false },
-    { "getpeerinfo",            &getpeerinfo,            true,      false,     false },
-    { "addnode",                &addnode,                true,      true,      false },
-    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,      false },
-    { "addanonserver",          &addanonserver,          true,      true,      false },
-    { "getaddedanonserverinfo", &getaddedanonserverinfo, true,      true,      false },
-    { "ping",                   &ping,                   true,      false,     false },
-    { "getnettotals",           &getnettotals,           true,      true,      false },
-    { "getdifficulty",          &getdifficulty,          true,      false,     false },
-    { "getinfo",                &getinfo,                true,      false,     false },
-    { "getrawmempool",          &getrawmempool,          true,      false,     false },
-    { "getblock",               &getblock,               false,     false,     false },
-    { "getblockbynumber",       &getblockbynumber,       false,     false,     false },
-    { "getblockhash",           &getblockhash,           false,     false,     false },
-    { "getrawtransaction",      &getrawtransaction,      false,     false,     false },
-    { "createrawtransaction",   &createrawtransaction,   false,     false,     false },
-    { "decoderawtransaction",   &decoderawtransaction,   false,     false,     false },
-    { "decodescript",           &decodescript,           false,     false,     false },
-    { "signrawtransaction",     &signrawtransaction,     false,     false,     false },
-    { "sendrawtransaction",     &sendrawtransaction,     false,     false,     false },
-    { "getcheckpoint",          &getcheckpoint,          true,      false,     false },
-    { "sendalert",              &sendalert,              false,     false,     false },
-	{ "getstakereport",         &getstakereport,         false,  false},    // ** em52
-    { "validateaddress",        &validateaddress,        true,      false,     false },
-    { "validatepubkey",         &validatepubkey,         true,      false,     false },
-    { "verifymessage",          &verifymessage,          false,     false,     false },
-    { "searchrawtransactions",  &searchrawtransactions,  false,     false, false },
+{ //  name                      actor (function)         okSafeMode threadSafe reqWallet  streamActor
+  //  ------------------------  -----------------------  ---------- ---------- ---------  -----------
+    { "help",                   &help,                   true,      true,      false,     NULL },
+    { "stop",                   &stop,                   true,      true,      false,     NULL },
+    { "getbestblockhash",       &getbestblockhash,       true,      true,      false,     NULL },
+    { "getblockcount",          &getblockcount,          true,      true,      false,     NULL },
+    { "getconnectioncount",     &getconnectioncount,     true,      false,     false,     NULL },
+    { "getpeerinfo",            &getpeerinfo,            true,      false,     false,     NULL },
+    { "addnode",                &addnode,                true,      true,      false,     NULL },
+    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,      false,     NULL },
+    { "addanonserver",          &addanonserver,          true,      true,      false,     NULL },
+    { "getaddedanonserverinfo", &getaddedanonserverinfo, true,      true,      false,     NULL },
+    { "ping",                   &ping,                   true,      false,     false,     NULL },
+    { "getnettotals",           &getnettotals,           true,      true,      false,     NULL },
+    { "getdifficulty",          &getdifficulty,          true,      false,     false,     NULL },
+    { "getchainstats",          &getchainstats,          true,      true,      false,     NULL },
+    { "getinfo",                &getinfo,                true,      false,     false,     NULL },
+    { "getlockstats",           &getlockstats,           true,      false,     false,     NULL },
+    { "getrpcstats",            &getrpcstats,            true,      true,      false,     NULL },
+    { "getrawmempool",          &RPCStreamActor<&getrawmempool>, true, true,    false, &getrawmempool },
+    { "getblock",               &RPCStreamActor<&getblock>, false,  true,      false, &getblock },
+    { "getblockbynumber",       &RPCStreamActor<&getblockbynumber>, false, true, false, &getblockbynumber },
+    { "getblocksummary",        &getblocksummary,        false,     true,      false,     NULL },
+    { "getblockhash",           &getblockhash,           false,     true,      false,     NULL },
+    { "getrawtransaction",      &getrawtransaction,      false,     false,     false,     NULL },
+    { "createrawtransaction",   &createrawtransaction,   false,     false,     false,     NULL },
+    { "decoderawtransaction",   &decoderawtransaction,   false,     false,     false,     NULL },
+    { "decodescript",           &decodescript,           false,     false,     false,     NULL },
+    { "signrawtransaction",     &signrawtransaction,     false,     false,     false,     NULL },
+    { "sendrawtransaction",     &sendrawtransaction,     false,     false,     false,     NULL },
+    { "getcheckpoint",          &getcheckpoint,          true,      false,     false,     NULL },
+    { "sendalert",              &sendalert,              false,     false,     false,     NULL },
+	{ "getstakereport",         &getstakereport,         false,  false, false, NULL },    // ** em52
+    { "validateaddress",        &validateaddress,        true,      false,     false,     NULL },
+    { "validatepubkey",         &validatepubkey,         true,      false,     false,     NULL },
+    { "verifymessage",          &verifymessage,          false,     false,     false,     NULL },
+    { "searchrawtransactions",  &RPCStreamActor<&searchrawtransactions>, false, false, false, &searchrawtransactions },
 
 /* Anon features */
 
-    { "addincoming",            &addincoming,           false,     false,      true },
-    { "anonsend",               &anonsend,              false,     false,      true },
-    { "hub",                    &hub,                   true,      false,      false },
-    { "inode",                  &inode,                 true,      false,      true },
+    { "addincoming",            &addincoming,           false,     false,      true,      NULL },
+    { "anonsend",               &anonsend,              false,     false,      true,      NULL },
+    { "hub",                    &hub,                   true,      false,      false,     NULL },
+    { "inode",                  &inode,                 true,      false,      true,      NULL },
+    { "getschedulerinfo",       &getschedulerinfo,      true,      false,      false,     NULL },
 
 #ifdef ENABLE_WALLET
-    { "getmininginfo",          &getmininginfo,          true,      false,     false },
-    { "getstakinginfo",         &getstakinginfo,         true,      false,     false },
-    { "getnewaddress",          &getnewaddress,          true,      false,     true },
-    { "getnewpubkey",           &getnewpubkey,           true,      false,     true },
-    { "getaccountaddress",      &getaccountaddress,      true,      false,     true },
-    { "setaccount",             &setaccount,             true,      false,     true },
-    { "getaccount",             &getaccount,             false,     false,     true },
-    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,     true },
-    { "sendtoaddress",          &sendtoaddress,          false,     false,     true },
-    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,     true },
-    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,     true },
-    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,     true },
-    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,     true },
-    { "backupwallet",           &backupwallet,           true,      false,     true },
-    { "keypoolrefill",          &keypoolrefill,          true,      false,     true },
-    { "walletpassphrase",       &walletpassphrase,       true,      false,     true },
-    { "walletpassphrasechange", &walletpassphrasechange, false,     false,     true },
-    { "walletlock",             &walletlock,             true,      false,     true },
-    { "encryptwallet",          &encryptwallet,          false,     false,     true },
-    { "getbalance",             &getbalance,             false,     false,     true },
-    { "move",                   &movecmd,                false,     false,     true },
-    { "sendfrom",               &sendfrom,               false,     false,     true },
-    { "sendmany",               &sendmany,               false,     false,     true },
-    { "addmultisigaddress",     &addmultisigaddress,     false,     false,     true },
-    { "addredeemscript",        &addredeemscript,        false,     false,     true },
-    { "gettransaction",         &gettransaction,         false,     false,     true },
-    { "listtransactions",       &listtransactions,       false,     false,     true },
-    { "listaddressgroupings",   &listaddressgroupings,   false,     false,     true },
-    { "signmessage",            &signmessage,            false,     false,     true },
-    { "getwork",                &getwork,                true,      false,     true },
-    { "getworkex",              &getworkex,              true,      false,     true },
-    { "listaccounts",           &listaccounts,           false,     false,     true },
-    { "getblocktemplate",       &getblocktemplate,       true,      false,     false },
-    { "submitblock",            &submitblock,            false,     false,     false },
-    { "listsinceblock",         &listsinceblock,         false,     false,     true },
-    { "dumpprivkey",            &dumpprivkey,            false,     false,     true },
-    { "dumpwallet",             &dumpwallet,             true,      false,     true },
-    { "importprivkey",          &importprivkey,          false,     false,     true },
-    { "importwallet",           &importwallet,           false,     false,     true },
-    { "listunspent",            &listunspent,            false,     false,     true },
-    { "settxfee",               &settxfee,               false,     false,     true },
-    { "getsubsidy",             &getsubsidy,             true,      true,      false },
-    { "getstakesubsidy",        &getstakesubsidy,        true,      true,      false },
-    { "reservebalance",         &reservebalance,         false,     true,      true },
-    { "checkwallet",            &checkwallet,            false,     true,      true },
-    { "repairwallet",           &repairwallet,           false,     true,      true },
-    { "resendtx",               &resendtx,               false,     true,      true },
-    { "makekeypair",            &makekeypair,            false,     true,      false },
-    { "checkkernel",            &checkkernel,            true,      false,     true },
-    { "getnewsecretaddress",   &getnewsecretaddress,   false,  false, true},
-    { "listsecretaddresses",   &listsecretaddresses,   false,  false, true},
-    { "importsecretaddress",   &importsecretaddress,   false,  false, true},
-    { "sendtosecretaddress",   &sendtosecretaddress,   false,  false, true},
+    { "getmininginfo",          &getmininginfo,          true,      false,     false,     NULL },
+    { "getstakinginfo",         &getstakinginfo,         true,      false,     false,     NULL },
+    { "getnewaddress",          &getnewaddress,          true,      false,     true,      NULL },
+    { "getnewpubkey",           &getnewpubkey,           true,      false,     true,      NULL },
+    { "getaccountaddress",      &getaccountaddress,      true,      false,     true,      NULL },
+    { "setaccount",             &setaccount,             true,      false,     true,      NULL },
+    { "getaccount",             &getaccount,             false,     false,     true,      NULL },
+    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,     true,      NULL },
+    { "sendtoaddress",          &sendtoaddress,          false,     false,     true,      NULL },
+    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,     true,      NULL },
+    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,     true,      NULL },
+    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,     true,      NULL },
+    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,     true,      NULL },
+    { "backupwallet",           &backupwallet,           true,      false,     true,      NULL },
+    { "keypoolrefill",          &keypoolrefill,          true,      false,     true,      NULL },
+    { "walletpassphrase",       &walletpassphrase,       true,      false,     true,      NULL },
+    { "walletpassphrasechange", &walletpassphrasechange, false,     false,     true,      NULL },
+    { "walletlock",             &walletlock,             true,      false,     true,      NULL },
+    { "encryptwallet",          &encryptwallet,          false,     false,     true,      NULL },
+    { "getbalance",             &getbalance,             false,     false,     true,      NULL },
+    { "move",                   &movecmd,                false,     false,     true,      NULL },
+    { "sendfrom",               &sendfrom,               false,     false,     true,      NULL },
+    { "sendmany",               &sendmany,               false,     false,     true,      NULL },
+    { "addmultisigaddress",     &addmultisigaddress,     false,     false,     true,      NULL },
+    { "addredeemscript",        &addredeemscript,        false,     false,     true,      NULL },
+    { "gettransaction",         &gettransaction,         false,     false,     true,      NULL },
+    { "listtransactions",       &RPCStreamActor<&listtransactions>, false, false, true, &listtransactions },
+    { "listaddressgroupings",   &listaddressgroupings,   false,     false,     true,      NULL },
+    { "signmessage",            &signmessage,            false,     false,     true,      NULL },
+    { "getwork",                &getwork,                true,      false,     true,      NULL },
+    { "getworkex",              &getworkex,              true,      false,     true,      NULL },
+    { "listaccounts",           &listaccounts,           false,     false,     true,      NULL },
+    { "getblocktemplate",       &getblocktemplate,       true,      false,     false,     NULL },
+    { "submitblock",            &submitblock,            false,     false,     false,     NULL },
+    { "listsinceblock",         &listsinceblock,         false,     false,     true,      NULL },
+    { "dumpprivkey",            &dumpprivkey,            false,     false,     true,      NULL },
+    { "dumpwallet",             &dumpwallet,             true,      false,     true,      NULL },
+    { "importprivkey",          &importprivkey,          false,     false,     true,      NULL },
+    { "importwallet",           &importwallet,           false,     false,     true,      NULL },
+    { "listunspent",            &RPCStreamActor<&listunspent>, false, false,   true, &listunspent },
+    { "settxfee",               &settxfee,               false,     false,     true,      NULL },
+    { "getsubsidy",             &getsubsidy,             true,      true,      false,     NULL },
+    { "getstakesubsidy",        &getstakesubsidy,        true,      true,      false,     NULL },
+    { "reservebalance",         &reservebalance,         false,     true,      true,      NULL },
+    { "checkwallet",            &checkwallet,            false,     true,      true,      NULL },
+    { "repairwallet",           &repairwallet,           false,     true,      true,      NULL },
+    { "resendtx",               &resendtx,               false,     true,      true,      NULL },
+    { "makekeypair",            &makekeypair,            false,     true,      false,     NULL },
+    { "checkkernel",            &checkkernel,            true,      false,     true,      NULL },
+    { "getnewsecretaddress",   &getnewsecretaddress,   false,  false, true, NULL },
+    { "listsecretaddresses",   &listsecretaddresses,   false,  false, true, NULL },
+    { "importsecretaddress",   &importsecretaddress,   false,  false, true, NULL },
+    { "sendtosecretaddress",   &sendtosecretaddress,   false,  false, true, NULL },
 #endif
 };
 
@@ -335,9 +454,8 @@ const CRPCCommand *CRPCTable::operator[](string name) const
 }
 
 
-bool HTTPAuthorized(map<string, string>& mapHeaders)
+bool HTTPAuthorized(const string& strAuth)
 {
-    string strAuth = mapHeaders["authorization"];
     if (strAuth.substr(0,6) != "Basic ")
         return false;
     string strUserPass64 = strAuth.substr(6); boost::trim(strUserPass64);
@@ -345,7 +463,7 @@ bool HTTPAuthorized(map<string, string>& mapHeaders)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
-void ErrorReply(std::ostream& stream, const Object& objError, const Value& id)
+string ErrorReply(const Object& objError, const Value& id)
 {
     // Send error reply from json-rpc error object
     int nStatus = HTTP_INTERNAL_SERVER_ERROR;
@@ -353,7 +471,7 @@ void ErrorReply(std::ostream& stream, const Object& objError, const Value& id)
     if (code == RPC_INVALID_REQUEST) nStatus = HTTP_BAD_REQUEST;
     else if (code == RPC_METHOD_NOT_FOUND) nStatus = HTTP_NOT_FOUND;
     string strReply = JSONRPCReply(Value::null, objError, id);
-    stream << HTTPReply(nStatus, strReply, false) << std::flush;
+    return HTTPReply(nStatus, strReply, false);
 }
 
 bool ClientAllowed(const boost::asio::ip::address& address)
@@ -384,7 +502,10 @@ class AcceptedConnection
 public:
     virtual ~AcceptedConnection() {}
 
-    virtual std::iostream& stream() = 0;
+    /** Read what has arrived, waiting if nothing has; 0 once the connection is gone */
+    virtual size_t read_some(char* pch, size_t nMax) = 0;
+    /** Write all of str, false if the connection failed */
+    virtual bool write(const std::string& str) = 0;
     virtual std::string peer_address_to_string() const = 0;
     virtual void close() = 0;
 };
@@ -396,16 +517,39 @@ public:
     AcceptedConnectionImpl(
             asio::io_service& io_service,
             ssl::context &context,
-            bool fUseSSL) :
+            bool fUseSSLIn) :
         sslStream(io_service, context),
-        _d(sslStream, fUseSSL),
-        _stream(_d)
+        fUseSSL(fUseSSLIn),
+        fNeedHandshake(fUseSSLIn)
     {
     }
 
-    virtual std::iostream& stream()
+    virtual size_t read_some(char* pch, size_t nMax)
     {
-        return _stream;
+        boost::system::error_code error;
+        if (fNeedHandshake)
+        {
+            fNeedHandshake = false;
+            sslStream.handshake(ssl::stream_base::server, error);
+            if (error)
+                return 0;
+        }
+        size_t n;
+        if (fUseSSL)
+            n = sslStream.read_some(asio::buffer(pch, nMax), error);
+        else
+            n = sslStream.next_layer().read_some(asio::buffer(pch, nMax), error);
+        return error ? 0 : n;
+    }
+
+    virtual bool write(const std::string& str)
+    {
+        boost::system::error_code error;
+        if (fUseSSL)
+            asio::write(sslStream, asio::buffer(str), error);
+        else
+            asio::write(sslStream.next_layer(), asio::buffer(str), error);
+        return !error;
     }
 
     virtual std::string peer_address_to_string() const
@@ -415,15 +559,16 @@ public:
 
     virtual void close()
     {
-        _stream.close();
+        boost::system::error_code error;
+        sslStream.lowest_layer().close(error);
     }
 
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
-    SSLIOStreamDevice<Protocol> _d;
-    iostreams::stream< SSLIOStreamDevice<Protocol> > _stream;
+    bool fUseSSL;
+    bool fNeedHandshake;
 };
 
 void ServiceConnection(AcceptedConnection *conn);
@@ -488,10 +633,17 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol,
     {
         // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
         if (!fUseSSL)
-            conn->stream() << HTTPReply(HTTP_FORBIDDEN, "", false) << std::flush;
+            conn->write(HTTPReply(HTTP_FORBIDDEN, "", false));
         delete conn;
     }
     else {
+        // Replies are written whole, Nagle would only hold back the last
+        // segment of each until the client's delayed ack
+        if (tcp_conn)
+        {
+            boost::system::error_code ec;
+            tcp_conn->sslStream.lowest_layer().set_option(ip::tcp::no_delay(true), ec);
+        }
         ServiceConnection(conn);
         conn->close();
         delete conn;
@@ -612,6 +764,11 @@ void StartRPCThreads()
         return;
     }
 
+    {
+        LOCK(cs_rpcStats);
+        nRPCTimeStarted = GetTime();
+    }
+
     rpc_worker_group = new boost::thread_group();
     for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
         rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
@@ -657,15 +814,16 @@ public:
     Array params;
 
     JSONRequest() { id = Value::null; }
-    void parse(const Value& valRequest);
+    void parse(Value& valRequest);
 };
 
-void JSONRequest::parse(const Value& valRequest)
+// Takes the params out of valRequest rather than copying them
+void JSONRequest::parse(Value& valRequest)
 {
     // Parse request
     if (valRequest.type() != obj_type)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Invalid Request object");
-    const Object& request = valRequest.get_obj();
+    Object& request = valRequest.get_obj();
 
     // Parse id now so errors from here on will have the id
     id = find_value(request, "id");
@@ -681,17 +839,25 @@ void JSONRequest::parse(const Value& valRequest)
         LogPrint("rpc", "ThreadRPCServer method=%s\n", strMethod);
 
     // Parse params
-    Value valParams = find_value(request, "params");
-    if (valParams.type() == array_type)
-        params = valParams.get_array();
-    else if (valParams.type() == null_type)
+    Value* pvalParams = NULL;
+    BOOST_FOREACH(Pair& pair, request)
+    {
+        if (pair.name_ == "params")
+        {
+            pvalParams = &pair.value_;
+            break;
+        }
+    }
+    if (pvalParams && pvalParams->type() == array_type)
+        params.swap(pvalParams->get_array());
+    else if (!pvalParams || pvalParams->type() == null_type)
         params = Array();
     else
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
 }
 
 
-static Object JSONRPCExecOne(const Value& req)
+static Object JSONRPCExecOne(Value& req)
 {
     Object rpc_result;
 
@@ -715,7 +881,7 @@ static Object JSONRPCExecOne(const Value& req)
     return rpc_result;
 }
 
-static string JSONRPCExecBatch(const Array& vReq)
+static string JSONRPCExecBatch(Array& vReq)
 {
     Array ret;
     for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
@@ -724,34 +890,133 @@ static string JSONRPCExecBatch(const Array& vReq)
     return write_string(Value(ret), false) + "\n";
 }
 
+// The reply of a single request, written as the command produces it
+static void JSONRPCReplyStream(const JSONRequest& jreq, CJSONStream& stream)
+{
+    stream.BeginObject();
+    stream.Key("result");
+    tableRPC.execute(jreq.strMethod, jreq.params, stream);
+    stream.Pair("error", Value::null);
+    stream.Pair("id", jreq.id);
+    stream.EndObject();
+    stream.WriteRaw("\n");
+}
+
+/**
+ * Replies waiting to go out on a connection. Replies to pipelined requests
+ * collect here and leave in one write once the server is about to wait for
+ * the client again.
+ */
+class CReplyBuffer
+{
+private:
+    AcceptedConnection* conn;
+    string strPending;
+    uint64_t nBytesWritten;
+    bool fFailed;
+
+    void Write(const string& str)
+    {
+        if (fFailed)
+            return;
+        fFailed = !conn->write(str);
+        nBytesWritten += str.size();
+    }
+
+public:
+    CReplyBuffer(AcceptedConnection* connIn) : conn(connIn), nBytesWritten(0), fFailed(false) {}
+
+    void Add(const string& str)
+    {
+        if (strPending.size() + str.size() < 65536)
+        {
+            strPending += str;
+            return;
+        }
+        // Large replies are written as they are rather than copied
+        Flush();
+        Write(str);
+    }
+
+    /** Write what is pending, false once the connection has failed */
+    bool Flush()
+    {
+        if (!strPending.empty())
+        {
+            Write(strPending);
+            strPending.clear();
+        }
+        return !fFailed;
+    }
+
+    uint64_t GetBytesWritten() const { return nBytesWritten; }
+};
+
+// The request reader's source. Pending replies go out before waiting on the
+// client, which may be waiting for them.
+static size_t ReadRequestBytes(AcceptedConnection* conn, CReplyBuffer* preply, char* pch, size_t n)
+{
+    if (!preply->Flush())
+        return 0;
+    return conn->read_some(pch, n);
+}
+
+/** A reply sent with chunked transfer encoding, the header goes out with the first chunk */
+class CChunkedReply
+{
+private:
+    CReplyBuffer& reply;
+    bool fKeepAlive;
+    bool fStarted;
+
+public:
+    CChunkedReply(CReplyBuffer& replyIn, bool fKeepAliveIn) : reply(replyIn), fKeepAlive(fKeepAliveIn), fStarted(false) {}
+
+    bool IsStarted() const { return fStarted; }
+
+    void Send(const string& strData)
+    {
+        if (!fStarted)
+        {
+            reply.Add(HTTPReplyChunkedHeader(HTTP_OK, fKeepAlive));
+            fStarted = true;
+        }
+        reply.Add(HTTPChunk(strData));
+        reply.Flush();
+    }
+
+    void End()
+    {
+        reply.Add(HTTPChunk(""));
+    }
+};
+
 void ServiceConnection(AcceptedConnection *conn)
 {
+    CReplyBuffer reply(conn);
+    CHTTPRequestReader reader(boost::bind(&ReadRequestBytes, conn, &reply, _1, _2), MAX_SIZE);
+    int64_t nConnectionId = RPCConnectionOpened(conn->peer_address_to_string());
+
     bool fRun = true;
     while (fRun)
     {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
+        CHTTPRequest req;
+        if (!reader.Read(req))
             break;
+        RPCConnectionUpdate(nConnectionId, reader.GetBytesRead(), reply.GetBytesWritten(), true);
 
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
-
-        if (strURI != "/") {
-            conn->stream() << HTTPReply(HTTP_NOT_FOUND, "", false) << std::flush;
+        if (req.strURI != "/") {
+            reply.Add(HTTPReply(HTTP_NOT_FOUND, "", false));
             break;
         }
 
         // Check authorization
-        if (mapHeaders.count("authorization") == 0)
+        if (req.strAuthorization.empty())
         {
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
+            reply.Add(HTTPReply(HTTP_UNAUTHORIZED, "", false));
             break;
         }
-        if (!HTTPAuthorized(mapHeaders))
+        if (!HTTPAuthorized(req.strAuthorization))
         {
             LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", conn->peer_address_to_string());
             /* Deter brute-forcing short passwords.
@@ -760,50 +1025,100 @@ void ServiceConnection(AcceptedConnection *conn)
             if (mapArgs["-rpcpassword"].size() < 20)
                 MilliSleep(250);
 
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
+            reply.Add(HTTPReply(HTTP_UNAUTHORIZED, "", false));
             break;
         }
-        if (mapHeaders["connection"] == "close")
-            fRun = false;
+        fRun = req.fKeepAlive;
 
         JSONRequest jreq;
+        CChunkedReply chunkedReply(reply, fRun);
         try
         {
             // Parse request
             Value valRequest;
-            if (!read_string(strRequest, valRequest))
+            if (!ReadJSON(req.strBody, valRequest))
                 throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-            string strReply;
-
             // singleton request
             if (valRequest.type() == obj_type) {
                 jreq.parse(valRequest);
 
-                Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+                // Streamed commands that run without cs_main write to the
+                // connection as they go. The others write into memory and
+                // the reply is sent once they have released their locks, so
+                // a slow client never holds them up.
+                const CRPCCommand *pcmd = tableRPC[jreq.strMethod];
+                CJSONStream::flush_type flush;
+                if (pcmd && pcmd->streamActor && pcmd->threadSafe && req.nProto >= 1)
+                    flush = boost::bind(&CChunkedReply::Send, &chunkedReply, _1);
+                CJSONStream stream(flush);
+
+                JSONRPCReplyStream(jreq, stream);
 
                 // Send reply
-                strReply = JSONRPCReply(result, Value::null, jreq.id);
+                if (stream.IsFlushed())
+                {
+                    stream.Flush();
+                    chunkedReply.End();
+                }
+                else
+                    reply.Add(HTTPReply(HTTP_OK, stream.GetString(), fRun));
 
             // array of requests
             } else if (valRequest.type() == array_type)
-                strReply = JSONRPCExecBatch(valRequest.get_array());
+                reply.Add(HTTPReply(HTTP_OK, JSONRPCExecBatch(valRequest.get_array()), fRun));
             else
                 throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
-
-            conn->stream() << HTTPReply(HTTP_OK, strReply, fRun) << std::flush;
         }
         catch (Object& objError)
         {
-            ErrorReply(conn->stream(), objError, jreq.id);
+            if (!chunkedReply.IsStarted())
+                reply.Add(ErrorReply(objError, jreq.id));
+            else
+                LogPrintf("ThreadRPCServer %s failed after part of the reply was sent\n", jreq.strMethod);
             break;
         }
         catch (std::exception& e)
         {
-            ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+            if (!chunkedReply.IsStarted())
+                reply.Add(ErrorReply(JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id));
+            else
+                LogPrintf("ThreadRPCServer %s failed after part of the reply was sent: %s\n", jreq.strMethod, e.what());
             break;
         }
     }
+    reply.Flush();
+    RPCConnectionClosed(nConnectionId, reader.GetBytesRead(), reply.GetBytesWritten());
+}
+
+static void CallCommand(const CRPCCommand *pcmd, const Array& params, Value* presult, CJSONStream* pstream)
+{
+    if (pstream)
+        (*pcmd->streamActor)(params, false, *pstream);
+    else
+        *presult = (*pcmd->actor)(params, false);
+}
+
+// Run a command with the locks it needs, returning its result in *presult or
+// writing it to *pstream
+static void RunCommand(const CRPCCommand *pcmd, const Array& params, Value* presult, CJSONStream* pstream)
+{
+    if (pcmd->threadSafe)
+        CallCommand(pcmd, params, presult, pstream);
+#ifdef ENABLE_WALLET
+    else if (!pwalletMain) {
+        LOCK(cs_main);
+        CallCommand(pcmd, params, presult, pstream);
+    } else {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        CallCommand(pcmd, params, presult, pstream);
+    }
+#else // ENABLE_WALLET
+    else {
+        LOCK(cs_main);
+        CallCommand(pcmd, params, presult, pstream);
+    }
+#endif // !ENABLE_WALLET
 }
 
 json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
@@ -827,24 +1142,7 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
     {
         // Execute
         Value result;
-        {
-            if (pcmd->threadSafe)
-                result = pcmd->actor(params, false);
-#ifdef ENABLE_WALLET
-            else if (!pwalletMain) {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            } else {
-                LOCK2(cs_main, pwalletMain->cs_wallet);
-                result = pcmd->actor(params, false);
-            }
-#else // ENABLE_WALLET
-            else {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            }
-#endif // !ENABLE_WALLET
-        }
+        RunCommand(pcmd, params, &result, NULL);
         return result;
     }
     catch (std::exception& e)
@@ -853,4 +1151,44 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
     }
 }
 
+void CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params, CJSONStream& stream) const
+{
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (!pcmd || !pcmd->streamActor)
+    {
+        stream.Write(execute(strMethod, params));
+        return;
+    }
+
+    // Same checks as above
+#ifdef ENABLE_WALLET
+    if (pcmd->reqWallet && !pwalletMain)
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found (disabled)");
+#endif
+
+    string strWarning = GetWarnings("rpc");
+    if (strWarning != "" && !GetBoolArg("-disablesafemode", false) &&
+        !pcmd->okSafeMode)
+        throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
+
+    try
+    {
+        RunCommand(pcmd, params, NULL, &stream);
+    }
+    catch (std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
+Value RPCStreamToValue(rpcstreamfn_type pfn, const Array& params, bool fHelp)
+{
+    CJSONStream stream;
+    (*pfn)(params, fHelp, stream);
+    Value value;
+    if (!ReadJSON(stream.GetString(), value))
+        throw runtime_error("RPCStreamToValue() : invalid JSON written");
+    return value;
+}
+
 const CRPCTable tableRPC;
@@ -8,6 +8,7 @@
 
 #include "uint256.h"
 #include "rpcprotocol.h"
+#include "rpcstream.h"
 
 #include <list>
 #include <map>
@@ -39,6 +40,9 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 
 typedef json_spirit::Value(*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
 
+/** A command that writes its result to a stream as it goes, for large results */
+typedef void(*rpcstreamfn_type)(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+
 class CRPCCommand
 {
 public:
@@ -47,8 +51,19 @@ public:
     bool okSafeMode;
     bool threadSafe;
     bool reqWallet;
+    rpcstreamfn_type streamActor;   // NULL unless the command streams
 };
 
+/** Run a streamed command and parse what it wrote */
+json_spirit::Value RPCStreamToValue(rpcstreamfn_type pfn, const json_spirit::Array& params, bool fHelp);
+
+/** The actor of a streamed command, for batches, help and the debug console */
+template<rpcstreamfn_type pfn>
+json_spirit::Value RPCStreamActor(const json_spirit::Array& params, bool fHelp)
+{
+    return RPCStreamToValue(pfn, params, fHelp);
+}
+
 /**
  * Bitcoin RPC command dispatcher.
  */
@@ -69,6 +84,9 @@ public:
      * @throws an exception (json_spirit::Value) when an error happens.
      */
     json_spirit::Value execute(const std::string &method, const json_spirit::Array &params) const;
+
+    /** Execute a method and write the result to stream */
+    void execute(const std::string &method, const json_spirit::Array &params, CJSONStream& stream) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -142,7 +160,7 @@ extern json_spirit::Value addmultisigaddress(const json_spirit::Array& params, b
 extern json_spirit::Value addredeemscript(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listreceivedbyaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listreceivedbyaccount(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value listtransactions(const json_spirit::Array& params, bool fHelp);
+extern void listtransactions(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
 extern json_spirit::Value listaddressgroupings(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listaccounts(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listsinceblock(const json_spirit::Array& params, bool fHelp);
@@ -162,11 +180,13 @@ extern json_spirit::Value resendtx(const json_spirit::Array& params, bool fHelp)
 extern json_spirit::Value makekeypair(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value validatepubkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnewpubkey(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getlockstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getrpcstats(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getrawtransaction(const json_spirit::Array& params, bool fHelp); // in rcprawtransaction.cpp
-extern json_spirit::Value searchrawtransactions(const json_spirit::Array& params, bool fHelp);
+extern void searchrawtransactions(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
 
-extern json_spirit::Value listunspent(const json_spirit::Array& params, bool fHelp);
+extern void listunspent(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
 extern json_spirit::Value createrawtransaction(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value decoderawtransaction(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value decodescript(const json_spirit::Array& params, bool fHelp);
@@ -176,11 +196,13 @@ extern json_spirit::Value sendrawtransaction(const json_spirit::Array& params, b
 extern json_spirit::Value getbestblockhash(const json_spirit::Array& params, bool fHelp); // in rpcblockchain.cpp
 extern json_spirit::Value getblockcount(const json_spirit::Array& params, bool fHelp); // in rpcblockchain.cpp
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getchainstats(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern void getrawmempool(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getblockbynumber(const json_spirit::Array& params, bool fHelp);
+extern void getblock(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void getblockbynumber(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern json_spirit::Value getblocksummary(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getcheckpoint(const json_spirit::Array& params, bool fHelp);
 
 
@@ -192,6 +214,7 @@ extern json_spirit::Value sendtosecretaddress(const json_spirit::Array& params,
 extern json_spirit::Value anonsend(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value hub(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value inode(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getschedulerinfo(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getstakereport(const json_spirit::Array& params, bool fHelp);  // ** em52
 #endif
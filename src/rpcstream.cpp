@@ -0,0 +1,129 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpcstream.h"
+
+#include "util.h"
+
+#include "json/json_spirit_writer_template.h"
+
+#include <cassert>
+
+using namespace std;
+
+CJSONStream::CJSONStream() : nFlushSize(0), nFlushed(0), fAfterKey(false)
+{
+}
+
+CJSONStream::CJSONStream(const flush_type& flushIn, size_t nFlushSizeIn) : flush(flushIn), nFlushSize(nFlushSizeIn), nFlushed(0), fAfterKey(false)
+{
+    if (flush)
+        strBuffer.reserve(nFlushSize + nFlushSize / 4);
+}
+
+void CJSONStream::BeginValue()
+{
+    if (fAfterKey)
+    {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty())
+    {
+        if (!vEmpty.back())
+            strBuffer += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void CJSONStream::Begin(char ch)
+{
+    BeginValue();
+    strBuffer += ch;
+    vEmpty.push_back(true);
+}
+
+void CJSONStream::End(char ch)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    strBuffer += ch;
+    CheckFlush();
+}
+
+void CJSONStream::CheckFlush()
+{
+    if (flush && strBuffer.size() >= nFlushSize)
+        Flush();
+}
+
+void CJSONStream::Key(const string& strKey)
+{
+    BeginValue();
+    strBuffer += '"';
+    strBuffer += json_spirit::add_esc_chars(strKey);
+    strBuffer += "\":";
+    fAfterKey = true;
+}
+
+void CJSONStream::Write(const string& str)
+{
+    BeginValue();
+    strBuffer += '"';
+    strBuffer += json_spirit::add_esc_chars(str);
+    strBuffer += '"';
+    CheckFlush();
+}
+
+void CJSONStream::Write(bool f)
+{
+    BeginValue();
+    strBuffer += f ? "true" : "false";
+}
+
+void CJSONStream::Write(int64_t n)
+{
+    BeginValue();
+    strBuffer += strprintf("%d", n);
+}
+
+void CJSONStream::Write(uint64_t n)
+{
+    BeginValue();
+    strBuffer += strprintf("%u", n);
+}
+
+void CJSONStream::Write(double d)
+{
+    BeginValue();
+    strBuffer += strprintf("%.8f", d);
+}
+
+void CJSONStream::Write(const json_spirit::Value& value)
+{
+    BeginValue();
+    strBuffer += json_spirit::write_string(value, false);
+    CheckFlush();
+}
+
+void CJSONStream::WriteNull()
+{
+    BeginValue();
+    strBuffer += "null";
+}
+
+void CJSONStream::WriteRaw(const string& str)
+{
+    strBuffer += str;
+    CheckFlush();
+}
+
+void CJSONStream::Flush()
+{
+    if (!flush || strBuffer.empty())
+        return;
+    flush(strBuffer);
+    nFlushed += strBuffer.size();
+    strBuffer.clear();
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPCSTREAM_H
+#define BITCOIN_RPCSTREAM_H
+
+#include "json/json_spirit_value.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+/**
+ * JSON text written as it is produced, for RPC replies too large to build
+ * as a json_spirit tree first.
+ *
+ * The output is what write_string(value, false) gives for the same value:
+ * same escaping, reals with 8 decimals. Values from json_spirit can be mixed
+ * in with Write(const Value&), so a handler can stream a long array and still
+ * build each element the usual way.
+ *
+ * With a flush function the text is handed over in pieces of about
+ * nFlushSize bytes as soon as they are complete, otherwise it all stays in
+ * the buffer for GetString().
+ */
+class CJSONStream
+{
+public:
+    typedef boost::function<void (const std::string&)> flush_type;
+
+private:
+    std::string strBuffer;
+    flush_type flush;
+    size_t nFlushSize;
+    size_t nFlushed;
+    std::vector<bool> vEmpty;   // per open object or array, nothing in it yet
+    bool fAfterKey;             // a key was written, its value comes next
+
+    void BeginValue();
+    void Begin(char ch);
+    void End(char ch);
+    void CheckFlush();
+
+public:
+    CJSONStream();
+    explicit CJSONStream(const flush_type& flushIn, size_t nFlushSizeIn = 65536);
+
+    void BeginObject() { Begin('{'); }
+    void EndObject() { End('}'); }
+    void BeginArray() { Begin('['); }
+    void EndArray() { End(']'); }
+
+    /** Key of the next value in an object */
+    void Key(const std::string& strKey);
+
+    void Write(const std::string& str);
+    void Write(const char* psz) { Write(std::string(psz)); }
+    void Write(bool f);
+    void Write(int n) { Write((int64_t)n); }
+    void Write(unsigned int n) { Write((int64_t)n); }
+    void Write(int64_t n);
+    void Write(uint64_t n);
+    void Write(double d);
+    void Write(const json_spirit::Value& value);
+    void WriteNull();
+
+    template<typename T>
+    void Pair(const std::string& strKey, const T& value)
+    {
+        Key(strKey);
+        Write(value);
+    }
+
+    /** Text outside any value, e.g. the newline after a reply */
+    void WriteRaw(const std::string& str);
+
+    /** Hand the buffer to the flush function */
+    void Flush();
+
+    /** True once any text has gone to the flush function and can't be taken back */
+    bool IsFlushed() const { return nFlushed > 0; }
+
+    const std::string& GetString() const { return strBuffer; }
+};
+
+#endif
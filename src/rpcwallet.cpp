@@ -1060,7 +1060,18 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Ar
     }
 }
 
-Value listtransactions(const Array& params, bool fHelp)
+// The entries of one item of CWallet::OrderedTxItems
+static void ListTxItem(const CWallet::TxPair& item, const string& strAccount, Array& ret)
+{
+    CWalletTx *const pwtx = item.first;
+    if (pwtx != 0)
+        ListTransactions(*pwtx, strAccount, 0, true, ret);
+    CAccountingEntry *const pacentry = item.second;
+    if (pacentry != 0)
+        AcentryToJSON(*pacentry, strAccount, ret);
+}
+
+void listtransactions(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() > 3)
         throw runtime_error(
@@ -1082,40 +1093,49 @@ Value listtransactions(const Array& params, bool fHelp)
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-    Array ret;
-
     std::list<CAccountingEntry> acentries;
     CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
 
-    // iterate backwards until we have nCount items to return:
+    // Walk back from the newest item until nCount+nFrom entries are covered,
+    // keeping only the number of entries of each item. The entries are made
+    // again below as they are written, so they are never all in memory.
+    vector<pair<CWallet::TxItems::reverse_iterator, int> > vItems;
+    int nEntries = 0;
     for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
     {
-        CWalletTx *const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret);
-        CAccountingEntry *const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
-
-        if ((int)ret.size() >= (nCount+nFrom)) break;
-    }
-    // ret is newest to oldest
-
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-    Array::iterator first = ret.begin();
-    std::advance(first, nFrom);
-    Array::iterator last = ret.begin();
-    std::advance(last, nFrom+nCount);
+        Array entries;
+        ListTxItem((*it).second, strAccount, entries);
+        if (!entries.empty())
+        {
+            vItems.push_back(make_pair(it, (int)entries.size()));
+            nEntries += entries.size();
+        }
 
-    if (last != ret.end()) ret.erase(last, ret.end());
-    if (first != ret.begin()) ret.erase(ret.begin(), first);
+        if (nEntries >= (int64_t)nCount + nFrom) break;
+    }
+    // entries are numbered newest to oldest, those in [nFrom, nEnd) are returned
 
-    std::reverse(ret.begin(), ret.end()); // Return oldest to newest
+    if (nFrom > nEntries)
+        nFrom = nEntries;
+    int nEnd = (nCount > nEntries - nFrom) ? nEntries : nFrom + nCount;
 
-    return ret;
+    // Return oldest to newest
+    stream.BeginArray();
+    int nLast = nEntries;
+    for (int i = vItems.size() - 1; i >= 0; i--)
+    {
+        int nFirst = nLast - vItems[i].second;
+        if (nFirst < nEnd && nLast > nFrom)
+        {
+            Array entries;
+            ListTxItem((*vItems[i].first).second, strAccount, entries);
+            for (int j = vItems[i].second - 1; j >= 0; j--)
+                if (nFirst + j >= nFrom && nFirst + j < nEnd)
+                    stream.Write(entries[j]);
+        }
+        nLast = nFirst;
+    }
+    stream.EndArray();
 }
 
 Value listaccounts(const Array& params, bool fHelp)
@@ -1281,7 +1301,7 @@ Value gettransaction(const Array& params, bool fHelp)
             else
             {
                 entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+                BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
                 if (mi != mapBlockIndex.end() && (*mi).second)
                 {
                     CBlockIndex* pindex = (*mi).second;
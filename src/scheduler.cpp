@@ -0,0 +1,115 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "scheduler.h"
+
+#include "util.h"
+
+#include <limits>
+
+using namespace std;
+
+int64_t CScheduler::GetDueTime(const CTask& task)
+{
+    int64_t nDue = std::numeric_limits<int64_t>::max();
+    if (task.fTriggered)
+        nDue = task.stats.nLastRun + task.nMinIntervalMillis;
+    if (task.nIntervalMillis > 0)
+        nDue = std::min(nDue, task.nNextRun);
+    return nDue;
+}
+
+void CScheduler::AddTask(const std::string& strName, const Function& func, int64_t nIntervalMillis, int64_t nMinIntervalMillis)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    CTask& task = mapTasks[strName];
+    task.func = func;
+    task.nIntervalMillis = nIntervalMillis;
+    task.nMinIntervalMillis = nMinIntervalMillis;
+    task.nNextRun = GetTimeMillis() + nIntervalMillis;
+    task.fTriggered = false;
+    task.stats = CTaskStats();
+    task.stats.nIntervalMillis = nIntervalMillis;
+    cond.notify_one();
+}
+
+void CScheduler::Trigger(const std::string& strName)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<std::string, CTask>::iterator it = mapTasks.find(strName);
+    if (it == mapTasks.end() || it->second.fTriggered)
+        return;
+
+    it->second.fTriggered = true;
+    it->second.stats.nTriggered++;
+    cond.notify_one();
+}
+
+void CScheduler::ServiceQueue()
+{
+    while (true)
+    {
+        std::string strName;
+        Function func;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (true)
+            {
+                int64_t nNow = GetTimeMillis();
+                int64_t nDue = std::numeric_limits<int64_t>::max();
+                std::map<std::string, CTask>::iterator itNext = mapTasks.end();
+                for (std::map<std::string, CTask>::iterator it = mapTasks.begin(); it != mapTasks.end(); ++it)
+                {
+                    int64_t nTaskDue = GetDueTime(it->second);
+                    if (nTaskDue < nDue)
+                    {
+                        nDue = nTaskDue;
+                        itNext = it;
+                    }
+                }
+
+                if (itNext != mapTasks.end() && nDue <= nNow)
+                {
+                    CTask& task = itNext->second;
+                    strName = itNext->first;
+                    func = task.func;
+                    task.fTriggered = false;
+                    task.nNextRun = nNow + task.nIntervalMillis;
+                    task.stats.nLastRun = nNow;
+                    break;
+                }
+
+                // both waits are interruption points, that is how the thread is stopped
+                if (itNext == mapTasks.end())
+                    cond.wait(lock);
+                else
+                    cond.timed_wait(lock, boost::posix_time::milliseconds(nDue - nNow));
+            }
+        }
+
+        int64_t nStart = GetTimeMicros();
+        func();
+        int64_t nElapsed = GetTimeMicros() - nStart;
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CTaskStats& stats = mapTasks[strName].stats;
+        stats.nRuns++;
+        stats.nLastMicros = nElapsed;
+        stats.nTotalMicros += nElapsed;
+        stats.nMaxMicros = std::max(stats.nMaxMicros, nElapsed);
+        if (fDebug && nElapsed > 100000)
+            LogPrintf("CScheduler : task %s took %dms\n", strName, nElapsed / 1000);
+    }
+}
+
+void CScheduler::GetStats(std::map<std::string, CTaskStats>& mapStats)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    mapStats.clear();
+    for (std::map<std::string, CTask>::const_iterator it = mapTasks.begin(); it != mapTasks.end(); ++it)
+        mapStats[it->first] = it->second.stats;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SCHEDULER_H
+#define BITCOIN_SCHEDULER_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * Runs named background tasks on a single service thread.
+ *
+ * Each task has its own interval (0 for tasks that only run when triggered)
+ * and a minimum interval that limits how often Trigger() can make it run, so
+ * a burst of events (e.g. blocks during a reorg) collapses into one run.
+ * Tasks run outside the scheduler mutex and take whatever locks they need
+ * themselves; the scheduler records how long every run took.
+ */
+class CScheduler
+{
+public:
+    typedef boost::function<void ()> Function;
+
+    struct CTaskStats
+    {
+        int64_t nIntervalMillis;
+        uint64_t nRuns;
+        uint64_t nTriggered;
+        int64_t nTotalMicros;
+        int64_t nMaxMicros;
+        int64_t nLastMicros;
+        int64_t nLastRun;  // GetTimeMillis() at the start of the last run, 0 if it never ran
+
+        CTaskStats() : nIntervalMillis(0), nRuns(0), nTriggered(0), nTotalMicros(0), nMaxMicros(0), nLastMicros(0), nLastRun(0) {}
+    };
+
+private:
+    struct CTask
+    {
+        Function func;
+        int64_t nIntervalMillis;
+        int64_t nMinIntervalMillis;
+        int64_t nNextRun;
+        bool fTriggered;
+        CTaskStats stats;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::map<std::string, CTask> mapTasks;
+
+    // time the task wants to run next, INT64_MAX if it waits for a trigger
+    static int64_t GetDueTime(const CTask& task);
+
+public:
+    /** Register a task, the first timed run happens one interval from now */
+    void AddTask(const std::string& strName, const Function& func, int64_t nIntervalMillis, int64_t nMinIntervalMillis = 0);
+
+    /** Ask for a task to run as soon as its minimum interval allows, unknown names are ignored */
+    void Trigger(const std::string& strName);
+
+    /** Run due tasks until the thread is interrupted */
+    void ServiceQueue();
+
+    void GetStats(std::map<std::string, CTaskStats>& mapStats);
+};
+
+#endif
@@ -6,8 +6,95 @@
 
 #include "util.h"
 
+#include <algorithm>
+#include <map>
+
 #include <boost/foreach.hpp>
 
+bool fLockProfile = false;
+
+// keyed by the __FILE__ pointer and line of the LOCK, one entry per site
+static boost::mutex cs_lockstats;
+static std::map<std::pair<const char*, int>, CLockStats> mapLockStats;
+
+int64_t LockProfileTime()
+{
+    return GetTimeMicros();
+}
+
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros, int64_t nHoldMicros)
+{
+    boost::unique_lock<boost::mutex> lock(cs_lockstats);
+
+    CLockStats& stats = mapLockStats[std::make_pair(pszFile, nLine)];
+    if (stats.nAcquired == 0)
+    {
+        stats.strName = pszName;
+        stats.strLocation = strprintf("%s:%d", pszFile, nLine);
+    }
+    stats.nAcquired++;
+    if (fContended)
+        stats.nContended++;
+    stats.nWaitMicros += nWaitMicros;
+    stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, nWaitMicros);
+    stats.nHoldMicros += nHoldMicros;
+    stats.nMaxHoldMicros = std::max(stats.nMaxHoldMicros, nHoldMicros);
+}
+
+static bool CompareLockWait(const CLockStats& a, const CLockStats& b)
+{
+    return a.nWaitMicros > b.nWaitMicros;
+}
+
+void GetLockStats(std::vector<CLockStats>& vStats)
+{
+    // a LOCK in a header shows up once per translation unit, merge those
+    std::map<std::pair<std::string, std::string>, CLockStats> mapMerged;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_lockstats);
+        for (std::map<std::pair<const char*, int>, CLockStats>::const_iterator it = mapLockStats.begin(); it != mapLockStats.end(); ++it)
+        {
+            const CLockStats& stats = it->second;
+            CLockStats& merged = mapMerged[std::make_pair(stats.strLocation, stats.strName)];
+            merged.strName = stats.strName;
+            merged.strLocation = stats.strLocation;
+            merged.nAcquired += stats.nAcquired;
+            merged.nContended += stats.nContended;
+            merged.nWaitMicros += stats.nWaitMicros;
+            merged.nMaxWaitMicros = std::max(merged.nMaxWaitMicros, stats.nMaxWaitMicros);
+            merged.nHoldMicros += stats.nHoldMicros;
+            merged.nMaxHoldMicros = std::max(merged.nMaxHoldMicros, stats.nMaxHoldMicros);
+        }
+    }
+
+    vStats.clear();
+    vStats.reserve(mapMerged.size());
+    for (std::map<std::pair<std::string, std::string>, CLockStats>::const_iterator it = mapMerged.begin(); it != mapMerged.end(); ++it)
+        vStats.push_back(it->second);
+    std::sort(vStats.begin(), vStats.end(), CompareLockWait);
+}
+
+void ResetLockStats()
+{
+    boost::unique_lock<boost::mutex> lock(cs_lockstats);
+    mapLockStats.clear();
+}
+
+void LogLockStats()
+{
+    std::vector<CLockStats> vStats;
+    GetLockStats(vStats);
+
+    LogPrintf("Lock profile, %u sites, most waited on first:\n", vStats.size());
+    for (unsigned int i = 0; i < vStats.size() && i < 20; i++)
+    {
+        const CLockStats& stats = vStats[i];
+        LogPrintf("  %-16s %-28s acquired=%d contended=%d wait=%dus (max %dus) hold=%dus (max %dus)\n",
+            stats.strName, stats.strLocation, stats.nAcquired, stats.nContended,
+            stats.nWaitMicros, stats.nMaxWaitMicros, stats.nHoldMicros, stats.nMaxHoldMicros);
+    }
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
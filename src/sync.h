@@ -12,6 +12,11 @@
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
 
 
 ////////////////////////////////////////////////
@@ -84,6 +89,16 @@ typedef AnnotatedMixin<boost::recursive_mutex> CCriticalSection;
 /** Wrapped boost mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<boost::mutex> CWaitableCriticalSection;
 
+/**
+ * Many readers or one writer, not recursive. Don't take a shared lock while
+ * already holding one on the same mutex: a writer waiting in between blocks
+ * the second one for good.
+ */
+typedef boost::shared_mutex CSharedCriticalSection;
+
+#define LOCK_SHARED(cs) boost::shared_lock<CSharedCriticalSection> sharedblock(cs)
+#define LOCK_EXCLUSIVE(cs) boost::unique_lock<CSharedCriticalSection> exclusiveblock(cs)
+
 #ifdef DEBUG_LOCKORDER
 void EnterCritical(const char* pszName, const char* pszFile, int nLine, void* cs, bool fTry = false);
 void LeaveCritical();
@@ -100,6 +115,32 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Set by -lockprofile: LOCK and TRY_LOCK then record how long each site waits for and holds its lock */
+extern bool fLockProfile;
+
+/** Profile of one LOCK site, times are in microseconds */
+struct CLockStats
+{
+    std::string strName;
+    std::string strLocation;
+    uint64_t nAcquired;
+    uint64_t nContended; // acquisitions that found the lock taken and had to wait
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    int64_t nHoldMicros;
+    int64_t nMaxHoldMicros;
+
+    CLockStats() : nAcquired(0), nContended(0), nWaitMicros(0), nMaxWaitMicros(0), nHoldMicros(0), nMaxHoldMicros(0) {}
+};
+
+int64_t LockProfileTime();
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitMicros, int64_t nHoldMicros);
+/** Profile of every site that took a lock since the last reset, most waited on first */
+void GetLockStats(std::vector<CLockStats>& vStats);
+void ResetLockStats();
+/** Write the most contended sites to the debug log */
+void LogLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template<typename Mutex>
 class CMutexLock
@@ -107,9 +148,35 @@ class CMutexLock
 private:
     boost::unique_lock<Mutex> lock;
 
+    // -lockprofile bookkeeping, pszProfileName stays NULL when the lock isn't profiled
+    const char* pszProfileName;
+    const char* pszProfileFile;
+    int nProfileLine;
+    bool fProfileContended;
+    int64_t nProfileWait;
+    int64_t nProfileLocked;
+
+    void ProfiledEnter(const char* pszName, const char* pszFile, int nLine)
+    {
+        int64_t nStart = LockProfileTime();
+        fProfileContended = !lock.try_lock();
+        if (fProfileContended)
+            lock.lock();
+        nProfileLocked = LockProfileTime();
+        nProfileWait = nProfileLocked - nStart;
+        pszProfileName = pszName;
+        pszProfileFile = pszFile;
+        nProfileLine = nLine;
+    }
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        if (fLockProfile)
+        {
+            ProfiledEnter(pszName, pszFile, nLine);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock())
         {
@@ -127,11 +194,20 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (fLockProfile)
+        {
+            nProfileLocked = LockProfileTime();
+            nProfileWait = 0;
+            fProfileContended = false;
+            pszProfileName = pszName;
+            pszProfileFile = pszFile;
+            nProfileLine = nLine;
+        }
         return lock.owns_lock();
     }
 
 public:
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) : lock(mutexIn, boost::defer_lock)
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) : lock(mutexIn, boost::defer_lock), pszProfileName(NULL)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -141,8 +217,15 @@ public:
 
     ~CMutexLock()
     {
-        if (lock.owns_lock())
-            LeaveCritical();
+        if (!lock.owns_lock())
+            return;
+        if (pszProfileName)
+        {
+            int64_t nHold = LockProfileTime() - nProfileLocked;
+            lock.unlock();
+            LockProfileRecord(pszProfileName, pszProfileFile, nProfileLine, fProfileContended, nProfileWait, nHold);
+        }
+        LeaveCritical();
     }
 
     operator bool()
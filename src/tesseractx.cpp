@@ -13,6 +13,7 @@
 #include "activeinode.h"
 #include "anonsend.h"
 #include "hub.h"
+#include "msgverify.h"
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -21,8 +22,7 @@ using namespace boost;
 std::map<uint256, CTransaction> mapTxLockReq;
 std::map<uint256, CTransaction> mapTxLockReqRejected;
 std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
+CTransactionLockTracker txLockTracker;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
 int nCompleteTXLocks;
 
@@ -98,24 +98,17 @@ void ProcessMessageTesseractX(CNode* pfrom, std::string& strCommand, CDataStream
                 tx.GetHash().ToString().c_str()
             );
 
-            BOOST_FOREACH(const CTxIn& in, tx.vin){
-                if(!mapLockedInputs.count(in.prevout)){
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
-                }
-            }
+            txLockTracker.LockInputs(tx);
 
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()){
-                //we only care if we have a complete tx lock
-                if((*i).second.CountSignatures() >= TESSERACTX_SIGNATURES_REQUIRED){
-                    if(!CheckForConflictingLocks(tx)){
-                        LogPrintf("ProcessMessageTesseractX::txlreq - Found Existing Complete TSX Lock\n");
-
-                        CValidationState state;
-                        //DisconnectBlockAndInputs(state, tx);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
-                    }
+            //we only care if we have a complete tx lock
+            if(txLockTracker.CountSignatures(tx.GetHash()) >= TESSERACTX_SIGNATURES_REQUIRED){
+                if(!CheckForConflictingLocks(tx)){
+                    LogPrintf("ProcessMessageTesseractX::txlreq - Found Existing Complete TSX Lock\n");
+
+                    CValidationState state;
+                    //DisconnectBlockAndInputs(state, tx);
+                    mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
                 }
             }
 
@@ -136,38 +129,66 @@ void ProcessMessageTesseractX(CNode* pfrom, std::string& strCommand, CDataStream
 
         mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
 
-        if(ProcessConsensusVote(ctx)){
-            //Spam/Dos protection
-            /*
-                Nodes will sometimes propagate votes before the transaction is known to the client.
-                This tracks those messages and allows it at the same rate of the rest of the network, if
-                a peer violates it, it will simply be ignored
-            */
-            if(!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)){
-                if(!mapUnknownVotes.count(ctx.vinInode.prevout.hash)){
-                    mapUnknownVotes[ctx.vinInode.prevout.hash] = GetTime()+(60*10);
-                }
+        CPubKey pubkey2;
+        {
+            LOCK(cs_inodes);
+            int n = inodeRegistry.Find(ctx.vinInode);
+            if(n != -1) pubkey2 = inodeRegistry[n].pubkey2;
+        }
 
-                if(mapUnknownVotes[ctx.vinInode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinInode.prevout.hash] - GetAverageVoteTime() > 60*10){
-                        LogPrintf("ProcessMessageTesseractX::txlreq - inode is spamming transaction votes: %s %s\n",
-                            ctx.vinInode.ToString().c_str(),
-                            ctx.txHash.ToString().c_str()
-                        );
-                        return;
-                } else {
-                    mapUnknownVotes[ctx.vinInode.prevout.hash] = GetTime()+(60*10);
-                }
+        if(!pubkey2.IsValid()){
+            if(fDebug) LogPrintf("ProcessMessageTesseractX::txlvote - Unknown Inode %s\n", ctx.vinInode.ToString().c_str());
+            return;
+        }
+
+        // the signature is checked off this thread, the vote is counted once it comes back;
+        // a vote dropped by a full queue is forgotten so it is taken again when relayed
+        if(!messageVerifyQueue.Push(pubkey2, ctx.vchINodeSignature, ctx.GetSignedMessage(), boost::bind(&ProcessVerifiedConsensusVote, ctx, _1)))
+            mapTxLockVote.erase(ctx.GetHash());
+
+        return;
+    }
+}
+
+void ProcessVerifiedConsensusVote(const CConsensusVote& vote, bool fValid)
+{
+    if(!fValid){
+        LogPrintf("ProcessMessageTesseractX::txlvote - Signature invalid %s\n", vote.GetHash().ToString().c_str());
+        return;
+    }
+
+    CConsensusVote ctx = vote;
+    CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
+
+    if(ProcessConsensusVote(ctx)){
+        //Spam/Dos protection
+        /*
+            Nodes will sometimes propagate votes before the transaction is known to the client.
+            This tracks those messages and allows it at the same rate of the rest of the network, if
+            a peer violates it, it will simply be ignored
+        */
+        if(!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)){
+            if(!mapUnknownVotes.count(ctx.vinInode.prevout.hash)){
+                mapUnknownVotes[ctx.vinInode.prevout.hash] = GetTime()+(60*10);
             }
-            vector<CInv> vInv;
-            vInv.push_back(inv);
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-                pnode->PushMessage("inv", vInv);
 
+            if(mapUnknownVotes[ctx.vinInode.prevout.hash] > GetTime() &&
+                mapUnknownVotes[ctx.vinInode.prevout.hash] - GetAverageVoteTime() > 60*10){
+                    LogPrintf("ProcessMessageTesseractX::txlreq - inode is spamming transaction votes: %s %s\n",
+                        ctx.vinInode.ToString().c_str(),
+                        ctx.txHash.ToString().c_str()
+                    );
+                    return;
+            } else {
+                mapUnknownVotes[ctx.vinInode.prevout.hash] = GetTime()+(60*10);
+            }
         }
+        vector<CInv> vInv;
+        vInv.push_back(inv);
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            pnode->PushMessage("inv", vInv);
 
-        return;
     }
 }
 
@@ -238,19 +259,7 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (pindexBest->nHeight - nTxAge)+4;
 
-    if (!mapTxLocks.count(tx.GetHash())){
-        LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime()+(60*60); //locks expire after 15 minutes (6 confirmations)
-        newLock.nTimeout = GetTime()+(60*5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
-    } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
-        if(fDebug) LogPrintf("CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
-    }
+    txLockTracker.CreateLock(tx.GetHash(), nBlockHeight);
 
     return nBlockHeight;
 }
@@ -310,9 +319,11 @@ bool ProcessConsensusVote(CConsensusVote& ctx)
 {
     int n = GetInodeRank(ctx.vinInode, ctx.nBlockHeight, MIN_TESSERACTX_PROTO_VERSION);
 
-    int x = GetInodeByVin(ctx.vinInode);
-    if(x != -1){
-        if(fDebug) LogPrintf("TesseractX::ProcessConsensusVote - Inode ADDR %s %d\n", vecInodes[x].addr.ToString().c_str(), n);
+    if(fDebug){
+        LOCK(cs_inodes);
+        int x = inodeRegistry.Find(ctx.vinInode);
+        if(x != -1)
+            LogPrintf("TesseractX::ProcessConsensusVote - Inode ADDR %s %d\n", inodeRegistry[x].addr.ToString().c_str(), n);
     }
 
     if(n == -1)
@@ -328,76 +339,52 @@ bool ProcessConsensusVote(CConsensusVote& ctx)
         return false;
     }
 
-    if(!ctx.SignatureValid()) {
-        LogPrintf("TesseractX::ProcessConsensusVote - Signature invalid\n");
-        //don't ban, it could just be a non-synced inode
-        return false;
-    }
-
-    if (!mapTxLocks.count(ctx.txHash)){
-        LogPrintf("TesseractX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime()+(60*60);
-        newLock.nTimeout = GetTime()+(60*5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else {
-        if(fDebug) LogPrintf("TesseractX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
-    }
+    // the signature was checked before the vote got here, it is not verified again
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()){
-        (*i).second.AddSignature(ctx);
+    int nSignatures = 0;
+    if(!txLockTracker.AddVote(ctx, nSignatures)){
+        if(fDebug) LogPrintf("TesseractX::ProcessConsensusVote - Inode already voted %s !\n", ctx.GetHash().ToString().c_str());
+        return false;
+    }
 
 #ifdef ENABLE_WALLET
-        if(pwalletMain){
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if(pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
+    if(pwalletMain){
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if(pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
-        if(fDebug) LogPrintf("TesseractX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+    if(fDebug) LogPrintf("TesseractX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
 
-        if((*i).second.CountSignatures() >= TESSERACTX_SIGNATURES_REQUIRED){
-            if(fDebug) LogPrintf("TesseractX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+    if(nSignatures >= TESSERACTX_SIGNATURES_REQUIRED){
+        if(fDebug) LogPrintf("TesseractX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if(!CheckForConflictingLocks(tx)){
+        std::map<uint256, CTransaction>::iterator itReq = mapTxLockReq.find(ctx.txHash);
+        if(itReq == mapTxLockReq.end() || !CheckForConflictingLocks(itReq->second)){
 
 #ifdef ENABLE_WALLET
-                if(pwalletMain){
-                    pwalletMain->UpdatedTransaction((*i).second.txHash);
-                        nCompleteTXLocks++;
-                    
-                }
+            if(pwalletMain){
+                pwalletMain->UpdatedTransaction(ctx.txHash);
+                nCompleteTXLocks++;
+            }
 #endif
 
-                if(mapTxLockReq.count(ctx.txHash)){
-                    BOOST_FOREACH(const CTxIn& in, tx.vin){
-                        if(!mapLockedInputs.count(in.prevout)){
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
-                }
+            if(itReq != mapTxLockReq.end())
+                txLockTracker.LockInputs(itReq->second);
 
-                // resolve conflicts
+            // resolve conflicts
 
-                //if this tx lock was rejected, we need to remove the conflicting blocks
-                if(mapTxLockReqRejected.count((*i).second.txHash)){
-                    CValidationState state;
-                    //DisconnectBlockAndInputs(state, mapTxLockReqRejected[(*i).second.txHash]);
-                }
+            //if this tx lock was rejected, we need to remove the conflicting blocks
+            if(mapTxLockReqRejected.count(ctx.txHash)){
+                CValidationState state;
+                //DisconnectBlockAndInputs(state, mapTxLockReqRejected[ctx.txHash]);
             }
         }
-        return true;
     }
 
-
-    return false;
+    return true;
 }
 
 bool CheckForConflictingLocks(CTransaction& tx)
@@ -409,15 +396,12 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                LogPrintf("TesseractX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if(mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if(mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
-        }
+    uint256 txHashConflict;
+    if(txLockTracker.GetConflictingLock(tx, txHashConflict)){
+        LogPrintf("TesseractX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), txHashConflict.ToString().c_str());
+        txLockTracker.ExpireLock(tx.GetHash());
+        txLockTracker.ExpireLock(txHashConflict);
+        return true;
     }
 
     return false;
@@ -442,31 +426,18 @@ void CleanTransactionLocksList()
 {
     if(pindexBest == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
-
-    while(it != mapTxLocks.end()) {
-        if(GetTime() > it->second.nExpiration){ //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    std::vector<CTransactionLock> vRemoved;
+    txLockTracker.RemoveExpired(pindexBest->nHeight, vRemoved);
 
-            if(mapTxLockReq.count(it->second.txHash)){
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+    BOOST_FOREACH(const CTransactionLock& lock, vRemoved) {
+        LogPrintf("Removing old transaction lock %s\n", lock.txHash.ToString().c_str());
 
-                BOOST_FOREACH(const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+        mapTxLockReq.erase(lock.txHash);
+        mapTxLockReqRejected.erase(lock.txHash);
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
-
-                BOOST_FOREACH(CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
-
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
-        }
+        for(std::map<COutPoint, CConsensusVote>::const_iterator it = lock.mapVotes.begin(); it != lock.mapVotes.end(); ++it)
+            mapTxLockVote.erase(it->second.GetHash());
     }
-
 }
 
 uint256 CConsensusVote::GetHash() const
@@ -475,32 +446,32 @@ uint256 CConsensusVote::GetHash() const
 }
 
 
+std::string CConsensusVote::GetSignedMessage() const
+{
+    return txHash.ToString() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetSignedMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
-    int n = GetInodeByVin(vinInode);
-
-    if(n == -1)
+    CPubKey pubkey2;
     {
-        LogPrintf("TesseractX::CConsensusVote::SignatureValid() - Unknown INode\n");
-        return false;
-    }
+        LOCK(cs_inodes);
+        int n = inodeRegistry.Find(vinInode);
 
-    //LogPrintf("verify addr %s \n", vecInodes[0].addr.ToString().c_str());
-    //LogPrintf("verify addr %s \n", vecInodes[1].addr.ToString().c_str());
-    //LogPrintf("verify addr %d %s \n", n, vecInodes[n].addr.ToString().c_str());
+        if(n == -1)
+        {
+            LogPrintf("TesseractX::CConsensusVote::SignatureValid() - Unknown INode\n");
+            return false;
+        }
 
-    CScript pubkey;
-    pubkey =GetScriptForDestination(vecInodes[n].pubkey2.GetID());
-    CTxDestination address1;
-    ExtractDestination(pubkey, address1);
-    CBitcoinAddress address2(address1);
-    //LogPrintf("verify pubkey2 %s \n", address2.ToString().c_str());
+        pubkey2 = inodeRegistry[n].pubkey2;
+    }
 
-    if(!anonSendSigner.VerifyMessage(vecInodes[n].pubkey2, vchINodeSignature, strMessage, errorMessage)) {
+    if(!anonSendSigner.VerifyMessage(pubkey2, vchINodeSignature, strMessage, errorMessage)) {
         LogPrintf("TesseractX::CConsensusVote::SignatureValid() - Verify message failed\n");
         return false;
     }
@@ -547,9 +518,10 @@ bool CConsensusVote::Sign()
 
 bool CTransactionLock::SignaturesValid()
 {
-
-    BOOST_FOREACH(CConsensusVote vote, vecConsensusVotes)
+    // the signatures were verified when the votes were added, only the inode ranks can change
+    for(std::map<COutPoint, CConsensusVote>::iterator it = mapVotes.begin(); it != mapVotes.end(); ++it)
     {
+        CConsensusVote& vote = it->second;
         int n = GetInodeRank(vote.vinInode, vote.nBlockHeight, MIN_TESSERACTX_PROTO_VERSION);
 
         if(n == -1)
@@ -560,12 +532,7 @@ bool CTransactionLock::SignaturesValid()
 
         if(n > TESSERACTX_SIGNATURES_TOTAL)
         {
-            LogPrintf("TesseractX::DoConsensusVote - Inode not in the top %s\n", TESSERACTX_SIGNATURES_TOTAL);
-            return false;
-        }
-
-        if(!vote.SignatureValid()){
-            LogPrintf("TesseractX::CTransactionLock::SignaturesValid - Signature not valid\n");
+            LogPrintf("TesseractX::DoConsensusVote - Inode not in the top %d\n", TESSERACTX_SIGNATURES_TOTAL);
             return false;
         }
     }
@@ -573,12 +540,16 @@ bool CTransactionLock::SignaturesValid()
     return true;
 }
 
-void CTransactionLock::AddSignature(CConsensusVote& cv)
+bool CTransactionLock::AddSignature(const CConsensusVote& cv)
 {
-    vecConsensusVotes.push_back(cv);
+    if(!mapVotes.insert(make_pair(cv.vinInode.prevout, cv)).second)
+        return false;
+
+    mapCountByHeight[cv.nBlockHeight]++;
+    return true;
 }
 
-int CTransactionLock::CountSignatures()
+int CTransactionLock::CountSignatures() const
 {
     /*
         Only count signatures where the BlockHeight matches the transaction's blockheight.
@@ -587,11 +558,127 @@ int CTransactionLock::CountSignatures()
 
     if(nBlockHeight == 0) return -1;
 
-    int n = 0;
-    BOOST_FOREACH(CConsensusVote v, vecConsensusVotes){
-        if(v.nBlockHeight == nBlockHeight){
-            n++;
+    std::map<int, int>::const_iterator it = mapCountByHeight.find(nBlockHeight);
+    return it == mapCountByHeight.end() ? 0 : it->second;
+}
+
+CTransactionLock& CTransactionLockTracker::GetOrCreate(const uint256& txHash)
+{
+    std::map<uint256, CTransactionLock>::iterator it = mapLocks.find(txHash);
+    if(it != mapLocks.end())
+        return it->second;
+
+    LogPrintf("TesseractX - New Transaction Lock %s !\n", txHash.ToString().c_str());
+
+    CTransactionLock& lock = mapLocks[txHash];
+    lock.txHash = txHash;
+    lock.nTimeout = GetTime()+(60*5);
+    SetExpiration(lock, nBestHeight + TESSERACTX_LOCK_EXPIRATION_BLOCKS);
+    return lock;
+}
+
+void CTransactionLockTracker::SetExpiration(CTransactionLock& lock, int nExpirationHeight)
+{
+    setByExpiration.erase(make_pair(lock.nExpirationHeight, lock.txHash));
+    lock.nExpirationHeight = nExpirationHeight;
+    setByExpiration.insert(make_pair(lock.nExpirationHeight, lock.txHash));
+}
+
+void CTransactionLockTracker::CreateLock(const uint256& txHash, int nBlockHeight)
+{
+    LOCK(cs);
+    GetOrCreate(txHash).nBlockHeight = nBlockHeight;
+}
+
+bool CTransactionLockTracker::AddVote(const CConsensusVote& vote, int& nSignatures)
+{
+    LOCK(cs);
+    CTransactionLock& lock = GetOrCreate(vote.txHash);
+    if(!lock.AddSignature(vote))
+        return false;
+
+    nSignatures = lock.CountSignatures();
+    return true;
+}
+
+int CTransactionLockTracker::CountSignatures(const uint256& txHash) const
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::const_iterator it = mapLocks.find(txHash);
+    if(it == mapLocks.end())
+        return -1;
+    return it->second.CountSignatures();
+}
+
+bool CTransactionLockTracker::IsTimedOut(const uint256& txHash) const
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::const_iterator it = mapLocks.find(txHash);
+    if(it == mapLocks.end())
+        return false;
+    return GetTime() > it->second.nTimeout;
+}
+
+void CTransactionLockTracker::LockInputs(const CTransaction& tx)
+{
+    LOCK(cs);
+    CTransactionLock& lock = GetOrCreate(tx.GetHash());
+    BOOST_FOREACH(const CTxIn& in, tx.vin){
+        if(mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash())).second)
+            lock.vLockedInputs.push_back(in.prevout);
+    }
+}
+
+bool CTransactionLockTracker::GetLockedInput(const COutPoint& outpoint, uint256& txHash) const
+{
+    LOCK(cs);
+    boost::unordered_map<COutPoint, uint256, COutPointHasher>::const_iterator it = mapLockedInputs.find(outpoint);
+    if(it == mapLockedInputs.end())
+        return false;
+    txHash = it->second;
+    return true;
+}
+
+bool CTransactionLockTracker::GetConflictingLock(const CTransaction& tx, uint256& txHashConflict) const
+{
+    LOCK(cs);
+    BOOST_FOREACH(const CTxIn& in, tx.vin){
+        boost::unordered_map<COutPoint, uint256, COutPointHasher>::const_iterator it = mapLockedInputs.find(in.prevout);
+        if(it != mapLockedInputs.end() && it->second != tx.GetHash()){
+            txHashConflict = it->second;
+            return true;
         }
     }
-    return n;
+    return false;
+}
+
+void CTransactionLockTracker::ExpireLock(const uint256& txHash)
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::iterator it = mapLocks.find(txHash);
+    if(it != mapLocks.end())
+        SetExpiration(it->second, nBestHeight);
+}
+
+void CTransactionLockTracker::RemoveExpired(int nHeight, std::vector<CTransactionLock>& vRemoved)
+{
+    LOCK(cs);
+    while(!setByExpiration.empty() && setByExpiration.begin()->first <= nHeight) {
+        std::map<uint256, CTransactionLock>::iterator it = mapLocks.find(setByExpiration.begin()->second);
+        setByExpiration.erase(setByExpiration.begin());
+        if(it == mapLocks.end())
+            continue;
+
+        BOOST_FOREACH(const COutPoint& outpoint, it->second.vLockedInputs)
+            mapLockedInputs.erase(outpoint);
+
+        vRemoved.push_back(it->second);
+        mapLocks.erase(it);
+    }
+}
+
+size_t CTransactionLockTracker::size() const
+{
+    LOCK(cs);
+    return mapLocks.size();
 }
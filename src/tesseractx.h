@@ -15,10 +15,14 @@
 #include "script.h"
 #include "base58.h"
 #include "main.h"
+#include "inode.h"
 
 using namespace std;
 using namespace boost;
 
+// locks are dropped this many blocks after they were created (about an hour)
+#define TESSERACTX_LOCK_EXPIRATION_BLOCKS        120
+
 class CConsensusVote;
 class CTransaction;
 class CTransactionLock;
@@ -26,8 +30,6 @@ class CTransactionLock;
 extern map<uint256, CTransaction> mapTxLockReq;
 extern map<uint256, CTransaction> mapTxLockReqRejected;
 extern map<uint256, CConsensusVote> mapTxLockVote;
-extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
 extern int nCompleteTXLocks;
 
 
@@ -46,7 +48,10 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
 //process consensus vote message
 bool ProcessConsensusVote(CConsensusVote& ctx);
 
-// keep transaction locks in memory for an hour
+//count and relay a vote once its signature has been checked
+void ProcessVerifiedConsensusVote(const CConsensusVote& vote, bool fValid);
+
+// drop the transaction locks that are more than TESSERACTX_LOCK_EXPIRATION_BLOCKS old
 void CleanTransactionLocksList();
 
 int64_t GetAverageVoteTime();
@@ -60,6 +65,7 @@ public:
     std::vector<unsigned char> vchINodeSignature;
 
     uint256 GetHash() const;
+    std::string GetSignedMessage() const;
 
     bool SignatureValid();
     bool Sign();
@@ -81,13 +87,26 @@ class CTransactionLock
 public:
     int nBlockHeight;
     uint256 txHash;
-    std::vector<CConsensusVote> vecConsensusVotes;
-    int nExpiration;
+    // the counted vote of each inode, keyed by its collateral
+    std::map<COutPoint, CConsensusVote> mapVotes;
+    // number of votes per vote height, CountSignatures() only counts nBlockHeight
+    std::map<int, int> mapCountByHeight;
+    // inputs registered in the locked input index for this lock
+    std::vector<COutPoint> vLockedInputs;
+    int nExpirationHeight;
     int nTimeout;
 
+    CTransactionLock()
+    {
+        nBlockHeight = 0;
+        nExpirationHeight = 0;
+        nTimeout = 0;
+    }
+
     bool SignaturesValid();
-    int CountSignatures();
-    void AddSignature(CConsensusVote& cv);
+    int CountSignatures() const;
+    // false if this inode already has a vote on the transaction
+    bool AddSignature(const CConsensusVote& cv);
 
     uint256 GetHash()
     {
@@ -95,5 +114,49 @@ public:
     }
 };
 
+/**
+ * All transaction locks, with their votes and the inputs of complete locks.
+ *
+ * Votes are added after their signature was checked and are never verified
+ * again. Each inode counts once per transaction. Complete locks register their
+ * inputs in a hash index, so conflicts are found with one lookup per input, and
+ * locks are expired in bulk from an index ordered by expiration height.
+ */
+class CTransactionLockTracker
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<uint256, CTransactionLock> mapLocks;
+    boost::unordered_map<COutPoint, uint256, COutPointHasher> mapLockedInputs;
+    std::set<std::pair<int, uint256> > setByExpiration;
+
+    CTransactionLock& GetOrCreate(const uint256& txHash);
+    void SetExpiration(CTransactionLock& lock, int nExpirationHeight);
+
+public:
+    // create the lock for a transaction, or update the vote height of an existing one
+    void CreateLock(const uint256& txHash, int nBlockHeight);
+    // count a verified vote, false if the inode already voted on this transaction
+    bool AddVote(const CConsensusVote& vote, int& nSignatures);
+    // votes at the lock's height, -1 if there is no lock or its height isn't known yet
+    int CountSignatures(const uint256& txHash) const;
+    bool IsTimedOut(const uint256& txHash) const;
+
+    // register the inputs of tx as locked, inputs that are locked already keep their lock
+    void LockInputs(const CTransaction& tx);
+    // the transaction holding the lock on an input
+    bool GetLockedInput(const COutPoint& outpoint, uint256& txHash) const;
+    // the first input of tx that is locked by another transaction
+    bool GetConflictingLock(const CTransaction& tx, uint256& txHashConflict) const;
+    // make a lock expire with the next clean up
+    void ExpireLock(const uint256& txHash);
+
+    // remove all locks that expired at nHeight, they are handed back so their votes can be dropped
+    void RemoveExpired(int nHeight, std::vector<CTransactionLock>& vRemoved);
+    size_t size() const;
+};
+
+extern CTransactionLockTracker txLockTracker;
+
 
 #endif
@@ -0,0 +1,167 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "key.h"
+#include "msgverify.h"
+#include "util.h"
+
+using namespace std;
+
+struct CallbackResults
+{
+    vector<bool> vResults;
+    void Add(bool fValid) { vResults.push_back(fValid); }
+    void AddAndThrow(bool fValid) { vResults.push_back(fValid); throw runtime_error("callback failed"); }
+};
+
+static vector<unsigned char> SignMessage(const CKey& key, const string& strMessage)
+{
+    vector<unsigned char> vchSig;
+    BOOST_CHECK(key.SignCompact(GetSignedMessageHash(strMessage), vchSig));
+    return vchSig;
+}
+
+BOOST_AUTO_TEST_SUITE(msgverify_tests)
+
+BOOST_AUTO_TEST_CASE(msgverify_verify)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    vector<unsigned char> vchSig = SignMessage(key, "dsee message");
+
+    CMessageVerifyQueue queue;
+    bool fRecovered;
+    CKeyID keyIDRecovered;
+    BOOST_CHECK(queue.Verify(key.GetPubKey(), vchSig, "dsee message", fRecovered, keyIDRecovered));
+    BOOST_CHECK(fRecovered);
+    BOOST_CHECK(keyIDRecovered == key.GetPubKey().GetID());
+
+    // the second check is answered from the cache
+    BOOST_CHECK(queue.Verify(key.GetPubKey(), vchSig, "dsee message", fRecovered, keyIDRecovered));
+    uint64_t nVerified, nCacheHits, nMerged, nDropped;
+    queue.GetStats(nVerified, nCacheHits, nMerged, nDropped);
+    BOOST_CHECK_EQUAL(nVerified, 1U);
+    BOOST_CHECK_EQUAL(nCacheHits, 1U);
+
+    // a mismatch reports the key that did sign
+    BOOST_CHECK(!queue.Verify(keyOther.GetPubKey(), vchSig, "dsee message", fRecovered, keyIDRecovered));
+    BOOST_CHECK(fRecovered);
+    BOOST_CHECK(keyIDRecovered == key.GetPubKey().GetID());
+
+    BOOST_CHECK(!queue.Verify(key.GetPubKey(), vchSig, "other message", fRecovered, keyIDRecovered));
+
+    vchSig.resize(10);
+    BOOST_CHECK(!queue.Verify(key.GetPubKey(), vchSig, "dsee message", fRecovered, keyIDRecovered));
+    BOOST_CHECK(!fRecovered);
+}
+
+BOOST_AUTO_TEST_CASE(msgverify_push_inline)
+{
+    CKey key;
+    key.MakeNewKey(false);
+    vector<unsigned char> vchSig = SignMessage(key, "txlvote");
+
+    // without workers the callback runs before Push returns
+    CMessageVerifyQueue queue;
+    CallbackResults results;
+    BOOST_CHECK(queue.Push(key.GetPubKey(), vchSig, "txlvote", boost::bind(&CallbackResults::Add, &results, _1)));
+    BOOST_CHECK(queue.Push(key.GetPubKey(), vchSig, "changed", boost::bind(&CallbackResults::Add, &results, _1)));
+    BOOST_REQUIRE_EQUAL(results.vResults.size(), 2U);
+    BOOST_CHECK(results.vResults[0]);
+    BOOST_CHECK(!results.vResults[1]);
+}
+
+BOOST_AUTO_TEST_CASE(msgverify_push_workers)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    vector<unsigned char> vchSig = SignMessage(key, "dseep");
+
+    CMessageVerifyQueue queue;
+    boost::thread_group threadGroup;
+    queue.Start(threadGroup, 2);
+
+    CallbackResults results;
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(queue.Push(key.GetPubKey(), vchSig, "dseep", boost::bind(&CallbackResults::Add, &results, _1)));
+    BOOST_CHECK(queue.Push(key.GetPubKey(), vchSig, "bad", boost::bind(&CallbackResults::Add, &results, _1)));
+
+    // callbacks only run from ProcessCompleted, on the calling thread
+    for (int i = 0; i < 500 && results.vResults.size() < 4; i++)
+    {
+        MilliSleep(10);
+        queue.ProcessCompleted();
+    }
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    BOOST_REQUIRE_EQUAL(results.vResults.size(), 4U);
+    BOOST_CHECK_EQUAL(count(results.vResults.begin(), results.vResults.end(), true), 3);
+
+    // verified once it is cached, later pushes call back at once
+    CallbackResults resultsCached;
+    BOOST_CHECK(queue.Push(key.GetPubKey(), vchSig, "dseep", boost::bind(&CallbackResults::Add, &resultsCached, _1)));
+    BOOST_REQUIRE_EQUAL(resultsCached.vResults.size(), 1U);
+    BOOST_CHECK(resultsCached.vResults[0]);
+}
+
+BOOST_AUTO_TEST_CASE(msgverify_push_limit)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMessageVerifyQueue queue(2);
+    boost::thread_group threadGroup;
+    queue.Start(threadGroup, 1);
+
+    // callbacks count until ProcessCompleted ran them, the third request is dropped
+    CallbackResults results;
+    BOOST_CHECK(queue.Push(key.GetPubKey(), SignMessage(key, "a"), "a", boost::bind(&CallbackResults::Add, &results, _1)));
+    BOOST_CHECK(queue.Push(key.GetPubKey(), SignMessage(key, "b"), "b", boost::bind(&CallbackResults::Add, &results, _1)));
+    BOOST_CHECK(!queue.Push(key.GetPubKey(), SignMessage(key, "c"), "c", boost::bind(&CallbackResults::Add, &results, _1)));
+
+    for (int i = 0; i < 500 && results.vResults.size() < 2; i++)
+    {
+        MilliSleep(10);
+        queue.ProcessCompleted();
+    }
+    BOOST_CHECK_EQUAL(results.vResults.size(), 2U);
+
+    // room again once they ran
+    BOOST_CHECK(queue.Push(key.GetPubKey(), SignMessage(key, "c"), "c", boost::bind(&CallbackResults::Add, &results, _1)));
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    uint64_t nVerified, nCacheHits, nMerged, nDropped;
+    queue.GetStats(nVerified, nCacheHits, nMerged, nDropped);
+    BOOST_CHECK_EQUAL(nDropped, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(msgverify_callback_throws)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMessageVerifyQueue queue;
+    boost::thread_group threadGroup;
+    queue.Start(threadGroup, 1);
+
+    // a throwing callback is logged, the ones after it still run
+    CallbackResults results;
+    BOOST_CHECK(queue.Push(key.GetPubKey(), SignMessage(key, "a"), "a", boost::bind(&CallbackResults::AddAndThrow, &results, _1)));
+    BOOST_CHECK(queue.Push(key.GetPubKey(), SignMessage(key, "b"), "b", boost::bind(&CallbackResults::Add, &results, _1)));
+    for (int i = 0; i < 500 && results.vResults.size() < 2; i++)
+    {
+        MilliSleep(10);
+        BOOST_CHECK_NO_THROW(queue.ProcessCompleted());
+    }
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    BOOST_CHECK_EQUAL(results.vResults.size(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,138 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "prevector.h"
+#include "script.h"
+#include "serialize.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(prevector_tests)
+
+typedef prevector<8, int> pretype;
+typedef vector<int> realtype;
+
+// Applies every operation to a prevector and a vector and compares them
+class prevector_tester
+{
+    realtype real_vector;
+    pretype pre_vector;
+
+    void test()
+    {
+        const pretype& const_pre_vector = pre_vector;
+        BOOST_CHECK_EQUAL(real_vector.size(), pre_vector.size());
+        BOOST_CHECK_EQUAL(real_vector.empty(), pre_vector.empty());
+        for (unsigned int s = 0; s < real_vector.size(); s++)
+        {
+            BOOST_CHECK(real_vector[s] == pre_vector[s]);
+            BOOST_CHECK(&(pre_vector[s]) == &(pre_vector.begin()[s]));
+            BOOST_CHECK(&(pre_vector[s]) == &*(pre_vector.begin() + s));
+        }
+        BOOST_CHECK(pre_vector.capacity() >= pre_vector.size());
+        BOOST_CHECK(realtype(pre_vector.begin(), pre_vector.end()) == real_vector);
+        BOOST_CHECK(realtype(const_pre_vector.rbegin(), const_pre_vector.rend()) == realtype(real_vector.rbegin(), real_vector.rend()));
+        BOOST_CHECK(pretype(real_vector.begin(), real_vector.end()) == pre_vector);
+        BOOST_CHECK(pretype(pre_vector) == pre_vector);
+    }
+
+public:
+    size_t size() const { return real_vector.size(); }
+    void resize(size_t s) { real_vector.resize(s); pre_vector.resize(s); test(); }
+    void reserve(size_t s) { real_vector.reserve(s); pre_vector.reserve(s); test(); }
+    void insert(size_t position, const int& value) { real_vector.insert(real_vector.begin() + position, value); pre_vector.insert(pre_vector.begin() + position, value); test(); }
+    void insert(size_t position, size_t count, const int& value) { real_vector.insert(real_vector.begin() + position, count, value); pre_vector.insert(pre_vector.begin() + position, count, value); test(); }
+    void erase(size_t position) { real_vector.erase(real_vector.begin() + position); pre_vector.erase(pre_vector.begin() + position); test(); }
+    void erase(size_t first, size_t last) { real_vector.erase(real_vector.begin() + first, real_vector.begin() + last); pre_vector.erase(pre_vector.begin() + first, pre_vector.begin() + last); test(); }
+    void push_back(const int& value) { real_vector.push_back(value); pre_vector.push_back(value); test(); }
+    void pop_back() { real_vector.pop_back(); pre_vector.pop_back(); test(); }
+    void clear() { real_vector.clear(); pre_vector.clear(); test(); }
+    void assign(size_t n, const int& value) { real_vector.assign(n, value); pre_vector.assign(n, value); test(); }
+    void shrink_to_fit() { pre_vector.shrink_to_fit(); test(); }
+    void swap()
+    {
+        realtype real_copy(real_vector);
+        pretype pre_copy(pre_vector);
+        real_vector.swap(real_copy);
+        pre_vector.swap(pre_copy);
+        test();
+    }
+    void update(size_t pos, const int& value) { real_vector[pos] = value; pre_vector[pos] = value; test(); }
+};
+
+BOOST_AUTO_TEST_CASE(PrevectorTestInt)
+{
+    seed_insecure_rand(true);
+    for (int j = 0; j < 64; j++)
+    {
+        prevector_tester test;
+        for (int i = 0; i < 2048; i++)
+        {
+            int r = insecure_rand();
+            if ((r % 4) == 0)
+                test.insert(insecure_rand() % (test.size() + 1), insecure_rand());
+            if (test.size() > 0 && ((r >> 2) % 4) == 1)
+                test.erase(insecure_rand() % test.size());
+            if (((r >> 4) % 8) == 2)
+            {
+                int new_size = std::max<int>(0, std::min<int>(30, test.size() + (insecure_rand() % 5) - 2));
+                test.resize(new_size);
+            }
+            if (((r >> 7) % 8) == 3)
+                test.insert(insecure_rand() % (test.size() + 1), 1 + (insecure_rand() % 2), insecure_rand());
+            if (((r >> 10) % 8) == 4)
+            {
+                int del = std::min<int>(test.size(), 1 + (insecure_rand() % 2));
+                int beg = insecure_rand() % (test.size() + 1 - del);
+                test.erase(beg, beg + del);
+            }
+            if (((r >> 13) % 16) == 5)
+                test.push_back(insecure_rand());
+            if (test.size() > 0 && ((r >> 17) % 16) == 6)
+                test.pop_back();
+            if (((r >> 21) % 32) == 7)
+                test.assign(insecure_rand() % 16, insecure_rand());
+            if (((r >> 26) % 32) == 8)
+                test.reserve(insecure_rand() % 32);
+            if (((r >> 27) % 32) == 9)
+                test.shrink_to_fit();
+            if (((r >> 28) % 32) == 10)
+                test.swap();
+            if (test.size() > 0 && ((r >> 29) % 8) == 3)
+                test.update(insecure_rand() % test.size(), insecure_rand());
+            if ((i % 256) == 255)
+                test.clear();
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(PrevectorScript)
+{
+    // scripts serialize and order exactly like the vectors they were before
+    for (unsigned int nSize = 0; nSize < 100; nSize += 7)
+    {
+        vector<unsigned char> vch(nSize);
+        for (unsigned int i = 0; i < nSize; i++)
+            vch[i] = (unsigned char)(i * 37 + nSize);
+        CScript script(vch.begin(), vch.end());
+
+        CDataStream ssScript(SER_NETWORK, PROTOCOL_VERSION);
+        ssScript << script;
+        CDataStream ssVector(SER_NETWORK, PROTOCOL_VERSION);
+        ssVector << vch;
+        BOOST_CHECK(ssScript.str() == ssVector.str());
+        BOOST_CHECK_EQUAL(::GetSerializeSize(script, SER_NETWORK, PROTOCOL_VERSION), ssVector.size());
+
+        CScript scriptRead;
+        ssScript >> scriptRead;
+        BOOST_CHECK(scriptRead == script);
+    }
+
+    vector<unsigned char> a(1, 0x01), b(2, 0x00);
+    BOOST_CHECK(CScript(a.begin(), a.end()) > CScript(b.begin(), b.end()));
+    BOOST_CHECK(CScript(b.begin(), b.begin() + 1) < CScript(b.begin(), b.end()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "rpcprotocol.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(rpchttp_tests)
+
+/** Hands out a string at most nStep bytes per read, like a slow socket */
+struct CFakeConnection
+{
+    string strData;
+    size_t nPos;
+    size_t nStep;
+    int nReads;
+
+    CFakeConnection(const string& strDataIn, size_t nStepIn) : strData(strDataIn), nPos(0), nStep(nStepIn), nReads(0) {}
+
+    size_t Read(char* pch, size_t n)
+    {
+        n = min(n, min(nStep, strData.size() - nPos));
+        memcpy(pch, strData.data() + nPos, n);
+        nPos += n;
+        nReads++;
+        return n;
+    }
+};
+
+static string Post(const string& strBody, const string& strHeaders = "")
+{
+    return "POST / HTTP/1.1\r\n"
+           "Authorization: Basic dXNlcjpwYXNz\r\n" + strHeaders +
+           "Content-Length: " + boost::lexical_cast<string>(strBody.size()) + "\r\n"
+           "\r\n" + strBody;
+}
+
+BOOST_AUTO_TEST_CASE(rpchttp_pipelined)
+{
+    string strRequests;
+    for (int i = 0; i < 100; i++)
+        strRequests += Post(strprintf("{\"method\":\"getblockcount\",\"id\":%d}", i));
+
+    // whole buffers and single bytes give the same requests
+    size_t vStep[] = { 1 << 20, 7, 1 };
+    for (unsigned int n = 0; n < sizeof(vStep) / sizeof(vStep[0]); n++)
+    {
+        CFakeConnection conn(strRequests, vStep[n]);
+        CHTTPRequestReader reader(boost::bind(&CFakeConnection::Read, &conn, _1, _2), MAX_SIZE);
+        for (int i = 0; i < 100; i++)
+        {
+            CHTTPRequest req;
+            BOOST_REQUIRE(reader.Read(req));
+            BOOST_CHECK_EQUAL(req.strMethod, "POST");
+            BOOST_CHECK_EQUAL(req.strURI, "/");
+            BOOST_CHECK_EQUAL(req.nProto, 1);
+            BOOST_CHECK(req.fKeepAlive);
+            BOOST_CHECK_EQUAL(req.strAuthorization, "Basic dXNlcjpwYXNz");
+            BOOST_CHECK_EQUAL(req.strBody, strprintf("{\"method\":\"getblockcount\",\"id\":%d}", i));
+        }
+        CHTTPRequest req;
+        BOOST_CHECK(!reader.Read(req));
+        BOOST_CHECK_EQUAL(reader.GetBytesRead(), strRequests.size());
+        if (n == 0)
+            BOOST_CHECK(conn.nReads <= 3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpchttp_headers)
+{
+    CHTTPRequest req;
+
+    // 1.1 stays open unless the client closes, 1.0 only on request
+    string vRequests[] = {
+        Post("{}", "Connection: close\r\n"),
+        "POST / HTTP/1.0\r\nContent-Length: 2\r\n\r\n{}",
+        "POST / HTTP/1.0\r\nconnection:  Keep-Alive \r\nCONTENT-LENGTH: 2\r\n\r\n{}",
+    };
+    bool vKeepAlive[] = { false, false, true };
+    for (int i = 0; i < 3; i++)
+    {
+        CFakeConnection conn(vRequests[i], 5);
+        CHTTPRequestReader reader(boost::bind(&CFakeConnection::Read, &conn, _1, _2), MAX_SIZE);
+        BOOST_REQUIRE(reader.Read(req));
+        BOOST_CHECK_EQUAL(req.fKeepAlive, vKeepAlive[i]);
+        BOOST_CHECK_EQUAL(req.strBody, "{}");
+    }
+
+    // chunked body with an extension and a trailer, then the next request
+    string strChunked = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                        "5;ext=1\r\n{\"met\r\n"
+                        "9\r\nhod\":\"x\"}\r\n"
+                        "0\r\nX-Trailer: 1\r\n\r\n" + Post("[]");
+    CFakeConnection conn(strChunked, 3);
+    CHTTPRequestReader reader(boost::bind(&CFakeConnection::Read, &conn, _1, _2), MAX_SIZE);
+    BOOST_REQUIRE(reader.Read(req));
+    BOOST_CHECK_EQUAL(req.strBody, "{\"method\":\"x\"}");
+    BOOST_REQUIRE(reader.Read(req));
+    BOOST_CHECK_EQUAL(req.strBody, "[]");
+}
+
+BOOST_AUTO_TEST_CASE(rpchttp_large_body)
+{
+    // a body far larger than one read arrives a packet at a time, reading it
+    // has to stay linear in its size
+    string strBody(32 << 20, 'x');
+    for (size_t i = 0; i < strBody.size(); i += 4096)
+        strBody[i] = 'a' + i / 4096 % 26;
+    string strRequests = Post(strBody) + Post("[]");
+
+    CFakeConnection conn(strRequests, 1460);
+    CHTTPRequestReader reader(boost::bind(&CFakeConnection::Read, &conn, _1, _2), MAX_SIZE);
+    int64_t nStart = GetTimeMillis();
+    CHTTPRequest req;
+    BOOST_REQUIRE(reader.Read(req));
+    BOOST_CHECK(req.strBody == strBody);
+    BOOST_REQUIRE(reader.Read(req));
+    BOOST_CHECK_EQUAL(req.strBody, "[]");
+    int64_t nElapsed = GetTimeMillis() - nStart;
+    BOOST_CHECK_MESSAGE(nElapsed < 5000, nElapsed);
+    BOOST_CHECK_EQUAL(reader.GetBytesRead(), strRequests.size());
+
+    // the transfer encoding is matched without case
+    string strChunked = "POST / HTTP/1.1\r\nTransfer-Encoding: Chunked\r\n\r\n2\r\n{}\r\n0\r\n\r\n";
+    CFakeConnection connChunked(strChunked, 1460);
+    CHTTPRequestReader readerChunked(boost::bind(&CFakeConnection::Read, &connChunked, _1, _2), MAX_SIZE);
+    BOOST_REQUIRE(readerChunked.Read(req));
+    BOOST_CHECK_EQUAL(req.strBody, "{}");
+}
+
+BOOST_AUTO_TEST_CASE(rpchttp_refused)
+{
+    string vBad[] = {
+        Post(string(101, 'x')),                                                      // over the limit
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n65\r\n" + string(101, 'x'),
+        "DELETE / HTTP/1.1\r\n\r\n",
+        "POST http://host/ HTTP/1.1\r\n\r\n",
+        "POST\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\nshort",                        // connection gone
+        "POST / HTTP/1.1\r\n" + string(100000, 'x'),                                 // endless line
+    };
+    for (unsigned int i = 0; i < sizeof(vBad) / sizeof(vBad[0]); i++)
+    {
+        CFakeConnection conn(vBad[i], 1000);
+        CHTTPRequestReader reader(boost::bind(&CFakeConnection::Read, &conn, _1, _2), 100);
+        CHTTPRequest req;
+        BOOST_CHECK_MESSAGE(!reader.Read(req), i);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
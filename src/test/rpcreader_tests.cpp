@@ -0,0 +1,164 @@
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include "rpcreader.h"
+#include "util.h"
+
+#include "json/json_spirit_reader_template.h"
+#include "json/json_spirit_utils.h"
+
+using namespace std;
+using namespace json_spirit;
+
+BOOST_AUTO_TEST_SUITE(rpcreader_tests)
+
+// Value::operator== doesn't look at the uint64 flag
+static bool SameValue(const Value& a, const Value& b)
+{
+    if (a.type() != b.type())
+        return false;
+    switch (a.type())
+    {
+    case obj_type:
+        if (a.get_obj().size() != b.get_obj().size())
+            return false;
+        for (unsigned int i = 0; i < a.get_obj().size(); i++)
+            if (a.get_obj()[i].name_ != b.get_obj()[i].name_ || !SameValue(a.get_obj()[i].value_, b.get_obj()[i].value_))
+                return false;
+        return true;
+    case array_type:
+        if (a.get_array().size() != b.get_array().size())
+            return false;
+        for (unsigned int i = 0; i < a.get_array().size(); i++)
+            if (!SameValue(a.get_array()[i], b.get_array()[i]))
+                return false;
+        return true;
+    case int_type:
+        return a.is_uint64() == b.is_uint64() && a.get_int64() == b.get_int64();
+    default:
+        return a == b;
+    }
+}
+
+static bool SameAsSpirit(const string& str)
+{
+    Value valueSpirit, value;
+    bool fSpirit = read_string(str, valueSpirit);
+    bool fRead = ReadJSON(str, value);
+    if (fSpirit != fRead)
+        return false;
+    return !fSpirit || SameValue(valueSpirit, value);
+}
+
+template<typename T, size_t N>
+static const char* Pick(T (&vItems)[N])
+{
+    return vItems[insecure_rand() % N];
+}
+
+static const char* vSpace[] = { "", "", "", " ", "\n", "\t ", "\r\n", "\v", "\f" };
+static const char* vNumber[] = {
+    "0", "1", "-1", "+1", "01", "-0", "123456789", "1.5", "-1.5", ".5", "-.5", "+.5",
+    "5.", "1e5", "1E+5", "1e-5", "-2.5e3", "1.5e", "1e", ".", "-", "+", "1.2.3", "0.00000001",
+    "21000000.12345678", "9223372036854775807", "9223372036854775808", "-9223372036854775808",
+    "-9223372036854775809", "18446744073709551615", "18446744073709551616", "+9223372036854775808",
+    "1e400", "123.456e-7"
+};
+static const char* vStringPart[] = {
+    "a", "txid", " ", "\\n", "\\t", "\\\"", "\\\\", "\\/", "\\b\\f\\r", "\\u00e9", "\\u12", "\\x41",
+    "\\x7", "\\x7f", "\\x80", "\\X4a", "\\xg", "\\q", "\\'", "\\0", "\\177", "\\400", "\xc3\xa9",
+    "\n", "0123456789abcdef", "\\"
+};
+static const char* vLiteral[] = { "true", "false", "null", "tru", "nul", "True" };
+static const char vNoise[] = "{}[],:\"\\ x0123456789.eE+-tfnul";
+
+static string RandomString()
+{
+    string str = "\"";
+    unsigned int nParts = insecure_rand() % 6;
+    for (unsigned int i = 0; i < nParts; i++)
+        str += Pick(vStringPart);
+    return str + "\"";
+}
+
+static string RandomJSON(int nDepth)
+{
+    string str = Pick(vSpace);
+    int nKind = insecure_rand() % (nDepth < 4 ? 6 : 4);
+    if (nKind == 0)
+        str += RandomString();
+    else if (nKind == 1)
+        str += Pick(vNumber);
+    else if (nKind == 2)
+        str += Pick(vLiteral);
+    else if (nKind == 3)
+        str += Pick(vNumber) + string(Pick(vSpace)) + Pick(vNumber);
+    else
+    {
+        bool fObject = (nKind == 4);
+        str += fObject ? "{" : "[";
+        unsigned int nItems = insecure_rand() % 5;
+        for (unsigned int i = 0; i < nItems; i++)
+        {
+            if (i > 0)
+                str += string(Pick(vSpace)) + ",";
+            if (fObject)
+                str += string(Pick(vSpace)) + RandomString() + Pick(vSpace) + ":";
+            str += RandomJSON(nDepth + 1);
+        }
+        str += string(Pick(vSpace)) + (fObject ? "}" : "]");
+    }
+    return str + Pick(vSpace);
+}
+
+static void Mutate(string& str)
+{
+    unsigned int nEdits = insecure_rand() % 4;
+    for (unsigned int i = 0; i < nEdits; i++)
+    {
+        unsigned int nPos = str.empty() ? 0 : insecure_rand() % (str.size() + 1);
+        switch (insecure_rand() % 3)
+        {
+        case 0: str.insert(nPos, 1, vNoise[insecure_rand() % (sizeof(vNoise) - 1)]); break;
+        case 1: if (nPos < str.size()) str.erase(nPos, 1); break;
+        case 2: str.resize(nPos); break;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpcreader_examples)
+{
+    Value value;
+    BOOST_CHECK(ReadJSON("{\"method\":\"sendrawtransaction\",\"params\":[\"0100ff\",1.5,-2,18446744073709551615],\"id\":null}", value));
+    const Object& obj = value.get_obj();
+    BOOST_CHECK_EQUAL(find_value(obj, "method").get_str(), "sendrawtransaction");
+    const Array& params = find_value(obj, "params").get_array();
+    BOOST_CHECK_EQUAL(params[0].get_str(), "0100ff");
+    BOOST_CHECK_EQUAL(params[1].get_real(), 1.5);
+    BOOST_CHECK_EQUAL(params[2].get_int(), -2);
+    BOOST_CHECK(params[3].is_uint64());
+    BOOST_CHECK(find_value(obj, "id").is_null());
+
+    BOOST_CHECK(!ReadJSON("", value));
+    BOOST_CHECK(!ReadJSON("[1,]", value));
+    BOOST_CHECK(!ReadJSON("{\"a\" 1}", value));
+    BOOST_CHECK(!ReadJSON("\"\\xff\"", value));
+
+    // trailing text is ignored, as json_spirit does
+    BOOST_CHECK(ReadJSON("[1] junk", value));
+}
+
+BOOST_AUTO_TEST_CASE(rpcreader_matches_spirit)
+{
+    seed_insecure_rand(true);
+    for (int i = 0; i < 20000; i++)
+    {
+        string str = RandomJSON(0);
+        if (i % 2)
+            Mutate(str);
+        BOOST_CHECK_MESSAGE(SameAsSpirit(str), str);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
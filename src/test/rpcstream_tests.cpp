@@ -0,0 +1,154 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "rpcprotocol.h"
+#include "rpcstream.h"
+#include "util.h"
+
+#include "json/json_spirit_writer_template.h"
+
+using namespace std;
+using namespace json_spirit;
+
+BOOST_AUTO_TEST_SUITE(rpcstream_tests)
+
+// Writes a value through the stream calls, the way a handler would
+static void StreamValue(const Value& value, CJSONStream& stream)
+{
+    switch (value.type())
+    {
+    case obj_type:
+        stream.BeginObject();
+        BOOST_FOREACH(const Pair& pair, value.get_obj())
+        {
+            stream.Key(pair.name_);
+            StreamValue(pair.value_, stream);
+        }
+        stream.EndObject();
+        break;
+    case array_type:
+        stream.BeginArray();
+        BOOST_FOREACH(const Value& v, value.get_array())
+            StreamValue(v, stream);
+        stream.EndArray();
+        break;
+    case str_type:  stream.Write(value.get_str()); break;
+    case bool_type: stream.Write(value.get_bool()); break;
+    case int_type:
+        if (value.is_uint64())
+            stream.Write(value.get_uint64());
+        else
+            stream.Write(value.get_int64());
+        break;
+    case real_type: stream.Write(value.get_real()); break;
+    case null_type: stream.WriteNull(); break;
+    }
+}
+
+static Value SampleValue()
+{
+    Object entry;
+    entry.push_back(Pair("txid", "0123456789abcdef"));
+    entry.push_back(Pair("escaped", "quote\" backslash\\ newline\n tab\t \x01"));
+    entry.push_back(Pair("amount", 12.345678912));
+    entry.push_back(Pair("negative", -0.5));
+    entry.push_back(Pair("confirmations", 42));
+    entry.push_back(Pair("time", (int64_t)1400000000000LL));
+    entry.push_back(Pair("nonce", (uint64_t)0xffffffffffffffffULL));
+    entry.push_back(Pair("generated", true));
+    entry.push_back(Pair("account", Value::null));
+    entry.push_back(Pair("empty", Array()));
+    entry.push_back(Pair("emptyobj", Object()));
+
+    Array a;
+    for (int i = 0; i < 5; i++)
+    {
+        a.push_back(entry);
+        a.push_back(i);
+        a.push_back(Array(1, Value("nested")));
+    }
+    return a;
+}
+
+BOOST_AUTO_TEST_CASE(rpcstream_matches_write_string)
+{
+    Value value = SampleValue();
+
+    CJSONStream stream;
+    StreamValue(value, stream);
+    BOOST_CHECK_EQUAL(stream.GetString(), write_string(value, false));
+    BOOST_CHECK(!stream.IsFlushed());
+
+    // json_spirit values spliced in
+    CJSONStream streamMixed;
+    streamMixed.BeginObject();
+    streamMixed.Pair("result", value);
+    streamMixed.Pair("error", Value::null);
+    streamMixed.Pair("id", 1);
+    streamMixed.EndObject();
+    Object reply;
+    reply.push_back(Pair("result", value));
+    reply.push_back(Pair("error", Value::null));
+    reply.push_back(Pair("id", 1));
+    BOOST_CHECK_EQUAL(streamMixed.GetString(), write_string(Value(reply), false));
+}
+
+static void AppendFlushed(vector<string>* pvFlushed, const string& str)
+{
+    pvFlushed->push_back(str);
+}
+
+BOOST_AUTO_TEST_CASE(rpcstream_flush)
+{
+    Value value = SampleValue();
+    vector<string> vFlushed;
+    CJSONStream stream(boost::bind(&AppendFlushed, &vFlushed, _1), 100);
+    StreamValue(value, stream);
+    BOOST_CHECK(stream.IsFlushed());
+    BOOST_CHECK(vFlushed.size() > 1);
+    stream.Flush();
+    BOOST_CHECK(stream.GetString().empty());
+
+    string strAll;
+    BOOST_FOREACH(const string& str, vFlushed)
+        strAll += str;
+    BOOST_CHECK_EQUAL(strAll, write_string(value, false));
+}
+
+BOOST_AUTO_TEST_CASE(rpcstream_http_chunks)
+{
+    string strBody = write_string(SampleValue(), false) + "\n";
+
+    // split the body at odd places, as a flushing CJSONStream would
+    ostringstream ss;
+    ss << HTTPReplyChunkedHeader(HTTP_OK, true);
+    for (size_t nPos = 0; nPos < strBody.size(); nPos += 97)
+        ss << HTTPChunk(strBody.substr(nPos, 97));
+    ss << HTTPChunk("");
+    ss << "next";
+
+    istringstream in(ss.str());
+    int nProto = 0;
+    BOOST_CHECK_EQUAL(ReadHTTPStatus(in, nProto), HTTP_OK);
+    map<string, string> mapHeaders;
+    string strMessage;
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(in, mapHeaders, strMessage, nProto, MAX_SIZE), HTTP_OK);
+    BOOST_CHECK_EQUAL(strMessage, strBody);
+    BOOST_CHECK_EQUAL(mapHeaders["connection"], "keep-alive");
+
+    // the stream is left at the next reply
+    string strRest;
+    in >> strRest;
+    BOOST_CHECK_EQUAL(strRest, "next");
+
+    // a body over the limit is refused
+    istringstream inLarge(ss.str());
+    ReadHTTPStatus(inLarge, nProto);
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(inLarge, mapHeaders, strMessage, nProto, 100), HTTP_INTERNAL_SERVER_ERROR);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,51 @@
+#include <boost/test/unit_test.hpp>
+
+#include "crypto/sha256.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(sha256_tests)
+
+static void DoubleSHA256(const unsigned char* data, size_t len, unsigned char hash[CSHA256::OUTPUT_SIZE])
+{
+    CSHA256().Write(data, len).Finalize(hash);
+    CSHA256().Write(hash, CSHA256::OUTPUT_SIZE).Finalize(hash);
+}
+
+BOOST_AUTO_TEST_CASE(sha256d56_matches_sha256)
+{
+    for (int i = 0; i < 200; i++)
+    {
+        unsigned char vMessage[56];
+        GetRandBytes(vMessage, sizeof(vMessage));
+
+        unsigned char vExpected[32], vHash[32];
+        DoubleSHA256(vMessage, sizeof(vMessage), vExpected);
+        CSHA256D56(vMessage).Finalize(vMessage + CSHA256D56::PREFIX_SIZE, 1, vHash);
+        BOOST_CHECK(memcmp(vExpected, vHash, 32) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d56_batch)
+{
+    static const int nCount = 100;
+    unsigned char vMessage[56];
+    unsigned char vSuffixes[4 * nCount];
+    unsigned char vHashes[32 * nCount];
+    GetRandBytes(vMessage, sizeof(vMessage));
+    GetRandBytes(vSuffixes, sizeof(vSuffixes));
+
+    CSHA256D56 hasher(vMessage);
+    hasher.Finalize(vSuffixes, nCount, vHashes);
+
+    for (int i = 0; i < nCount; i++)
+    {
+        unsigned char vExpected[32];
+        memcpy(vMessage + CSHA256D56::PREFIX_SIZE, vSuffixes + 4 * i, 4);
+        DoubleSHA256(vMessage, sizeof(vMessage), vExpected);
+        BOOST_CHECK(memcmp(vExpected, vHashes + 32 * i, 32) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
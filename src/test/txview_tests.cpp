@@ -0,0 +1,183 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "main.h"
+#include "txview.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(txview_tests)
+
+static CScript RandomScript()
+{
+    // sizes around the compact size boundary of 253
+    static const unsigned int vSizes[] = { 0, 1, 25, 100, 252, 253, 300 };
+    CScript script;
+    unsigned int nSize = vSizes[insecure_rand() % (sizeof(vSizes) / sizeof(vSizes[0]))];
+    for (unsigned int i = 0; i < nSize; i++)
+        script.push_back((unsigned char)insecure_rand());
+    return script;
+}
+
+static CTransaction RandomTransaction()
+{
+    CTransaction tx;
+    tx.nVersion = 1 + insecure_rand() % 2;
+    tx.nTime = insecure_rand();
+    tx.vin.resize(insecure_rand() % 4);
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        tx.vin[i].prevout.hash = GetRandHash();
+        tx.vin[i].prevout.n = insecure_rand() % 8;
+        tx.vin[i].scriptSig = RandomScript();
+        tx.vin[i].nSequence = insecure_rand();
+    }
+    tx.vout.resize(insecure_rand() % 4);
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        tx.vout[i].nValue = ((int64_t)insecure_rand() << 16) ^ insecure_rand();
+        tx.vout[i].scriptPubKey = RandomScript();
+    }
+    tx.nLockTime = insecure_rand();
+    if (tx.nVersion >= CTransaction::TXDZEEL_VERSION && insecure_rand() % 2)
+        tx.strDZeel = "comment";
+    return tx;
+}
+
+static void CheckView(const CTransaction& tx, const CTransactionView& view)
+{
+    BOOST_CHECK(view.IsValid());
+    BOOST_CHECK_EQUAL(view.GetVersion(), tx.nVersion);
+    BOOST_CHECK_EQUAL(view.GetTime(), tx.nTime);
+    BOOST_CHECK_EQUAL(view.GetLockTime(), tx.nLockTime);
+    BOOST_CHECK_EQUAL(view.GetInputCount(), tx.vin.size());
+    BOOST_CHECK_EQUAL(view.GetOutputCount(), tx.vout.size());
+    BOOST_CHECK_EQUAL(view.size(), ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK(view.GetHash() == tx.GetHash());
+    BOOST_CHECK_EQUAL(view.IsCoinBase(), tx.IsCoinBase());
+    BOOST_CHECK_EQUAL(view.IsCoinStake(), tx.IsCoinStake());
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        CTxOutView out;
+        BOOST_CHECK(view.GetOutput(i, out));
+        BOOST_CHECK_EQUAL(out.GetValue(), tx.vout[i].nValue);
+        BOOST_CHECK(out.GetScriptPubKey() == tx.vout[i].scriptPubKey);
+    }
+    CTxOutView out;
+    BOOST_CHECK(!view.GetOutput(tx.vout.size(), out));
+}
+
+BOOST_AUTO_TEST_CASE(txview_fields)
+{
+    seed_insecure_rand(true);
+    for (int i = 0; i < 200; i++)
+    {
+        CTransaction tx = RandomTransaction();
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+        // trailing bytes belong to whatever follows in the buffer
+        ss << (unsigned char)0x42;
+
+        CheckView(tx, CTransactionView(&ss[0], &ss[0] + ss.size()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(txview_coinbase_coinstake)
+{
+    CTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].nValue = 50 * COIN;
+
+    CTransaction txCoinStake;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout = COutPoint(GetRandHash(), 1);
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1].nValue = 10 * COIN;
+
+    CTransaction vtx[] = { txCoinBase, txCoinStake };
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << vtx[i];
+        CheckView(vtx[i], CTransactionView(&ss[0], &ss[0] + ss.size()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(txview_truncated)
+{
+    seed_insecure_rand(true);
+    for (int i = 0; i < 50; i++)
+    {
+        CTransaction tx = RandomTransaction();
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+        for (unsigned int nSize = 0; nSize < ss.size(); nSize++)
+        {
+            CTransactionView view(&ss[0], &ss[0] + nSize);
+            BOOST_CHECK(!view.IsValid());
+            BOOST_CHECK(view.IsTruncated());
+        }
+    }
+
+    // oversized and non-canonical counts are malformed, not short
+    unsigned char vTooLarge[] = { 1, 0, 0, 0, 0, 0, 0, 0, 0xfe, 0xff, 0xff, 0xff, 0xff };
+    CTransactionView viewTooLarge((const char*)vTooLarge, (const char*)vTooLarge + sizeof(vTooLarge));
+    BOOST_CHECK(!viewTooLarge.IsValid());
+    BOOST_CHECK(!viewTooLarge.IsTruncated());
+
+    unsigned char vNonCanonical[] = { 1, 0, 0, 0, 0, 0, 0, 0, 0xfd, 0x01, 0x00 };
+    CTransactionView viewNonCanonical((const char*)vNonCanonical, (const char*)vNonCanonical + sizeof(vNonCanonical));
+    BOOST_CHECK(!viewNonCanonical.IsValid());
+    BOOST_CHECK(!viewNonCanonical.IsTruncated());
+}
+
+BOOST_AUTO_TEST_CASE(blockview)
+{
+    seed_insecure_rand(true);
+    CBlock block;
+    block.nVersion = 7;
+    block.hashPrevBlock = GetRandHash();
+    block.hashMerkleRoot = GetRandHash();
+    block.nTime = insecure_rand();
+    block.nBits = insecure_rand();
+    block.nNonce = insecure_rand();
+    for (int i = 0; i < 10; i++)
+        block.vtx.push_back(RandomTransaction());
+    block.vchBlockSig.resize(72, 0x30);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    CBlockView view(&ss[0], &ss[0] + ss.size());
+    BOOST_CHECK(view.IsValid());
+
+    CBlockHeaderView header = view.GetHeader();
+    BOOST_CHECK_EQUAL(header.GetVersion(), block.nVersion);
+    BOOST_CHECK(header.GetPrevBlockHash() == block.hashPrevBlock);
+    BOOST_CHECK(header.GetMerkleRoot() == block.hashMerkleRoot);
+    BOOST_CHECK_EQUAL(header.GetBlockTime(), block.GetBlockTime());
+    BOOST_CHECK_EQUAL(header.GetBits(), block.nBits);
+    BOOST_CHECK_EQUAL(header.GetNonce(), block.nNonce);
+    BOOST_CHECK(header.GetHash() == block.GetHash());
+
+    BOOST_CHECK_EQUAL(view.GetTransactionCount(), block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        CTransactionView tx;
+        BOOST_CHECK(view.GetTransaction(i, tx));
+        CheckView(block.vtx[i], tx);
+
+        CTransactionView txFound;
+        BOOST_CHECK(view.FindTransaction(block.vtx[i].GetHash(), txFound));
+        BOOST_CHECK(txFound.begin() == tx.begin());
+    }
+    CTransactionView tx;
+    BOOST_CHECK(!view.GetTransaction(block.vtx.size(), tx));
+    BOOST_CHECK(!view.FindTransaction(GetRandHash(), tx));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,8 @@
 #include <boost/test/unit_test.hpp>
 
+#include "bignum.h"
 #include "uint256.h"
+#include "util.h"
 
 BOOST_AUTO_TEST_SUITE(uint256_tests)
 
@@ -15,4 +17,78 @@ BOOST_AUTO_TEST_CASE(uint256_equality)
     BOOST_CHECK(num1+num2 == num3+num2);
 }
 
+static uint256 RandomUint256(unsigned int nBits)
+{
+    uint256 n;
+    GetRandBytes(n.begin(), 32);
+    if (nBits < 256)
+        n >>= 256 - nBits;
+    return n;
+}
+
+BOOST_AUTO_TEST_CASE(uint256_arith_matches_bignum)
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        uint256 a = RandomUint256(1 + GetRand(256));
+        uint256 b = RandomUint256(1 + GetRand(256));
+        uint32_t c = (uint32_t)GetRand(0xffffffff);
+
+        CBigNum bnA(a);
+        BOOST_CHECK(a.bits() == (unsigned int)BN_num_bits(&bnA));
+        BOOST_CHECK((a * b) == CBigNum(CBigNum(a) * CBigNum(b)).getuint256());
+        BOOST_CHECK((a * c) == CBigNum(CBigNum(a) * CBigNum(c)).getuint256());
+        if (b != 0)
+            BOOST_CHECK((a / b) == CBigNum(CBigNum(a) / CBigNum(b)).getuint256());
+        if (a != 0)
+            BOOST_CHECK((b / a) == CBigNum(CBigNum(b) / CBigNum(a)).getuint256());
+    }
+
+    uint256 one = 1;
+    BOOST_CHECK(~uint256(0) / one == ~uint256(0));
+    BOOST_CHECK(uint256(7) / ~uint256(0) == 0);
+    BOOST_CHECK_THROW(one / uint256(0), uint_error);
+}
+
+BOOST_AUTO_TEST_CASE(uint256_compact_matches_bignum)
+{
+    for (int i = 0; i < 5000; i++)
+    {
+        // sizes around and beyond 32 bytes, every kind of mantissa
+        unsigned int nCompact = (GetRand(40) << 24) | GetRand(0x01000000);
+        if (i % 3 == 0)
+            nCompact &= 0xff00ffff;
+
+        bool fNegative, fOverflow;
+        uint256 n;
+        n.SetCompact(nCompact, &fNegative, &fOverflow);
+        CBigNum bn;
+        bn.SetCompact(nCompact);
+
+        BOOST_CHECK(fNegative == (bn < 0));
+        BOOST_CHECK(fOverflow == (BN_num_bits(&bn) > 256));
+        if (!fOverflow)
+        {
+            BOOST_CHECK(n == bn.getuint256());
+            BOOST_CHECK(n.GetCompact(fNegative) == bn.GetCompact());
+        }
+    }
+
+    for (int i = 0; i < 1000; i++)
+    {
+        uint256 n = RandomUint256(GetRand(257));
+        BOOST_CHECK(n.GetCompact() == CBigNum(n).GetCompact());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(uint256_block_trust_matches_bignum)
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        uint256 bnTarget = RandomUint256(1 + GetRand(256));
+        uint256 bnTrust = (~bnTarget / (bnTarget + 1)) + 1;
+        BOOST_CHECK(bnTrust == ((CBigNum(1) << 256) / (CBigNum(bnTarget) + 1)).getuint256());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,177 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include "walletjournal.h"
+#include "util.h"
+
+using namespace std;
+
+static CWalletJournal::Data ToData(const string& str)
+{
+    return CWalletJournal::Data(str.begin(), str.end());
+}
+
+static void Put(CWalletJournal& journal, const string& strKey, const string& strValue)
+{
+    CWalletJournal::Batch batch(1);
+    batch[0].fErase = false;
+    batch[0].key = ToData(strKey);
+    batch[0].value = ToData(strValue);
+    BOOST_CHECK(journal.Write(batch));
+}
+
+static string Get(const CWalletJournal& journal, const string& strKey)
+{
+    CWalletJournal::Data value;
+    if (!journal.Read(ToData(strKey), value))
+        return "<none>";
+    return string(value.begin(), value.end());
+}
+
+struct JournalPath
+{
+    boost::filesystem::path path;
+    JournalPath() : path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("walletjournal-%%%%%%%%")) {}
+    ~JournalPath()
+    {
+        boost::filesystem::path pathDir = path.parent_path();
+        for (boost::filesystem::directory_iterator it(pathDir); it != boost::filesystem::directory_iterator(); ++it)
+            if (it->path().filename().string().find(path.filename().string()) == 0)
+                boost::filesystem::remove(it->path());
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(walletjournal_tests)
+
+BOOST_AUTO_TEST_CASE(walletjournal_reopen)
+{
+    JournalPath tmp;
+    {
+        CWalletJournal journal(tmp.path, false);
+        BOOST_CHECK(journal.Open());
+        Put(journal, "a", "1");
+        Put(journal, "b", "2");
+        Put(journal, "a", "3");
+
+        CWalletJournal::Batch batch(2);
+        batch[0].fErase = true;
+        batch[0].key = ToData("b");
+        batch[1].fErase = false;
+        batch[1].key = ToData("c");
+        batch[1].value = ToData("4");
+        BOOST_CHECK(journal.Write(batch));
+    }
+
+    CWalletJournal journal(tmp.path, false);
+    BOOST_CHECK(journal.Open());
+    BOOST_CHECK_EQUAL(journal.size(), 2U);
+    BOOST_CHECK_EQUAL(Get(journal, "a"), "3");
+    BOOST_CHECK_EQUAL(Get(journal, "b"), "<none>");
+    BOOST_CHECK_EQUAL(Get(journal, "c"), "4");
+}
+
+BOOST_AUTO_TEST_CASE(walletjournal_torn_write)
+{
+    JournalPath tmp;
+    {
+        CWalletJournal journal(tmp.path, false);
+        BOOST_CHECK(journal.Open());
+        Put(journal, "a", "1");
+        Put(journal, "b", "2");
+    }
+    boost::filesystem::resize_file(tmp.path, boost::filesystem::file_size(tmp.path) - 1);
+
+    // the last write is lost, the journal stays usable
+    {
+        CWalletJournal journal(tmp.path, false);
+        BOOST_CHECK(journal.Open());
+        BOOST_CHECK_EQUAL(Get(journal, "a"), "1");
+        BOOST_CHECK_EQUAL(Get(journal, "b"), "<none>");
+        Put(journal, "c", "3");
+    }
+    CWalletJournal journal(tmp.path, false);
+    BOOST_CHECK(journal.Open());
+    BOOST_CHECK_EQUAL(journal.size(), 2U);
+    BOOST_CHECK_EQUAL(Get(journal, "c"), "3");
+}
+
+BOOST_AUTO_TEST_CASE(walletjournal_bad_size)
+{
+    JournalPath tmp;
+    {
+        CWalletJournal journal(tmp.path, false);
+        BOOST_CHECK(journal.Open());
+        Put(journal, "a", "1");
+        Put(journal, "b", "2");
+    }
+    uintmax_t nSize = boost::filesystem::file_size(tmp.path);
+
+    // a size field that doesn't check out before the end of the file is
+    // corruption, not a torn write: the load fails and nothing is cut off
+    FILE* file = fopen(tmp.path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    const unsigned char pchZero[4] = { 0, 0, 0, 0 };
+    fseek(file, 8, SEEK_SET);
+    fwrite(pchZero, 1, 4, file);
+    fclose(file);
+
+    CWalletJournal journal(tmp.path, false);
+    BOOST_CHECK(!journal.Open());
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(tmp.path), nSize);
+}
+
+BOOST_AUTO_TEST_CASE(walletjournal_order)
+{
+    JournalPath tmp;
+    CWalletJournal journal(tmp.path, false);
+    BOOST_CHECK(journal.Open());
+
+    // keys compare as unsigned bytes, like Berkeley DB
+    Put(journal, "k\x80", "2");
+    Put(journal, "k\x01", "1");
+    Put(journal, "j", "0");
+
+    CWalletJournal::Data key, keyNext, value;
+    vector<string> vValues;
+    bool fStarted = false;
+    while (journal.Next(key, !fStarted, keyNext, value))
+    {
+        fStarted = true;
+        key = keyNext;
+        vValues.push_back(string(value.begin(), value.end()));
+    }
+    BOOST_CHECK_EQUAL(vValues.size(), 3U);
+    BOOST_CHECK(vValues.size() == 3 && vValues[0] == "0" && vValues[1] == "1" && vValues[2] == "2");
+
+    BOOST_CHECK(journal.Next(ToData("k\x02"), true, keyNext, value));
+    BOOST_CHECK(string(value.begin(), value.end()) == "2");
+}
+
+BOOST_AUTO_TEST_CASE(walletjournal_compact)
+{
+    JournalPath tmp;
+    {
+        CWalletJournal journal(tmp.path, false);
+        BOOST_CHECK(journal.Open());
+        for (int i = 0; i < 100; i++)
+            Put(journal, "a", strprintf("%d", i));
+        Put(journal, "pool1", "x");
+        Put(journal, "pool2", "y");
+
+        uint64_t nSize = boost::filesystem::file_size(tmp.path);
+        BOOST_CHECK(journal.Compact("pool"));
+        BOOST_CHECK(boost::filesystem::file_size(tmp.path) < nSize);
+        BOOST_CHECK_EQUAL(journal.size(), 1U);
+        Put(journal, "b", "1");
+    }
+
+    CWalletJournal journal(tmp.path, false);
+    BOOST_CHECK(journal.Open());
+    BOOST_CHECK_EQUAL(journal.size(), 2U);
+    BOOST_CHECK_EQUAL(Get(journal, "a"), "99");
+    BOOST_CHECK_EQUAL(Get(journal, "b"), "1");
+    BOOST_CHECK_EQUAL(Get(journal, "pool1"), "<none>");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
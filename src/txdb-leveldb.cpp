@@ -17,6 +17,7 @@
 #include "kernel.h"
 #include "checkpoints.h"
 #include "txdb.h"
+#include "indexsnapshot.h"
 #include "util.h"
 #include "main.h"
 #include "chainparams.h"
@@ -336,12 +337,13 @@ static CBlockIndex *InsertBlockIndex(uint256 hash)
         return NULL;
 
     // Return existing
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    LOCK_EXCLUSIVE(cs_blockindex);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
     if (mi != mapBlockIndex.end())
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = new (blockIndexArena.Allocate()) CBlockIndex();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
@@ -350,80 +352,145 @@ static CBlockIndex *InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
-bool CTxDB::LoadBlockIndex()
+static const string BLOCKINDEX_KEY_PREFIX = string("\x0a") + "blockindex";
+static const size_t BLOCKINDEX_BATCH_SIZE = 50000;
+
+struct CBlockIndexEntry
 {
-    if (mapBlockIndex.size() > 0) {
-        // Already loaded once in this session. It can happen during migration
-        // from BDB.
-        return true;
+    string strKey;
+    string strValue;
+    uint256 hash;
+    CDiskBlockIndex diskindex;
+    bool fValid;
+
+    CBlockIndexEntry() : fValid(false) {}
+};
+
+// Deserialize vEntries[nBegin, nEnd). The block hash is the second half of the
+// key, so entries are only hashed again when -fastindex is turned off.
+static void DecodeBlockIndexEntries(vector<CBlockIndexEntry>& vEntries, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++)
+    {
+        CBlockIndexEntry& entry = vEntries[i];
+        try {
+            CDataStream ssKey(entry.strKey.data(), entry.strKey.data() + entry.strKey.size(), SER_DISK, CLIENT_VERSION);
+            string strType;
+            ssKey >> strType >> entry.hash;
+            CDataStream ssValue(entry.strValue.data(), entry.strValue.data() + entry.strValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> entry.diskindex;
+            entry.fValid = fUseFastIndex || entry.diskindex.GetBlockHash() == entry.hash;
+        }
+        catch (std::exception& e) {
+            entry.fValid = false;
+        }
+        string().swap(entry.strKey);
+        string().swap(entry.strValue);
     }
+}
+
+bool CTxDB::LoadBlockIndexGuts()
+{
     // The block index is an in-memory structure that maps hashes to on-disk
     // locations where the contents of the block can be found. Here, we scan it
     // out of the DB and into mapBlockIndex.
+    int64_t nReadMillis = 0, nDecodeMillis = 0, nInsertMillis = 0;
+    int nThreads = std::max(1, std::min(8, (int)boost::thread::hardware_concurrency()));
     leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
     // Seek to start key.
     CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
     ssStartKey << make_pair(string("blockindex"), uint256(0));
     iterator->Seek(ssStartKey.str());
-    // Now read each entry.
-    while (iterator->Valid())
+    // Read the entries in batches. Each batch is decoded by nThreads workers
+    // and then linked into mapBlockIndex on this thread.
+    bool fEnd = false;
+    while (!fEnd)
     {
         boost::this_thread::interruption_point();
-        // Unpack keys and values.
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(iterator->key().data(), iterator->key().size());
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.write(iterator->value().data(), iterator->value().size());
-        string strType;
-        ssKey >> strType;
-        // Did we reach the end of the data to read?
-        if (strType != "blockindex")
-            break;
-        CDiskBlockIndex diskindex;
-        ssValue >> diskindex;
-
-        uint256 blockHash = diskindex.GetBlockHash();
-
-        // Construct block index object
-        CBlockIndex* pindexNew    = InsertBlockIndex(blockHash);
-        pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-        pindexNew->pnext          = InsertBlockIndex(diskindex.hashNext);
-        pindexNew->nFile          = diskindex.nFile;
-        pindexNew->nBlockPos      = diskindex.nBlockPos;
-        pindexNew->nHeight        = diskindex.nHeight;
-        pindexNew->nMint          = diskindex.nMint;
-        pindexNew->nMoneySupply   = diskindex.nMoneySupply;
-        pindexNew->nFlags         = diskindex.nFlags;
-        pindexNew->nStakeModifier = diskindex.nStakeModifier;
-        pindexNew->prevoutStake   = diskindex.prevoutStake;
-        pindexNew->nStakeTime     = diskindex.nStakeTime;
-        pindexNew->hashProof      = diskindex.hashProof;
-        pindexNew->nVersion       = diskindex.nVersion;
-        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-        pindexNew->nTime          = diskindex.nTime;
-        pindexNew->nBits          = diskindex.nBits;
-        pindexNew->nNonce         = diskindex.nNonce;
-
-        // Watch for genesis block
-        if (pindexGenesisBlock == NULL && blockHash == Params().HashGenesisBlock())
-            pindexGenesisBlock = pindexNew;
-
-        if (!pindexNew->CheckIndex()) {
-            delete iterator;
-            return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
+        int64_t nBatchStart = GetTimeMillis();
+        vector<CBlockIndexEntry> vEntries;
+        vEntries.reserve(BLOCKINDEX_BATCH_SIZE);
+        while (vEntries.size() < BLOCKINDEX_BATCH_SIZE)
+        {
+            if (!iterator->Valid())
+            {
+                fEnd = true;
+                break;
+            }
+            // Keys are ("blockindex", hash), stop at the first key of another type
+            leveldb::Slice key = iterator->key();
+            if (key.size() < BLOCKINDEX_KEY_PREFIX.size() || memcmp(key.data(), BLOCKINDEX_KEY_PREFIX.data(), BLOCKINDEX_KEY_PREFIX.size()) != 0)
+            {
+                fEnd = true;
+                break;
+            }
+            vEntries.push_back(CBlockIndexEntry());
+            vEntries.back().strKey.assign(key.data(), key.size());
+            vEntries.back().strValue.assign(iterator->value().data(), iterator->value().size());
+            iterator->Next();
         }
+        int64_t nDecodeStart = GetTimeMillis();
+        nReadMillis += nDecodeStart - nBatchStart;
 
-        // NavCoin: build setStakeSeen
-        if (pindexNew->IsProofOfStake())
-            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        size_t nPerThread = (vEntries.size() + nThreads - 1) / nThreads;
+        boost::thread_group decoders;
+        for (int i = 1; i < nThreads && i * nPerThread < vEntries.size(); i++)
+            decoders.create_thread(boost::bind(&DecodeBlockIndexEntries, boost::ref(vEntries), i * nPerThread, std::min(vEntries.size(), (i + 1) * nPerThread)));
+        DecodeBlockIndexEntries(vEntries, 0, std::min(vEntries.size(), nPerThread));
+        decoders.join_all();
 
-        iterator->Next();
+        int64_t nInsertStart = GetTimeMillis();
+        nDecodeMillis += nInsertStart - nDecodeStart;
+
+        BOOST_FOREACH(const CBlockIndexEntry& entry, vEntries)
+        {
+            if (!entry.fValid) {
+                delete iterator;
+                return error("LoadBlockIndex() : invalid block index entry %s", entry.hash.ToString());
+            }
+            const CDiskBlockIndex& diskindex = entry.diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew    = InsertBlockIndex(entry.hash);
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext          = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nBlockPos      = diskindex.nBlockPos;
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nMint          = diskindex.nMint;
+            pindexNew->nMoneySupply   = diskindex.nMoneySupply;
+            pindexNew->nFlags         = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake   = diskindex.prevoutStake;
+            pindexNew->nStakeTime     = diskindex.nStakeTime;
+            pindexNew->hashProof      = diskindex.hashProof;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+
+            // Watch for genesis block
+            if (pindexGenesisBlock == NULL && entry.hash == Params().HashGenesisBlock())
+                pindexGenesisBlock = pindexNew;
+
+            if (!pindexNew->CheckIndex()) {
+                delete iterator;
+                return error("LoadBlockIndex() : CheckIndex failed at %d", pindexNew->nHeight);
+            }
+
+            // NavCoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        }
+        nInsertMillis += GetTimeMillis() - nInsertStart;
     }
     delete iterator;
 
     boost::this_thread::interruption_point();
 
     // Calculate nChainTrust
+    int64_t nTrustStart = GetTimeMillis();
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
@@ -437,6 +504,31 @@ bool CTxDB::LoadBlockIndex()
         CBlockIndex* pindex = item.second;
         pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + pindex->GetBlockTrust();
     }
+    LogPrintf("LoadBlockIndex(): read %dms, decode %dms (%d threads), insert %dms, chain trust %dms\n",
+      nReadMillis, nDecodeMillis, nThreads, nInsertMillis, GetTimeMillis() - nTrustStart);
+
+    return true;
+}
+
+bool CTxDB::LoadBlockIndex()
+{
+    if (mapBlockIndex.size() > 0) {
+        // Already loaded once in this session. It can happen during migration
+        // from BDB.
+        return true;
+    }
+    int64_t nStart = GetTimeMillis();
+    bool fSnapshot = false;
+    if (GetBoolArg("-indexsnapshot", false))
+    {
+        uint256 hashBestChainDB = 0;
+        ReadHashBestChain(hashBestChainDB);
+        fSnapshot = LoadBlockIndexSnapshot(hashBestChainDB);
+    }
+    else
+        RemoveBlockIndexSnapshot();
+    if (!fSnapshot && !LoadBlockIndexGuts())
+        return false;
 
     // Load hashBestChain pointer to end of best chain
     if (!ReadHashBestChain(hashBestChain))
@@ -447,13 +539,19 @@ bool CTxDB::LoadBlockIndex()
     }
     if (!mapBlockIndex.count(hashBestChain))
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
-    pindexBest = mapBlockIndex[hashBestChain];
-    nBestHeight = pindexBest->nHeight;
-    nBestChainTrust = pindexBest->nChainTrust;
+    {
+        LOCK_EXCLUSIVE(cs_blockindex);
+        pindexBest = mapBlockIndex[hashBestChain];
+        chainActive.SetTip(pindexBest);
+        nBestHeight = pindexBest->nHeight;
+        nBestChainTrust = pindexBest->nChainTrust;
+    }
 
     LogPrintf("LoadBlockIndex(): hashBestChain=%s  height=%d  trust=%s  date=%s\n",
       hashBestChain.ToString(), nBestHeight, CBigNum(nBestChainTrust).ToString(),
       DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()));
+    LogPrintf("LoadBlockIndex(): %u entries in %dms, %uKiB of index entries\n",
+      mapBlockIndex.size(), GetTimeMillis() - nStart, blockIndexArena.GetMemoryUsage() / 1024);
 
     // NavCoin: load hashSyncCheckpoint
     if (!ReadSyncCheckpoint(Checkpoints::hashSyncCheckpoint))
@@ -465,27 +563,52 @@ bool CTxDB::LoadBlockIndex()
     ReadBestInvalidTrust(bnBestInvalidTrust);
     nBestInvalidTrust = bnBestInvalidTrust.getuint256();
 
-    // Verify blocks in the best chain
+    // Verify blocks in the best chain. The cheap levels only read block files
+    // and are left to ThreadVerifyBlocks once the node is up, the others look
+    // at the transaction index and have to run before anything changes it.
     int nCheckLevel = GetArg("-checklevel", 1);
-    int nCheckDepth = GetArg( "-checkblocks", 500);
+    if (nCheckLevel > MAX_BACKGROUND_CHECK_LEVEL)
+    {
+        int64_t nVerifyStart = GetTimeMillis();
+        if (!VerifyBlockIndex(nCheckLevel, GetArg("-checkblocks", 500)))
+            return false;
+        LogPrintf("LoadBlockIndex(): verified in %dms\n", GetTimeMillis() - nVerifyStart);
+    }
+
+    return true;
+}
+
+bool CTxDB::VerifyBlockIndex(int nCheckLevel, int nCheckDepth, bool fBackground)
+{
+    CBlockIndex* pindexTip;
+    int nTipHeight;
+    {
+        LOCK_SHARED(cs_blockindex);
+        pindexTip = pindexBest;
+        nTipHeight = nBestHeight;
+    }
+    if (pindexTip == NULL)
+        return true;
+
     if (nCheckDepth == 0)
         nCheckDepth = 1000000000; // suffices until the year 19000
-    if (nCheckDepth > nBestHeight)
-        nCheckDepth = nBestHeight;
+    if (nCheckDepth > nTipHeight)
+        nCheckDepth = nTipHeight;
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CBlockIndex* pindexFork = NULL;
     map<pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
-    for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
+    for (CBlockIndex* pindex = pindexTip; pindex && pindex->pprev; pindex = pindex->pprev)
     {
         boost::this_thread::interruption_point();
-        if (pindex->nHeight < nBestHeight-nCheckDepth)
+        if (pindex->nHeight < nTipHeight-nCheckDepth)
             break;
         CBlock block;
         if (!block.ReadFromDisk(pindex))
             return error("LoadBlockIndex() : block.ReadFromDisk failed");
         // check level 1: verify block validity
         // check level 7: verify block signature too
-        if (nCheckLevel>0 && !block.CheckBlock(true, true, (nCheckLevel>6)))
+        // Once the node runs, the lock tracker holds live locks an old block can conflict with
+        if (nCheckLevel>0 && !block.CheckBlock(true, true, (nCheckLevel>6), !fBackground))
         {
             LogPrintf("LoadBlockIndex() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexFork = pindex->pprev;
@@ -585,6 +708,22 @@ bool CTxDB::LoadBlockIndex()
     {
         boost::this_thread::interruption_point();
         // Reorg back to the fork
+        LOCK(cs_main);
+        if (fBackground)
+        {
+            // blocks connected since pindexTip was read are checked when they connect,
+            // a reorg away from pindexTip may already have dropped the bad block
+            bool fStillBest;
+            {
+                LOCK_SHARED(cs_blockindex);
+                fStillBest = chainActive.Contains(pindexTip);
+            }
+            if (!fStillBest)
+            {
+                LogPrintf("LoadBlockIndex() : *** best chain no longer contains block %d, not moving back to block %d\n", pindexTip->nHeight, pindexFork->nHeight);
+                return true;
+            }
+        }
         LogPrintf("LoadBlockIndex() : *** moving best chain pointer back to block %d\n", pindexFork->nHeight);
         CBlock block;
         if (!block.ReadFromDisk(pindexFork))
@@ -204,6 +204,12 @@ public:
     bool ReadCheckpointPubKey(std::string& strPubKey);
     bool WriteCheckpointPubKey(const std::string& strPubKey);
     bool LoadBlockIndex();
+    /**
+     * Check the last nCheckDepth blocks of the best chain (0 = all) and move the tip back before the first bad one.
+     * fBackground is for a node that is already running: the tip is only moved back if the checked blocks are still
+     * the best chain.
+     */
+    bool VerifyBlockIndex(int nCheckLevel, int nCheckDepth, bool fBackground=false);
 private:
     bool LoadBlockIndexGuts();
 };
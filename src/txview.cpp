@@ -0,0 +1,352 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txview.h"
+
+#include "blockstore.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "hashblock.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+// Bounds checked reading of serialized data, the view counterpart of the
+// stream operators: a short buffer or a bad size fails instead of throwing
+class CViewCursor
+{
+public:
+    const unsigned char* p;
+    const unsigned char* pend;
+    bool fFailed;
+    bool fTruncated;
+
+    CViewCursor(const unsigned char* pbegin, const unsigned char* pendIn) : p(pbegin), pend(pendIn), fFailed(false), fTruncated(false) {}
+
+    bool Skip(uint64_t n)
+    {
+        if (fFailed)
+            return false;
+        if ((uint64_t)(pend - p) < n)
+        {
+            fFailed = fTruncated = true;
+            return false;
+        }
+        p += n;
+        return true;
+    }
+
+    // same rules as ::ReadCompactSize
+    bool ReadCompactSize(uint64_t& nRet)
+    {
+        const unsigned char* pstart = p;
+        if (!Skip(1))
+            return false;
+        unsigned char chSize = *pstart;
+        uint64_t nMin = 0;
+        if (chSize < 253)
+            nRet = chSize;
+        else if (chSize == 253)
+        {
+            if (!Skip(2))
+                return false;
+            nRet = pstart[1] | ((uint64_t)pstart[2] << 8);
+            nMin = 253;
+        }
+        else if (chSize == 254)
+        {
+            if (!Skip(4))
+                return false;
+            nRet = ReadLE32(pstart + 1);
+            nMin = 0x10000;
+        }
+        else
+        {
+            if (!Skip(8))
+                return false;
+            nRet = ReadLE64(pstart + 1);
+            nMin = 0x100000000ULL;
+        }
+        if (nRet < nMin || nRet > (uint64_t)MAX_SIZE)
+        {
+            fFailed = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool SkipVector()
+    {
+        uint64_t nSize;
+        return ReadCompactSize(nSize) && Skip(nSize);
+    }
+};
+
+//
+// CTransactionView
+//
+
+CTransactionView::CTransactionView(const char* pbufbegin, const char* pbufend)
+    : pbegin((const unsigned char*)pbufbegin), pend(NULL), pvin(NULL), pvout(NULL), plocktime(NULL), nInputs(0), nOutputs(0), fTruncated(false)
+{
+    CViewCursor cursor(pbegin, (const unsigned char*)pbufend);
+    if (Parse(cursor))
+        pend = cursor.p;
+    else
+        fTruncated = cursor.fTruncated;
+}
+
+bool CTransactionView::Parse(CViewCursor& cursor)
+{
+    uint64_t nCount;
+
+    // nVersion, nTime
+    if (!cursor.Skip(8))
+        return false;
+
+    if (!cursor.ReadCompactSize(nCount))
+        return false;
+    nInputs = nCount;
+    pvin = cursor.p;
+    for (unsigned int i = 0; i < nInputs; i++)
+    {
+        // prevout, scriptSig, nSequence
+        if (!cursor.Skip(36) || !cursor.SkipVector() || !cursor.Skip(4))
+            return false;
+    }
+
+    if (!cursor.ReadCompactSize(nCount))
+        return false;
+    nOutputs = nCount;
+    pvout = cursor.p;
+    for (unsigned int i = 0; i < nOutputs; i++)
+    {
+        // nValue, scriptPubKey
+        if (!cursor.Skip(8) || !cursor.SkipVector())
+            return false;
+    }
+
+    plocktime = cursor.p;
+    if (!cursor.Skip(4))
+        return false;
+    if (GetVersion() >= CTransaction::TXDZEEL_VERSION && !cursor.SkipVector())
+        return false;
+    return true;
+}
+
+int CTransactionView::GetVersion() const
+{
+    return (int)ReadLE32(pbegin);
+}
+
+unsigned int CTransactionView::GetTime() const
+{
+    return ReadLE32(pbegin + 4);
+}
+
+unsigned int CTransactionView::GetLockTime() const
+{
+    return ReadLE32(plocktime);
+}
+
+bool CTransactionView::GetOutput(unsigned int n, CTxOutView& outRet) const
+{
+    if (!IsValid() || n >= nOutputs)
+        return false;
+
+    // already checked by Parse
+    CViewCursor cursor(pvout, pend);
+    uint64_t nSize;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        cursor.Skip(8);
+        cursor.SkipVector();
+    }
+    int64_t nValue = (int64_t)ReadLE64(cursor.p);
+    cursor.Skip(8);
+    cursor.ReadCompactSize(nSize);
+    outRet = CTxOutView(nValue, cursor.p, cursor.p + nSize);
+    return true;
+}
+
+uint256 CTransactionView::GetHash() const
+{
+    return Hash(pbegin, pend);
+}
+
+// COutPoint::IsNull of a serialized prevout
+static bool IsNullPrevout(const unsigned char* p)
+{
+    static const unsigned char vNull[36] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0xff, 0xff, 0xff, 0xff };
+    return memcmp(p, vNull, sizeof(vNull)) == 0;
+}
+
+bool CTransactionView::IsCoinBase() const
+{
+    return IsValid() && nInputs == 1 && IsNullPrevout(pvin) && nOutputs >= 1;
+}
+
+bool CTransactionView::IsCoinStake() const
+{
+    // the first output is empty
+    CTxOutView out;
+    return IsValid() && nInputs > 0 && !IsNullPrevout(pvin) && nOutputs >= 2 &&
+           GetOutput(0, out) && out.GetValue() == 0 && out.ScriptBegin() == out.ScriptEnd();
+}
+
+//
+// CBlockHeaderView
+//
+
+int CBlockHeaderView::GetVersion() const
+{
+    return (int)ReadLE32(pbegin);
+}
+
+uint256 CBlockHeaderView::GetPrevBlockHash() const
+{
+    uint256 hash;
+    memcpy(hash.begin(), pbegin + 4, 32);
+    return hash;
+}
+
+uint256 CBlockHeaderView::GetMerkleRoot() const
+{
+    uint256 hash;
+    memcpy(hash.begin(), pbegin + 36, 32);
+    return hash;
+}
+
+int64_t CBlockHeaderView::GetBlockTime() const
+{
+    return (int64_t)ReadLE32(pbegin + 68);
+}
+
+unsigned int CBlockHeaderView::GetBits() const
+{
+    return ReadLE32(pbegin + 72);
+}
+
+unsigned int CBlockHeaderView::GetNonce() const
+{
+    return ReadLE32(pbegin + 76);
+}
+
+uint256 CBlockHeaderView::GetHash() const
+{
+    if (GetVersion() > 6)
+        return Hash(pbegin, pbegin + SIZE);
+    else
+        return Hash9(pbegin, pbegin + SIZE);
+}
+
+//
+// CBlockView
+//
+
+CBlockView::CBlockView(const char* pbufbegin, const char* pbufendIn)
+    : pbegin((const unsigned char*)pbufbegin), pbufend((const unsigned char*)pbufendIn), pvtx(NULL), nTransactions(0)
+{
+    CViewCursor cursor(pbegin, pbufend);
+    uint64_t nCount;
+    if (cursor.Skip(CBlockHeaderView::SIZE) && cursor.ReadCompactSize(nCount))
+    {
+        nTransactions = nCount;
+        pvtx = cursor.p;
+    }
+}
+
+bool CBlockView::GetTransaction(unsigned int nIndex, CTransactionView& txRet) const
+{
+    if (!IsValid() || nIndex >= nTransactions)
+        return false;
+    const unsigned char* p = pvtx;
+    for (unsigned int i = 0; ; i++)
+    {
+        CTransactionView tx((const char*)p, (const char*)pbufend);
+        if (!tx.IsValid())
+            return false;
+        if (i == nIndex)
+        {
+            txRet = tx;
+            return true;
+        }
+        p = tx.end();
+    }
+}
+
+bool CBlockView::FindTransaction(const uint256& hash, CTransactionView& txRet) const
+{
+    if (!IsValid())
+        return false;
+    const unsigned char* p = pvtx;
+    for (unsigned int i = 0; i < nTransactions; i++)
+    {
+        CTransactionView tx((const char*)p, (const char*)pbufend);
+        if (!tx.IsValid())
+            return false;
+        if (tx.GetHash() == hash)
+        {
+            txRet = tx;
+            return true;
+        }
+        p = tx.end();
+    }
+    return false;
+}
+
+//
+// CDiskTxBytes
+//
+
+bool CDiskTxBytes::ReadFromDisk(const CDiskTxPos& pos)
+{
+    nBlockPos = pos.nBlockPos;
+    nTxPos = pos.nTxPos;
+
+    if (IsCompressedBlockFile(pos.nFile))
+    {
+        // the whole block is decompressed anyway, view it in place
+        if (!ReadCompressedTx(pos.nFile, pos.nTxPos, pBlock, nTxOffset))
+            return error("CDiskTxBytes::ReadFromDisk() : ReadCompressedTx failed");
+        if (pBlock->size() < CBlockHeaderView::SIZE || nTxOffset < CBlockHeaderView::SIZE || !GetTransaction().IsValid())
+            return error("CDiskTxBytes::ReadFromDisk() : deserialize error");
+        return true;
+    }
+
+    pBlock.reset();
+    CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, pos.nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("CDiskTxBytes::ReadFromDisk() : OpenBlockFile failed");
+
+    nTxOffset = CBlockHeaderView::SIZE;
+    vData.resize(nTxOffset);
+    if (fread(&vData[0], 1, nTxOffset, filein) != nTxOffset)
+        return error("CDiskTxBytes::ReadFromDisk() : read header failed");
+    if (fseek(filein, pos.nTxPos, SEEK_SET) != 0)
+        return error("CDiskTxBytes::ReadFromDisk() : fseek failed");
+
+    // The size of the transaction is only known once it is parsed, read
+    // enough for most and double until it is complete
+    size_t nRead = 0;
+    size_t nChunk = 1024;
+    while (true)
+    {
+        vData.resize(nTxOffset + nRead + nChunk);
+        size_t nGot = fread(&vData[nTxOffset + nRead], 1, nChunk, filein);
+        nRead += nGot;
+        vData.resize(nTxOffset + nRead);
+
+        CTransactionView tx = GetTransaction();
+        if (tx.IsValid())
+            return true;
+        if (!tx.IsTruncated() || nGot < nChunk || nRead >= MAX_BLOCK_SIZE)
+            return error("CDiskTxBytes::ReadFromDisk() : deserialize error");
+        nChunk = nRead;
+    }
+}
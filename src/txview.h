@@ -0,0 +1,173 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXVIEW_H
+#define BITCOIN_TXVIEW_H
+
+#include "blockstore.h"
+#include "script.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CDiskTxPos;
+class CViewCursor;
+
+/**
+ * Read-only views of serialized blocks and transactions.
+ *
+ * A view points into bytes owned by someone else and reads fields from them
+ * on demand, so a caller that needs a hash, a time or one output of a
+ * transaction on disk doesn't build the CTransaction with its vectors of
+ * inputs, outputs and scripts. The bytes must outlive the view.
+ *
+ * Construction walks the serialization once to check it is complete and to
+ * find where the outputs start; nothing is allocated.
+ */
+
+/** One output of a CTransactionView */
+class CTxOutView
+{
+private:
+    int64_t nValue;
+    const unsigned char* pScriptBegin;
+    const unsigned char* pScriptEnd;
+
+public:
+    CTxOutView() : nValue(-1), pScriptBegin(NULL), pScriptEnd(NULL) {}
+    CTxOutView(int64_t nValueIn, const unsigned char* pbegin, const unsigned char* pend) : nValue(nValueIn), pScriptBegin(pbegin), pScriptEnd(pend) {}
+
+    int64_t GetValue() const { return nValue; }
+    const unsigned char* ScriptBegin() const { return pScriptBegin; }
+    const unsigned char* ScriptEnd() const { return pScriptEnd; }
+    CScript GetScriptPubKey() const { return CScript(pScriptBegin, pScriptEnd); }
+};
+
+/** A serialized CTransaction */
+class CTransactionView
+{
+private:
+    const unsigned char* pbegin;
+    const unsigned char* pend;      // end of the transaction, not of the buffer
+    const unsigned char* pvin;      // first input
+    const unsigned char* pvout;     // first output
+    const unsigned char* plocktime;
+    unsigned int nInputs;
+    unsigned int nOutputs;
+    bool fTruncated;
+
+    bool Parse(CViewCursor& cursor);
+
+public:
+    CTransactionView() : pbegin(NULL), pend(NULL), pvin(NULL), pvout(NULL), plocktime(NULL), nInputs(0), nOutputs(0), fTruncated(false) {}
+
+    /** View of the transaction starting at pbufbegin, the buffer may continue past it */
+    CTransactionView(const char* pbufbegin, const char* pbufend);
+
+    /** False if the bytes are not a complete transaction */
+    bool IsValid() const { return pend != NULL; }
+    /** Invalid only because the buffer ends too early, more bytes may complete it */
+    bool IsTruncated() const { return fTruncated; }
+
+    const unsigned char* begin() const { return pbegin; }
+    const unsigned char* end() const { return pend; }
+    unsigned int size() const { return pend - pbegin; }
+
+    int GetVersion() const;
+    unsigned int GetTime() const;
+    unsigned int GetLockTime() const;
+    unsigned int GetInputCount() const { return nInputs; }
+    unsigned int GetOutputCount() const { return nOutputs; }
+
+    /** Output n, walks the outputs before it */
+    bool GetOutput(unsigned int n, CTxOutView& outRet) const;
+
+    /** Same as CTransaction::GetHash, hashed over the bytes as they are */
+    uint256 GetHash() const;
+
+    bool IsCoinBase() const;
+    bool IsCoinStake() const;
+};
+
+/** A serialized block header */
+class CBlockHeaderView
+{
+private:
+    const unsigned char* pbegin;
+
+public:
+    static const unsigned int SIZE = 80;
+
+    CBlockHeaderView() : pbegin(NULL) {}
+    /** The caller makes sure SIZE bytes are readable */
+    explicit CBlockHeaderView(const char* p) : pbegin((const unsigned char*)p) {}
+
+    bool IsNull() const { return pbegin == NULL; }
+
+    int GetVersion() const;
+    uint256 GetPrevBlockHash() const;
+    uint256 GetMerkleRoot() const;
+    int64_t GetBlockTime() const;
+    unsigned int GetBits() const;
+    unsigned int GetNonce() const;
+
+    /** Same as CBlock::GetHash */
+    uint256 GetHash() const;
+};
+
+/** A serialized CBlock */
+class CBlockView
+{
+private:
+    const unsigned char* pbegin;
+    const unsigned char* pbufend;
+    const unsigned char* pvtx;      // first transaction
+    unsigned int nTransactions;
+
+public:
+    CBlockView(const char* pbufbegin, const char* pbufendIn);
+
+    /** False if the buffer doesn't hold a header and transaction count */
+    bool IsValid() const { return pvtx != NULL; }
+
+    CBlockHeaderView GetHeader() const { return CBlockHeaderView((const char*)pbegin); }
+    unsigned int GetTransactionCount() const { return nTransactions; }
+
+    /** Transaction nIndex, walks the ones before it */
+    bool GetTransaction(unsigned int nIndex, CTransactionView& txRet) const;
+    /** Find a transaction by hash, hashing the ones before it */
+    bool FindTransaction(const uint256& hash, CTransactionView& txRet) const;
+
+    unsigned int GetOffset(const CTransactionView& tx) const { return tx.begin() - pbegin; }
+};
+
+/**
+ * The bytes of a transaction on disk and of the header of its block, read
+ * with as few file operations as a compressed or raw block file allows.
+ */
+class CDiskTxBytes
+{
+private:
+    std::vector<char> vData;        // the header, then the transaction at nTxOffset
+    BlockDataPtr pBlock;            // instead of vData, the whole block from a compressed file
+    unsigned int nTxOffset;
+    unsigned int nBlockPos;
+    unsigned int nTxPos;
+
+    const std::vector<char>& Data() const { return pBlock ? *pBlock : vData; }
+
+public:
+    CDiskTxBytes() : nTxOffset(0), nBlockPos(0), nTxPos(0) {}
+
+    bool ReadFromDisk(const CDiskTxPos& pos);
+
+    CBlockHeaderView GetHeader() const { return CBlockHeaderView(&Data()[0]); }
+    CTransactionView GetTransaction() const { return CTransactionView(&Data()[0] + nTxOffset, &Data()[0] + Data().size()); }
+
+    /** Offset of the transaction in its block, as used by the v1 stake kernel */
+    unsigned int GetTxOffset() const { return nTxPos - nBlockPos; }
+};
+
+#endif
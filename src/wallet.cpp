@@ -433,6 +433,10 @@ bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
         // bits of the unencrypted private key in slack space in the database file.
         CDB::Rewrite(strWalletFile);
 
+        // Copies of the wallet from switching -walletjournal still hold the keys in the clear
+        if (fFileBacked)
+            bitdb.WipeWalletCopies(strWalletFile);
+
     }
     NotifyStatusChanged(this);
 
@@ -527,6 +531,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        stakeLedger.Clear();
     }
 }
 
@@ -542,6 +547,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
+            anonsendRoundsCache.TransactionAdded(hash);
+
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
 
@@ -618,6 +625,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
+        if (fInsertedNew || fUpdated)
+            stakeLedger.TxChanged(hash);
+
         // Write to disk
         if (fInsertedNew || fUpdated)
             if (!wtx.WriteToDisk())
@@ -696,6 +706,9 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock, bool fConnect) {
     if (!fConnect)
     {
+        anonsendRoundsCache.Clear();
+        stakeLedger.Clear();
+
         // wallets need to refund inputs when disconnecting coinstake
         if (tx.IsCoinStake())
         {
@@ -715,7 +728,11 @@ void CWallet::EraseFromWallet(const uint256 &hash)
     {
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
+        {
+            anonsendRoundsCache.Clear();
+            stakeLedger.TxChanged(hash);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
@@ -1009,6 +1026,10 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
 
+    // keys may have been imported, so outputs already in the wallet can become ours
+    anonsendRoundsCache.Clear();
+    stakeLedger.Clear();
+
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
@@ -1192,7 +1213,8 @@ int64_t CWallet::GetBalance() const
 {
     int64_t nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
+        // depth queries take cs_blockindex themselves, no need for cs_main
+        LOCK(cs_wallet);
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
@@ -1340,7 +1362,7 @@ CAmount CWallet::GetDenominatedBalance(bool onlyDenom, bool onlyUnconfirmed) con
             // skip conflicted
             if(nDepth < 0) continue;
 
-            bool unconfirmed = (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && nDepth == 0));
+            bool unconfirmed = (!IsFinalTxAtBest(*pcoin) || (!pcoin->IsTrusted() && nDepth == 0));
             if(onlyUnconfirmed != unconfirmed) continue;
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++)
@@ -1370,11 +1392,11 @@ int64_t CWallet::GetUnconfirmedBalance() const
 {
     int64_t nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_wallet);
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
+            if (!IsFinalTxAtBest(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
     }
@@ -1385,7 +1407,7 @@ int64_t CWallet::GetImmatureBalance() const
 {
     int64_t nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_wallet);
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx& pcoin = (*it).second;
@@ -1610,7 +1632,7 @@ static void ApproximateBestSubset(vector<pair<int64_t, pair<const CWalletTx*,uns
 int64_t CWallet::GetStake() const
 {
     int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
+    LOCK(cs_wallet);
     for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         const CWalletTx* pcoin = &(*it).second;
@@ -1623,7 +1645,7 @@ int64_t CWallet::GetStake() const
 int64_t CWallet::GetNewMint() const
 {
     int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
+    LOCK(cs_wallet);
     for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         const CWalletTx* pcoin = &(*it).second;
@@ -3308,39 +3330,133 @@ bool CWallet::FindSecretTransactions(const CTransaction& tx, mapValue_t& mapNarr
 
 
 
-uint64_t CWallet::GetStakeWeight() const
+void CStakeLedger::TxChanged(const uint256& hash)
 {
-    // Choose coins to use
-    int64_t nBalance = GetBalance();
+    LOCK(cs_ledger);
+    if (!fRebuild)
+        setDirty.insert(hash);
+}
 
-    if (nBalance <= nReserveBalance)
-        return 0;
+void CStakeLedger::Clear()
+{
+    LOCK(cs_ledger);
+    fRebuild = true;
+    setDirty.clear();
+}
 
-    vector<const CWalletTx*> vwtxPrev;
+void CStakeLedger::AddValue(int64_t nMatureTime, int64_t nValue)
+{
+    if (nMatureTime < nAdvancedTime)
+    {
+        nMature += nValue;
+        return;
+    }
+    map<int64_t, int64_t>::iterator it = mapMaturing.insert(make_pair(nMatureTime, 0)).first;
+    it->second += nValue;
+    if (it->second == 0)
+        mapMaturing.erase(it);
+}
 
-    set<pair<const CWalletTx*,unsigned int> > setCoins;
-    int64_t nValueIn = 0;
+void CStakeLedger::Add(const uint256& hash, const CTxStake& stake)
+{
+    mapStakes[hash] = stake;
+    if (stake.fPending)
+        setPending.insert(hash);
+    else
+        AddValue(stake.nMatureTime, stake.nValue);
+}
 
-    if (!SelectCoinsForStaking(nBalance - nReserveBalance, GetTime(), setCoins, nValueIn))
-        return 0;
+void CStakeLedger::Remove(const uint256& hash)
+{
+    map<uint256, CTxStake>::iterator it = mapStakes.find(hash);
+    if (it == mapStakes.end())
+        return;
+    if (it->second.fPending)
+        setPending.erase(hash);
+    else
+        AddValue(it->second.nMatureTime, -it->second.nValue);
+    mapStakes.erase(it);
+}
 
-    if (setCoins.empty())
-        return 0;
+// Same outputs as AvailableCoinsForStaking, without the age
+void CStakeLedger::Update(const CWallet* pwallet, const uint256& hash)
+{
+    Remove(hash);
 
-    uint64_t nWeight = 0;
+    map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(hash);
+    if (mi == pwallet->mapWallet.end())
+        return;
+    const CWalletTx& wtx = mi->second;
+
+    CTxStake stake;
+    stake.nValue = 0;
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        if (!wtx.IsSpent(i) && pwallet->IsMine(wtx.vout[i]) && wtx.vout[i].nValue >= nMinimumInputValue)
+            stake.nValue += wtx.vout[i].nValue;
+    if (stake.nValue == 0)
+        return;
 
-    int64_t nCurrentTime = GetTime();
-    CTxDB txdb("r");
+    stake.nMatureTime = (int64_t)wtx.nTime + nStakeMinAge;
+    stake.fPending = wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 1;
+    Add(hash, stake);
+}
 
-    LOCK2(cs_main, cs_wallet);
-    BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
+void CStakeLedger::Rebuild(const CWallet* pwallet, int64_t nTime)
+{
+    mapStakes.clear();
+    setPending.clear();
+    mapMaturing.clear();
+    nMature = 0;
+    nAdvancedTime = nTime;
+
+    for (map<uint256, CWalletTx>::const_iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
+        Update(pwallet, it->first);
+
+    fRebuild = false;
+    setDirty.clear();
+}
+
+int64_t CStakeLedger::GetWeight(const CWallet* pwallet, int64_t nTime)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pwallet->cs_wallet);
+    LOCK(cs_ledger);
+
+    if (fRebuild || nTime < nAdvancedTime)
+        Rebuild(pwallet, nTime);
+
+    BOOST_FOREACH(const uint256& hash, setDirty)
+        Update(pwallet, hash);
+    setDirty.clear();
+
+    // Confirmations and coinstake maturity only change with blocks
+    vector<uint256> vPending(setPending.begin(), setPending.end());
+    BOOST_FOREACH(const uint256& hash, vPending)
+        Update(pwallet, hash);
+
+    while (!mapMaturing.empty() && mapMaturing.begin()->first < nTime)
     {
-        CTxIndex txindex;
-        if (!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex))
-            continue;
+        nMature += mapMaturing.begin()->second;
+        mapMaturing.erase(mapMaturing.begin());
+    }
+    nAdvancedTime = nTime;
+
+    return nMature;
+}
+
+uint64_t CWallet::GetStakeWeight() const
+{
+    LOCK2(cs_main, cs_wallet);
+
+    int64_t nWeight = stakeLedger.GetWeight(this, GetTime());
 
-        if (nCurrentTime - pcoin.first->nTime > nStakeMinAge)
-            nWeight += pcoin.first->vout[pcoin.second].nValue;
+    // Staking leaves the reserve alone
+    if (nReserveBalance > 0 && nWeight > 0)
+    {
+        int64_t nBalance = GetBalance();
+        if (nBalance <= nReserveBalance)
+            return 0;
+        nWeight = min(nWeight, nBalance - nReserveBalance);
     }
 
     return nWeight;
@@ -3384,75 +3500,70 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
         static int nMaxStakeSearchInterval = 60;
-        bool fKernelFound = false;
-        for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == pindexBest; n++)
+        boost::this_thread::interruption_point();
+        if (pindexPrev != pindexBest)
+            break;
+        // Search backward in time from the given txNew timestamp
+        // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
+        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        int64_t nBlockTime, nTimeKernel;
+        int64_t nSearch = min(nSearchInterval, (int64_t)nMaxStakeSearchInterval);
+        if (nSearch <= 0 || !FindKernel(pindexPrev, nBits, txNew.nTime, nSearch, prevoutStake, nTimeKernel, &nBlockTime))
+            continue;
+
+        // Found a kernel
+        LogPrint("coinstake", "CreateCoinStake : kernel found\n");
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+        {
+            LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
+            continue;
+        }
+        LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
         {
-            boost::this_thread::interruption_point();
-            // Search backward in time from the given txNew timestamp 
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, &nBlockTime))
+            LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
+            continue;  // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            // convert to pay to public key type
+            if (!keystore.GetKey(uint160(vSolutions[0]), key))
             {
-                // Found a kernel
-                LogPrint("coinstake", "CreateCoinStake : kernel found\n");
-                vector<valtype> vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
-                    break;
-                }
-                LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
-                {
-                    LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break;  // only support pay to public key and pay to address
-                }
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    // convert to pay to public key type
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-                    scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-                }
-                if (whichType == TX_PUBKEY)
-                {
-                    valtype& vchPubKey = vSolutions[0];
-                    if (!keystore.GetKey(Hash160(vchPubKey), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-
-                    if (key.GetPubKey() != vchPubKey)
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                        break; // keys mismatch
-                    }
-
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                }
-
-                txNew.nTime -= n;
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->vout[pcoin.second].nValue;
-                vwtxPrev.push_back(pcoin.first);
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+                LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            }
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        }
+        if (whichType == TX_PUBKEY)
+        {
+            valtype& vchPubKey = vSolutions[0];
+            if (!keystore.GetKey(Hash160(vchPubKey), key))
+            {
+                LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            }
 
-                LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
-                fKernelFound = true;
-                break;
+            if (key.GetPubKey() != vchPubKey)
+            {
+                LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
+                continue; // keys mismatch
             }
+
+            scriptPubKeyOut = scriptPubKeyKernel;
         }
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        txNew.nTime = nTimeKernel;
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+
+        LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
+        break; // if kernel is found stop searching
     }
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
@@ -3524,9 +3635,10 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if(bINodePayment) {
         //hub
         if(!inodePayments.GetBlockPayee(pindexPrev->nHeight+1, payee)){
+            LOCK(cs_inodes);
             int winningNode = GetCurrentINode(1);
                 if(winningNode >= 0){
-                    payee =GetScriptForDestination(vecInodes[winningNode].pubkey.GetID());
+                    payee =GetScriptForDestination(inodeRegistry[winningNode].pubkey.GetID());
                 } else {
                     LogPrintf("CreateCoinStake: Failed to detect inode to pay\n");
                     hasPayment = false;
@@ -4104,7 +4216,7 @@ std::map<CTxDestination, int64_t> CWallet::GetAddressBalances()
         {
             CWalletTx *pcoin = &walletEntry.second;
 
-            if (!IsFinalTx(*pcoin) || !pcoin->IsTrusted())
+            if (!IsFinalTxAtBest(*pcoin) || !pcoin->IsTrusted())
                 continue;
 
             if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
@@ -4425,7 +4537,7 @@ void CWallet::GetKeyBirthTimes(std::map<CKeyID, int64_t> &mapKeyBirth) const {
     for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); it++) {
         // iterate over all wallet transactions...
         const CWalletTx &wtx = (*it).second;
-        std::map<uint256, CBlockIndex*>::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
+        BlockMap::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
         if (blit != mapBlockIndex.end() && blit->second->IsInMainChain()) {
             // ... which are already in a block
             int nHeight = blit->second->nHeight;
@@ -4467,26 +4579,14 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if(!IsHubActive(HUB_1_INODE_PAYMENTS_ENFORCEMENT)) return -3;
     if(nTesseractXDepth == 0) return -1;
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()){
-        return (*i).second.CountSignatures();
-    }
-
-    return -1;
+    return txLockTracker.CountSignatures(GetHash());
 }
 
 bool CMerkleTx::IsTransactionLockTimedOut() const
 {
     if(nTesseractXDepth == 0) return 0;
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()){
-        return GetTime() > (*i).second.nTimeout;
-    }
-
-    return false;
+    return txLockTracker.IsTimedOut(GetHash());
 }
 
 bool CWallet::AddRushNodeConfig(CRushNodeConfig nodeConfig)
@@ -94,6 +94,53 @@ public:
     )
 };
 
+/** Stakeable outputs of a wallet, summed for GetStakeWeight.
+ *
+ * Every transaction with unspent outputs the wallet could stake is kept with
+ * the value of those outputs. Confirmed ones are bucketed by the time they
+ * get older than nStakeMinAge and move into the mature total when the clock
+ * passes it, so a query doesn't look at any transaction that didn't change.
+ * Unconfirmed and immature transactions are pending and checked again on
+ * every query until they can stake; there are only a few of them.
+ *
+ * The wallet reports changed transactions; a reorganisation, a rescan or
+ * CWallet::MarkDirty rebuild the ledger from mapWallet.
+ */
+class CStakeLedger
+{
+private:
+    struct CTxStake
+    {
+        int64_t nValue;
+        int64_t nMatureTime;    // nTime + nStakeMinAge
+        bool fPending;
+    };
+
+    CCriticalSection cs_ledger;
+    bool fRebuild;
+    std::map<uint256, CTxStake> mapStakes;
+    std::set<uint256> setDirty;
+    std::set<uint256> setPending;
+    std::map<int64_t, int64_t> mapMaturing;  // confirmed value by mature time, at or after nAdvancedTime
+    int64_t nMature;
+    int64_t nAdvancedTime;
+
+    void Add(const uint256& hash, const CTxStake& stake);
+    void Remove(const uint256& hash);
+    void AddValue(int64_t nMatureTime, int64_t nValue);
+    void Update(const CWallet* pwallet, const uint256& hash);
+    void Rebuild(const CWallet* pwallet, int64_t nTime);
+
+public:
+    CStakeLedger() : fRebuild(true), nMature(0), nAdvancedTime(0) {}
+
+    void TxChanged(const uint256& hash);
+    void Clear();
+
+    /** Value of the outputs older than nStakeMinAge at nTime, cs_main and cs_wallet must be held */
+    int64_t GetWeight(const CWallet* pwallet, int64_t nTime);
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -179,6 +226,7 @@ public:
     }
 
     std::map<uint256, CWalletTx> mapWallet;
+    mutable CStakeLedger stakeLedger;
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
 
@@ -636,6 +684,8 @@ public:
                 fAvailableCreditCached = false;
             }
         }
+        if (fReturn)
+            StakeLedgerChanged();
         return fReturn;
     }
 
@@ -648,6 +698,13 @@ public:
         fChangeCached = false;
     }
 
+    // spent flags changed, the stake weight needs this transaction again
+    void StakeLedgerChanged()
+    {
+        if (pwallet)
+            pwallet->stakeLedger.TxChanged(GetHash());
+    }
+
     void BindWallet(CWallet *pwalletIn)
     {
         pwallet = pwalletIn;
@@ -663,6 +720,7 @@ public:
         {
             vfSpent[nOut] = true;
             fAvailableCreditCached = false;
+            StakeLedgerChanged();
         }
     }
 
@@ -675,6 +733,7 @@ public:
         {
             vfSpent[nOut] = false;
             fAvailableCreditCached = false;
+            StakeLedgerChanged();
         }
     }
 
@@ -769,7 +828,7 @@ public:
     bool IsTrusted() const
     {
         // Quick answer in most cases
-        if (!IsFinalTx(*this))
+        if (!IsFinalTxAtBest(*this))
             return false;
         int nDepth = GetDepthInMainChain();
         if (nDepth >= 1)
@@ -789,7 +848,7 @@ public:
         {
             const CMerkleTx* ptx = vWorkQueue[i];
 
-            if (!IsFinalTx(*ptx))
+            if (!IsFinalTxAtBest(*ptx))
                 return false;
             int nPDepth = ptx->GetDepthInMainChain();
             if (nPDepth >= 1)
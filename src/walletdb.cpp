@@ -225,24 +225,24 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error("CWalletDB::ListAccountCreditDebit() : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
     while (true)
     {
         // Read next record
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         if (fFlags == DB_SET_RANGE)
             ssKey << boost::make_tuple(string("acentry"), (fAllAccounts? string("") : strAccount), uint64_t(0));
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
         int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
         fFlags = DB_NEXT;
         if (ret == DB_NOTFOUND)
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            CloseCursor(pcursor);
             throw runtime_error("CWalletDB::ListAccountCreditDebit() : error scanning DB");
         }
 
@@ -261,7 +261,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    CloseCursor(pcursor);
 }
 
 
@@ -361,7 +361,7 @@ public:
 };
 
 bool
-ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
+ReadKeyValue(CWallet* pwallet, CSecureDataStream& ssKey, CSecureDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
 {
     try {
@@ -648,7 +648,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
@@ -658,8 +658,8 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         while (true)
         {
             // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
             int ret = ReadAtCursor(pcursor, ssKey, ssValue);
             if (ret == DB_NOTFOUND)
                 break;
@@ -689,7 +689,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        CloseCursor(pcursor);
     }
     catch (boost::thread_interrupted) {
         throw;
@@ -760,7 +760,18 @@ void ThreadFlushWalletDB(const string& strFile)
         if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
         {
             TRY_LOCK(bitdb.cs_db,lockDb);
-            if (lockDb)
+            CWalletJournal* pjournal = lockDb ? bitdb.GetJournal(strFile) : NULL;
+            if (pjournal)
+            {
+                // Journal writes are already in the file, make them durable
+                // and drop the dead records once they dominate it
+                boost::this_thread::interruption_point();
+                nLastFlushed = nWalletDBUpdated;
+                pjournal->Flush();
+                if (pjournal->NeedsCompaction())
+                    pjournal->Compact();
+            }
+            else if (lockDb)
             {
                 // Don't do this if any databases are in use
                 int nRefCount = 0;
@@ -798,6 +809,32 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
 {
     if (!wallet.fFileBacked)
         return false;
+
+    if (bitdb.GetJournal(wallet.strWalletFile))
+    {
+        // A backup is a regular wallet.dat, so it can be restored without -walletjournal
+        filesystem::path pathDest(strDest);
+        if (filesystem::is_directory(pathDest))
+            pathDest /= wallet.strWalletFile;
+        string strExport = wallet.strWalletFile + ".export";
+        bitdb.RemoveDb(strExport);
+        if (!bitdb.ExportJournal(wallet.strWalletFile, strExport))
+            return false;
+        bool fSuccess = true;
+        try {
+#if BOOST_VERSION >= 104000
+            filesystem::copy_file(GetDataDir() / strExport, pathDest, filesystem::copy_option::overwrite_if_exists);
+#else
+            filesystem::copy_file(GetDataDir() / strExport, pathDest);
+#endif
+            LogPrintf("exported wallet journal to %s\n", pathDest.string());
+        } catch(const filesystem::filesystem_error &e) {
+            LogPrintf("error copying wallet to %s - %s\n", pathDest.string(), e.what());
+            fSuccess = false;
+        }
+        filesystem::remove(GetDataDir() / strExport);
+        return fSuccess;
+    }
     while (true)
     {
         {
@@ -889,8 +926,8 @@ bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename, bool fOnlyKeys)
     {
         if (fOnlyKeys)
         {
-            CDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
             string strType, strErr;
             bool fReadOK = ReadKeyValue(&dummyWallet, ssKey, ssValue,
                                         wss, strType, strErr);
@@ -0,0 +1,396 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "walletjournal.h"
+
+#include "serialize.h"
+#include "util.h"
+#include "version.h"
+#include "xxhash/xxhash.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+static const char JOURNAL_MAGIC[8] = { 'N', 'A', 'V', 'W', 'J', 'R', 'N', '1' };
+static const uint32_t MAX_FRAME_SIZE = 0x10000000;
+// batches written by Compact are cut at about this size
+static const size_t COMPACT_FRAME_SIZE = 1 << 20;
+// compact once the file is twice the live data and at least this much is garbage
+static const uint64_t MIN_COMPACT_GARBAGE = 4 << 20;
+
+static void WriteLE32(unsigned char* p, uint32_t n)
+{
+    p[0] = n; p[1] = n >> 8; p[2] = n >> 16; p[3] = n >> 24;
+}
+
+static uint32_t ReadLE32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Frame a batch: size, payload, checksum
+static void SerializeBatch(const CWalletJournal::Batch& batch, CSecureDataStream& ssFrame)
+{
+    ssFrame.clear();
+    ssFrame.resize(4);
+    for (CWalletJournal::Batch::const_iterator it = batch.begin(); it != batch.end(); ++it)
+    {
+        ssFrame << it->fErase << it->key;
+        if (!it->fErase)
+            ssFrame << it->value;
+    }
+    uint32_t nPayload = ssFrame.size() - 4;
+    WriteLE32((unsigned char*)&ssFrame[0], nPayload);
+    unsigned char pchChecksum[4];
+    WriteLE32(pchChecksum, XXH32(&ssFrame[4], nPayload, 0));
+    ssFrame.write((const char*)pchChecksum, 4);
+}
+
+static bool WriteFrame(FILE* file, const CSecureDataStream& ssFrame)
+{
+    return fwrite(&ssFrame[0], 1, ssFrame.size(), file) == ssFrame.size() && fflush(file) == 0;
+}
+
+CWalletJournal::CWalletJournal(const boost::filesystem::path& pathIn, bool fSyncWritesIn)
+{
+    path = pathIn;
+    file = NULL;
+    fSyncWrites = fSyncWritesIn;
+    fDirty = false;
+    nFileSize = 0;
+    nLiveBytes = 0;
+    nBytesLogical = 0;
+    nBytesAppended = 0;
+}
+
+CWalletJournal::~CWalletJournal()
+{
+    Close();
+}
+
+void CWalletJournal::Apply(const COp& op)
+{
+    RecordMap::iterator it = mapRecords.find(op.key);
+    if (it != mapRecords.end())
+    {
+        nLiveBytes -= it->first.size() + it->second.size();
+        if (op.fErase)
+            mapRecords.erase(it);
+        else
+            it->second = op.value;
+    }
+    else if (!op.fErase)
+        mapRecords.insert(make_pair(op.key, op.value));
+    if (!op.fErase)
+        nLiveBytes += op.key.size() + op.value.size();
+}
+
+bool CWalletJournal::Open()
+{
+    LOCK(cs_journal);
+    int64_t nStart = GetTimeMillis();
+
+    if (!boost::filesystem::exists(path))
+    {
+        file = fopen(path.string().c_str(), "wb");
+        if (!file || fwrite(JOURNAL_MAGIC, 1, sizeof(JOURNAL_MAGIC), file) != sizeof(JOURNAL_MAGIC))
+            return error("CWalletJournal::Open() : cannot create %s", path.string());
+        FileCommit(file);
+        nFileSize = sizeof(JOURNAL_MAGIC);
+        return true;
+    }
+
+    FILE* fileIn = fopen(path.string().c_str(), "rb");
+    if (!fileIn)
+        return error("CWalletJournal::Open() : cannot open %s", path.string());
+    setvbuf(fileIn, NULL, _IOFBF, 1 << 20);
+
+    uint64_t nSize = boost::filesystem::file_size(path);
+    char pchMagic[sizeof(JOURNAL_MAGIC)];
+    if (fread(pchMagic, 1, sizeof(pchMagic), fileIn) != sizeof(pchMagic) ||
+        memcmp(pchMagic, JOURNAL_MAGIC, sizeof(pchMagic)) != 0)
+    {
+        fclose(fileIn);
+        return error("CWalletJournal::Open() : %s is not a wallet journal", path.string());
+    }
+
+    uint64_t nPos = sizeof(JOURNAL_MAGIC);
+    unsigned int nFrames = 0;
+    vector<char, zero_after_free_allocator<char> > vPayload;
+    while (nPos < nSize)
+    {
+        // Anything that doesn't check out and reaches the end of the file is a
+        // torn write and gets cut off; in the middle of the file it is corruption.
+        unsigned char pchSize[4], pchChecksum[4];
+        if (fread(pchSize, 1, 4, fileIn) != 4)
+            break;
+        uint32_t nPayload = ReadLE32(pchSize);
+        if (nPayload == 0 || nPayload > MAX_FRAME_SIZE || nPos + 8 + nPayload > nSize)
+        {
+            if (nPos + 8 + nPayload < nSize)
+            {
+                fclose(fileIn);
+                return error("CWalletJournal::Open() : bad frame size %u at offset %u of %s", nPayload, nPos, path.string());
+            }
+            break;
+        }
+        vPayload.resize(nPayload);
+        if (fread(&vPayload[0], 1, nPayload, fileIn) != nPayload || fread(pchChecksum, 1, 4, fileIn) != 4)
+            break;
+        if (XXH32(&vPayload[0], nPayload, 0) != ReadLE32(pchChecksum))
+        {
+            if (nPos + 8 + nPayload < nSize)
+            {
+                fclose(fileIn);
+                return error("CWalletJournal::Open() : checksum mismatch at offset %u of %s", nPos, path.string());
+            }
+            break;
+        }
+
+        try {
+            CSecureDataStream ssPayload(&vPayload[0], &vPayload[0] + nPayload, SER_DISK, CLIENT_VERSION);
+            while (!ssPayload.empty())
+            {
+                COp op;
+                ssPayload >> op.fErase >> op.key;
+                if (!op.fErase)
+                    ssPayload >> op.value;
+                Apply(op);
+            }
+        }
+        catch (std::exception& e) {
+            fclose(fileIn);
+            return error("CWalletJournal::Open() : bad frame at offset %u of %s", nPos, path.string());
+        }
+        memset(&vPayload[0], 0, nPayload);
+        nPos += 8 + nPayload;
+        nFrames++;
+    }
+    fclose(fileIn);
+
+    if (nPos < nSize)
+    {
+        // keep a copy in case it wasn't a torn write after all
+        boost::filesystem::path pathBak = path.string() + strprintf(".%d.bak", GetTime());
+        LogPrintf("CWalletJournal::Open() : dropping %u bytes of an incomplete write at the end of %s, original saved as %s\n",
+                  nSize - nPos, path.string(), pathBak.string());
+        try {
+            boost::filesystem::copy_file(path, pathBak);
+            boost::filesystem::resize_file(path, nPos);
+        } catch (const boost::filesystem::filesystem_error& e) {
+            return error("CWalletJournal::Open() : %s", e.what());
+        }
+    }
+    nFileSize = nPos;
+
+    file = fopen(path.string().c_str(), "ab");
+    if (!file)
+        return error("CWalletJournal::Open() : cannot open %s for writing", path.string());
+
+    LogPrintf("Loaded wallet journal: %u records from %u frames, %uKB, %dms\n",
+              mapRecords.size(), nFrames, nFileSize / 1024, GetTimeMillis() - nStart);
+    return true;
+}
+
+void CWalletJournal::Close()
+{
+    LOCK(cs_journal);
+    if (!file)
+        return;
+    FileCommit(file);
+    fclose(file);
+    file = NULL;
+    fDirty = false;
+}
+
+bool CWalletJournal::Read(const Data& key, Data& valueRet) const
+{
+    LOCK(cs_journal);
+    RecordMap::const_iterator it = mapRecords.find(key);
+    if (it == mapRecords.end())
+        return false;
+    valueRet = it->second;
+    return true;
+}
+
+bool CWalletJournal::Exists(const Data& key) const
+{
+    LOCK(cs_journal);
+    return mapRecords.count(key) > 0;
+}
+
+bool CWalletJournal::Append(const Batch& batch)
+{
+    if (!file)
+        return false;
+
+    CSecureDataStream ssFrame(SER_DISK, CLIENT_VERSION);
+    SerializeBatch(batch, ssFrame);
+    if (!WriteFrame(file, ssFrame))
+    {
+        // cut the partial frame off again, later frames would land behind it
+        fclose(file);
+        file = NULL;
+        try {
+            boost::filesystem::resize_file(path, nFileSize);
+            file = fopen(path.string().c_str(), "ab");
+        } catch (const boost::filesystem::filesystem_error& e) {
+        }
+        return error("CWalletJournal::Append() : write to %s failed", path.string());
+    }
+    if (fSyncWrites)
+        FileCommit(file);
+    else
+        fDirty = true;
+
+    nFileSize += ssFrame.size();
+    nBytesAppended += ssFrame.size();
+    return true;
+}
+
+bool CWalletJournal::Write(const Batch& batch)
+{
+    if (batch.empty())
+        return true;
+
+    LOCK(cs_journal);
+    if (!Append(batch))
+        return false;
+    for (Batch::const_iterator it = batch.begin(); it != batch.end(); ++it)
+    {
+        nBytesLogical += it->key.size() + it->value.size();
+        Apply(*it);
+    }
+    return true;
+}
+
+bool CWalletJournal::Next(const Data& key, bool fInclusive, Data& keyRet, Data& valueRet) const
+{
+    LOCK(cs_journal);
+    RecordMap::const_iterator it = fInclusive ? mapRecords.lower_bound(key) : mapRecords.upper_bound(key);
+    if (it == mapRecords.end())
+        return false;
+    keyRet = it->first;
+    valueRet = it->second;
+    return true;
+}
+
+bool CWalletJournal::Flush()
+{
+    LOCK(cs_journal);
+    if (!file || !fDirty)
+        return true;
+    FileCommit(file);
+    fDirty = false;
+    return true;
+}
+
+bool CWalletJournal::NeedsCompaction() const
+{
+    LOCK(cs_journal);
+    return nFileSize > 2 * nLiveBytes && nFileSize - nLiveBytes > MIN_COMPACT_GARBAGE;
+}
+
+bool CWalletJournal::Compact(const char* pszSkip)
+{
+    LOCK(cs_journal);
+    if (!file)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    uint64_t nOldSize = nFileSize;
+    boost::filesystem::path pathNew = path.string() + ".new";
+    size_t nSkip = pszSkip ? strlen(pszSkip) : 0;
+
+    FILE* fileNew = fopen(pathNew.string().c_str(), "wb");
+    if (!fileNew)
+        return error("CWalletJournal::Compact() : cannot create %s", pathNew.string());
+    bool fSuccess = fwrite(JOURNAL_MAGIC, 1, sizeof(JOURNAL_MAGIC), fileNew) == sizeof(JOURNAL_MAGIC);
+    uint64_t nNewSize = sizeof(JOURNAL_MAGIC);
+
+    CSecureDataStream ssFrame(SER_DISK, CLIENT_VERSION);
+    Batch batch;
+    size_t nBatchBytes = 0;
+    vector<Data> vSkipped;
+    for (RecordMap::const_iterator it = mapRecords.begin(); fSuccess && it != mapRecords.end(); )
+    {
+        if (nSkip && it->first.size() >= nSkip && memcmp(&it->first[0], pszSkip, nSkip) == 0)
+        {
+            vSkipped.push_back(it->first);
+            ++it;
+            continue;
+        }
+        batch.push_back(COp());
+        batch.back().fErase = false;
+        batch.back().key = it->first;
+        batch.back().value = it->second;
+        nBatchBytes += it->first.size() + it->second.size();
+        ++it;
+        if (nBatchBytes >= COMPACT_FRAME_SIZE || it == mapRecords.end())
+        {
+            SerializeBatch(batch, ssFrame);
+            fSuccess = WriteFrame(fileNew, ssFrame);
+            nNewSize += ssFrame.size();
+            batch.clear();
+            nBatchBytes = 0;
+        }
+    }
+    if (fSuccess && !batch.empty())
+    {
+        // the last records were skipped, the batch before them is still open
+        SerializeBatch(batch, ssFrame);
+        fSuccess = WriteFrame(fileNew, ssFrame);
+        nNewSize += ssFrame.size();
+    }
+    if (fSuccess)
+        FileCommit(fileNew);
+    fclose(fileNew);
+
+    if (!fSuccess)
+    {
+        boost::filesystem::remove(pathNew);
+        return error("CWalletJournal::Compact() : writing %s failed", pathNew.string());
+    }
+
+    fclose(file);
+    file = NULL;
+    if (!RenameOver(pathNew, path))
+    {
+        file = fopen(path.string().c_str(), "ab");
+        return error("CWalletJournal::Compact() : cannot rename %s", pathNew.string());
+    }
+    file = fopen(path.string().c_str(), "ab");
+    if (!file)
+        return error("CWalletJournal::Compact() : cannot reopen %s", path.string());
+
+    BOOST_FOREACH(const Data& key, vSkipped)
+    {
+        COp op;
+        op.fErase = true;
+        op.key = key;
+        Apply(op);
+    }
+    nFileSize = nNewSize;
+    nBytesAppended += nNewSize;
+    fDirty = false;
+
+    LogPrintf("Compacted wallet journal from %uKB to %uKB in %dms\n", nOldSize / 1024, nNewSize / 1024, GetTimeMillis() - nStart);
+    return true;
+}
+
+size_t CWalletJournal::size() const
+{
+    LOCK(cs_journal);
+    return mapRecords.size();
+}
+
+void CWalletJournal::LogStats(const char* pszWhen) const
+{
+    LOCK(cs_journal);
+    LogPrintf("Wallet journal %s: %u records, %uKB live, %uKB file, %uKB written for %uKB of records (write amplification %.2f)\n",
+              pszWhen, mapRecords.size(), nLiveBytes / 1024, nFileSize / 1024, nBytesAppended / 1024, nBytesLogical / 1024,
+              nBytesLogical ? (double)nBytesAppended / nBytesLogical : 0.0);
+}
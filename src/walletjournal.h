@@ -0,0 +1,105 @@
+// Copyright (c) 2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLETJOURNAL_H
+#define BITCOIN_WALLETJOURNAL_H
+
+#include "allocators.h"
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+/**
+ * Append-only store for the wallet records (-walletjournal).
+ *
+ * The journal holds the same key/value pairs CWalletDB writes to wallet.dat,
+ * all of them in memory and ordered like the Berkeley DB btree. Every write
+ * appends one frame to the file:
+ *
+ *   uint32 payload size | payload | uint32 XXH32 of the payload
+ *
+ * where the payload is a batch of puts and erases. A batch is applied
+ * completely or not at all, which is what CDB transactions map to. Loading
+ * is one sequential pass over the file; a torn frame at the end (a crash
+ * during a write) is cut off.
+ *
+ * Overwritten and erased records stay in the file until Compact writes the
+ * live records to a new file and renames it over the old one.
+ */
+class CWalletJournal
+{
+public:
+    typedef std::vector<unsigned char, zero_after_free_allocator<unsigned char> > Data;
+
+    struct COp
+    {
+        bool fErase;
+        Data key;
+        Data value;
+    };
+    typedef std::vector<COp> Batch;
+
+private:
+    // Berkeley DB compares keys as unsigned bytes, so does this
+    struct CDataCompare
+    {
+        bool operator()(const Data& a, const Data& b) const
+        {
+            return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+        }
+    };
+    typedef std::map<Data, Data, CDataCompare> RecordMap;
+
+    mutable CCriticalSection cs_journal;
+    boost::filesystem::path path;
+    FILE* file;
+    RecordMap mapRecords;
+    bool fSyncWrites;
+    bool fDirty;           // appended since the last fsync
+
+    uint64_t nFileSize;
+    uint64_t nLiveBytes;   // key and value bytes of mapRecords
+    uint64_t nBytesLogical;  // key and value bytes written since open
+    uint64_t nBytesAppended; // file bytes written since open, compaction included
+
+    bool Append(const Batch& batch);
+    void Apply(const COp& op);
+
+public:
+    CWalletJournal(const boost::filesystem::path& pathIn, bool fSyncWritesIn);
+    ~CWalletJournal();
+
+    /** Load the journal, creating it if it doesn't exist */
+    bool Open();
+    void Close();
+
+    bool Read(const Data& key, Data& valueRet) const;
+    bool Exists(const Data& key) const;
+    bool Write(const Batch& batch);
+
+    /**
+     * The first record after key, or at or after it if fInclusive; an empty key
+     * starts at the beginning. Used by the CDB cursors.
+     */
+    bool Next(const Data& key, bool fInclusive, Data& keyRet, Data& valueRet) const;
+
+    /** fsync what was appended since the last call */
+    bool Flush();
+
+    /** True if most of the file is overwritten or erased records */
+    bool NeedsCompaction() const;
+    /** Rewrite the file with only the live records, skipping keys starting with pszSkip */
+    bool Compact(const char* pszSkip = NULL);
+
+    size_t size() const;
+    const boost::filesystem::path& GetPath() const { return path; }
+    void LogStats(const char* pszWhen) const;
+};
+
+#endif